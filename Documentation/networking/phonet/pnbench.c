@@ -0,0 +1,223 @@
+/*
+ * pnbench - Phonet datagram socket loopback benchmark
+ *
+ * Each thread opens a Phonet datagram socket bound to a local address,
+ * then sends datagrams to itself and waits for each one to come back,
+ * counting round trips. Every round trip goes through the route and
+ * device lookups on send and the socket hash lookup on receive, so
+ * running many threads at once measures how those lookups scale.
+ * Extra idle sockets can be bound to make the socket hash chains
+ * longer.
+ *
+ * A Phonet address must first be assigned to a local network
+ * interface, and the benchmark told about it with -a.
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/phonet.h>
+
+#ifndef AF_PHONET
+#define AF_PHONET 35
+#endif
+#ifndef PF_PHONET
+#define PF_PHONET AF_PHONET
+#endif
+
+#define MAX_LEN 4096
+
+struct thread {
+	pthread_t id;
+	int fd;
+	unsigned long trips;
+	unsigned long errors;
+	double rtt_sum;
+	double rtt_max;
+};
+
+static volatile int stop;
+static unsigned int addr = 0x40;
+static unsigned int length = 32;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int open_socket(struct sockaddr_pn *spn)
+{
+	socklen_t len = sizeof(*spn);
+	int fd;
+
+	fd = socket(PF_PHONET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	memset(spn, 0, sizeof(*spn));
+	spn->spn_family = AF_PHONET;
+	spn->spn_dev = addr & 0xfc;
+	/* Object 0: let the kernel pick a free port */
+	if (bind(fd, (struct sockaddr *)spn, sizeof(*spn)) ||
+	    getsockname(fd, (struct sockaddr *)spn, &len)) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void *run(void *arg)
+{
+	struct thread *t = arg;
+	struct sockaddr_pn self;
+	char buf[MAX_LEN];
+	double start, rtt;
+	ssize_t len;
+
+	t->fd = open_socket(&self);
+	if (t->fd < 0) {
+		t->errors++;
+		return NULL;
+	}
+	memset(buf, 0x5a, length);
+	while (!stop) {
+		start = now();
+		if (sendto(t->fd, buf, length, 0, (struct sockaddr *)&self,
+			   sizeof(self)) != (ssize_t)length) {
+			t->errors++;
+			continue;
+		}
+		len = recv(t->fd, buf, sizeof(buf), 0);
+		if (len != (ssize_t)length) {
+			t->errors++;
+			continue;
+		}
+		rtt = now() - start;
+		t->rtt_sum += rtt;
+		if (rtt > t->rtt_max)
+			t->rtt_max = rtt;
+		t->trips++;
+	}
+	close(t->fd);
+	return NULL;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-a addr] [-t threads] [-s seconds] [-l length]"
+		" [-i idle]\n"
+		"  -a  local Phonet address (default 0x40)\n"
+		"  -t  sending threads (default 1)\n"
+		"  -s  duration in seconds (default 5)\n"
+		"  -l  datagram length (default 32, max %d)\n"
+		"  -i  extra idle sockets bound to addr (default 0)\n",
+		name, MAX_LEN);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int nthreads = 1, seconds = 5, idle = 0, i;
+	unsigned long trips = 0, errors = 0;
+	double rtt_sum = 0, rtt_max = 0, elapsed;
+	struct sockaddr_pn spn;
+	struct thread *threads;
+	int *idle_fds;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "a:t:s:l:i:")) != -1) {
+		switch (opt) {
+		case 'a':
+			addr = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nthreads = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			length = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			idle = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!nthreads || !seconds || !length || length > MAX_LEN ||
+	    addr > 0xff)
+		usage(argv[0]);
+
+	idle_fds = calloc(idle ? idle : 1, sizeof(*idle_fds));
+	threads = calloc(nthreads, sizeof(*threads));
+	if (!idle_fds || !threads) {
+		perror("calloc");
+		return 1;
+	}
+	for (i = 0; i < idle; i++) {
+		idle_fds[i] = open_socket(&spn);
+		if (idle_fds[i] < 0)
+			return 1;
+	}
+
+	elapsed = now();
+	for (i = 0; i < nthreads; i++) {
+		errno = pthread_create(&threads[i].id, NULL, run, &threads[i]);
+		if (errno) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i].id, NULL);
+		trips += threads[i].trips;
+		errors += threads[i].errors;
+		rtt_sum += threads[i].rtt_sum;
+		if (threads[i].rtt_max > rtt_max)
+			rtt_max = threads[i].rtt_max;
+	}
+	elapsed = now() - elapsed;
+
+	printf("%u threads, %u idle sockets, %u bytes: %.0f round trips/s, "
+	       "rtt avg %.1f us max %.1f us, %lu errors\n",
+	       nthreads, idle, length, trips / elapsed,
+	       trips ? rtt_sum / trips * 1e6 : 0.0, rtt_max * 1e6, errors);
+
+	for (i = 0; i < idle; i++)
+		close(idle_fds[i]);
+	free(idle_fds);
+	free(threads);
+	return errors ? 1 : 0;
+}
@@ -59,6 +59,19 @@ struct dbll_sect_info {
 	dbll_flags type;	/* Code, data, or BSS */
 };
 
+/*
+ *  ======== dbll_file_id ========
+ *  Identity of an open file. Two files with equal ids have the same
+ *  contents.
+ */
+struct dbll_file_id {
+	u32 dev;
+	u32 size;
+	u64 ino;
+	s64 mtime_sec;
+	u32 mtime_nsec;
+};
+
 /*
  *  ======== dbll_sym_val ========
  *  (Needed for dynamic load library)
@@ -91,6 +104,13 @@ typedef s32(*dbll_f_close_fxn) (void *);
 typedef bool(*dbll_free_fxn) (void *hdl, u32 addr, s32 space, u32 size,
 			      bool reserved);
 
+/*
+ *  ======== dbll_f_ident_fxn ========
+ *  Fill in the identity of an open file. Returns FALSE if it can't be
+ *  determined, in which case nothing parsed from the file is cached.
+ */
+typedef bool(*dbll_f_ident_fxn) (void *, struct dbll_file_id *);
+
 /*
  *  ======== dbll_f_open_fxn ========
  */
@@ -173,6 +193,8 @@ struct dbll_attrs {
 	 s32(*ftell) (void *);
 	 s32(*fclose) (void *);
 	void *(*fopen) (const char *, const char *);
+	/* Optional, enables the parsed base image cache when set */
+	dbll_f_ident_fxn fident;
 };
 
 /*
@@ -286,6 +286,19 @@ extern void io_intr_dsp2(IN struct io_mgr *pio_mgr, IN u16 mb_val);
 
 extern void io_sm_init(void);
 
+/*
+ *  ======== io_msg_stats ========
+ *  Purpose:
+ *      Format message and mailbox doorbell counters into buf.
+ *  Parameters:
+ *      hio_mgr:    IO manager handle.
+ *      buf:        Output buffer.
+ *      len:        Size of buf.
+ *  Returns:
+ *      Number of characters written.
+ */
+extern ssize_t io_msg_stats(struct io_mgr *hio_mgr, char *buf, size_t len);
+
 /*
  *  ========print_dsp_trace_buffer ========
  *      Print DSP tracebuffer.
@@ -24,6 +24,8 @@
 #include <dspbridge/host_os.h>
 #include <linux/fs.h>
 #include <linux/uaccess.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
 
 /*  ----------------------------------- DSP/BIOS Bridge */
 #include <dspbridge/std.h>
@@ -75,6 +77,43 @@ struct cod_libraryobj {
 
 static u32 refs = 0L;
 
+/*
+ * Images read by the loader (base image and node libraries) are kept in
+ * memory, keyed by path and file identity, so that restarting the DSP
+ * after hibernation or recovery does not read them from the filesystem
+ * again. Unused images are dropped, least recently used first, once
+ * the cache grows past COD_CACHE_MAX bytes.
+ */
+#define COD_CACHE_MAX	(8 * 1024 * 1024)
+
+struct cod_image {
+	struct list_head link;	/* In cod_image_cache, MRU first */
+	char *path;
+	dev_t dev;
+	unsigned long ino;
+	struct timespec mtime;
+	u32 size;
+	u8 *data;
+	u32 users;
+	bool stale;		/* File changed, free on last close */
+};
+
+/*
+ * Opaque file handle passed to the loader through dbll_attrs. Images that
+ * cannot be cached (too big, or out of memory) are read from filp.
+ */
+struct cod_file {
+	struct cod_image *image;
+	struct file *filp;
+	u32 pos;
+};
+
+static LIST_HEAD(cod_image_cache);
+static DEFINE_MUTEX(cod_cache_lock);
+static u32 cod_cache_bytes;
+static u32 cod_cache_hits;
+static u32 cod_cache_misses;
+
 static struct dbll_fxns ldr_fxns = {
 	(dbll_close_fxn) dbll_close,
 	(dbll_create_fxn) dbll_create,
@@ -99,44 +138,187 @@ static bool no_op(void);
 /*
  * File operations (originally were under kfile.c)
  */
-static s32 cod_f_close(struct file *filp)
+static void cod_image_free(struct cod_image *image)
+{
+	cod_cache_bytes -= image->size;
+	vfree(image->data);
+	kfree(image->path);
+	kfree(image);
+}
+
+/* Drop unused images until the cache fits. Called with cod_cache_lock. */
+static void cod_cache_trim(u32 max_bytes)
+{
+	struct cod_image *image, *tmp;
+
+	list_for_each_entry_safe_reverse(image, tmp, &cod_image_cache, link) {
+		if (cod_cache_bytes <= max_bytes)
+			break;
+		if (image->users)
+			continue;
+		list_del(&image->link);
+		cod_image_free(image);
+	}
+}
+
+/*
+ * Read a whole image into memory. Returns NULL if it is too big to cache
+ * or cannot be read; cod_f_open() then falls back to the file itself.
+ */
+static struct cod_image *cod_image_read(struct file *filp, CONST char *path)
+{
+	struct inode *inode = filp->f_path.dentry->d_inode;
+	struct cod_image *image;
+	mm_segment_t fs;
+	loff_t pos = 0;
+	ssize_t ret;
+
+	if (i_size_read(inode) > COD_CACHE_MAX)
+		return NULL;
+
+	image = kzalloc(sizeof(*image), GFP_KERNEL);
+	if (!image)
+		return NULL;
+
+	image->size = i_size_read(inode);
+	image->dev = inode->i_sb->s_dev;
+	image->ino = inode->i_ino;
+	image->mtime = inode->i_mtime;
+	image->path = kstrdup(path, GFP_KERNEL);
+	image->data = vmalloc(image->size ? image->size : 1);
+	if (!image->path || !image->data)
+		goto err;
+
+	fs = get_fs();
+	set_fs(get_ds());
+	while (pos < image->size) {
+		ret = vfs_read(filp, (char __user *)image->data + pos,
+			       image->size - pos, &pos);
+		if (ret <= 0)
+			break;
+	}
+	set_fs(fs);
+	if (pos != image->size)
+		goto err;
+
+	cod_cache_bytes += image->size;
+	return image;
+
+err:
+	vfree(image->data);
+	kfree(image->path);
+	kfree(image);
+	return NULL;
+}
+
+static s32 cod_f_close(struct cod_file *cf)
 {
+	struct cod_image *image;
+
 	/* Check for valid handle */
-	if (!filp)
+	if (!cf)
 		return DSP_EHANDLE;
 
-	filp_close(filp, NULL);
+	if (!cf->image) {
+		filp_close(cf->filp, NULL);
+		kfree(cf);
+		return 0;
+	}
+
+	image = cf->image;
+	mutex_lock(&cod_cache_lock);
+	if (--image->users == 0) {
+		if (image->stale)
+			cod_image_free(image);
+		else
+			cod_cache_trim(COD_CACHE_MAX);
+	}
+	mutex_unlock(&cod_cache_lock);
+	kfree(cf);
 
 	/* we can't use DSP_SOK here */
 	return 0;
 }
 
-static struct file *cod_f_open(CONST char *psz_file_name, CONST char *pszMode)
+static struct cod_file *cod_f_open(CONST char *psz_file_name,
+				   CONST char *pszMode)
 {
+	struct cod_image *image, *tmp, *found = NULL;
+	struct cod_file *cf;
+	struct inode *inode;
 	mm_segment_t fs;
 	struct file *filp;
 
+	cf = kzalloc(sizeof(*cf), GFP_KERNEL);
+	if (!cf)
+		return NULL;
+
 	fs = get_fs();
 	set_fs(get_ds());
 
 	/* ignore given mode and open file as read-only */
 	filp = filp_open(psz_file_name, O_RDONLY, 0);
 
-	if (IS_ERR(filp))
-		filp = NULL;
-
 	set_fs(fs);
 
-	return filp;
+	if (IS_ERR(filp)) {
+		kfree(cf);
+		return NULL;
+	}
+	inode = filp->f_path.dentry->d_inode;
+
+	mutex_lock(&cod_cache_lock);
+	list_for_each_entry_safe(image, tmp, &cod_image_cache, link) {
+		if (strcmp(image->path, psz_file_name))
+			continue;
+		if (image->dev == inode->i_sb->s_dev &&
+		    image->ino == inode->i_ino &&
+		    image->size == i_size_read(inode) &&
+		    timespec_equal(&image->mtime, &inode->i_mtime)) {
+			found = image;
+			list_move(&image->link, &cod_image_cache);
+			break;
+		}
+		/* The file was replaced; forget the old contents */
+		list_del(&image->link);
+		if (image->users)
+			image->stale = true;
+		else
+			cod_image_free(image);
+	}
+
+	if (found) {
+		cod_cache_hits++;
+	} else {
+		cod_cache_misses++;
+		found = cod_image_read(filp, psz_file_name);
+		if (found)
+			list_add(&found->link, &cod_image_cache);
+	}
+	if (found)
+		found->users++;
+	mutex_unlock(&cod_cache_lock);
+
+	if (!found) {
+		/* Not cacheable: fall back to reading the file directly */
+		dev_dbg(bridge, "%s: %s not cached\n", __func__,
+			psz_file_name);
+		cf->filp = filp;
+		return cf;
+	}
+	filp_close(filp, NULL);
+
+	dev_dbg(bridge, "%s: %s size %u hits %u misses %u cached %u\n",
+		__func__, psz_file_name, found->size, cod_cache_hits,
+		cod_cache_misses, cod_cache_bytes);
+
+	cf->image = found;
+	return cf;
 }
 
-static s32 cod_f_read(void __user *pbuffer, s32 size, s32 cCount,
-		      struct file *filp)
+static s32 cod_f_read_file(void __user *pbuffer, s32 size, s32 cCount,
+			   struct file *filp)
 {
-	/* check for valid file handle */
-	if (!filp)
-		return DSP_EHANDLE;
-
 	if ((size > 0) && (cCount > 0) && pbuffer) {
 		u32 dw_bytes_read;
 		mm_segment_t fs;
@@ -157,38 +339,117 @@ static s32 cod_f_read(void __user *pbuffer, s32 size, s32 cCount,
 	return DSP_EINVALIDARG;
 }
 
-static s32 cod_f_seek(struct file *filp, s32 lOffset, s32 cOrigin)
+static s32 cod_f_read(void __user *pbuffer, s32 size, s32 cCount,
+		      struct cod_file *cf)
+{
+	/* check for valid file handle */
+	if (!cf)
+		return DSP_EHANDLE;
+
+	if (!cf->image)
+		return cod_f_read_file(pbuffer, size, cCount, cf->filp);
+
+	if ((size > 0) && (cCount > 0) && pbuffer) {
+		u32 dw_bytes_read = size * cCount;
+
+		if (dw_bytes_read > cf->image->size - cf->pos)
+			dw_bytes_read = cf->image->size - cf->pos;
+		if (!dw_bytes_read)
+			return DSP_EFREAD;
+
+		/* the loader always reads into kernel buffers */
+		memcpy((__force void *)pbuffer, cf->image->data + cf->pos,
+		       dw_bytes_read);
+		cf->pos += dw_bytes_read;
+
+		return dw_bytes_read / size;
+	}
+
+	return DSP_EINVALIDARG;
+}
+
+static s32 cod_f_seek(struct cod_file *cf, s32 lOffset, s32 cOrigin)
 {
-	loff_t dw_cur_pos;
+	s32 dw_cur_pos;
 
 	/* check for valid file handle */
-	if (!filp)
+	if (!cf)
 		return DSP_EHANDLE;
 
+	if (!cf->image) {
+		loff_t pos = cf->filp->f_op->llseek(cf->filp, lOffset,
+						    cOrigin);
+
+		if ((s32) pos < 0)
+			return DSP_EFAIL;
+		return 0;
+	}
+
 	/* based on the origin flag, move the internal pointer */
-	dw_cur_pos = filp->f_op->llseek(filp, lOffset, cOrigin);
+	switch (cOrigin) {
+	case SEEK_SET:
+		dw_cur_pos = lOffset;
+		break;
+	case SEEK_CUR:
+		dw_cur_pos = cf->pos + lOffset;
+		break;
+	case SEEK_END:
+		dw_cur_pos = cf->image->size + lOffset;
+		break;
+	default:
+		return DSP_EFAIL;
+	}
 
-	if ((s32) dw_cur_pos < 0)
+	if (dw_cur_pos < 0 || dw_cur_pos > cf->image->size)
 		return DSP_EFAIL;
+	cf->pos = dw_cur_pos;
 
 	/* we can't use DSP_SOK here */
 	return 0;
 }
 
-static s32 cod_f_tell(struct file *filp)
+static s32 cod_f_tell(struct cod_file *cf)
 {
-	loff_t dw_cur_pos;
-
-	if (!filp)
+	if (!cf)
 		return DSP_EHANDLE;
 
-	/* Get current position */
-	dw_cur_pos = filp->f_op->llseek(filp, 0, SEEK_CUR);
+	if (!cf->image) {
+		/* Get current position */
+		loff_t pos = cf->filp->f_op->llseek(cf->filp, 0, SEEK_CUR);
 
-	if ((s32) dw_cur_pos < 0)
-		return DSP_EFAIL;
+		if ((s32) pos < 0)
+			return DSP_EFAIL;
+		return pos;
+	}
 
-	return dw_cur_pos;
+	return cf->pos;
+}
+
+/* Identify the file so dbll can reuse what it parsed from it last time */
+static bool cod_f_ident(struct cod_file *cf, struct dbll_file_id *id)
+{
+	struct inode *inode;
+
+	if (!cf)
+		return false;
+
+	memset(id, 0, sizeof(*id));
+	if (cf->image) {
+		id->dev = cf->image->dev;
+		id->ino = cf->image->ino;
+		id->size = cf->image->size;
+		id->mtime_sec = cf->image->mtime.tv_sec;
+		id->mtime_nsec = cf->image->mtime.tv_nsec;
+	} else {
+		inode = cf->filp->f_path.dentry->d_inode;
+		id->dev = inode->i_sb->s_dev;
+		id->ino = inode->i_ino;
+		id->size = i_size_read(inode);
+		id->mtime_sec = inode->i_mtime.tv_sec;
+		id->mtime_nsec = inode->i_mtime.tv_nsec;
+	}
+
+	return true;
 }
 
 /*
@@ -253,6 +514,7 @@ dsp_status cod_create(OUT struct cod_manager **phMgr, char *pstrDummyFile,
 	zl_attrs.ftell = (dbll_tell_fxn) cod_f_tell;
 	zl_attrs.fclose = (dbll_f_close_fxn) cod_f_close;
 	zl_attrs.fopen = (dbll_f_open_fxn) cod_f_open;
+	zl_attrs.fident = (dbll_f_ident_fxn) cod_f_ident;
 	zl_attrs.sym_lookup = NULL;
 	zl_attrs.base_image = true;
 	zl_attrs.log_write = NULL;
@@ -313,6 +575,11 @@ void cod_exit(void)
 	DBC_REQUIRE(refs > 0);
 
 	refs--;
+	if (refs == 0) {
+		mutex_lock(&cod_cache_lock);
+		cod_cache_trim(0);
+		mutex_unlock(&cod_cache_lock);
+	}
 
 	DBC_ENSURE(refs >= 0);
 }
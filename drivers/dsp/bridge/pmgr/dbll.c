@@ -16,6 +16,8 @@
 
 /*  ----------------------------------- Host OS */
 #include <dspbridge/host_os.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
 
 /*  ----------------------------------- DSP/BIOS Bridge */
 #include <dspbridge/std.h>
@@ -134,8 +136,57 @@ struct dbll_library_obj {
 	u32 load_ref;		/* Number of times loaded */
 	struct gh_t_hash_tab *sym_tab;	/* Hash table of symbols */
 	u32 ul_pos;
+	struct dbll_file_id file_id;	/* Valid if have_id */
+	bool have_id;
+	struct dbll_image *rec;	/* Load being recorded, or NULL */
 };
 
+/*
+ *  ======== dbll_image ========
+ *  Parsed base image cache.
+ *
+ *  Loading the base image parses its headers and string tables, builds
+ *  and relocates its symbol table and only then writes the sections to
+ *  the DSP. None of that changes between loads of the same file, so the
+ *  first load records the writes it makes, in order, along with the
+ *  entry point. When the library is unloaded or closed its symbol table
+ *  is parked in the entry rather than freed. Opening the same file again
+ *  adopts that table instead of doing a symbol-only load, and loading it
+ *  replays the recorded writes instead of running the dynamic loader.
+ *
+ *  Entries are keyed by file name and the identity returned by
+ *  attrs.fident, and are dropped least recently used first once the
+ *  recorded data exceeds DBLL_CACHE_MAX bytes. Only base images whose
+ *  writes are not logged are cached; node libraries are relocated to
+ *  wherever memory is free at load time.
+ */
+#define DBLL_CACHE_MAX	(8 * 1024 * 1024)
+
+struct dbll_image {
+	struct list_head link;	/* In dbll_cache, MRU first */
+	char *file_name;
+	struct dbll_file_id id;
+	u32 entry;		/* Entry point */
+	struct list_head recs;	/* struct dbll_rec, in load order */
+	u32 bytes;		/* Recorded data */
+	struct gh_t_hash_tab *sym_tab;	/* Parked symbol table, or NULL */
+};
+
+/* One write_mem() or fill_mem() call made by the loader */
+struct dbll_rec {
+	struct list_head link;
+	u32 addr;
+	u32 bytes;
+	u32 val;		/* Fill value */
+	u16 type;		/* Section type */
+	bool fill;
+	u8 data[0];		/* Data written, unless fill */
+};
+
+static LIST_HEAD(dbll_cache);
+static DEFINE_MUTEX(dbll_cache_lock);
+static u32 dbll_cache_bytes;
+
 /*
  *  ======== dbll_symbol ========
  */
@@ -147,6 +198,15 @@ extern bool symbols_reloaded;
 
 static void dof_close(struct dbll_library_obj *zl_lib);
 static dsp_status dof_open(struct dbll_library_obj *zl_lib);
+static bool dbll_cache_adopt_symbols(struct dbll_library_obj *lib);
+static bool dbll_cache_park_symbols(struct dbll_library_obj *lib);
+static int dbll_cache_replay(struct dbll_library_obj *lib, bool got_symbols);
+static void dbll_cache_record_start(struct dbll_library_obj *lib);
+static void dbll_cache_record(struct dbll_library_obj *lib, ldr_addr addr,
+			      struct ldr_section_info *info, void *buf,
+			      unsigned bytes, unsigned val);
+static void dbll_cache_record_end(struct dbll_library_obj *lib, bool ok);
+static void dbll_cache_flush(void);
 static s32 no_op(struct dynamic_loader_initialize *thisptr, void *bufr,
 		 ldr_addr locn, struct ldr_section_info *info, unsigned bytsiz);
 
@@ -230,11 +290,11 @@ void dbll_close(struct dbll_library_obj *zl_lib)
 
 		/* Free DOF resources */
 		dof_close(zl_lib);
-		kfree(zl_lib->file_name);
 
 		/* remove symbols from symbol table */
-		if (zl_lib->sym_tab)
+		if (zl_lib->sym_tab && !dbll_cache_park_symbols(zl_lib))
 			gh_delete(zl_lib->sym_tab);
+		kfree(zl_lib->file_name);
 
 		/* remove the library object itself */
 		MEM_FREE_OBJECT(zl_lib);
@@ -300,8 +360,10 @@ void dbll_exit(void)
 
 	refs--;
 
-	if (refs == 0)
+	if (refs == 0) {
+		dbll_cache_flush();
 		gh_exit();
+	}
 
 	DBC_ENSURE(refs >= 0);
 }
@@ -467,7 +529,7 @@ dsp_status dbll_load(struct dbll_library_obj *lib, dbll_flags flags,
 	struct dbll_library_obj *zl_lib = (struct dbll_library_obj *)lib;
 	struct dbll_tar_obj *dbzl;
 	bool got_symbols = true;
-	s32 err;
+	s32 err = 0;
 	dsp_status status = DSP_SOK;
 	bool opened_doff = false;
 	DBC_REQUIRE(refs > 0);
@@ -535,6 +597,15 @@ dsp_status dbll_load(struct dbll_library_obj *lib, dbll_flags flags,
 
 		}
 		if (DSP_SUCCEEDED(status)) {
+			err = dbll_cache_replay(zl_lib, got_symbols);
+			if (err < 0) {
+				status = DSP_EDYNLOAD;
+			} else if (err > 0) {
+				symbols_reloaded = true;
+				*pEntry = zl_lib->entry;
+			}
+		}
+		if (DSP_SUCCEEDED(status) && err == 0) {
 			zl_lib->ul_pos = (*(zl_lib->target_obj->attrs.ftell))
 			    (zl_lib->fp);
 			/* Reset file cursor */
@@ -542,6 +613,7 @@ dsp_status dbll_load(struct dbll_library_obj *lib, dbll_flags flags,
 							      (long)0,
 							      SEEK_SET);
 			symbols_reloaded = true;
+			dbll_cache_record_start(zl_lib);
 			/* The 5th argument, DLOAD_INITBSS, tells the DLL
 			 * module to zero-init all BSS sections.  In general,
 			 * this is not necessary and also increases load time.
@@ -552,6 +624,8 @@ dsp_status dbll_load(struct dbll_library_obj *lib, dbll_flags flags,
 						  &zl_lib->init.dl_init,
 						  DLOAD_INITBSS,
 						  &zl_lib->dload_mod_obj);
+			dbll_cache_record_end(zl_lib, err == 0 &&
+					      !redefined_symbol);
 
 			if (err != 0) {
 				status = DSP_EDYNLOAD;
@@ -681,6 +755,9 @@ dsp_status dbll_open(struct dbll_tar_obj *target, char *file, dbll_flags flags,
 	if (zl_lib->sym_tab != NULL || !(flags & DBLL_SYMB))
 		goto func_cont;
 
+	if (DSP_SUCCEEDED(status) && dbll_cache_adopt_symbols(zl_lib))
+		goto func_cont;
+
 	zl_lib->sym_tab =
 	    gh_create(MAXBUCKETS, sizeof(struct dbll_symbol), name_hash,
 		      name_match, sym_delete);
@@ -851,10 +928,13 @@ void dbll_unload(struct dbll_library_obj *lib, struct dbll_attrs *attrs)
 		if (err != 0) {
 			dev_dbg(bridge, "%s: failed: 0x%x\n", __func__, err);
 		}
+		/* A replayed load has no module for the next unload */
+		zl_lib->dload_mod_obj = NULL;
 	}
 	/* remove symbols from symbol table */
 	if (zl_lib->sym_tab != NULL) {
-		gh_delete(zl_lib->sym_tab);
+		if (!dbll_cache_park_symbols(zl_lib))
+			gh_delete(zl_lib->sym_tab);
 		zl_lib->sym_tab = NULL;
 	}
 	/* delete DOFF desc since it holds *lots* of host OS
@@ -905,6 +985,9 @@ static dsp_status dof_open(struct dbll_library_obj *zl_lib)
 	zl_lib->fp =
 	    (void *)((dbll_f_open_fxn) (open)) (zl_lib->file_name, "rb");
 
+	zl_lib->have_id = zl_lib->fp && zl_lib->target_obj->attrs.fident &&
+	    (*zl_lib->target_obj->attrs.fident) (zl_lib->fp, &zl_lib->file_id);
+
 	/* Open DOFF module */
 	if (zl_lib->fp && zl_lib->desc == NULL) {
 		(*(zl_lib->target_obj->attrs.fseek)) (zl_lib->fp, (long)0,
@@ -924,6 +1007,271 @@ static dsp_status dof_open(struct dbll_library_obj *zl_lib)
 	return status;
 }
 
+/*
+ *  ======== dbll_cache_usable ========
+ *  Whether loads of this library may be recorded and replayed.
+ */
+static bool dbll_cache_usable(struct dbll_library_obj *lib)
+{
+	struct dbll_attrs *attrs = &lib->target_obj->attrs;
+
+	return lib->have_id && attrs->base_image && !attrs->log_write;
+}
+
+static bool dbll_file_id_equal(const struct dbll_file_id *a,
+			       const struct dbll_file_id *b)
+{
+	return a->dev == b->dev && a->size == b->size && a->ino == b->ino &&
+	    a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec;
+}
+
+static void dbll_image_free(struct dbll_image *image)
+{
+	struct dbll_rec *rec, *tmp;
+
+	list_for_each_entry_safe(rec, tmp, &image->recs, link)
+		kfree(rec);
+	if (image->sym_tab)
+		gh_delete(image->sym_tab);
+	kfree(image->file_name);
+	kfree(image);
+}
+
+/* Called with dbll_cache_lock held */
+static void dbll_cache_drop(struct dbll_image *image)
+{
+	list_del(&image->link);
+	dbll_cache_bytes -= image->bytes;
+	dbll_image_free(image);
+}
+
+/*
+ *  ======== dbll_cache_find ========
+ *  Look up the entry for the library's file, dropping entries recorded
+ *  from older versions of it. Called with dbll_cache_lock held.
+ */
+static struct dbll_image *dbll_cache_find(struct dbll_library_obj *lib)
+{
+	struct dbll_image *image, *tmp;
+
+	list_for_each_entry_safe(image, tmp, &dbll_cache, link) {
+		if (strcmp(image->file_name, lib->file_name))
+			continue;
+		if (dbll_file_id_equal(&image->id, &lib->file_id)) {
+			list_move(&image->link, &dbll_cache);
+			return image;
+		}
+		dbll_cache_drop(image);
+	}
+
+	return NULL;
+}
+
+/*
+ *  ======== dbll_cache_flush ========
+ */
+static void dbll_cache_flush(void)
+{
+	struct dbll_image *image, *tmp;
+
+	mutex_lock(&dbll_cache_lock);
+	list_for_each_entry_safe(image, tmp, &dbll_cache, link)
+		dbll_cache_drop(image);
+	mutex_unlock(&dbll_cache_lock);
+}
+
+/*
+ *  ======== dbll_cache_adopt_symbols ========
+ *  Take over the symbol table parked for the library's file, if any.
+ */
+static bool dbll_cache_adopt_symbols(struct dbll_library_obj *lib)
+{
+	struct dbll_image *image;
+	bool found = false;
+
+	if (!dbll_cache_usable(lib))
+		return false;
+
+	mutex_lock(&dbll_cache_lock);
+	image = dbll_cache_find(lib);
+	if (image && image->sym_tab) {
+		lib->sym_tab = image->sym_tab;
+		image->sym_tab = NULL;
+		found = true;
+	}
+	mutex_unlock(&dbll_cache_lock);
+
+	dev_dbg(bridge, "%s: %s symbols %s\n", __func__, lib->file_name,
+		found ? "cached" : "not cached");
+	return found;
+}
+
+/*
+ *  ======== dbll_cache_park_symbols ========
+ *  Hand the library's symbol table to the cache entry for its file
+ *  instead of freeing it. Returns false if the caller must free it.
+ */
+static bool dbll_cache_park_symbols(struct dbll_library_obj *lib)
+{
+	struct dbll_image *image;
+	bool parked = false;
+
+	if (!lib->have_id || !lib->target_obj->attrs.base_image)
+		return false;
+
+	mutex_lock(&dbll_cache_lock);
+	image = dbll_cache_find(lib);
+	if (image && !image->sym_tab) {
+		image->sym_tab = lib->sym_tab;
+		parked = true;
+	}
+	mutex_unlock(&dbll_cache_lock);
+
+	return parked;
+}
+
+/*
+ *  ======== dbll_cache_replay ========
+ *  Load the library by replaying a recorded load of the same file.
+ *  Returns 1 if it was loaded, 0 if there is nothing to replay, or a
+ *  negative value if a write to the DSP failed.
+ */
+static int dbll_cache_replay(struct dbll_library_obj *lib, bool got_symbols)
+{
+	struct ldr_section_info info;
+	struct dbll_image *image;
+	struct dbll_rec *rec;
+	int ret = 1;
+
+	if (!dbll_cache_usable(lib))
+		return 0;
+
+	mutex_lock(&dbll_cache_lock);
+	image = dbll_cache_find(lib);
+	if (!image || (!got_symbols && !image->sym_tab)) {
+		mutex_unlock(&dbll_cache_lock);
+		return 0;
+	}
+	if (!got_symbols) {
+		/* Use the parked table instead of the empty one */
+		gh_delete(lib->sym_tab);
+		lib->sym_tab = image->sym_tab;
+		image->sym_tab = NULL;
+	}
+
+	memset(&info, 0, sizeof(info));
+	list_for_each_entry(rec, &image->recs, link) {
+		info.type = rec->type;
+		if (rec->fill) {
+			fill_mem(&lib->init.dl_init, rec->addr, &info,
+				 rec->bytes, rec->val);
+		} else if (!write_mem(&lib->init.dl_init, rec->data, rec->addr,
+				      &info, rec->bytes)) {
+			ret = -EIO;
+			break;
+		}
+	}
+	lib->entry = image->entry;
+
+	dev_dbg(bridge, "%s: %s replayed %u bytes, status %d\n", __func__,
+		lib->file_name, image->bytes, ret);
+	mutex_unlock(&dbll_cache_lock);
+
+	return ret;
+}
+
+/*
+ *  ======== dbll_cache_record_start ========
+ */
+static void dbll_cache_record_start(struct dbll_library_obj *lib)
+{
+	struct dbll_image *image;
+
+	if (!dbll_cache_usable(lib))
+		return;
+
+	image = kzalloc(sizeof(*image), GFP_KERNEL);
+	if (!image)
+		return;
+
+	INIT_LIST_HEAD(&image->recs);
+	lib->rec = image;
+}
+
+/*
+ *  ======== dbll_cache_record ========
+ *  Append a write (buf != NULL) or fill made by the loader to the load
+ *  being recorded. The recording is abandoned if memory runs out or it
+ *  grows past DBLL_CACHE_MAX.
+ */
+static void dbll_cache_record(struct dbll_library_obj *lib, ldr_addr addr,
+			      struct ldr_section_info *info, void *buf,
+			      unsigned bytes, unsigned val)
+{
+	struct dbll_image *image = lib->rec;
+	u32 size = sizeof(struct dbll_rec) + (buf ? bytes : 0);
+	struct dbll_rec *rec = NULL;
+
+	if (image->bytes + size <= DBLL_CACHE_MAX)
+		rec = kmalloc(size, GFP_KERNEL);
+	if (!rec) {
+		lib->rec = NULL;
+		dbll_image_free(image);
+		return;
+	}
+
+	rec->addr = addr;
+	rec->bytes = bytes;
+	rec->val = val;
+	rec->type = info->type;
+	rec->fill = !buf;
+	if (buf)
+		memcpy(rec->data, buf, bytes);
+	list_add_tail(&rec->link, &image->recs);
+	image->bytes += size;
+}
+
+/*
+ *  ======== dbll_cache_record_end ========
+ *  Add the recording to the cache if the load succeeded.
+ */
+static void dbll_cache_record_end(struct dbll_library_obj *lib, bool ok)
+{
+	struct dbll_image *image = lib->rec;
+	struct dbll_image *old, *tmp;
+
+	if (!image)
+		return;
+
+	lib->rec = NULL;
+	if (ok)
+		image->file_name = kstrdup(lib->file_name, GFP_KERNEL);
+	if (!image->file_name) {
+		dbll_image_free(image);
+		return;
+	}
+	image->id = lib->file_id;
+	image->entry = lib->entry;
+
+	mutex_lock(&dbll_cache_lock);
+	old = dbll_cache_find(lib);
+	if (old)
+		dbll_cache_drop(old);
+	list_add(&image->link, &dbll_cache);
+	dbll_cache_bytes += image->bytes;
+
+	/* Drop least recently used entries until the cache fits */
+	list_for_each_entry_safe_reverse(old, tmp, &dbll_cache, link) {
+		if (dbll_cache_bytes <= DBLL_CACHE_MAX)
+			break;
+		dbll_cache_drop(old);
+	}
+
+	dev_dbg(bridge, "%s: %s recorded %u bytes, cached %u\n", __func__,
+		lib->file_name, image->bytes, dbll_cache_bytes);
+	mutex_unlock(&dbll_cache_lock);
+}
+
 /*
  *  ======== name_hash ========
  */
@@ -1443,6 +1791,8 @@ static int write_mem(struct dynamic_loader_initialize *this, void *buf,
 		    (*target_obj->attrs.write) (target_obj->attrs.input_params,
 						addr, buf, bytes,
 						mem_sect_type);
+		if (ret && bytes && lib->rec)
+			dbll_cache_record(lib, addr, info, buf, bytes, 0);
 
 		if (target_obj->attrs.log_write) {
 			sect_info.name = info->name;
@@ -1486,6 +1836,8 @@ static int fill_mem(struct dynamic_loader_initialize *this, ldr_addr addr,
 		write_mem(this, &pbuf, addr, info, 0);
 	if (pbuf)
 		memset(pbuf, val, bytes);
+	if (lib->rec)
+		dbll_cache_record(lib, addr, info, NULL, bytes, val);
 
 	return ret;
 }
@@ -23,6 +23,7 @@
 
 /*  ----------------------------------- Host OS */
 #include <dspbridge/host_os.h>
+#include <linux/rbtree.h>
 
 /*  ----------------------------------- DSP/BIOS Bridge */
 #include <dspbridge/std.h>
@@ -69,10 +70,23 @@ struct map_page {
 	u32 mapped:1;
 };
 
+/*
+ * Free regions of the virtual mapping table. Each one is linked in two
+ * rbtrees: free_by_size, ordered by (pages, start), gives the best fit
+ * for a reservation; free_by_addr, ordered by start, finds the
+ * neighbours to coalesce with when a chunk is released.
+ */
+struct dmm_free_region {
+	struct rb_node size_node;
+	struct rb_node addr_node;
+	u32 start;		/* Index into virtual_mapping_table */
+	u32 pages;
+};
+
 /*  Create the free list */
 static struct map_page *virtual_mapping_table;
-static u32 free_region;		/* The index of free region */
-static u32 free_size;
+static struct rb_root free_by_size = RB_ROOT;
+static struct rb_root free_by_addr = RB_ROOT;
 static u32 dyn_mem_map_beg;	/* The Beginning of dynamic memory mapping */
 static u32 table_size;		/* The size of virt and phys pages tables */
 
@@ -80,6 +94,9 @@ static u32 table_size;		/* The size of virt and phys pages tables */
 static struct map_page *get_region(u32 addr);
 static struct map_page *get_free_region(u32 aSize);
 static struct map_page *get_mapped_region(u32 aAddr);
+static void put_free_region(u32 start, u32 pages,
+			    struct dmm_free_region *new_region);
+static void free_regions_delete(void);
 #ifdef DSP_DMM_DEBUG
 u32 dmm_mem_map_dump(struct dmm_object *dmm_mgr);
 #endif
@@ -94,6 +111,7 @@ u32 dmm_mem_map_dump(struct dmm_object *dmm_mgr);
 dsp_status dmm_create_tables(struct dmm_object *dmm_mgr, u32 addr, u32 size)
 {
 	struct dmm_object *dmm_obj = (struct dmm_object *)dmm_mgr;
+	struct dmm_free_region *region;
 	dsp_status status = DSP_SOK;
 
 	status = dmm_delete_tables(dmm_obj);
@@ -104,14 +122,16 @@ dsp_status dmm_create_tables(struct dmm_object *dmm_mgr, u32 addr, u32 size)
 		/*  Create the free list */
 		virtual_mapping_table = (struct map_page *)mem_calloc
 		    (table_size * sizeof(struct map_page), MEM_LARGEVIRTMEM);
-		if (virtual_mapping_table == NULL)
+		region = mem_calloc(sizeof(*region), MEM_NONPAGED);
+		if (virtual_mapping_table == NULL || region == NULL) {
+			vfree(virtual_mapping_table);
+			virtual_mapping_table = NULL;
+			kfree(region);
 			status = DSP_EMEMORY;
-		else {
+		} else {
 			/* On successful allocation,
 			 * all entries are zero ('free') */
-			free_region = 0;
-			free_size = table_size * PG_SIZE4K;
-			virtual_mapping_table[0].region_size = table_size;
+			put_free_region(0, table_size, region);
 		}
 		sync_leave_cs(dmm_obj->dmm_lock);
 	}
@@ -192,6 +212,8 @@ dsp_status dmm_delete_tables(struct dmm_object *dmm_mgr)
 		sync_enter_cs(dmm_obj->dmm_lock);
 
 		vfree(virtual_mapping_table);
+		virtual_mapping_table = NULL;
+		free_regions_delete();
 
 		sync_leave_cs(dmm_obj->dmm_lock);
 	} else
@@ -381,15 +403,21 @@ dsp_status dmm_un_reserve_memory(struct dmm_object *dmm_mgr, u32 rsv_addr)
 {
 	struct dmm_object *dmm_obj = (struct dmm_object *)dmm_mgr;
 	struct map_page *chunk;
+	struct dmm_free_region *region;
 	u32 i;
 	dsp_status status = DSP_SOK;
 	u32 chunk_size;
 
+	/* Releasing a chunk may need a new free region node */
+	region = mem_calloc(sizeof(*region), MEM_NONPAGED);
+	if (region == NULL)
+		return DSP_EMEMORY;
+
 	sync_enter_cs(dmm_obj->dmm_lock);
 
-	/* Find the chunk containing the reserved address */
+	/* rsv_addr must start a chunk that is currently reserved */
 	chunk = get_mapped_region(rsv_addr);
-	if (chunk == NULL)
+	if (chunk == NULL || !chunk->reserved)
 		status = DSP_ENOTFOUND;
 
 	if (DSP_SUCCEEDED(status)) {
@@ -406,14 +434,14 @@ dsp_status dmm_un_reserve_memory(struct dmm_object *dmm_mgr, u32 rsv_addr)
 			} else
 				i++;
 		}
-		/* Clear the flags (mark the region 'free') */
-		chunk->reserved = false;
-		/* NOTE: We do NOT coalesce free regions here.
-		 * Free regions are coalesced in get_region(), as it traverses
-		 *the whole mapping table
-		 */
+		/* Mark the region 'free' and coalesce it with its free
+		 * neighbours */
+		put_free_region(chunk - virtual_mapping_table,
+				chunk->region_size, region);
+		region = NULL;
 	}
 	sync_leave_cs(dmm_obj->dmm_lock);
+	kfree(region);
 
 	dev_dbg(bridge, "%s: dmm_mgr %p, rsv_addr %x\n\tstatus %x chunk %p",
 		__func__, dmm_mgr, rsv_addr, status, chunk);
@@ -438,11 +466,120 @@ static struct map_page *get_region(u32 aAddr)
 			curr_region = virtual_mapping_table + i;
 	}
 
-	dev_dbg(bridge, "%s: curr_region %p, free_region %d, free_size %d\n",
-		__func__, curr_region, free_region, free_size);
+	dev_dbg(bridge, "%s: curr_region %p\n", __func__, curr_region);
 	return curr_region;
 }
 
+static void free_insert_size(struct dmm_free_region *region)
+{
+	struct rb_node **link = &free_by_size.rb_node;
+	struct rb_node *parent = NULL;
+	struct dmm_free_region *cur;
+
+	while (*link) {
+		parent = *link;
+		cur = rb_entry(parent, struct dmm_free_region, size_node);
+		if (region->pages < cur->pages ||
+		    (region->pages == cur->pages && region->start < cur->start))
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&region->size_node, parent, link);
+	rb_insert_color(&region->size_node, &free_by_size);
+}
+
+static void free_insert_addr(struct dmm_free_region *region)
+{
+	struct rb_node **link = &free_by_addr.rb_node;
+	struct rb_node *parent = NULL;
+	struct dmm_free_region *cur;
+
+	while (*link) {
+		parent = *link;
+		cur = rb_entry(parent, struct dmm_free_region, addr_node);
+		if (region->start < cur->start)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&region->addr_node, parent, link);
+	rb_insert_color(&region->addr_node, &free_by_addr);
+}
+
+/* Free region with the highest start not above 'start', or NULL */
+static struct dmm_free_region *free_find_addr(u32 start)
+{
+	struct rb_node *node = free_by_addr.rb_node;
+	struct dmm_free_region *cur, *found = NULL;
+
+	while (node) {
+		cur = rb_entry(node, struct dmm_free_region, addr_node);
+		if (cur->start <= start) {
+			found = cur;
+			node = node->rb_right;
+		} else {
+			node = node->rb_left;
+		}
+	}
+	return found;
+}
+
+static void free_regions_delete(void)
+{
+	struct rb_node *node;
+
+	while ((node = rb_first(&free_by_addr)) != NULL) {
+		rb_erase(node, &free_by_addr);
+		kfree(rb_entry(node, struct dmm_free_region, addr_node));
+	}
+	free_by_size = RB_ROOT;
+}
+
+/*
+ *  ======== put_free_region ========
+ *  Purpose:
+ *      Return 'pages' entries at 'start' to the free trees, merging with
+ *      adjacent free regions. new_region is used or freed.
+ */
+static void put_free_region(u32 start, u32 pages,
+			    struct dmm_free_region *new_region)
+{
+	struct dmm_free_region *region;
+	struct dmm_free_region *next;
+
+	/* The released chunk no longer heads a region of its own */
+	virtual_mapping_table[start].reserved = false;
+	virtual_mapping_table[start].region_size = 0;
+
+	region = start ? free_find_addr(start - 1) : NULL;
+	if (region != NULL && region->start + region->pages == start) {
+		rb_erase(&region->size_node, &free_by_size);
+		region->pages += pages;
+		kfree(new_region);
+	} else {
+		region = new_region;
+		region->start = start;
+		region->pages = pages;
+		free_insert_addr(region);
+	}
+
+	next = free_find_addr(region->start + region->pages);
+	if (next != NULL && next != region &&
+	    next->start == region->start + region->pages) {
+		rb_erase(&next->size_node, &free_by_size);
+		rb_erase(&next->addr_node, &free_by_addr);
+		region->pages += next->pages;
+		virtual_mapping_table[next->start].reserved = false;
+		virtual_mapping_table[next->start].region_size = 0;
+		kfree(next);
+	}
+	free_insert_size(region);
+
+	virtual_mapping_table[region->start].reserved = false;
+	virtual_mapping_table[region->start].region_size = region->pages;
+}
+
 /*
  *  ======== get_free_region ========
  *  Purpose:
@@ -450,44 +587,40 @@ static struct map_page *get_region(u32 aAddr)
  */
 static struct map_page *get_free_region(u32 aSize)
 {
-	struct map_page *curr_region = NULL;
-	u32 i = 0;
-	u32 region_size = 0;
-	u32 next_i = 0;
+	struct rb_node *node = free_by_size.rb_node;
+	struct dmm_free_region *cur, *best = NULL;
+	u32 pages = aSize / PG_SIZE4K;
+	u32 start;
 
 	if (virtual_mapping_table == NULL)
-		return curr_region;
-
-		/* Find the largest free region
-		 * (coalesce during the traversal) */
-		while (i < table_size) {
-			region_size = virtual_mapping_table[i].region_size;
-			next_i = i + region_size;
-			if (virtual_mapping_table[i].reserved == false) {
-				/* Coalesce, if possible */
-				if (next_i < table_size &&
-				    virtual_mapping_table[next_i].reserved
-				    == false) {
-					virtual_mapping_table[i].region_size +=
-					    virtual_mapping_table
-					    [next_i].region_size;
-					continue;
-				}
-				region_size *= PG_SIZE4K;
-				if (region_size >= aSize) {
-					free_region = i;
-					free_size = region_size;
-					break;
-				}
-			}
-			i = next_i;
+		return NULL;
+
+	/* Smallest free region that fits, lowest address on ties */
+	while (node) {
+		cur = rb_entry(node, struct dmm_free_region, size_node);
+		if (cur->pages >= pages) {
+			best = cur;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
 		}
-	if (aSize <= free_size) {
-		curr_region = virtual_mapping_table + free_region;
-		free_region += (aSize / PG_SIZE4K);
-		free_size -= aSize;
 	}
-	return curr_region;
+	if (best == NULL)
+		return NULL;
+
+	start = best->start;
+	rb_erase(&best->size_node, &free_by_size);
+	if (best->pages == pages) {
+		rb_erase(&best->addr_node, &free_by_addr);
+		kfree(best);
+	} else {
+		/* The remainder keeps its place in address order */
+		best->start += pages;
+		best->pages -= pages;
+		free_insert_size(best);
+	}
+
+	return virtual_mapping_table + start;
 }
 
 /*
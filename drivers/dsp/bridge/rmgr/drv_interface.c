@@ -63,6 +63,7 @@
 #include <dspbridge/dev.h>
 #include <dspbridge/drvdefs.h>
 #include <dspbridge/drv.h>
+#include <dspbridge/io_sm.h>
 
 #ifdef CONFIG_BRIDGE_DVFS
 #include <mach-omap2/omap3-opp.h>
@@ -84,6 +85,21 @@ static struct cdev bridge_cdev;
 
 static struct class *bridge_class;
 
+static ssize_t msg_stats_show(struct class *class, char *buf)
+{
+	struct io_mgr *hio_mgr = NULL;
+	struct dev_object *dev_obj = dev_get_first();
+
+	if (dev_obj)
+		dev_get_io_mgr(dev_obj, &hio_mgr);
+	if (!hio_mgr)
+		return 0;
+
+	return io_msg_stats(hio_mgr, buf, PAGE_SIZE);
+}
+
+static CLASS_ATTR(msg_stats, S_IRUGO, msg_stats_show, NULL);
+
 static u32 driver_context;
 static s32 driver_major;
 static char *base_img;
@@ -260,6 +276,8 @@ static int __devinit omap34_xx_bridge_probe(struct platform_device *pdev)
 
 	if (IS_ERR(bridge_class))
 		pr_err("%s: Error creating bridge class\n", __func__);
+	else if (class_create_file(bridge_class, &class_attr_msg_stats))
+		pr_err("%s: Error creating msg_stats\n", __func__);
 
 	device_create(bridge_class, NULL, MKDEV(driver_major, 0),
 		      NULL, "DspBridge");
@@ -398,6 +416,7 @@ func_cont:
 	if (bridge_class) {
 		/* remove the device from sysfs */
 		device_destroy(bridge_class, MKDEV(driver_major, 0));
+		class_remove_file(bridge_class, &class_attr_msg_stats);
 		class_destroy(bridge_class);
 
 	}
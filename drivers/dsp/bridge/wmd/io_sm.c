@@ -124,7 +124,14 @@ struct io_mgr {
 	u32 dpc_sched;		/* Number of executed DPC's. */
 	struct tasklet_struct dpc_tasklet;
 	spinlock_t dpc_lock;
-
+	u32 dpc_coalesced;	/* DPC requests folded into another run */
+
+	/* Message doorbell statistics, updated from the DPC only */
+	bool msg_doorbell;	/* Ring the DSP once the dispatch is done */
+	u32 msg_irqs;		/* Mailbox interrupts raised for messages */
+	u32 msgs_to_dsp;
+	u32 msgs_from_dsp;
+	u32 msg_max_batch;	/* Most messages covered by one interrupt */
 };
 
 /* Function Prototypes */
@@ -859,16 +866,50 @@ func_end:
  */
 static void io_dispatch_msg(IN struct io_mgr *pio_mgr, struct msg_mgr *hmsg_mgr)
 {
+	u32 msgs;
+
 	if (!MEM_IS_VALID_HANDLE(pio_mgr, IO_MGRSIGNATURE))
 		goto func_end;
 
+	msgs = pio_mgr->msgs_to_dsp + pio_mgr->msgs_from_dsp;
+
 	/* We are performing both input and output processing. */
 	input_msg(pio_mgr, hmsg_mgr);
 	output_msg(pio_mgr, hmsg_mgr);
+
+	/*
+	 * The DSP checks the post_swi flag of both msg_ctrl blocks on
+	 * every MBX_PCPY_CLASS interrupt, so acknowledging input and
+	 * posting output share one doorbell.
+	 */
+	if (pio_mgr->msg_doorbell) {
+		pio_mgr->msg_doorbell = false;
+		msgs = pio_mgr->msgs_to_dsp + pio_mgr->msgs_from_dsp - msgs;
+		pio_mgr->msg_irqs++;
+		if (msgs > pio_mgr->msg_max_batch)
+			pio_mgr->msg_max_batch = msgs;
+		sm_interrupt_dsp(pio_mgr->hwmd_context, MBX_PCPY_CLASS);
+	}
 func_end:
 	return;
 }
 
+/*
+ *  ======== io_msg_stats ========
+ *      Format the message doorbell counters into buf.
+ */
+ssize_t io_msg_stats(struct io_mgr *hio_mgr, char *buf, size_t len)
+{
+	if (!MEM_IS_VALID_HANDLE(hio_mgr, IO_MGRSIGNATURE))
+		return 0;
+
+	return snprintf(buf, len, "to_dsp %u from_dsp %u irqs %u "
+			"max_batch %u dpc_coalesced %u\n",
+			hio_mgr->msgs_to_dsp, hio_mgr->msgs_from_dsp,
+			hio_mgr->msg_irqs, hio_mgr->msg_max_batch,
+			hio_mgr->dpc_coalesced);
+}
+
 /*
  *  ======== io_dispatch_pm ========
  *      Performs I/O dispatch on PM related messages from DSP
@@ -939,29 +980,33 @@ void io_dpc(IN OUT unsigned long pRefData)
 	if (serviced == requested)
 		goto func_end;
 
-	/* Process pending DPC's */
-	do {
-		/* Check value of interrupt reg to ensure it's a valid error */
-		if ((pio_mgr->intr_val > DEH_BASE) &&
-		    (pio_mgr->intr_val < DEH_LIMIT)) {
-			/* Notify DSP/BIOS exception */
-			if (hdeh_mgr)
-				bridge_deh_notify(hdeh_mgr, DSP_SYSERROR,
-						  pio_mgr->intr_val);
-		}
-		io_dispatch_chnl(pio_mgr, NULL, IO_SERVICE);
+	/*
+	 * One dispatch pass drains everything the DSP and the clients have
+	 * queued so far, so a burst of requests is served by a single pass
+	 * (and at most one message doorbell). Requests made while we run
+	 * reschedule the tasklet.
+	 */
+	pio_mgr->dpc_coalesced += requested - serviced - 1;
+
+	/* Check value of interrupt reg to ensure it's a valid error */
+	if ((pio_mgr->intr_val > DEH_BASE) &&
+	    (pio_mgr->intr_val < DEH_LIMIT)) {
+		/* Notify DSP/BIOS exception */
+		if (hdeh_mgr)
+			bridge_deh_notify(hdeh_mgr, DSP_SYSERROR,
+					  pio_mgr->intr_val);
+	}
+	io_dispatch_chnl(pio_mgr, NULL, IO_SERVICE);
 #ifdef CHNL_MESSAGES
-		if (MEM_IS_VALID_HANDLE(msg_mgr_obj, MSGMGR_SIGNATURE))
-			io_dispatch_msg(pio_mgr, msg_mgr_obj);
+	if (MEM_IS_VALID_HANDLE(msg_mgr_obj, MSGMGR_SIGNATURE))
+		io_dispatch_msg(pio_mgr, msg_mgr_obj);
 #endif
 #ifdef CONFIG_BRIDGE_DEBUG
-		if (pio_mgr->intr_val & MBX_DBG_SYSPRINTF) {
-			/* Notify DSP Trace message */
-			print_dsp_debug_trace(pio_mgr);
-		}
+	if (pio_mgr->intr_val & MBX_DBG_SYSPRINTF) {
+		/* Notify DSP Trace message */
+		print_dsp_debug_trace(pio_mgr);
+	}
 #endif
-		serviced++;
-	} while (serviced != requested);
 	pio_mgr->dpc_sched = requested;
 func_end:
 	return;
@@ -1345,7 +1390,8 @@ static void input_msg(struct io_mgr *pio_mgr, struct msg_mgr *hmsg_mgr)
 			     msg_ctr_obj, buf_empty, true);
 		IO_SET_VALUE(pio_mgr->hwmd_context, struct msg_ctrl,
 			     msg_ctr_obj, post_swi, true);
-		sm_interrupt_dsp(pio_mgr->hwmd_context, MBX_PCPY_CLASS);
+		pio_mgr->msgs_from_dsp += num_msgs;
+		pio_mgr->msg_doorbell = true;
 	}
 func_end:
 	return;
@@ -1554,7 +1600,8 @@ static void output_msg(struct io_mgr *pio_mgr, struct msg_mgr *hmsg_mgr)
 			IO_SET_VALUE(pio_mgr->hwmd_context, struct msg_ctrl,
 				     msg_ctr_obj, post_swi, true);
 			/* Tell the DSP we have written the output. */
-			sm_interrupt_dsp(pio_mgr->hwmd_context, MBX_PCPY_CLASS);
+			pio_mgr->msgs_to_dsp += num_msgs;
+			pio_mgr->msg_doorbell = true;
 		}
 	}
 func_end:
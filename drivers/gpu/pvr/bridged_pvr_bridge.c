@@ -2457,6 +2457,7 @@ static int PVRSRVEventObjectWaitBW(u32 ui32BridgeID,
 	   struct PVRSRV_PER_PROCESS_DATA *psPerProc)
 {
 	void *hOSEventKM;
+	enum PVRSRV_ERROR eError;
 
 	BRIDGE_ID_CHECK(ui32BridgeID, PVRSRV_BRIDGE_EVENT_OBJECT_WAIT);
 
@@ -2468,7 +2469,17 @@ static int PVRSRVEventObjectWaitBW(u32 ui32BridgeID,
 	if (psRetOUT->eError != PVRSRV_OK)
 		return 0;
 
-	psRetOUT->eError = OSEventObjectWait(hOSEventKM);
+	/*
+	 * Don't block the other threads of this process while sleeping.
+	 * OSEventObjectWait() drops pvr_lock as well and retakes it before
+	 * returning, so the lock order is kept. The bridge buffer may be
+	 * reused meanwhile; only psRetOUT is written after this point.
+	 */
+	mutex_unlock(&psPerProc->lock);
+	eError = OSEventObjectWait(hOSEventKM);
+	mutex_lock(&psPerProc->lock);
+
+	psRetOUT->eError = eError;
 
 	return 0;
 }
@@ -2541,6 +2552,19 @@ static int PVRSRVEventObjectCloseBW(u32 ui32BridgeID,
 	return 0;
 }
 
+enum pvr_bridge_lock bridged_lock_type(u32 cmd_id)
+{
+	switch (PVRSRV_IOWR(cmd_id)) {
+	case PVRSRV_BRIDGE_ENUM_DEVICES:
+	case PVRSRV_BRIDGE_MHANDLE_TO_MMAP_DATA:	/* g_sMMapMutex */
+	case PVRSRV_BRIDGE_RELEASE_MMAP_DATA:		/* g_sMMapMutex */
+	case PVRSRV_BRIDGE_GETMMU_PD_DEVPADDR:
+		return PVR_BRIDGE_LOCK_PROC;
+	default:
+		return PVR_BRIDGE_LOCK_GLOBAL;
+	}
+}
+
 static int bridged_check_cmd(u32 cmd_id)
 {
 	if (PVRSRVGetInitServerState(PVRSRV_INIT_SERVER_RAN)) {
@@ -2989,7 +3013,6 @@ int BridgedDispatchKM(struct file *filp, struct PVRSRV_PER_PROCESS_DATA *pd,
 	void *out;
 	u32 bid = pkg->ui32BridgeID;
 	int err = -EFAULT;
-	struct SYS_DATA *psSysData;
 
 #if defined(DEBUG_BRIDGE_KM)
 	g_BridgeDispatchTable[bid].ui32CallCount++;
@@ -2998,10 +3021,7 @@ int BridgedDispatchKM(struct file *filp, struct PVRSRV_PER_PROCESS_DATA *pd,
 	if (!pd->bInitProcess && bridged_check_cmd(bid))
 		goto return_fault;
 
-	if (SysAcquireData(&psSysData) != PVRSRV_OK)
-		goto return_fault;
-
-	in = ((struct ENV_DATA *)psSysData->pvEnvSpecificData)->pvBridgeData;
+	in = pd->pvBridgeData;
 	out = (void *)((u8 *)in + PVRSRV_MAX_BRIDGE_IN_SIZE);
 
 	if (pkg->ui32InBufferSize > 0 &&
@@ -132,6 +132,20 @@ extern struct PVRSRV_BRIDGE_GLOBAL_STATS g_BridgeGlobalStats;
 
 #endif /* DEBUG_BRIDGE_KM */
 
+/*
+ * Locking needed by a bridge call. Most calls touch device or shared
+ * state and run under pvr_lock. Calls that only read the caller's own
+ * handle base, plus state that is fixed after init or has a lock of its
+ * own, need just the per-process lock and don't serialise against other
+ * processes.
+ */
+enum pvr_bridge_lock {
+	PVR_BRIDGE_LOCK_GLOBAL,
+	PVR_BRIDGE_LOCK_PROC,
+};
+
+enum pvr_bridge_lock bridged_lock_type(u32 cmd_id);
+
 int BridgedDispatchKM(struct file *filp,
 			struct PVRSRV_PER_PROCESS_DATA *psPerProc,
 			struct PVRSRV_BRIDGE_PACKAGE *psBridgePackageKM);
@@ -41,7 +41,6 @@ struct PVR_PCI_DEV {
 };
 
 struct ENV_DATA {
-	void *pvBridgeData;
 	struct pm_dev *psPowerDevice;
 	IMG_BOOL bLISRInstalled;
 	IMG_BOOL bMISRInstalled;
@@ -125,6 +125,12 @@ struct sHandle {
 	struct sHandleList sSiblings;
 };
 
+/*
+ * A handle base has no lock of its own. A per-process base is modified
+ * only with both pvr_lock and the owner's PVRSRV_PER_PROCESS_DATA lock
+ * held; lookups need either one. The kernel handle base is protected by
+ * pvr_lock alone.
+ */
 struct PVRSRV_HANDLE_BASE {
 	void *hBaseBlockAlloc;
 
@@ -39,6 +39,14 @@
 #define	KEY_COMPARE(pHash, pKey1, pKey2) \
 	((pHash)->pfnKeyComp((pHash)->uKeySize, pKey1, pKey2))
 
+/*
+ * Resizing doesn't move every entry at once. The previous bucket table is
+ * kept and drained HASH_REHASH_STEP chains at a time by each insert and
+ * remove, so no single call pays for the whole table. Until it's empty,
+ * lookups check both tables.
+ */
+#define HASH_REHASH_STEP	4
+
 struct BUCKET {
 	struct BUCKET *pNext;
 	u32 v;
@@ -52,6 +60,9 @@ struct HASH_TABLE {
 	u32 uCount;
 	u32 uMinimumSize;
 	u32 uKeySize;
+	struct BUCKET **ppOldTable;
+	u32 uOldSize;
+	u32 uRehashIndex;
 	u32 (*pfnHashFunc)(size_t uKeySize, void *pkey, u32 uHashTabLen);
 	IMG_BOOL (*pfnKeyComp)(size_t uKeySize, void *pKey1, void *pkey2);
 };
@@ -123,26 +134,28 @@ static enum PVRSRV_ERROR _ChainInsert(struct HASH_TABLE *pHash,
 	return PVRSRV_OK;
 }
 
-static enum PVRSRV_ERROR _Rehash(struct HASH_TABLE *pHash,
-				 struct BUCKET **ppOldTable, u32 uOldSize,
-				 struct BUCKET **ppNewTable, u32 uNewSize)
+static void _RehashStep(struct HASH_TABLE *pHash, u32 uChains)
 {
-	u32 uIndex;
-	for (uIndex = 0; uIndex < uOldSize; uIndex++) {
+	while (pHash->ppOldTable != NULL && uChains--) {
 		struct BUCKET *pBucket;
-		pBucket = ppOldTable[uIndex];
+
+		pBucket = pHash->ppOldTable[pHash->uRehashIndex];
+		pHash->ppOldTable[pHash->uRehashIndex] = NULL;
 		while (pBucket != NULL) {
 			struct BUCKET *pNextBucket = pBucket->pNext;
-			if (_ChainInsert(pHash, pBucket, ppNewTable, uNewSize)
-			    != PVRSRV_OK) {
-				PVR_DPF(PVR_DBG_ERROR,
-					"_Rehash: call to _ChainInsert failed");
-				return PVRSRV_ERROR_GENERIC;
-			}
+
+			_ChainInsert(pHash, pBucket, pHash->ppBucketTable,
+				     pHash->uSize);
 			pBucket = pNextBucket;
 		}
+
+		if (++pHash->uRehashIndex == pHash->uOldSize) {
+			OSFreeMem(PVRSRV_PAGEABLE_SELECT,
+				  sizeof(struct BUCKET *) * pHash->uOldSize,
+				  pHash->ppOldTable, NULL);
+			pHash->ppOldTable = NULL;
+		}
 	}
-	return PVRSRV_OK;
 }
 
 static IMG_BOOL _Resize(struct HASH_TABLE *pHash, u32 uNewSize)
@@ -155,6 +168,10 @@ static IMG_BOOL _Resize(struct HASH_TABLE *pHash, u32 uNewSize)
 			 "HASH_Resize: oldsize=0x%x  newsize=0x%x  count=0x%x",
 			 pHash->uSize, uNewSize, pHash->uCount);
 
+		/* Only one table can be draining at a time. */
+		if (pHash->ppOldTable != NULL)
+			_RehashStep(pHash, pHash->uOldSize);
+
 		table_size = sizeof(struct BUCKET *) * uNewSize;
 		if (OSAllocMem(PVRSRV_PAGEABLE_SELECT, table_size,
 			   (void **) &ppNewTable, NULL) != PVRSRV_OK)
@@ -162,22 +179,38 @@ static IMG_BOOL _Resize(struct HASH_TABLE *pHash, u32 uNewSize)
 
 		memset(ppNewTable, 0, table_size);
 
-		if (_Rehash(pHash, pHash->ppBucketTable, pHash->uSize,
-			    ppNewTable, uNewSize) != PVRSRV_OK) {
-			OSFreeMem(PVRSRV_PAGEABLE_SELECT, table_size,
-				  ppNewTable, NULL);
-			return IMG_FALSE;
-		}
-
-		OSFreeMem(PVRSRV_PAGEABLE_SELECT,
-			  sizeof(struct BUCKET *) * pHash->uSize,
-			  pHash->ppBucketTable, NULL);
+		pHash->ppOldTable = pHash->ppBucketTable;
+		pHash->uOldSize = pHash->uSize;
+		pHash->uRehashIndex = 0;
 		pHash->ppBucketTable = ppNewTable;
 		pHash->uSize = uNewSize;
 	}
 	return IMG_TRUE;
 }
 
+static struct BUCKET **_FindBucket(struct HASH_TABLE *pHash, void *pKey)
+{
+	struct BUCKET **ppBucket;
+	u32 uIndex;
+
+	uIndex = KEY_TO_INDEX(pHash, pKey, pHash->uSize);
+	for (ppBucket = &(pHash->ppBucketTable[uIndex]); *ppBucket != NULL;
+	     ppBucket = &((*ppBucket)->pNext))
+		if (KEY_COMPARE(pHash, (*ppBucket)->k, pKey))
+			return ppBucket;
+
+	if (pHash->ppOldTable == NULL)
+		return NULL;
+
+	uIndex = KEY_TO_INDEX(pHash, pKey, pHash->uOldSize);
+	for (ppBucket = &(pHash->ppOldTable[uIndex]); *ppBucket != NULL;
+	     ppBucket = &((*ppBucket)->pNext))
+		if (KEY_COMPARE(pHash, (*ppBucket)->k, pKey))
+			return ppBucket;
+
+	return NULL;
+}
+
 struct HASH_TABLE *HASH_Create_Extended(u32 uInitialLen, size_t uKeySize,
 				 u32 (*pfnHashFunc)(size_t uKeySize, void *pkey,
 						    u32 uHashTabLen),
@@ -200,6 +233,9 @@ struct HASH_TABLE *HASH_Create_Extended(u32 uInitialLen, size_t uKeySize,
 	pHash->uSize = uInitialLen;
 	pHash->uMinimumSize = uInitialLen;
 	pHash->uKeySize = uKeySize;
+	pHash->ppOldTable = NULL;
+	pHash->uOldSize = 0;
+	pHash->uRehashIndex = 0;
 	pHash->pfnHashFunc = pfnHashFunc;
 	pHash->pfnKeyComp = pfnKeyComp;
 
@@ -228,6 +264,10 @@ void HASH_Delete(struct HASH_TABLE *pHash)
 		PVR_DPF(PVR_DBG_MESSAGE, "HASH_Delete");
 
 		PVR_ASSERT(pHash->uCount == 0);
+		if (pHash->ppOldTable != NULL)
+			OSFreeMem(PVRSRV_PAGEABLE_SELECT,
+				  sizeof(struct BUCKET *) * pHash->uOldSize,
+				  pHash->ppOldTable, NULL);
 		OSFreeMem(PVRSRV_PAGEABLE_SELECT,
 			  sizeof(struct BUCKET *) * pHash->uSize,
 			  pHash->ppBucketTable, NULL);
@@ -269,6 +309,8 @@ IMG_BOOL HASH_Insert_Extended(struct HASH_TABLE *pHash, void *pKey, u32 v)
 
 	pHash->uCount++;
 
+	_RehashStep(pHash, HASH_REHASH_STEP);
+
 	if (pHash->uCount << 1 > pHash->uSize)
 		_Resize(pHash, pHash->uSize << 1);
 
@@ -286,7 +328,6 @@ IMG_BOOL HASH_Insert(struct HASH_TABLE *pHash, u32 k, u32 v)
 u32 HASH_Remove_Extended(struct HASH_TABLE *pHash, void *pKey)
 {
 	struct BUCKET **ppBucket;
-	u32 uIndex;
 
 	PVR_DPF(PVR_DBG_MESSAGE, "HASH_Remove: Hash=%08X, pKey=%08X", pHash,
 		 pKey);
@@ -299,33 +340,32 @@ u32 HASH_Remove_Extended(struct HASH_TABLE *pHash, void *pKey)
 		return 0;
 	}
 
-	uIndex = KEY_TO_INDEX(pHash, pKey, pHash->uSize);
+	ppBucket = _FindBucket(pHash, pKey);
+	if (ppBucket != NULL) {
+		struct BUCKET *pBucket = *ppBucket;
+		u32 v = pBucket->v;
+		(*ppBucket) = pBucket->pNext;
 
-	for (ppBucket = &(pHash->ppBucketTable[uIndex]); *ppBucket != NULL;
-	     ppBucket = &((*ppBucket)->pNext))
-		if (KEY_COMPARE(pHash, (*ppBucket)->k, pKey)) {
-			struct BUCKET *pBucket = *ppBucket;
-			u32 v = pBucket->v;
-			(*ppBucket) = pBucket->pNext;
+		OSFreeMem(PVRSRV_PAGEABLE_SELECT,
+			  sizeof(struct BUCKET) + pHash->uKeySize,
+			  pBucket, NULL);
 
-			OSFreeMem(PVRSRV_PAGEABLE_SELECT,
-				  sizeof(struct BUCKET) + pHash->uKeySize,
-				  pBucket, NULL);
+		pHash->uCount--;
 
-			pHash->uCount--;
+		_RehashStep(pHash, HASH_REHASH_STEP);
 
-			if (pHash->uSize > (pHash->uCount << 2) &&
-			    pHash->uSize > pHash->uMinimumSize)
+		if (pHash->uSize > (pHash->uCount << 2) &&
+		    pHash->uSize > pHash->uMinimumSize)
 
-				_Resize(pHash,
-					PRIVATE_MAX(pHash->uSize >> 1,
-						    pHash->uMinimumSize));
+			_Resize(pHash,
+				PRIVATE_MAX(pHash->uSize >> 1,
+					    pHash->uMinimumSize));
 
-			PVR_DPF(PVR_DBG_MESSAGE,
-			"HASH_Remove_Extended: Hash=%08X, pKey=%08X = 0x%x",
-				 pHash, pKey, v);
-			return v;
-		}
+		PVR_DPF(PVR_DBG_MESSAGE,
+		"HASH_Remove_Extended: Hash=%08X, pKey=%08X = 0x%x",
+			 pHash, pKey, v);
+		return v;
+	}
 	PVR_DPF(PVR_DBG_MESSAGE,
 		 "HASH_Remove_Extended: Hash=%08X, pKey=%08X = 0x0 !!!!", pHash,
 		 pKey);
@@ -342,7 +382,6 @@ u32 HASH_Remove(struct HASH_TABLE *pHash, u32 k)
 u32 HASH_Retrieve_Extended(struct HASH_TABLE *pHash, void *pKey)
 {
 	struct BUCKET **ppBucket;
-	u32 uIndex;
 
 	PVR_DPF(PVR_DBG_MESSAGE, "HASH_Retrieve: Hash=%08X, pKey=%08X", pHash,
 		 pKey);
@@ -355,19 +394,15 @@ u32 HASH_Retrieve_Extended(struct HASH_TABLE *pHash, void *pKey)
 		return 0;
 	}
 
-	uIndex = KEY_TO_INDEX(pHash, pKey, pHash->uSize);
+	ppBucket = _FindBucket(pHash, pKey);
+	if (ppBucket != NULL) {
+		u32 v = (*ppBucket)->v;
 
-	for (ppBucket = &(pHash->ppBucketTable[uIndex]); *ppBucket != NULL;
-	     ppBucket = &((*ppBucket)->pNext))
-		if (KEY_COMPARE(pHash, (*ppBucket)->k, pKey)) {
-			struct BUCKET *pBucket = *ppBucket;
-			u32 v = pBucket->v;
-
-			PVR_DPF(PVR_DBG_MESSAGE,
-				 "HASH_Retrieve: Hash=%08X, pKey=%08X = 0x%x",
-				 pHash, pKey, v);
-			return v;
-		}
+		PVR_DPF(PVR_DBG_MESSAGE,
+			 "HASH_Retrieve: Hash=%08X, pKey=%08X = 0x%x",
+			 pHash, pKey, v);
+		return v;
+	}
 	PVR_DPF(PVR_DBG_MESSAGE,
 		 "HASH_Retrieve: Hash=%08X, pKey=%08X = 0x0 !!!!", pHash, pKey);
 	return 0;
@@ -32,6 +32,11 @@
 #include <linux/highmem.h>
 #include <linux/sched.h>
 #include <linux/dma-mapping.h>
+#include <linux/moduleparam.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <asm/cacheflush.h>
+#include <asm/div64.h>
 
 #include "img_defs.h"
 #include "services.h"
@@ -120,6 +125,137 @@ static off_t printLinuxMemAreaRecords(char *buffer, size_t size, off_t off);
 
 static struct kmem_cache *psLinuxMemAreaCache;
 
+/*
+ * Pages freed from ALLOC_PAGES areas are kept here, linked through
+ * page->lru, so that buffer churn does not go back to the page
+ * allocator every time. Every pooled page has no dirty lines in the
+ * CPU caches: pages of cached areas are flushed on the way in, so an
+ * allocation can hand them out without any maintenance.
+ */
+static unsigned int page_pool_max = 1024;
+module_param(page_pool_max, uint, 0644);
+MODULE_PARM_DESC(page_pool_max, "Max number of pages kept in the pool");
+
+static DEFINE_SPINLOCK(g_sPagePoolLock);
+static LIST_HEAD(g_sPagePool);
+static u32 g_ui32PagePoolCount;
+static u32 g_ui32PagePoolHits;
+static u32 g_ui32PagePoolMisses;
+static u32 g_ui32PagePoolShrunk;
+static u32 g_ui32PageAreaAllocs;
+static u64 g_ui64PageAreaAllocNs;
+static u64 g_ui64PageAreaAllocMaxNs;
+
+static struct page *PagePoolGet(void)
+{
+	struct page *psPage = NULL;
+
+	spin_lock(&g_sPagePoolLock);
+	if (!list_empty(&g_sPagePool)) {
+		psPage = list_first_entry(&g_sPagePool, struct page, lru);
+		list_del(&psPage->lru);
+		g_ui32PagePoolCount--;
+		g_ui32PagePoolHits++;
+	} else {
+		g_ui32PagePoolMisses++;
+	}
+	spin_unlock(&g_sPagePoolLock);
+
+	if (!psPage)
+		psPage = alloc_pages(GFP_KERNEL | __GFP_HIGHMEM, 0);
+
+	return psPage;
+}
+
+static void PagePoolPut(struct page *psPage, IMG_BOOL bDirty)
+{
+	/* Someone else (e.g. a wrapped user mapping) still holds it. */
+	if (page_count(psPage) != 1) {
+		__free_pages(psPage, 0);
+		return;
+	}
+
+	spin_lock(&g_sPagePoolLock);
+	if (g_ui32PagePoolCount >= page_pool_max) {
+		spin_unlock(&g_sPagePoolLock);
+		__free_pages(psPage, 0);
+		return;
+	}
+	spin_unlock(&g_sPagePoolLock);
+
+#ifdef CONFIG_ARM
+	if (bDirty) {
+		void *pvAddr = kmap(psPage);
+
+		dmac_flush_range(pvAddr, pvAddr + PAGE_SIZE);
+		kunmap(psPage);
+	}
+#endif
+
+	spin_lock(&g_sPagePoolLock);
+	list_add(&psPage->lru, &g_sPagePool);
+	g_ui32PagePoolCount++;
+	spin_unlock(&g_sPagePoolLock);
+}
+
+static void PagePoolDrain(u32 ui32Count)
+{
+	LIST_HEAD(sFree);
+	struct page *psPage, *psTmp;
+
+	spin_lock(&g_sPagePoolLock);
+	while (ui32Count-- && !list_empty(&g_sPagePool)) {
+		psPage = list_first_entry(&g_sPagePool, struct page, lru);
+		list_move(&psPage->lru, &sFree);
+		g_ui32PagePoolCount--;
+		g_ui32PagePoolShrunk++;
+	}
+	spin_unlock(&g_sPagePoolLock);
+
+	list_for_each_entry_safe(psPage, psTmp, &sFree, lru) {
+		list_del(&psPage->lru);
+		__free_pages(psPage, 0);
+	}
+}
+
+static int PagePoolShrink(int nr_to_scan, gfp_t gfp_mask)
+{
+	if (nr_to_scan)
+		PagePoolDrain(nr_to_scan);
+
+	return g_ui32PagePoolCount;
+}
+
+static struct shrinker g_sPagePoolShrinker = {
+	.shrink = PagePoolShrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static off_t printPagePoolStats(char *buffer, size_t count, off_t off)
+{
+	u64 ui64AvgNs;
+	off_t Ret;
+
+	if (off)
+		return END_OF_FILE;
+
+	spin_lock(&g_sPagePoolLock);
+	ui64AvgNs = g_ui64PageAreaAllocNs;
+	if (g_ui32PageAreaAllocs)
+		do_div(ui64AvgNs, g_ui32PageAreaAllocs);
+	Ret = printAppend(buffer, count, 0,
+			  "pages %u max %u\n"
+			  "hits %u misses %u shrunk %u\n"
+			  "area allocs %u avg %llu ns max %llu ns\n",
+			  g_ui32PagePoolCount, page_pool_max,
+			  g_ui32PagePoolHits, g_ui32PagePoolMisses,
+			  g_ui32PagePoolShrunk, g_ui32PageAreaAllocs,
+			  ui64AvgNs, g_ui64PageAreaAllocMaxNs);
+	spin_unlock(&g_sPagePoolLock);
+
+	return Ret;
+}
+
 
 static struct LinuxMemArea *LinuxMemAreaStructAlloc(void);
 static void LinuxMemAreaStructFree(struct LinuxMemArea *psLinuxMemArea);
@@ -164,6 +300,9 @@ enum PVRSRV_ERROR LinuxMMInit(void)
 		return PVRSRV_ERROR_OUT_OF_MEMORY;
 	}
 
+	register_shrinker(&g_sPagePoolShrinker);
+	CreateProcReadEntry("page_pool", printPagePoolStats);
+
 	return PVRSRV_OK;
 }
 
@@ -261,6 +400,10 @@ void LinuxMMCleanup(void)
 	}
 #endif
 
+	RemoveProcEntry("page_pool");
+	unregister_shrinker(&g_sPagePoolShrinker);
+	PagePoolDrain(g_ui32PagePoolCount);
+
 	if (psLinuxMemAreaCache) {
 		kmem_cache_destroy(psLinuxMemAreaCache);
 		psLinuxMemAreaCache = NULL;
@@ -700,6 +843,8 @@ struct LinuxMemArea *NewAllocPagesLinuxMemArea(u32 ui32Bytes,
 	void *hBlockPageList;
 	s32 i;
 	enum PVRSRV_ERROR eError;
+	ktime_t sStart = ktime_get();
+	u64 ui64Ns;
 
 	psLinuxMemArea = LinuxMemAreaStructAlloc();
 	if (!psLinuxMemArea)
@@ -712,7 +857,7 @@ struct LinuxMemArea *NewAllocPagesLinuxMemArea(u32 ui32Bytes,
 		goto failed_page_list_alloc;
 
 	for (i = 0; i < ui32PageCount; i++) {
-		pvPageList[i] = alloc_pages(GFP_KERNEL | __GFP_HIGHMEM, 0);
+		pvPageList[i] = PagePoolGet();
 		if (!pvPageList[i])
 			goto failed_alloc_pages;
 
@@ -736,11 +881,19 @@ struct LinuxMemArea *NewAllocPagesLinuxMemArea(u32 ui32Bytes,
 	DebugLinuxMemAreaRecordAdd(psLinuxMemArea, ui32AreaFlags);
 #endif
 
+	ui64Ns = ktime_to_ns(ktime_sub(ktime_get(), sStart));
+	spin_lock(&g_sPagePoolLock);
+	g_ui32PageAreaAllocs++;
+	g_ui64PageAreaAllocNs += ui64Ns;
+	if (ui64Ns > g_ui64PageAreaAllocMaxNs)
+		g_ui64PageAreaAllocMaxNs = ui64Ns;
+	spin_unlock(&g_sPagePoolLock);
+
 	return psLinuxMemArea;
 
 failed_alloc_pages:
 	for (i--; i >= 0; i--)
-		__free_pages(pvPageList[i], 0);
+		PagePoolPut(pvPageList[i], IMG_FALSE);
 	OSFreeMem(0, sizeof(*pvPageList) * ui32PageCount, pvPageList,
 			hBlockPageList);
 failed_page_list_alloc:
@@ -756,6 +909,7 @@ void FreeAllocPagesLinuxMemArea(struct LinuxMemArea *psLinuxMemArea)
 	u32 ui32PageCount;
 	struct page **pvPageList;
 	void *hBlockPageList;
+	IMG_BOOL bDirty;
 	u32 i;
 
 	PVR_ASSERT(psLinuxMemArea);
@@ -774,8 +928,10 @@ void FreeAllocPagesLinuxMemArea(struct LinuxMemArea *psLinuxMemArea)
 				  __FILE__, __LINE__);
 #endif
 
+	bDirty = (psLinuxMemArea->ui32AreaFlags & PVRSRV_HAP_CACHED) ?
+			IMG_TRUE : IMG_FALSE;
 	for (i = 0; i < ui32PageCount; i++)
-		__free_pages(pvPageList[i], 0);
+		PagePoolPut(pvPageList[i], bDirty);
 
 	OSFreeMem(0, sizeof(*pvPageList) * ui32PageCount, pvPageList,
 			hBlockPageList);
@@ -35,6 +35,7 @@
 #include <asm/shmparam.h>
 #include <asm/pgtable.h>
 #include <linux/sched.h>
+#include <linux/hash.h>
 #include <asm/current.h>
 #include "img_defs.h"
 #include "services.h"
@@ -55,7 +56,16 @@ static struct mutex g_sMMapMutex;
 
 static struct kmem_cache *g_psMemmapCache;
 static LIST_HEAD(g_sMMapAreaList);
-static LIST_HEAD(g_sMMapOffsetStructList);
+
+/*
+ * Offset structures waiting for their mmap(2) call, hashed by mmap
+ * offset so PVRMMap() doesn't have to walk every pending mapping.
+ */
+#define MMAP_HASH_BITS		8
+static struct hlist_head g_asMMapOffsetHash[1 << MMAP_HASH_BITS];
+static u32 g_ui32MMapLookups;
+static u32 g_ui32MMapLookupSteps;
+static u32 g_ui32MMapLookupMaxChain;
 #if defined(DEBUG_LINUX_MMAP_AREAS)
 static u32 g_ui32RegisteredAreas;
 static u32 g_ui32TotalByteSize;
@@ -105,6 +115,11 @@ static inline IMG_BOOL LinuxMemAreaUsesPhysicalMap(
 	return LinuxMemAreaPhysIsContig(psLinuxMemArea);
 }
 
+static inline struct hlist_head *MMapOffsetBucket(u32 ui32Offset)
+{
+	return &g_asMMapOffsetHash[hash_32(ui32Offset, MMAP_HASH_BITS)];
+}
+
 static inline u32 GetCurrentThreadID(void)
 {
 
@@ -165,7 +180,7 @@ static void DestroyOffsetStruct(struct KV_OFFSET_STRUCT *psOffsetStruct)
 	list_del(&psOffsetStruct->sAreaItem);
 
 	if (psOffsetStruct->bOnMMapList)
-		list_del(&psOffsetStruct->sMMapItem);
+		hlist_del(&psOffsetStruct->sMMapItem);
 
 	PVR_DPF(PVR_DBG_MESSAGE, "%s: Table entry: "
 		 "psLinuxMemArea=0x%08lX, CpuPAddr=0x%08lX", __func__,
@@ -255,7 +270,8 @@ enum PVRSRV_ERROR PVRMMapOSMemHandleToMMapData(
 		goto exit_unlock;
 	}
 
-	list_add_tail(&psOffsetStruct->sMMapItem, &g_sMMapOffsetStructList);
+	hlist_add_head(&psOffsetStruct->sMMapItem,
+		       MMapOffsetBucket(psOffsetStruct->ui32MMapOffset));
 	psOffsetStruct->bOnMMapList = IMG_TRUE;
 	psOffsetStruct->ui32RefCount++;
 	eError = PVRSRV_OK;
@@ -338,20 +354,30 @@ static inline struct KV_OFFSET_STRUCT *FindOffsetStructByOffset(u32 ui32Offset,
 							u32 ui32RealByteSize)
 {
 	struct KV_OFFSET_STRUCT *psOffsetStruct;
+	struct hlist_node *psNode;
 	u32 ui32TID = GetCurrentThreadID();
 	u32 ui32PID = OSGetCurrentProcessIDKM();
+	u32 ui32Steps = 0;
 
-	list_for_each_entry(psOffsetStruct, &g_sMMapOffsetStructList,
-			    sMMapItem) {
+	g_ui32MMapLookups++;
+
+	hlist_for_each_entry(psOffsetStruct, psNode,
+			     MMapOffsetBucket(ui32Offset), sMMapItem) {
+		ui32Steps++;
 		if (ui32Offset == psOffsetStruct->ui32MMapOffset &&
 		    ui32RealByteSize == psOffsetStruct->ui32RealByteSize &&
 		    psOffsetStruct->ui32PID == ui32PID)
 			if (!PFNIsPhysical(ui32Offset) ||
 			    psOffsetStruct->ui32TID == ui32TID)
-				return psOffsetStruct;
+				goto found;
 	}
+	psOffsetStruct = NULL;
+found:
+	g_ui32MMapLookupSteps += ui32Steps;
+	if (ui32Steps > g_ui32MMapLookupMaxChain)
+		g_ui32MMapLookupMaxChain = ui32Steps;
 
-	return NULL;
+	return psOffsetStruct;
 }
 
 static IMG_BOOL DoMapToUser(struct LinuxMemArea *psLinuxMemArea,
@@ -567,7 +593,7 @@ int PVRMMap(struct file *pFile, struct vm_area_struct *ps_vma)
 		iRetVal = -EINVAL;
 		goto unlock_and_return;
 	}
-	list_del(&psOffsetStruct->sMMapItem);
+	hlist_del(&psOffsetStruct->sMMapItem);
 	psOffsetStruct->bOnMMapList = IMG_FALSE;
 
 	PVR_DPF(PVR_DBG_MESSAGE, "%s: Mapped psLinuxMemArea 0x%p\n",
@@ -710,6 +736,41 @@ unlock_and_return:
 }
 #endif
 
+static off_t PrintMMapHashStats(char *buffer, size_t size, off_t off)
+{
+	u32 ui32Pending = 0;
+	u32 ui32Used = 0;
+	off_t Ret;
+	int i;
+
+	if (off)
+		return END_OF_FILE;
+
+	mutex_lock(&g_sMMapMutex);
+
+	for (i = 0; i < ARRAY_SIZE(g_asMMapOffsetHash); i++) {
+		struct hlist_node *psNode;
+		u32 ui32Len = 0;
+
+		hlist_for_each(psNode, &g_asMMapOffsetHash[i])
+			ui32Len++;
+		if (ui32Len)
+			ui32Used++;
+		ui32Pending += ui32Len;
+	}
+
+	Ret = printAppend(buffer, size, 0,
+			  "buckets %u used %u pending %u\n"
+			  "lookups %u chain steps %u max chain %u\n",
+			  ARRAY_SIZE(g_asMMapOffsetHash), ui32Used,
+			  ui32Pending, g_ui32MMapLookups,
+			  g_ui32MMapLookupSteps, g_ui32MMapLookupMaxChain);
+
+	mutex_unlock(&g_sMMapMutex);
+
+	return Ret;
+}
+
 enum PVRSRV_ERROR PVRMMapRegisterArea(struct LinuxMemArea *psLinuxMemArea)
 {
 	enum PVRSRV_ERROR eError = PVRSRV_ERROR_GENERIC;
@@ -819,17 +880,21 @@ enum PVRSRV_ERROR LinuxMMapPerProcessConnect(struct PVRSRV_ENV_PER_PROCESS_DATA
 void LinuxMMapPerProcessDisconnect(struct PVRSRV_ENV_PER_PROCESS_DATA
 				   *psEnvPerProc)
 {
-	struct KV_OFFSET_STRUCT *psOffsetStruct, *psTmpOffsetStruct;
+	struct KV_OFFSET_STRUCT *psOffsetStruct;
+	struct hlist_node *psNode, *psTmpNode;
 	IMG_BOOL bWarn = IMG_FALSE;
 	u32 ui32PID = OSGetCurrentProcessIDKM();
+	int i;
 
 	PVR_UNREFERENCED_PARAMETER(psEnvPerProc);
 
 	mutex_lock(&g_sMMapMutex);
 
-	list_for_each_entry_safe(psOffsetStruct, psTmpOffsetStruct,
-				 &g_sMMapOffsetStructList, sMMapItem) {
-		if (psOffsetStruct->ui32PID == ui32PID) {
+	for (i = 0; i < ARRAY_SIZE(g_asMMapOffsetHash); i++)
+		hlist_for_each_entry_safe(psOffsetStruct, psNode, psTmpNode,
+					  &g_asMMapOffsetHash[i], sMMapItem) {
+			if (psOffsetStruct->ui32PID != ui32PID)
+				continue;
 			if (!bWarn) {
 				PVR_DPF(PVR_DBG_WARNING, "%s: process has "
 						"unmapped offset structures. "
@@ -842,7 +907,6 @@ void LinuxMMapPerProcessDisconnect(struct PVRSRV_ENV_PER_PROCESS_DATA
 
 			DestroyOffsetStruct(psOffsetStruct);
 		}
-	}
 
 	mutex_unlock(&g_sMMapMutex);
 }
@@ -877,6 +941,7 @@ void PVRMMapInit(void)
 #if defined(DEBUG_LINUX_MMAP_AREAS)
 	CreateProcReadEntry("mmap", PrintMMapRegistrations);
 #endif
+	CreateProcReadEntry("mmap_hash", PrintMMapHashStats);
 
 	return;
 
@@ -912,6 +977,7 @@ void PVRMMapCleanup(void)
 	PVR_ASSERT(list_empty((&g_sMMapAreaList)));
 
 	RemoveProcEntry("mmap");
+	RemoveProcEntry("mmap_hash");
 
 	if (g_psMemmapCache) {
 		kmem_cache_destroy(g_psMemmapCache);
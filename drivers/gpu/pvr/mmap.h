@@ -46,7 +46,7 @@ struct KV_OFFSET_STRUCT {
 #if defined(DEBUG_LINUX_MMAP_AREAS)
 	const char *pszName;
 #endif
-	struct list_head sMMapItem;
+	struct hlist_node sMMapItem;
 	struct list_head sAreaItem;
 };
 
@@ -315,14 +315,6 @@ enum PVRSRV_ERROR OSInitEnvData(void **ppvEnvSpecificData)
 
 	memset(psEnvData, 0, sizeof(*psEnvData));
 
-	if (OSAllocMem(PVRSRV_OS_PAGEABLE_HEAP,
-	     PVRSRV_MAX_BRIDGE_IN_SIZE + PVRSRV_MAX_BRIDGE_OUT_SIZE,
-	     &psEnvData->pvBridgeData, NULL) != PVRSRV_OK) {
-		OSFreeMem(PVRSRV_OS_PAGEABLE_HEAP, sizeof(struct ENV_DATA),
-			  psEnvData, NULL);
-		return PVRSRV_ERROR_GENERIC;
-	}
-
 	psEnvData->bMISRInstalled = IMG_FALSE;
 	psEnvData->bLISRInstalled = IMG_FALSE;
 
@@ -338,10 +330,6 @@ enum PVRSRV_ERROR OSDeInitEnvData(void *pvEnvSpecificData)
 	PVR_ASSERT(!psEnvData->bMISRInstalled);
 	PVR_ASSERT(!psEnvData->bLISRInstalled);
 
-	OSFreeMem(PVRSRV_OS_PAGEABLE_HEAP,
-		  PVRSRV_MAX_BRIDGE_IN_SIZE + PVRSRV_MAX_BRIDGE_OUT_SIZE,
-		  psEnvData->pvBridgeData, NULL);
-
 	OSFreeMem(PVRSRV_OS_PAGEABLE_HEAP, sizeof(struct ENV_DATA),
 		  pvEnvSpecificData, NULL);
 
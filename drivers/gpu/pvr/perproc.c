@@ -29,6 +29,7 @@
 #include "handle.h"
 #include "perproc.h"
 #include "osperproc.h"
+#include "env_data.h"
 
 #define	HASH_TAB_INIT_SIZE 32
 
@@ -93,6 +94,12 @@ static enum PVRSRV_ERROR FreePerProcessData(
 		return eError;
 	}
 
+	if (psPerProc->pvBridgeData != NULL)
+		OSFreeMem(PVRSRV_OS_PAGEABLE_HEAP,
+			  PVRSRV_MAX_BRIDGE_IN_SIZE +
+			  PVRSRV_MAX_BRIDGE_OUT_SIZE,
+			  psPerProc->pvBridgeData, NULL);
+
 	OSFreeMem(PVRSRV_OS_NON_PAGEABLE_HEAP, sizeof(*psPerProc), psPerProc,
 		  psPerProc->hBlockAlloc);
 
@@ -133,6 +140,7 @@ enum PVRSRV_ERROR PVRSRVPerProcessDataConnect(u32 ui32PID)
 		}
 		OSMemSet(psPerProc, 0, sizeof(*psPerProc));
 		psPerProc->hBlockAlloc = hBlockAlloc;
+		mutex_init(&psPerProc->lock);
 
 		get_proc_name(ui32PID, psPerProc->name,
 			      sizeof(psPerProc->name));
@@ -184,6 +192,17 @@ enum PVRSRV_ERROR PVRSRVPerProcessDataConnect(u32 ui32PID)
 			goto failure;
 		}
 
+		eError = OSAllocMem(PVRSRV_OS_PAGEABLE_HEAP,
+				    PVRSRV_MAX_BRIDGE_IN_SIZE +
+				    PVRSRV_MAX_BRIDGE_OUT_SIZE,
+				    &psPerProc->pvBridgeData, NULL);
+		if (eError != PVRSRV_OK) {
+			PVR_DPF(PVR_DBG_ERROR, "PVRSRVPerProcessDataConnect: "
+				"Couldn't allocate bridge buffer (%d)",
+				 eError);
+			goto failure;
+		}
+
 		eError =
 		    PVRSRVResManConnect(psPerProc, &psPerProc->hResManContext);
 		if (eError != PVRSRV_OK) {
@@ -28,6 +28,7 @@
 #define __PERPROC_H__
 
 #include <linux/sched.h>
+#include <linux/mutex.h>
 
 #include "img_types.h"
 #include "resman.h"
@@ -48,6 +49,15 @@ struct PVRSRV_PER_PROCESS_DATA {
 	IMG_BOOL bInitProcess;
 
 	void *hOsPrivateData;
+
+	/*
+	 * Serialises the bridge calls of this process and guards its
+	 * handle base and bridge buffer. Nests inside pvr_lock. Handle base
+	 * changes are made holding both locks, so either one is enough to
+	 * look up a handle.
+	 */
+	struct mutex lock;
+	void *pvBridgeData;
 };
 
 struct PVRSRV_PER_PROCESS_DATA *PVRSRVPerProcessData(u32 ui32PID);
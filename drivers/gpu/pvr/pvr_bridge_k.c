@@ -40,7 +40,11 @@
 
 #include "bridged_pvr_bridge.h"
 
-/* Global driver lock protecting all HW and SW state tracking objects. */
+/*
+ * Global driver lock protecting all HW and SW state tracking objects.
+ * Bridge calls that only need the caller's own state take the per-process
+ * lock instead, see bridged_lock_type().
+ */
 DEFINE_MUTEX(gPVRSRVLock);
 static int pvr_dev_locked;
 static DECLARE_WAIT_QUEUE_HEAD(pvr_dev_wq);
@@ -174,14 +178,11 @@ long PVRSRV_BridgeDispatchKM(struct file *filp, unsigned int cmd,
 	u32 ui32PID = OSGetCurrentProcessIDKM();
 	struct PVRSRV_FILE_PRIVATE_DATA *priv;
 	struct PVRSRV_PER_PROCESS_DATA *psPerProc;
+	enum pvr_bridge_lock lock_type;
 	int err = -EFAULT;
 
-	pvr_lock();
-
-	if (pvr_is_disabled()) {
-		pvr_unlock();
+	if (pvr_is_disabled())
 		return -ENODEV;
-	}
 
 	if (!OSAccessOK(PVR_VERIFY_WRITE, psBridgePackageUM,
 			sizeof(struct PVRSRV_BRIDGE_PACKAGE))) {
@@ -189,12 +190,12 @@ long PVRSRV_BridgeDispatchKM(struct file *filp, unsigned int cmd,
 			 "%s: Received invalid pointer to function arguments",
 			 __func__);
 
-		goto unlock_and_return;
+		return err;
 	}
 
 	if (OSCopyFromUser(NULL, &sBridgePackageKM, psBridgePackageUM,
 			   sizeof(struct PVRSRV_BRIDGE_PACKAGE)) != PVRSRV_OK)
-		goto unlock_and_return;
+		return err;
 
 	priv = filp->private_data;
 	psPerProc = priv->proc;
@@ -207,19 +208,30 @@ long PVRSRV_BridgeDispatchKM(struct file *filp, unsigned int cmd,
 				 "%s: Process %d tried to access data "
 				 "belonging to process %d", __func__,
 				 ui32PID, psPerProc->ui32PID);
-			goto unlock_and_return;
+			return err;
 		}
 	}
 
 	sBridgePackageKM.ui32BridgeID = PVRSRV_GET_BRIDGE_ID(
 						sBridgePackageKM.ui32BridgeID);
 
-	err = BridgedDispatchKM(filp, psPerProc, &sBridgePackageKM);
-	if (err != PVRSRV_OK)
+	lock_type = bridged_lock_type(sBridgePackageKM.ui32BridgeID);
+	if (lock_type == PVR_BRIDGE_LOCK_GLOBAL)
+		pvr_lock();
+	mutex_lock(&psPerProc->lock);
+
+	/* Recheck, recovery may have failed while we were waiting. */
+	if (pvr_is_disabled()) {
+		err = -ENODEV;
 		goto unlock_and_return;
+	}
+
+	err = BridgedDispatchKM(filp, psPerProc, &sBridgePackageKM);
 
 unlock_and_return:
-	pvr_unlock();
+	mutex_unlock(&psPerProc->lock);
+	if (lock_type == PVR_BRIDGE_LOCK_GLOBAL)
+		pvr_unlock();
 
 	return err;
 }
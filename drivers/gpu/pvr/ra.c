@@ -31,6 +31,8 @@
 #include "osfunc.h"
 
 #include <linux/kernel.h>
+#include <linux/rbtree.h>
+#include <asm/div64.h>
 #include "proc.h"
 
 
@@ -49,8 +51,7 @@ struct BT {
 	struct BT *pNextSegment;
 	struct BT *pPrevSegment;
 
-	struct BT *pNextFree;
-	struct BT *pPrevFree;
+	struct rb_node sFreeNode;
 
 	struct BM_MAPPING *psMapping;
 };
@@ -65,8 +66,7 @@ struct RA_ARENA {
 	void (*pImportFree)(void *, u32, struct BM_MAPPING *psMapping);
 	void (*pBackingStoreFree)(void *, u32, u32, void *);
 	void *pImportHandle;
-#define FREE_TABLE_LIMIT	32
-	struct BT *aHeadFree[FREE_TABLE_LIMIT];
+	struct rb_root sFreeTree;
 	struct BT *pHeadSegment;
 	struct BT *pTailSegment;
 	struct HASH_TABLE *pSegmentHash;
@@ -115,17 +115,6 @@ static IMG_BOOL _RequestAllocFail(void *_h, size_t _uSize, size_t *_pActualSize,
 	return IMG_FALSE;
 }
 
-static u32 pvr_log2(size_t n)
-{
-	u32 l = 0;
-	n >>= 1;
-	while (n > 0) {
-		n >>= 1;
-		l++;
-	}
-	return l;
-}
-
 static enum PVRSRV_ERROR _SegmentListInsertAfter(struct RA_ARENA *pArena,
 						 struct BT *pInsertionPoint,
 						 struct BT *pBT)
@@ -227,28 +216,65 @@ static struct BT *_SegmentSplit(struct RA_ARENA *pArena, struct BT *pBT,
 	return pNeighbour;
 }
 
+/*
+ * Free segments are kept in an rbtree ordered by (size, base), so the
+ * leftmost node not smaller than a request is its best fit and ties go
+ * to the lowest address.
+ */
+static inline int _FreeTreeLess(const struct BT *a, const struct BT *b)
+{
+	if (a->uSize != b->uSize)
+		return a->uSize < b->uSize;
+	return a->base < b->base;
+}
+
 static void _FreeListInsert(struct RA_ARENA *pArena, struct BT *pBT)
 {
-	u32 uIndex;
-	uIndex = pvr_log2(pBT->uSize);
+	struct rb_node **ppLink = &pArena->sFreeTree.rb_node;
+	struct rb_node *pParent = NULL;
+
 	pBT->type = btt_free;
-	pBT->pNextFree = pArena->aHeadFree[uIndex];
-	pBT->pPrevFree = NULL;
-	if (pArena->aHeadFree[uIndex] != NULL)
-		pArena->aHeadFree[uIndex]->pPrevFree = pBT;
-	pArena->aHeadFree[uIndex] = pBT;
+	while (*ppLink) {
+		struct BT *pCur = rb_entry(*ppLink, struct BT, sFreeNode);
+
+		pParent = *ppLink;
+		if (_FreeTreeLess(pBT, pCur))
+			ppLink = &pParent->rb_left;
+		else
+			ppLink = &pParent->rb_right;
+	}
+	rb_link_node(&pBT->sFreeNode, pParent, ppLink);
+	rb_insert_color(&pBT->sFreeNode, &pArena->sFreeTree);
 }
 
 static void _FreeListRemove(struct RA_ARENA *pArena, struct BT *pBT)
 {
-	u32 uIndex;
-	uIndex = pvr_log2(pBT->uSize);
-	if (pBT->pNextFree != NULL)
-		pBT->pNextFree->pPrevFree = pBT->pPrevFree;
-	if (pBT->pPrevFree == NULL)
-		pArena->aHeadFree[uIndex] = pBT->pNextFree;
-	else
-		pBT->pPrevFree->pNextFree = pBT->pNextFree;
+	rb_erase(&pBT->sFreeNode, &pArena->sFreeTree);
+}
+
+static inline struct BT *_FreeTreeNext(struct BT *pBT)
+{
+	struct rb_node *pNext = rb_next(&pBT->sFreeNode);
+
+	return pNext ? rb_entry(pNext, struct BT, sFreeNode) : NULL;
+}
+
+static struct BT *_FreeTreeFirstFit(struct RA_ARENA *pArena, size_t uSize)
+{
+	struct rb_node *pNode = pArena->sFreeTree.rb_node;
+	struct BT *pBest = NULL;
+
+	while (pNode) {
+		struct BT *pCur = rb_entry(pNode, struct BT, sFreeNode);
+
+		if (pCur->uSize >= uSize) {
+			pBest = pCur;
+			pNode = pNode->rb_left;
+		} else {
+			pNode = pNode->rb_right;
+		}
+	}
+	return pBest;
 }
 
 static struct BT *_BuildSpanMarker(u32 base, size_t uSize)
@@ -538,7 +564,8 @@ static IMG_BOOL _AttemptAllocAligned(struct RA_ARENA *pArena, size_t uSize,
 		     struct BM_MAPPING **ppsMapping, u32 uFlags, u32 uAlignment,
 		     u32 *base)
 {
-	u32 uIndex;
+	struct BT *pBT;
+
 	PVR_ASSERT(pArena != NULL);
 	if (pArena == NULL) {
 		PVR_DPF(PVR_DBG_ERROR,
@@ -546,49 +573,44 @@ static IMG_BOOL _AttemptAllocAligned(struct RA_ARENA *pArena, size_t uSize,
 		return IMG_FALSE;
 	}
 
-	uIndex = pvr_log2(uSize);
-
-	while (uIndex < FREE_TABLE_LIMIT && pArena->aHeadFree[uIndex] == NULL)
-		uIndex++;
+	/*
+	 * Walk the free tree in ascending size from the smallest segment
+	 * that could hold the request. Only alignment padding or a flags
+	 * mismatch makes us move past the first candidate.
+	 */
+	for (pBT = _FreeTreeFirstFit(pArena, uSize); pBT != NULL;
+	     pBT = _FreeTreeNext(pBT)) {
+		u32 aligned_base;
 
-	for (; uIndex < FREE_TABLE_LIMIT; uIndex++) {
-		struct BT *pBT;
+#ifdef RA_STATS
+		pArena->sStatistics.uSearchSteps++;
+#endif
+		if (uAlignment > 1)
+			aligned_base = (pBT->base + uAlignment - 1) /
+					uAlignment * uAlignment;
+		else
+			aligned_base = pBT->base;
+		PVR_DPF(PVR_DBG_MESSAGE,
+		   "RA_AttemptAllocAligned: pBT-base=0x%x "
+		   "pBT-size=0x%x alignedbase=0x%x size=0x%x",
+		   pBT->base, pBT->uSize, aligned_base, uSize);
 
-		pBT = pArena->aHeadFree[uIndex];
-		if (!pBT)
+		if (pBT->base + pBT->uSize < aligned_base + uSize)
 			continue;
 
-		for (; pBT != NULL; pBT = pBT->pNextFree) {
-			u32 aligned_base;
-
-			if (uAlignment > 1)
-				aligned_base = (pBT->base + uAlignment -
-					  1) / uAlignment * uAlignment;
-			else
-				aligned_base = pBT->base;
+		if (pBT->psMapping && pBT->psMapping->ui32Flags != uFlags) {
 			PVR_DPF(PVR_DBG_MESSAGE,
-			   "RA_AttemptAllocAligned: pBT-base=0x%x "
-			   "pBT-size=0x%x alignedbase=0x%x size=0x%x",
-			   pBT->base, pBT->uSize, aligned_base, uSize);
-
-			if (pBT->base + pBT->uSize < aligned_base + uSize)
-				continue;
-
-			if (pBT->psMapping && pBT->psMapping->ui32Flags !=
-			    uFlags) {
-				PVR_DPF(PVR_DBG_MESSAGE,
-					"AttemptAllocAligned: mismatch in "
-					"flags. Import has %x, request was %x",
-					 pBT->psMapping->ui32Flags, uFlags);
-				continue;
-			}
+				"AttemptAllocAligned: mismatch in "
+				"flags. Import has %x, request was %x",
+				 pBT->psMapping->ui32Flags, uFlags);
+			continue;
+		}
 
-			if (alloc_from_bt(pArena, pBT, aligned_base, uSize,
-					  uFlags, ppsMapping, base) < 0)
-				return IMG_FALSE;
+		if (alloc_from_bt(pArena, pBT, aligned_base, uSize,
+				  uFlags, ppsMapping, base) < 0)
+			return IMG_FALSE;
 
-			return IMG_TRUE;
-		}
+		return IMG_TRUE;
 	}
 
 	return IMG_FALSE;
@@ -606,7 +628,6 @@ struct RA_ARENA *RA_Create(char *name, u32 base, size_t uSize,
 {
 	struct RA_ARENA *pArena;
 	struct BT *pBT;
-	int i;
 
 	PVR_DPF(PVR_DBG_MESSAGE, "RA_Create: "
 		 "name='%s', base=0x%x, uSize=0x%x, alloc=0x%x, free=0x%x",
@@ -623,8 +644,7 @@ struct RA_ARENA *RA_Create(char *name, u32 base, size_t uSize,
 	pArena->pImportFree = imp_free;
 	pArena->pBackingStoreFree = backingstore_free;
 	pArena->pImportHandle = pImportHandle;
-	for (i = 0; i < FREE_TABLE_LIMIT; i++)
-		pArena->aHeadFree[i] = NULL;
+	pArena->sFreeTree = RB_ROOT;
 	pArena->pHeadSegment = NULL;
 	pArena->pTailSegment = NULL;
 	pArena->uQuantum = uQuantum;
@@ -639,6 +659,8 @@ struct RA_ARENA *RA_Create(char *name, u32 base, size_t uSize,
 	pArena->sStatistics.uCumulativeFrees = 0;
 	pArena->sStatistics.uImportCount = 0;
 	pArena->sStatistics.uExportCount = 0;
+	pArena->sStatistics.uSearchSteps = 0;
+	pArena->sStatistics.uFailedAllocs = 0;
 #endif
 
 #if defined(CONFIG_PROC_FS) && defined(CONFIG_PVR_DEBUG_EXTRA)
@@ -710,8 +732,6 @@ arena_fail:
 
 void RA_Delete(struct RA_ARENA *pArena)
 {
-	u32 uIndex;
-
 	PVR_ASSERT(pArena != NULL);
 
 	if (pArena == NULL) {
@@ -722,8 +742,7 @@ void RA_Delete(struct RA_ARENA *pArena)
 
 	PVR_DPF(PVR_DBG_MESSAGE, "RA_Delete: name='%s'", pArena->name);
 
-	for (uIndex = 0; uIndex < FREE_TABLE_LIMIT; uIndex++)
-		pArena->aHeadFree[uIndex] = NULL;
+	pArena->sFreeTree = RB_ROOT;
 
 	while (pArena->pHeadSegment != NULL) {
 		struct BT *pBT = pArena->pHeadSegment;
@@ -854,6 +873,8 @@ IMG_BOOL RA_Alloc(struct RA_ARENA *pArena, size_t uRequestSize,
 #ifdef RA_STATS
 	if (bResult)
 		pArena->sStatistics.uCumulativeAllocs++;
+	else
+		pArena->sStatistics.uFailedAllocs++;
 #endif
 
 	PVR_DPF(PVR_DBG_MESSAGE,
@@ -922,6 +943,33 @@ IMG_BOOL RA_GetNextLiveSegment(void *hArena,
 	return IMG_FALSE;
 }
 
+#ifdef RA_STATS
+static size_t _LargestFree(struct RA_ARENA *pArena)
+{
+	struct rb_node *pNode = rb_last(&pArena->sFreeTree);
+
+	return pNode ? rb_entry(pNode, struct BT, sFreeNode)->uSize : 0;
+}
+
+/*
+ * External fragmentation: the share of free space that is not usable
+ * by a single allocation, in percent. 0 means all free space is one
+ * contiguous segment.
+ */
+static u32 _FragmentationPct(struct RA_ARENA *pArena)
+{
+	u32 uFree = pArena->sStatistics.uFreeResourceCount;
+	u64 uLargest;
+
+	if (uFree == 0)
+		return 0;
+	uLargest = (u64)_LargestFree(pArena) * 100;
+	do_div(uLargest, uFree);
+
+	return 100 - (u32)uLargest;
+}
+#endif
+
 #if (defined(CONFIG_PROC_FS) && defined(CONFIG_PVR_DEBUG_EXTRA)) || \
      defined(RA_STATS)
 static char *_BTType(int eType)
@@ -1053,6 +1101,23 @@ static int RA_DumpInfo(char *page, char **start, off_t off, int count, int *eof,
 		len = printAppend(page, count, 0, "export count\t\t%u\n",
 				pArena->sStatistics.uExportCount);
 		break;
+	case 10:
+		len = printAppend(page, count, 0, "failed allocs\t\t%u\n",
+				pArena->sStatistics.uFailedAllocs);
+		break;
+	case 11:
+		len = printAppend(page, count, 0, "search steps\t\t%u\n",
+				pArena->sStatistics.uSearchSteps);
+		break;
+	case 12:
+		len = printAppend(page, count, 0,
+				"largest free segment\t%u (0x%x)\n",
+				_LargestFree(pArena), _LargestFree(pArena));
+		break;
+	case 13:
+		len = printAppend(page, count, 0, "fragmentation\t\t%u%%\n",
+				_FragmentationPct(pArena));
+		break;
 #endif
 
 	default:
@@ -1124,6 +1189,26 @@ enum PVRSRV_ERROR RA_GetStats(struct RA_ARENA *pArena, char **ppszStr,
 		       pArena->sStatistics.uExportCount);
 	UPDATE_SPACE(pszStr, i32Count, ui32StrLen);
 
+	CHECK_SPACE(ui32StrLen);
+	i32Count = OSSNPrintf(pszStr, 100, "failed allocs\t\t%lu\n",
+		       pArena->sStatistics.uFailedAllocs);
+	UPDATE_SPACE(pszStr, i32Count, ui32StrLen);
+
+	CHECK_SPACE(ui32StrLen);
+	i32Count = OSSNPrintf(pszStr, 100, "search steps\t\t%lu\n",
+		       pArena->sStatistics.uSearchSteps);
+	UPDATE_SPACE(pszStr, i32Count, ui32StrLen);
+
+	CHECK_SPACE(ui32StrLen);
+	i32Count = OSSNPrintf(pszStr, 100, "largest free segment\t%u\n",
+		       _LargestFree(pArena));
+	UPDATE_SPACE(pszStr, i32Count, ui32StrLen);
+
+	CHECK_SPACE(ui32StrLen);
+	i32Count = OSSNPrintf(pszStr, 100, "fragmentation\t\t%u%%\n",
+		       _FragmentationPct(pArena));
+	UPDATE_SPACE(pszStr, i32Count, ui32StrLen);
+
 	CHECK_SPACE(ui32StrLen);
 	i32Count = OSSNPrintf(pszStr, 100, "  segment Chain:\n");
 	UPDATE_SPACE(pszStr, i32Count, ui32StrLen);
@@ -46,6 +46,8 @@ struct RA_STATISTICS {
 	u32 uCumulativeFrees;
 	u32 uImportCount;
 	u32 uExportCount;
+	u32 uFailedAllocs;
+	u32 uSearchSteps;
 };
 struct RA_STATISTICS;
 
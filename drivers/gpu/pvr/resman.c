@@ -28,21 +28,27 @@
 #include <linux/sched.h>
 #include <linux/hardirq.h>
 
-#include <linux/semaphore.h>
+#include <linux/mutex.h>
 
 #include "services_headers.h"
 #include "resman.h"
 
-static DECLARE_MUTEX(lock);
+/*
+ * Each context has its own mutex protecting its item list, so processes
+ * registering and freeing resources don't serialise against each other.
+ * ctx_list_lock protects the list of contexts and nests outside the
+ * context locks. Neither is held across pfnFreeResource callbacks.
+ */
+static DEFINE_MUTEX(ctx_list_lock);
 
-#define ACQUIRE_SYNC_OBJ  do {						   \
+#define ACQUIRE_SYNC_OBJ(ctx)  do {					   \
 		if (in_interrupt()) {					   \
 			printk(KERN_ERR "ISR cannot take RESMAN mutex\n"); \
 			BUG();						   \
 	} else								\
-			down(&lock);					   \
+			mutex_lock(&(ctx)->lock);			   \
 } while (0)
-#define RELEASE_SYNC_OBJ up(&lock)
+#define RELEASE_SYNC_OBJ(ctx) mutex_unlock(&(ctx)->lock)
 
 
 #define RESMAN_SIGNATURE 0x12345678
@@ -53,6 +59,7 @@ struct RESMAN_ITEM {
 #endif
 	struct RESMAN_ITEM **ppsThis;
 	struct RESMAN_ITEM *psNext;
+	struct RESMAN_CONTEXT *psContext;
 
 	u32 ui32Flags;
 	u32 ui32ResType;
@@ -71,7 +78,7 @@ struct RESMAN_CONTEXT {
 	struct RESMAN_CONTEXT *psNext;
 	struct PVRSRV_PER_PROCESS_DATA *psPerProc;
 	struct RESMAN_ITEM *psResItemList;
-
+	struct mutex lock;
 };
 
 struct RESMAN_LIST {
@@ -93,9 +100,12 @@ static int FreeResourceByCriteria(struct RESMAN_CONTEXT *psContext,
 
 #ifdef CONFIG_PVR_DEBUG_EXTRA
 static void ValidateResList(struct RESMAN_LIST *psResList);
+static void ValidateResContext(struct RESMAN_CONTEXT *psContext);
 #define VALIDATERESLIST() ValidateResList(gpsResList)
+#define VALIDATERESCTX(ctx) ValidateResContext(ctx)
 #else
 #define VALIDATERESLIST()
+#define VALIDATERESCTX(ctx)
 #endif
 
 enum PVRSRV_ERROR ResManInit(void)
@@ -129,19 +139,11 @@ enum PVRSRV_ERROR PVRSRVResManConnect(void *hPerProc,
 	enum PVRSRV_ERROR eError;
 	struct RESMAN_CONTEXT *psResManContext;
 
-	ACQUIRE_SYNC_OBJ;
-
-	VALIDATERESLIST();
-
 	eError = OSAllocMem(PVRSRV_OS_PAGEABLE_HEAP, sizeof(*psResManContext),
 			    (void **) &psResManContext, NULL);
 	if (eError != PVRSRV_OK) {
 		PVR_DPF(PVR_DBG_ERROR, "PVRSRVResManConnect: "
 				"ERROR allocating new RESMAN context struct");
-
-		VALIDATERESLIST();
-		RELEASE_SYNC_OBJ;
-
 		return eError;
 	}
 #ifdef CONFIG_PVR_DEBUG
@@ -149,6 +151,11 @@ enum PVRSRV_ERROR PVRSRVResManConnect(void *hPerProc,
 #endif
 	psResManContext->psResItemList = NULL;
 	psResManContext->psPerProc = hPerProc;
+	mutex_init(&psResManContext->lock);
+
+	mutex_lock(&ctx_list_lock);
+
+	VALIDATERESLIST();
 
 	psResManContext->psNext = gpsResList->psContextList;
 	psResManContext->ppsThis = &gpsResList->psContextList;
@@ -158,7 +165,7 @@ enum PVRSRV_ERROR PVRSRVResManConnect(void *hPerProc,
 
 	VALIDATERESLIST();
 
-	RELEASE_SYNC_OBJ;
+	mutex_unlock(&ctx_list_lock);
 
 	*phResManContext = psResManContext;
 
@@ -187,9 +194,9 @@ static int free_one_res(struct RESMAN_CONTEXT *ctx, u32 restype)
 void PVRSRVResManDisconnect(struct RESMAN_CONTEXT *ctx, IMG_BOOL bKernelContext)
 {
 
-	ACQUIRE_SYNC_OBJ;
+	ACQUIRE_SYNC_OBJ(ctx);
 
-	VALIDATERESLIST();
+	VALIDATERESCTX(ctx);
 
 	PRINT_RESLIST(gpsResList, ctx, IMG_TRUE);
 
@@ -222,18 +229,22 @@ void PVRSRVResManDisconnect(struct RESMAN_CONTEXT *ctx, IMG_BOOL bKernelContext)
 
 	PVR_ASSERT(ctx->psResItemList == NULL);
 
+	RELEASE_SYNC_OBJ(ctx);
+
+	mutex_lock(&ctx_list_lock);
+
 	*(ctx->ppsThis) = ctx->psNext;
 	if (ctx->psNext)
 		ctx->psNext->ppsThis = ctx->ppsThis;
 
-	OSFreeMem(PVRSRV_OS_PAGEABLE_HEAP, sizeof(struct RESMAN_CONTEXT),
-		  ctx, NULL);
-
 	VALIDATERESLIST();
 
+	mutex_unlock(&ctx_list_lock);
+
 	PRINT_RESLIST(gpsResList, ctx, IMG_FALSE);
 
-	RELEASE_SYNC_OBJ;
+	OSFreeMem(PVRSRV_OS_PAGEABLE_HEAP, sizeof(struct RESMAN_CONTEXT),
+		  ctx, NULL);
 }
 
 struct RESMAN_ITEM *ResManRegisterRes(struct RESMAN_CONTEXT *psResManContext,
@@ -253,9 +264,9 @@ struct RESMAN_ITEM *ResManRegisterRes(struct RESMAN_CONTEXT *psResManContext,
 		return (struct RESMAN_ITEM *)NULL;
 	}
 
-	ACQUIRE_SYNC_OBJ;
+	ACQUIRE_SYNC_OBJ(psResManContext);
 
-	VALIDATERESLIST();
+	VALIDATERESCTX(psResManContext);
 
 	PVR_DPF(PVR_DBG_MESSAGE, "ResManRegisterRes: register resource "
 		 "Context 0x%x, ResType 0x%x, pvParam 0x%x, ui32Param 0x%x, "
@@ -269,7 +280,7 @@ struct RESMAN_ITEM *ResManRegisterRes(struct RESMAN_CONTEXT *psResManContext,
 		PVR_DPF(PVR_DBG_ERROR, "ResManRegisterRes: "
 			 "ERROR allocating new resource item");
 
-		RELEASE_SYNC_OBJ;
+		RELEASE_SYNC_OBJ(psResManContext);
 
 		return (struct RESMAN_ITEM *)NULL;
 	}
@@ -282,6 +293,7 @@ struct RESMAN_ITEM *ResManRegisterRes(struct RESMAN_CONTEXT *psResManContext,
 	psNewResItem->ui32Param = ui32Param;
 	psNewResItem->pfnFreeResource = pfnFreeResource;
 	psNewResItem->ui32Flags = 0;
+	psNewResItem->psContext = psResManContext;
 
 	psNewResItem->ppsThis = &psResManContext->psResItemList;
 	psNewResItem->psNext = psResManContext->psResItemList;
@@ -289,29 +301,49 @@ struct RESMAN_ITEM *ResManRegisterRes(struct RESMAN_CONTEXT *psResManContext,
 	if (psNewResItem->psNext)
 		psNewResItem->psNext->ppsThis = &psNewResItem->psNext;
 
-	VALIDATERESLIST();
+	VALIDATERESCTX(psResManContext);
 
-	RELEASE_SYNC_OBJ;
+	RELEASE_SYNC_OBJ(psResManContext);
 
 	return psNewResItem;
 }
 
+/*
+ * An item's context can change under ResManDissociateRes() until that
+ * context's lock is held, so lock whatever the item points at and retry
+ * if the item was moved in the meantime.
+ */
+static struct RESMAN_CONTEXT *lock_item_context(struct RESMAN_ITEM *psResItem)
+{
+	struct RESMAN_CONTEXT *ctx;
+
+	for (;;) {
+		ctx = ACCESS_ONCE(psResItem->psContext);
+		ACQUIRE_SYNC_OBJ(ctx);
+		if (likely(psResItem->psContext == ctx))
+			return ctx;
+		RELEASE_SYNC_OBJ(ctx);
+	}
+}
+
 void ResManFreeResByPtr(struct RESMAN_ITEM *psResItem)
 {
+	struct RESMAN_CONTEXT *ctx;
+
 	BUG_ON(!psResItem);
 
 	PVR_DPF(PVR_DBG_MESSAGE,
 		 "ResManFreeResByPtr: freeing resource at %08X", psResItem);
 
-	ACQUIRE_SYNC_OBJ;
+	ctx = lock_item_context(psResItem);
 
-	VALIDATERESLIST();
+	VALIDATERESCTX(ctx);
 
 	FreeResourceByPtr(psResItem, IMG_TRUE);
 
-	VALIDATERESLIST();
+	VALIDATERESCTX(ctx);
 
-	RELEASE_SYNC_OBJ;
+	RELEASE_SYNC_OBJ(ctx);
 }
 
 void ResManFreeResByCriteria(struct RESMAN_CONTEXT *psResManContext,
@@ -320,9 +352,9 @@ void ResManFreeResByCriteria(struct RESMAN_CONTEXT *psResManContext,
 {
 	PVR_ASSERT(psResManContext != NULL);
 
-	ACQUIRE_SYNC_OBJ;
+	ACQUIRE_SYNC_OBJ(psResManContext);
 
-	VALIDATERESLIST();
+	VALIDATERESCTX(psResManContext);
 
 	PVR_DPF(PVR_DBG_MESSAGE, "ResManFreeResByCriteria: "
 		"Context 0x%x, Criteria 0x%x, Type 0x%x, Addr 0x%x, Param 0x%x",
@@ -333,9 +365,24 @@ void ResManFreeResByCriteria(struct RESMAN_CONTEXT *psResManContext,
 					ui32ResType, pvParam, ui32Param,
 					IMG_TRUE);
 
-	VALIDATERESLIST();
+	VALIDATERESCTX(psResManContext);
+
+	RELEASE_SYNC_OBJ(psResManContext);
+}
+
+/*
+ * Moving an item between contexts needs both item lists. Take the locks
+ * in address order so two concurrent moves in opposite directions can't
+ * deadlock.
+ */
+static void lock_two_contexts(struct RESMAN_CONTEXT *a,
+			      struct RESMAN_CONTEXT *b)
+{
+	if (a > b)
+		swap(a, b);
 
-	RELEASE_SYNC_OBJ;
+	ACQUIRE_SYNC_OBJ(a);
+	mutex_lock_nested(&b->lock, SINGLE_DEPTH_NESTING);
 }
 
 enum PVRSRV_ERROR ResManDissociateRes(struct RESMAN_ITEM *psResItem,
@@ -354,17 +401,38 @@ enum PVRSRV_ERROR ResManDissociateRes(struct RESMAN_ITEM *psResItem,
 #endif
 
 	if (psNewResManContext != NULL) {
+		struct RESMAN_CONTEXT *psOldResManContext;
+
+retry:
+		psOldResManContext = ACCESS_ONCE(psResItem->psContext);
+		if (psOldResManContext == psNewResManContext)
+			return PVRSRV_OK;
+
+		lock_two_contexts(psOldResManContext, psNewResManContext);
+		if (unlikely(psResItem->psContext != psOldResManContext)) {
+			RELEASE_SYNC_OBJ(psNewResManContext);
+			RELEASE_SYNC_OBJ(psOldResManContext);
+			goto retry;
+		}
+
 		if (psResItem->psNext)
 			psResItem->psNext->ppsThis = psResItem->ppsThis;
 		*psResItem->ppsThis = psResItem->psNext;
 
+		psResItem->psContext = psNewResManContext;
 		psResItem->ppsThis = &psNewResManContext->psResItemList;
 		psResItem->psNext = psNewResManContext->psResItemList;
 		psNewResManContext->psResItemList = psResItem;
 		if (psResItem->psNext)
 			psResItem->psNext->ppsThis = &psResItem->psNext;
+
+		RELEASE_SYNC_OBJ(psNewResManContext);
+		RELEASE_SYNC_OBJ(psOldResManContext);
 	} else {
+		struct RESMAN_CONTEXT *ctx = lock_item_context(psResItem);
+
 		FreeResourceByPtr(psResItem, IMG_FALSE);
+		RELEASE_SYNC_OBJ(ctx);
 	}
 
 	return PVRSRV_OK;
@@ -389,7 +457,7 @@ enum PVRSRV_ERROR ResManFindResourceByPtr(
 	PVR_ASSERT(psItem->ui32Signature == RESMAN_SIGNATURE);
 #endif
 
-	ACQUIRE_SYNC_OBJ;
+	ACQUIRE_SYNC_OBJ(psResManContext);
 
 	PVR_DPF(PVR_DBG_MESSAGE,
 		 "FindResourceByPtr: psItem=%08X, psItem->psNext=%08X",
@@ -409,19 +477,22 @@ enum PVRSRV_ERROR ResManFindResourceByPtr(
 		if (psCurItem != psItem) {
 			psCurItem = psCurItem->psNext;
 		} else {
-			RELEASE_SYNC_OBJ;
+			RELEASE_SYNC_OBJ(psResManContext);
 			return PVRSRV_OK;
 		}
 	}
 
-	RELEASE_SYNC_OBJ;
+	RELEASE_SYNC_OBJ(psResManContext);
 
 	return PVRSRV_ERROR_NOT_OWNER;
 }
 
+/* Called and returns with the item's context lock held. */
 static void FreeResourceByPtr(struct RESMAN_ITEM *psItem,
 				      IMG_BOOL bExecuteCallback)
 {
+	struct RESMAN_CONTEXT *ctx = psItem->psContext;
+
 	PVR_ASSERT(psItem->ui32Signature == RESMAN_SIGNATURE);
 
 	PVR_DPF(PVR_DBG_MESSAGE,
@@ -439,7 +510,7 @@ static void FreeResourceByPtr(struct RESMAN_ITEM *psItem,
 		psItem->psNext->ppsThis = psItem->ppsThis;
 	*psItem->ppsThis = psItem->psNext;
 
-	RELEASE_SYNC_OBJ;
+	RELEASE_SYNC_OBJ(ctx);
 
 	if (bExecuteCallback &&
 	    psItem->pfnFreeResource(psItem->pvParam, psItem->ui32Param) !=
@@ -447,7 +518,7 @@ static void FreeResourceByPtr(struct RESMAN_ITEM *psItem,
 		PVR_DPF(PVR_DBG_ERROR, "FreeResourceByPtr: "
 					"ERROR calling FreeResource function");
 
-	ACQUIRE_SYNC_OBJ;
+	ACQUIRE_SYNC_OBJ(ctx);
 
 	OSFreeMem(PVRSRV_OS_PAGEABLE_HEAP, sizeof(struct RESMAN_ITEM), psItem,
 		  NULL);
@@ -480,15 +551,20 @@ struct RESMAN_CONTEXT *pvr_get_resman_ctx(void *resource)
 {
 	struct RESMAN_CONTEXT *ctx;
 
+	mutex_lock(&ctx_list_lock);
 	for (ctx = gpsResList->psContextList; ctx; ctx = ctx->psNext) {
 		struct RESMAN_ITEM *item;
 
+		ACQUIRE_SYNC_OBJ(ctx);
 		item = find_res_by_crit(ctx, RESMAN_CRITERIA_PVOID_PARAM,
 					0, resource, 0);
+		RELEASE_SYNC_OBJ(ctx);
 		if (item)
-			return ctx;
+			break;
 	}
-	return NULL;
+	mutex_unlock(&ctx_list_lock);
+
+	return ctx;
 }
 
 struct PVRSRV_PER_PROCESS_DATA *pvr_get_proc_by_ctx(struct RESMAN_CONTEXT *ctx)
@@ -520,7 +596,6 @@ static int FreeResourceByCriteria(struct RESMAN_CONTEXT *psResManContext,
 #ifdef CONFIG_PVR_DEBUG_EXTRA
 static void ValidateResList(struct RESMAN_LIST *psResList)
 {
-	struct RESMAN_ITEM *psCurItem, **ppsThisItem;
 	struct RESMAN_CONTEXT *psCurContext, **ppsThisContext;
 
 	if (psResList == NULL) {
@@ -542,27 +617,32 @@ static void ValidateResList(struct RESMAN_LIST *psResList)
 			PVR_ASSERT(psCurContext->ppsThis == ppsThisContext);
 		}
 
-		psCurItem = psCurContext->psResItemList;
-		ppsThisItem = &psCurContext->psResItemList;
-		while (psCurItem != NULL) {
-			PVR_ASSERT(psCurItem->ui32Signature ==
-				   RESMAN_SIGNATURE);
-			if (psCurItem->ppsThis != ppsThisItem) {
-				PVR_DPF(PVR_DBG_WARNING, "psCurItem=%08X "
-					"psCurItem->ppsThis=%08X "
-					"psCurItem->psNext=%08X "
-					"ppsThisItem=%08X",
-					 psCurItem, psCurItem->ppsThis,
-					 psCurItem->psNext, ppsThisItem);
-				PVR_ASSERT(psCurItem->ppsThis == ppsThisItem);
-			}
-
-			ppsThisItem = &psCurItem->psNext;
-			psCurItem = psCurItem->psNext;
-		}
-
 		ppsThisContext = &psCurContext->psNext;
 		psCurContext = psCurContext->psNext;
 	}
 }
+
+static void ValidateResContext(struct RESMAN_CONTEXT *psContext)
+{
+	struct RESMAN_ITEM *psCurItem, **ppsThisItem;
+
+	psCurItem = psContext->psResItemList;
+	ppsThisItem = &psContext->psResItemList;
+	while (psCurItem != NULL) {
+		PVR_ASSERT(psCurItem->ui32Signature == RESMAN_SIGNATURE);
+		PVR_ASSERT(psCurItem->psContext == psContext);
+		if (psCurItem->ppsThis != ppsThisItem) {
+			PVR_DPF(PVR_DBG_WARNING, "psCurItem=%08X "
+				"psCurItem->ppsThis=%08X "
+				"psCurItem->psNext=%08X "
+				"ppsThisItem=%08X",
+				 psCurItem, psCurItem->ppsThis,
+				 psCurItem->psNext, ppsThisItem);
+			PVR_ASSERT(psCurItem->ppsThis == ppsThisItem);
+		}
+
+		ppsThisItem = &psCurItem->psNext;
+		psCurItem = psCurItem->psNext;
+	}
+}
 #endif
@@ -100,12 +100,15 @@ struct cs_hsi_iface {
 
 	/* state exposed to application */
 	struct cs_mmap_config_block	*mmap_cfg;
+	struct cs_mmap_ring_block	*ring;
 
 	unsigned long			mmap_base;
 	unsigned long			mmap_size;
 
 	unsigned int			rx_slot;
 	unsigned int			tx_slot;
+	unsigned int			rx_seq;
+	unsigned int			tx_seq;
 
 	/* note: for security reasons, we do not trust the contents of
 	 * mmap_cfg, but instead duplicate the variables here */
@@ -204,6 +207,27 @@ static void cs_notify_data(u32 message, int maxlength)
 	spin_unlock(&cs_char_data.lock);
 }
 
+/* Wake up pollers without queueing a data indication */
+static void cs_notify_ring(void)
+{
+	wake_up_interruptible(&cs_char_data.wait);
+	kill_fasync(&cs_char_data.async_queue, SIGIO, POLL_IN);
+}
+
+/*
+ * Fill in a ring descriptor and only then advance the counter the
+ * application polls on.
+ */
+static void cs_ring_publish(struct cs_ring_desc *desc, __u32 *counter,
+					unsigned int seq, unsigned int len)
+{
+	desc->seq = seq;
+	desc->len = len;
+	do_posix_clock_monotonic_gettime(&desc->tstamp);
+	smp_wmb();
+	*counter = seq;
+}
+
 static inline void cs_set_cmd(struct hsi_msg *msg, u32 cmd)
 {
 	u32 *data;
@@ -588,6 +612,7 @@ static int cs_hsi_write_on_control(struct cs_hsi_iface *hi, u32 message)
 static void cs_hsi_read_on_data_complete(struct hsi_msg *msg)
 {
 	struct cs_hsi_iface *hi = msg->context;
+	struct cs_mmap_ring_block *ring;
 	u32 payload;
 
 	if (unlikely(msg->status == HSI_STATUS_ERROR)) {
@@ -600,6 +625,14 @@ static void cs_hsi_read_on_data_complete(struct hsi_msg *msg)
 	hi->data_state &= ~SSI_CHANNEL_STATE_READING;
 	payload = CS_RX_DATA_RECEIVED;
 	payload |= hi->rx_slot;
+	ring = hi->ring;
+	if (ring) {
+		hi->rx_seq++;
+		if (hi->rx_seq - ACCESS_ONCE(ring->rx_tail) > hi->rx_bufs)
+			ring->rx_overruns++;
+		cs_ring_publish(&ring->rx_desc[hi->rx_slot % hi->rx_bufs],
+				&ring->rx_head, hi->rx_seq, msg->actual_len);
+	}
 	hi->rx_slot++;
 	hi->rx_slot %= hi->rx_ptr_boundary;
 	/* expose current rx ptr in mmap area */
@@ -608,7 +641,10 @@ static void cs_hsi_read_on_data_complete(struct hsi_msg *msg)
 		wake_up_interruptible(&hi->datawait);
 	spin_unlock(&hi->lock);
 
-	cs_notify_data(payload, hi->rx_bufs);
+	if (ring)
+		cs_notify_ring();
+	else
+		cs_notify_data(payload, hi->rx_bufs);
 	cs_hsi_read_on_data(hi);
 }
 
@@ -695,6 +731,10 @@ static void cs_hsi_write_on_data_complete(struct hsi_msg *msg)
 	if (msg->status == HSI_STATUS_COMPLETED) {
 		spin_lock(&hi->lock);
 		hi->data_state &= ~SSI_CHANNEL_STATE_WRITING;
+		if (hi->ring)
+			cs_ring_publish(&hi->ring->tx_desc[hi->tx_slot],
+					&hi->ring->tx_done, ++hi->tx_seq,
+					msg->actual_len);
 		if (unlikely(waitqueue_active(&hi->datawait)))
 			wake_up_interruptible(&hi->datawait);
 		spin_unlock(&hi->lock);
@@ -720,6 +760,11 @@ static int cs_hsi_write_on_data(struct cs_hsi_iface *hi, unsigned int slot)
 		ret = -EIO;
 		goto error;
 	}
+	if (slot >= hi->tx_bufs) {
+		dev_err(&hi->cl->device, "Invalid TX slot %u\n", slot);
+		ret = -EINVAL;
+		goto error;
+	}
 	if (hi->data_state & SSI_CHANNEL_STATE_WRITING) {
 		dev_err(&hi->cl->device, "Write pending on data channel.\n");
 		ret = -EBUSY;
@@ -823,12 +868,23 @@ static void set_buffer_sizes(struct cs_hsi_iface *hi, int rx_bufs, int tx_bufs)
 	}
 }
 
+/* Size of the control blocks preceding the data buffers */
+static size_t cs_ctrl_size(unsigned int flags)
+{
+	size_t size = L1_CACHE_ALIGN(sizeof(struct cs_mmap_config_block));
+
+	if (flags & CS_FEAT_RING)
+		size += L1_CACHE_ALIGN(sizeof(struct cs_mmap_ring_block));
+
+	return size;
+}
+
 static int check_buf_params(struct cs_hsi_iface *hi,
 					const struct cs_buffer_config *buf_cfg)
 {
 	size_t buf_size_aligned = L1_CACHE_ALIGN(buf_cfg->buf_size) *
 					(buf_cfg->rx_bufs + buf_cfg->tx_bufs);
-	size_t ctrl_size_aligned = L1_CACHE_ALIGN(sizeof(*hi->mmap_cfg));
+	size_t ctrl_size_aligned = cs_ctrl_size(buf_cfg->flags);
 	int r = 0;
 
 	if (buf_cfg->rx_bufs > CS_MAX_BUFFERS ||
@@ -906,7 +962,16 @@ static void cs_hsi_data_enable(struct cs_hsi_iface *hi,
 			"setting slot size to %u, buf size %u, align %u\n",
 			hi->slot_size, hi->buf_size, L1_CACHE_BYTES);
 
-	data_start = L1_CACHE_ALIGN(sizeof(*hi->mmap_cfg));
+	if (hi->flags & CS_FEAT_RING) {
+		unsigned int offset = L1_CACHE_ALIGN(sizeof(*hi->mmap_cfg));
+
+		hi->ring = (struct cs_mmap_ring_block *)
+						(hi->mmap_base + offset);
+		memset(hi->ring, 0, sizeof(*hi->ring));
+		hi->mmap_cfg->ring_offset = offset;
+	}
+
+	data_start = cs_ctrl_size(hi->flags);
 	dev_dbg(&hi->cl->device,
 			"setting data start at %u, cfg block %u, align %u\n",
 			data_start, sizeof(*hi->mmap_cfg), L1_CACHE_BYTES);
@@ -970,7 +1035,11 @@ static int cs_hsi_buf_config(struct cs_hsi_iface *hi,
 
 	hi->rx_slot = 0;
 	hi->tx_slot = 0;
+	hi->rx_seq = 0;
+	hi->tx_seq = 0;
 	hi->slot_size = 0;
+	hi->ring = NULL;
+	hi->mmap_cfg->ring_offset = 0;
 
 	if (hi->buf_size)
 		cs_hsi_data_enable(hi, buf_cfg);
@@ -1128,6 +1197,7 @@ static int cs_char_fasync(int fd, struct file *file, int on)
 static unsigned int cs_char_poll(struct file *file, poll_table *wait)
 {
 	struct cs_char *csdata = file->private_data;
+	struct cs_hsi_iface *hi = csdata->hi;
 	unsigned int ret = 0;
 
 	poll_wait(file, &cs_char_data.wait, wait);
@@ -1138,6 +1208,12 @@ static unsigned int cs_char_poll(struct file *file, poll_table *wait)
 		ret = POLLIN | POLLRDNORM;
 	spin_unlock_bh(&csdata->lock);
 
+	/* Ring frames are consumed from the mmap area, not read() */
+	spin_lock_bh(&hi->lock);
+	if (hi->ring && hi->rx_seq != ACCESS_ONCE(hi->ring->rx_tail))
+		ret = POLLIN | POLLRDNORM;
+	spin_unlock_bh(&hi->lock);
+
 	return ret;
 }
 
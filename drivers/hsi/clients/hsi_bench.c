@@ -0,0 +1,493 @@
+/*
+ * hsi_bench.c
+ *
+ * HSI throughput and latency benchmark. Streams messages from a client
+ * on one port to a client on another and reports the data rate and the
+ * time each message took from submission to reception. Meant to be run
+ * on the software loopback controller, e.g.:
+ *
+ *   modprobe hsi_loopback clients=hsi_bench_tx:0,hsi_bench_rx:1
+ *   modprobe hsi_bench msg_size=4096 msg_count=10000
+ *   echo 1 > /sys/bus/hsi/devices/hsi_bench_tx/bench
+ *   cat /sys/bus/hsi/devices/hsi_bench_tx/bench
+ *
+ * Copyright (C) 2010 Nokia Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/device.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/completion.h>
+#include <linux/scatterlist.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/hsi/hsi.h>
+
+#define HSI_BENCH_MAX_DEPTH	64
+
+static unsigned int msg_size = 4096;
+module_param(msg_size, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(msg_size, "Bytes per message (multiple of 4)");
+
+static unsigned int msg_count = 1000;
+module_param(msg_count, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(msg_count, "Messages per run");
+
+static unsigned int depth = 4;
+module_param(depth, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(depth, "Messages kept queued in each direction (1..64)");
+
+static unsigned int channel;
+module_param(channel, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(channel, "Channel to use");
+
+static unsigned int timeout = 30;
+module_param(timeout, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(timeout, "Seconds before a run is aborted");
+
+/**
+ * struct hsi_bench - Benchmark state
+ * @tx_cl: Client sending the messages
+ * @rx_cl: Client receiving them
+ * @mutex: Serialize runs against each other and against client removal
+ * @lock: Protect the counters below against the completion callbacks
+ * @done: Completed when the last message has been received
+ * @sent: Submission time of the messages in flight, by sequence number.
+ *	Twice the depth, since a write may complete, and its slot be
+ *	reused, just before the read that received it
+ * @count: Messages in this run
+ * @size: Bytes per message
+ * @slots: Entries of @sent in use
+ * @stop: Set to stop resubmitting messages
+ * @tx_seq: Messages submitted for writing
+ * @rx_seq: Messages submitted for reading
+ * @rx_done: Messages received
+ * @errors: Messages completed with an error
+ * @corrupt: Messages received with the wrong sequence number
+ * @lat_min: Shortest submission to reception time (ns)
+ * @lat_max: Longest submission to reception time (ns)
+ * @lat_sum: Sum of submission to reception times (ns)
+ * @start: Start of the run
+ * @elapsed: Length of the last run (ns)
+ * @result: Outcome of the last run (0, or -errno)
+ */
+struct hsi_bench {
+	struct hsi_client	*tx_cl;
+	struct hsi_client	*rx_cl;
+	struct mutex		mutex;
+	spinlock_t		lock;
+	struct completion	done;
+	ktime_t			sent[2 * HSI_BENCH_MAX_DEPTH];
+	unsigned int		count;
+	unsigned int		size;
+	unsigned int		slots;
+	unsigned int		stop:1;
+	unsigned int		tx_seq;
+	unsigned int		rx_seq;
+	unsigned int		rx_done;
+	unsigned int		errors;
+	unsigned int		corrupt;
+	u64			lat_min;
+	u64			lat_max;
+	u64			lat_sum;
+	ktime_t			start;
+	u64			elapsed;
+	int			result;
+};
+
+static struct hsi_bench hsi_bench;
+
+static void hsi_bench_free_msg(struct hsi_msg *msg)
+{
+	kfree(sg_virt(msg->sgt.sgl));
+	hsi_free_msg(msg);
+}
+
+static struct hsi_msg *hsi_bench_alloc_msg(struct hsi_bench *b,
+					void (*complete)(struct hsi_msg *msg))
+{
+	struct hsi_msg *msg;
+	void *buf;
+
+	msg = hsi_alloc_msg(1, GFP_KERNEL);
+	if (!msg)
+		return NULL;
+	buf = kzalloc(b->size, GFP_KERNEL);
+	if (!buf) {
+		hsi_free_msg(msg);
+		return NULL;
+	}
+	sg_init_one(msg->sgt.sgl, buf, b->size);
+	msg->channel = channel;
+	msg->complete = complete;
+	msg->destructor = hsi_bench_free_msg;
+	msg->context = b;
+
+	return msg;
+}
+
+/*
+ * Called with b->lock held. Controllers complete messages from their own
+ * bottom halves, never from within hsi_async(), so this cannot recurse
+ * into the completion callbacks.
+ */
+static int hsi_bench_write(struct hsi_bench *b, struct hsi_msg *msg)
+{
+	unsigned int seq = b->tx_seq++;
+
+	*(u32 *)sg_virt(msg->sgt.sgl) = seq;
+	b->sent[seq % b->slots] = ktime_get();
+
+	return hsi_async_write(b->tx_cl, msg);
+}
+
+/* Called with b->lock held */
+static int hsi_bench_read(struct hsi_bench *b, struct hsi_msg *msg)
+{
+	b->rx_seq++;
+
+	return hsi_async_read(b->rx_cl, msg);
+}
+
+static void hsi_bench_write_done(struct hsi_msg *msg)
+{
+	struct hsi_bench *b = msg->context;
+
+	spin_lock(&b->lock);
+	if (msg->status != HSI_STATUS_COMPLETED)
+		b->errors++;
+	if (b->stop || b->tx_seq == b->count || hsi_bench_write(b, msg) < 0)
+		hsi_bench_free_msg(msg);
+	spin_unlock(&b->lock);
+}
+
+static void hsi_bench_read_done(struct hsi_msg *msg)
+{
+	struct hsi_bench *b = msg->context;
+	ktime_t now = ktime_get();
+	unsigned int seq;
+	u64 lat;
+
+	spin_lock(&b->lock);
+	seq = b->rx_done++;
+	if (msg->status != HSI_STATUS_COMPLETED)
+		b->errors++;
+	if (*(u32 *)sg_virt(msg->sgt.sgl) != seq)
+		b->corrupt++;
+	lat = ktime_to_ns(ktime_sub(now, b->sent[seq % b->slots]));
+	b->lat_min = min(b->lat_min, lat);
+	b->lat_max = max(b->lat_max, lat);
+	b->lat_sum += lat;
+	if (b->rx_done == b->count) {
+		b->elapsed = ktime_to_ns(ktime_sub(now, b->start));
+		complete(&b->done);
+	}
+	if (b->stop || b->rx_seq == b->count || hsi_bench_read(b, msg) < 0)
+		hsi_bench_free_msg(msg);
+	spin_unlock(&b->lock);
+}
+
+static int hsi_bench_claim(struct hsi_client *cl)
+{
+	int err;
+
+	err = hsi_claim_port(cl, 0);
+	if (err < 0)
+		return err;
+	err = hsi_setup(cl);
+	if (err < 0)
+		hsi_release_port(cl);
+
+	return err;
+}
+
+/* Queue up to depth messages of each kind; the callbacks keep them going */
+static int hsi_bench_submit(struct hsi_bench *b)
+{
+	struct hsi_msg *rx[HSI_BENCH_MAX_DEPTH];
+	struct hsi_msg *tx[HSI_BENCH_MAX_DEPTH];
+	unsigned int n = min(b->slots / 2, b->count);
+	unsigned int i;
+	int err = 0;
+
+	memset(rx, 0, sizeof(rx));
+	memset(tx, 0, sizeof(tx));
+	for (i = 0; i < n; i++) {
+		rx[i] = hsi_bench_alloc_msg(b, hsi_bench_read_done);
+		tx[i] = hsi_bench_alloc_msg(b, hsi_bench_write_done);
+		if (!rx[i] || !tx[i]) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
+	spin_lock_bh(&b->lock);
+	b->start = ktime_get();
+	for (i = 0; i < n && !err; i++) {
+		err = hsi_bench_read(b, rx[i]);
+		if (!err)
+			rx[i] = NULL;
+	}
+	for (i = 0; i < n && !err; i++) {
+		err = hsi_bench_write(b, tx[i]);
+		if (!err)
+			tx[i] = NULL;
+	}
+	spin_unlock_bh(&b->lock);
+out:
+	for (i = 0; i < n; i++) {
+		if (rx[i])
+			hsi_bench_free_msg(rx[i]);
+		if (tx[i])
+			hsi_bench_free_msg(tx[i]);
+	}
+
+	return err;
+}
+
+/* Called with b->mutex held */
+static int hsi_bench_run(struct hsi_bench *b)
+{
+	long left;
+	int err;
+
+	if (!b->tx_cl || !b->rx_cl)
+		return -ENODEV;
+	if (!msg_count || msg_size < sizeof(u32) || (msg_size & 3) ||
+		!depth || depth > HSI_BENCH_MAX_DEPTH)
+		return -EINVAL;
+
+	spin_lock_bh(&b->lock);
+	b->count = msg_count;
+	b->size = msg_size;
+	b->slots = 2 * depth;
+	b->stop = 0;
+	b->tx_seq = 0;
+	b->rx_seq = 0;
+	b->rx_done = 0;
+	b->errors = 0;
+	b->corrupt = 0;
+	b->lat_min = ~0ULL;
+	b->lat_max = 0;
+	b->lat_sum = 0;
+	b->elapsed = 0;
+	spin_unlock_bh(&b->lock);
+	INIT_COMPLETION(b->done);
+
+	err = hsi_bench_claim(b->rx_cl);
+	if (err < 0)
+		return err;
+	err = hsi_bench_claim(b->tx_cl);
+	if (err < 0)
+		goto out1;
+	hsi_start_tx(b->tx_cl);
+
+	err = hsi_bench_submit(b);
+	if (!err) {
+		left = wait_for_completion_interruptible_timeout(&b->done,
+							timeout * HZ);
+		if (left == 0)
+			err = -ETIMEDOUT;
+		else if (left < 0)
+			err = left;
+	}
+
+	/* No resubmission after this, so the flushes leave nothing queued */
+	spin_lock_bh(&b->lock);
+	b->stop = 1;
+	spin_unlock_bh(&b->lock);
+	hsi_flush(b->tx_cl);
+	hsi_flush(b->rx_cl);
+
+	hsi_stop_tx(b->tx_cl);
+	hsi_release_port(b->tx_cl);
+out1:
+	hsi_release_port(b->rx_cl);
+
+	return err;
+}
+
+static ssize_t hsi_bench_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct hsi_bench *b = &hsi_bench;
+	unsigned long rate = 0;
+	u64 lat_avg = 0;
+	ssize_t len;
+
+	mutex_lock(&b->mutex);
+	if (b->result) {
+		len = sprintf(buf, "failed: %d (%u of %u received)\n",
+					b->result, b->rx_done, b->count);
+		goto out;
+	}
+	if (!b->elapsed) {
+		len = sprintf(buf, "not run\n");
+		goto out;
+	}
+	/* KiB/s, computed in ns to keep short runs accurate */
+	rate = div64_u64((u64)b->count * b->size * (NSEC_PER_SEC >> 10),
+								b->elapsed);
+	lat_avg = div_u64(b->lat_sum, b->count);
+	len = sprintf(buf, "%u x %u bytes in %llu us: %lu KiB/s, "
+			"latency min %llu avg %llu max %llu us, "
+			"%u errors, %u corrupt\n",
+			b->count, b->size, div_u64(b->elapsed, NSEC_PER_USEC),
+			rate, div_u64(b->lat_min, NSEC_PER_USEC),
+			div_u64(lat_avg, NSEC_PER_USEC),
+			div_u64(b->lat_max, NSEC_PER_USEC),
+			b->errors, b->corrupt);
+out:
+	mutex_unlock(&b->mutex);
+
+	return len;
+}
+
+static ssize_t hsi_bench_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct hsi_bench *b = &hsi_bench;
+	char result[256];
+	int err;
+
+	mutex_lock(&b->mutex);
+	err = hsi_bench_run(b);
+	b->result = err;
+	mutex_unlock(&b->mutex);
+
+	hsi_bench_show(dev, attr, result);
+	dev_info(dev, "%s", result);
+
+	return err < 0 ? err : count;
+}
+
+static DEVICE_ATTR(bench, S_IRUGO | S_IWUSR, hsi_bench_show,
+							hsi_bench_store);
+
+static int hsi_bench_tx_probe(struct device *dev)
+{
+	struct hsi_bench *b = &hsi_bench;
+	int err;
+
+	mutex_lock(&b->mutex);
+	if (b->tx_cl) {
+		err = -EBUSY;
+		goto out;
+	}
+	err = device_create_file(dev, &dev_attr_bench);
+	if (!err)
+		b->tx_cl = to_hsi_client(dev);
+out:
+	mutex_unlock(&b->mutex);
+
+	return err;
+}
+
+static int hsi_bench_tx_remove(struct device *dev)
+{
+	struct hsi_bench *b = &hsi_bench;
+
+	device_remove_file(dev, &dev_attr_bench);
+	mutex_lock(&b->mutex);
+	b->tx_cl = NULL;
+	mutex_unlock(&b->mutex);
+
+	return 0;
+}
+
+static int hsi_bench_rx_probe(struct device *dev)
+{
+	struct hsi_bench *b = &hsi_bench;
+	int err = 0;
+
+	mutex_lock(&b->mutex);
+	if (b->rx_cl)
+		err = -EBUSY;
+	else
+		b->rx_cl = to_hsi_client(dev);
+	mutex_unlock(&b->mutex);
+
+	return err;
+}
+
+static int hsi_bench_rx_remove(struct device *dev)
+{
+	struct hsi_bench *b = &hsi_bench;
+
+	mutex_lock(&b->mutex);
+	b->rx_cl = NULL;
+	mutex_unlock(&b->mutex);
+
+	return 0;
+}
+
+static struct hsi_client_driver hsi_bench_tx_driver = {
+	.driver = {
+		.name	= "hsi_bench_tx",
+		.owner	= THIS_MODULE,
+		.probe	= hsi_bench_tx_probe,
+		.remove	= hsi_bench_tx_remove,
+	},
+};
+
+static struct hsi_client_driver hsi_bench_rx_driver = {
+	.driver = {
+		.name	= "hsi_bench_rx",
+		.owner	= THIS_MODULE,
+		.probe	= hsi_bench_rx_probe,
+		.remove	= hsi_bench_rx_remove,
+	},
+};
+
+static int __init hsi_bench_init(void)
+{
+	int err;
+
+	mutex_init(&hsi_bench.mutex);
+	spin_lock_init(&hsi_bench.lock);
+	init_completion(&hsi_bench.done);
+
+	err = hsi_register_client_driver(&hsi_bench_rx_driver);
+	if (err < 0)
+		return err;
+	err = hsi_register_client_driver(&hsi_bench_tx_driver);
+	if (err < 0) {
+		hsi_unregister_client_driver(&hsi_bench_rx_driver);
+		return err;
+	}
+	pr_info("HSI benchmark loaded\n");
+
+	return 0;
+}
+module_init(hsi_bench_init);
+
+static void __exit hsi_bench_exit(void)
+{
+	hsi_unregister_client_driver(&hsi_bench_tx_driver);
+	hsi_unregister_client_driver(&hsi_bench_rx_driver);
+	pr_info("HSI benchmark removed\n");
+}
+module_exit(hsi_bench_exit);
+
+MODULE_DESCRIPTION("HSI throughput and latency benchmark");
+MODULE_LICENSE("GPL v2");
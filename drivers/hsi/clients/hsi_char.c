@@ -35,6 +35,9 @@
 #include <linux/ioctl.h>
 #include <linux/wait.h>
 #include <linux/fs.h>
+#include <linux/aio.h>
+#include <linux/uio.h>
+#include <linux/err.h>
 #include <linux/sched.h>
 #include <linux/device.h>
 #include <linux/cdev.h>
@@ -46,6 +49,7 @@
 #define HSI_CHAR_CHANNELS	8
 #define HSI_CHAR_DEVS		8
 #define HSI_CHAR_MSGS		4
+#define HSI_CHAR_MAX_MSGS	64
 
 #define HSI_CHST_UNAVAIL	0 /* SBZ! */
 #define HSI_CHST_AVAIL		1
@@ -110,6 +114,7 @@ struct hsi_char_channel {
 	struct fasync_struct	*async_queue;
 	wait_queue_head_t	rx_wait;
 	wait_queue_head_t	tx_wait;
+	struct hsc_stats	stats;
 };
 
 struct hsi_char_client_data {
@@ -127,6 +132,11 @@ static int channels_map[HSI_CHAR_DEVS] = {0, -1, -1 , -1, -1, -1, -1, -1};
 module_param_array(channels_map, int, NULL, 0);
 MODULE_PARM_DESC(channels_map, "Array of HSI channels ([0...7]) to be probed");
 
+static unsigned int queue_depth[HSI_CHAR_DEVS];
+module_param_array(queue_depth, uint, NULL, 0);
+MODULE_PARM_DESC(queue_depth,
+	"Array of messages per channel [2..64], 0 for default (4)");
+
 static dev_t hsi_char_dev;
 static struct hsi_char_client_data hsi_char_cl_data;
 
@@ -181,7 +191,7 @@ static inline int hsi_char_msgs_alloc(struct hsi_char_channel *channel)
 	struct hsi_msg *msg;
 	int i;
 
-	for (i = 0; i < HSI_CHAR_MSGS; i++) {
+	for (i = 0; i < channel->stats.queue_depth; i++) {
 		msg = hsi_char_msg_alloc(max_data_size);
 		if (!msg)
 			goto out;
@@ -616,202 +626,275 @@ static inline void hsi_char_tx2ecfg(struct hsc_tx_config *tx_cfg,
 	tx_cfg->arb_mode = cfg->arb_mode;
 }
 
-static ssize_t hsi_char_read(struct file *file, char __user *buf,
-						size_t len, loff_t *ppos)
+/* Index of the first non-empty iovec segment at or after seg */
+static inline unsigned long hsi_char_next_seg(const struct iovec *iov,
+				unsigned long nr_segs, unsigned long seg)
 {
-	struct hsi_char_channel *channel = file->private_data;
-	struct hsi_msg *msg = NULL;
-	ssize_t ret;
+	while ((seg < nr_segs) && (iov[seg].iov_len == 0))
+		seg++;
 
-	if (len == 0) {
-		channel->poll_event &= ~POLLPRI;
-		return 0;
-	}
-	channel->poll_event &= ~POLLPRI;
+	return seg;
+}
 
-	if (!IS_ALIGNED(len, sizeof(u32)))
-		return -EINVAL;
+static int hsi_char_xfer_start(struct hsi_char_channel *channel, int dir)
+{
+	if (HSI_CHST_OC(channel) != HSI_CHST_OPENED)
+		return -ENODEV;
+	if (dir == HSI_CHAR_RX) {
+		if (HSI_CHST_RD(channel) != HSI_CHST_READOFF)
+			return -EBUSY;
+		if (channel->ch >= channel->cl->rx_cfg.channels)
+			return -ENODEV;
+		HSI_CHST_RD_SET(channel, HSI_CHST_READING);
+	} else {
+		if (HSI_CHST_WR(channel) != HSI_CHST_WRITEOFF)
+			return -EBUSY;
+		if (channel->ch >= channel->cl->tx_cfg.channels)
+			return -ENODEV;
+		HSI_CHST_WR_SET(channel, HSI_CHST_WRITING);
+	}
 
-	if (len > max_data_size)
-		len = max_data_size;
+	return 0;
+}
 
-	spin_lock_bh(&channel->lock);
-	if (HSI_CHST_OC(channel) != HSI_CHST_OPENED) {
-		ret = -ENODEV;
-		goto out;
-	}
-	if (HSI_CHST_RD(channel) != HSI_CHST_READOFF) {
-		ret = -EBUSY;
-		goto out;
-	}
-	if (channel->ch >= channel->cl->rx_cfg.channels) {
-		ret = -ENODEV;
-		goto out;
-	}
-	if (list_empty(&channel->free_msgs_list)) {
-		ret = -ENOMEM;
-		goto out;
-	}
-	msg = list_first_entry(&channel->free_msgs_list, struct hsi_msg, link);
-	list_del(&msg->link);
-	spin_unlock_bh(&channel->lock);
+static int hsi_char_submit(struct hsi_char_channel *channel,
+			struct hsi_msg *msg, void __user *buf,
+			unsigned int len, int dir)
+{
 	hsi_char_msg_len_set(msg, len);
-	msg->complete = hsi_char_rx_completed;
-	msg->destructor = hsi_char_rx_msg_destructor;
-	ret = hsi_async_read(channel->cl, msg);
-	spin_lock_bh(&channel->lock);
-	if (ret < 0)
-		goto out;
-	HSI_CHST_RD_SET(channel, HSI_CHST_READING);
-	msg = NULL;
+	if (dir == HSI_CHAR_RX) {
+		msg->complete = hsi_char_rx_completed;
+		msg->destructor = hsi_char_rx_msg_destructor;
+		return hsi_async_read(channel->cl, msg);
+	}
+	if (copy_from_user(msg->context, buf, len))
+		return -EFAULT;
+	msg->complete = hsi_char_tx_completed;
+	msg->destructor = hsi_char_tx_msg_destructor;
 
+	return hsi_async_write(channel->cl, msg);
+}
+
+/*
+ * Wait for the next completed message on queue. Called and returns with
+ * channel->lock held.
+ */
+static struct hsi_msg *hsi_char_wait_msg(struct hsi_char_channel *channel,
+			struct list_head *queue, wait_queue_head_t *wq, int dir)
+{
 	for ( ; ; ) {
 		DEFINE_WAIT(wait);
 
-		if (!list_empty(&channel->rx_msgs_queue)) {
-			msg = list_first_entry(&channel->rx_msgs_queue,
-					struct hsi_msg, link);
-			HSI_CHST_RD_SET(channel, HSI_CHST_READOFF);
-			channel->poll_event &= ~(POLLIN | POLLRDNORM);
-			list_del(&msg->link);
+		if (!list_empty(queue))
+			return list_first_entry(queue, struct hsi_msg, link);
+		if (signal_pending(current)) {
 			spin_unlock_bh(&channel->lock);
-			if (msg->status == HSI_STATUS_ERROR) {
-				ret = -EIO;
-			} else {
-				ret = copy_to_user((void __user *)buf,
-						msg->context,
-						hsi_char_msg_len_get(msg));
-				if (ret)
-					ret = -EFAULT;
-				else
-					ret = hsi_char_msg_len_get(msg);
-			}
-			spin_lock_bh(&channel->lock);
-			break;
-		} else if (signal_pending(current)) {
-			spin_unlock_bh(&channel->lock);
-			hsi_char_rx_cancel(channel);
+			if (dir == HSI_CHAR_RX)
+				hsi_char_rx_cancel(channel);
+			else
+				hsi_char_tx_cancel(channel);
 			spin_lock_bh(&channel->lock);
-			HSI_CHST_RD_SET(channel, HSI_CHST_READOFF);
-			ret = -EINTR;
-			break;
-		} else if ((HSI_CHST_OC(channel) == HSI_CHST_CLOSING) ||
-				(HSI_CHST_OC(channel) == HSI_CHST_CLOSING)) {
-			ret = -EIO;
-			break;
+			return ERR_PTR(-EINTR);
 		}
-		prepare_to_wait(&channel->rx_wait, &wait, TASK_INTERRUPTIBLE);
+		if (HSI_CHST_OC(channel) == HSI_CHST_CLOSING)
+			return ERR_PTR(-EIO);
+		prepare_to_wait(wq, &wait, TASK_INTERRUPTIBLE);
 		spin_unlock_bh(&channel->lock);
 
 		schedule();
 
 		spin_lock_bh(&channel->lock);
-		finish_wait(&channel->rx_wait, &wait);
+		finish_wait(wq, &wait);
 	}
-out:
-	if (msg)
-		list_add_tail(&msg->link, &channel->free_msgs_list);
-	spin_unlock_bh(&channel->lock);
-
-	return ret;
 }
 
-static ssize_t hsi_char_write(struct file *file, const char __user *buf,
-						size_t len, loff_t *ppos)
+/*
+ * Transfer the iovec segments, one message per segment, keeping up to half
+ * of the channel's messages queued in the controller so that a transfer in
+ * the other direction always finds some free. Messages on a channel
+ * complete in submission order, so completions map back to the segments
+ * in order. A segment longer than max_data_size is cut short and ends the
+ * transfer, so the data moved is always contiguous. Returns the number of
+ * bytes of the leading segments that were transferred successfully, or an
+ * error if there are none.
+ */
+static ssize_t hsi_char_xfer(struct hsi_char_channel *channel,
+		const struct iovec *iov, unsigned long nr_segs, int dir)
 {
-	struct hsi_char_channel *channel = file->private_data;
-	struct hsi_msg *msg = NULL;
-	ssize_t ret;
-
-	if ((len == 0) || !IS_ALIGNED(len, sizeof(u32)))
-		return -EINVAL;
-
-	if (len > max_data_size)
-		len = max_data_size;
-
-	spin_lock_bh(&channel->lock);
-	if (HSI_CHST_OC(channel) != HSI_CHST_OPENED) {
-		ret = -ENODEV;
-		goto out;
-	}
-	if (HSI_CHST_WR(channel) != HSI_CHST_WRITEOFF) {
-		ret = -EBUSY;
-		goto out;
-	}
-	if (channel->ch >= channel->cl->tx_cfg.channels) {
-		ret = -ENODEV;
-		goto out;
-	}
-	if (list_empty(&channel->free_msgs_list)) {
-		ret = -ENOMEM;
-		goto out;
-	}
-	msg = list_first_entry(&channel->free_msgs_list, struct hsi_msg, link);
-	list_del(&msg->link);
-	HSI_CHST_WR_SET(channel, HSI_CHST_WRITEON);
-	spin_unlock_bh(&channel->lock);
+	struct hsc_stats *stats = &channel->stats;
+	struct list_head *queue;
+	wait_queue_head_t *wq;
+	struct hsi_msg *msg;
+	unsigned long sub, done;
+	unsigned int len, max_inflight;
+	u32 *inflight, *inflight_max, *msgs, *errors;
+	ssize_t bytes = 0;
+	int err, cerr = 0;
+
+	for (sub = 0; sub < nr_segs; sub++)
+		if (!IS_ALIGNED(iov[sub].iov_len, sizeof(u32)))
+			return -EINVAL;
 
-	if (copy_from_user(msg->context, (void __user *)buf, len)) {
-		spin_lock_bh(&channel->lock);
-		HSI_CHST_WR_SET(channel, HSI_CHST_WRITEOFF);
-		ret = -EFAULT;
-		goto out;
+	if (dir == HSI_CHAR_RX) {
+		queue = &channel->rx_msgs_queue;
+		wq = &channel->rx_wait;
+		inflight = &stats->rx_inflight;
+		inflight_max = &stats->rx_inflight_max;
+		msgs = &stats->rx_msgs;
+		errors = &stats->rx_errors;
+	} else {
+		queue = &channel->tx_msgs_queue;
+		wq = &channel->tx_wait;
+		inflight = &stats->tx_inflight;
+		inflight_max = &stats->tx_inflight_max;
+		msgs = &stats->tx_msgs;
+		errors = &stats->tx_errors;
 	}
+	max_inflight = max_t(unsigned int, stats->queue_depth / 2, 1);
 
-	hsi_char_msg_len_set(msg, len);
-	msg->complete = hsi_char_tx_completed;
-	msg->destructor = hsi_char_tx_msg_destructor;
-	channel->poll_event &= ~(POLLOUT | POLLWRNORM);
-	ret = hsi_async_write(channel->cl, msg);
 	spin_lock_bh(&channel->lock);
-	if (ret < 0) {
-		channel->poll_event |= (POLLOUT | POLLWRNORM);
-		HSI_CHST_WR_SET(channel, HSI_CHST_WRITEOFF);
-		goto out;
+	err = hsi_char_xfer_start(channel, dir);
+	if (err < 0) {
+		spin_unlock_bh(&channel->lock);
+		return err;
 	}
-	HSI_CHST_WR_SET(channel, HSI_CHST_WRITING);
-	msg = NULL;
 
+	sub = hsi_char_next_seg(iov, nr_segs, 0);
+	done = sub;
 	for ( ; ; ) {
-		DEFINE_WAIT(wait);
-
-		if (!list_empty(&channel->tx_msgs_queue)) {
-			msg = list_first_entry(&channel->tx_msgs_queue,
-					struct hsi_msg, link);
+		/* Nothing is queued behind a failed segment */
+		while (!err && !cerr && (sub < nr_segs) &&
+				(*inflight < max_inflight) &&
+				!list_empty(&channel->free_msgs_list)) {
+			msg = list_first_entry(&channel->free_msgs_list,
+							struct hsi_msg, link);
 			list_del(&msg->link);
-			HSI_CHST_WR_SET(channel, HSI_CHST_WRITEOFF);
-			if (msg->status == HSI_STATUS_ERROR)
-				ret = -EIO;
-			else
-				ret = hsi_char_msg_len_get(msg);
-			break;
-		} else if (signal_pending(current)) {
+			if (dir == HSI_CHAR_TX)
+				channel->poll_event &= ~(POLLOUT | POLLWRNORM);
 			spin_unlock_bh(&channel->lock);
-			hsi_char_tx_cancel(channel);
+			len = min_t(size_t, iov[sub].iov_len, max_data_size);
+			err = hsi_char_submit(channel, msg, iov[sub].iov_base,
+								len, dir);
 			spin_lock_bh(&channel->lock);
-			HSI_CHST_WR_SET(channel, HSI_CHST_WRITEOFF);
-			ret = -EINTR;
-			break;
-		} else if ((HSI_CHST_OC(channel) == HSI_CHST_CLOSING) ||
-				(HSI_CHST_OC(channel) == HSI_CHST_CLOSING)) {
-			ret = -EIO;
+			if (err < 0) {
+				list_add_tail(&msg->link,
+						&channel->free_msgs_list);
+				break;
+			}
+			if (len < iov[sub].iov_len)
+				sub = nr_segs;
+			else
+				sub = hsi_char_next_seg(iov, nr_segs, sub + 1);
+			if (++(*inflight) > *inflight_max)
+				*inflight_max = *inflight;
+		}
+		if (!*inflight) {
+			if (!err && !cerr && (sub < nr_segs))
+				err = -ENOMEM;
 			break;
 		}
-		prepare_to_wait(&channel->tx_wait, &wait, TASK_INTERRUPTIBLE);
-		spin_unlock_bh(&channel->lock);
 
-		schedule();
-
-		spin_lock_bh(&channel->lock);
-		finish_wait(&channel->tx_wait, &wait);
-	}
-out:
-	if (msg)
+		msg = hsi_char_wait_msg(channel, queue, wq, dir);
+		if (IS_ERR(msg)) {
+			cerr = PTR_ERR(msg);
+			break;
+		}
+		list_del(&msg->link);
+		(*inflight)--;
+		if (msg->status == HSI_STATUS_ERROR) {
+			(*errors)++;
+			if (!cerr)
+				cerr = -EIO;
+		} else {
+			(*msgs)++;
+		}
+		/*
+		 * Segments submitted before a submission error still count;
+		 * whatever completes after a failed segment cannot be handed
+		 * back contiguously and is dropped.
+		 */
+		if (!cerr) {
+			len = hsi_char_msg_len_get(msg);
+			if (dir == HSI_CHAR_RX) {
+				channel->poll_event &= ~(POLLIN | POLLRDNORM);
+				spin_unlock_bh(&channel->lock);
+				if (copy_to_user(iov[done].iov_base,
+							msg->context, len))
+					cerr = -EFAULT;
+				spin_lock_bh(&channel->lock);
+			}
+			if (!cerr)
+				bytes += len;
+		}
+		done = hsi_char_next_seg(iov, nr_segs, done + 1);
 		list_add_tail(&msg->link, &channel->free_msgs_list);
+	}
 
+	/* Flushed or abandoned messages are no longer ours to wait for */
+	*inflight = 0;
+	list_splice_tail_init(queue, &channel->free_msgs_list);
+	if (dir == HSI_CHAR_RX) {
+		HSI_CHST_RD_SET(channel, HSI_CHST_READOFF);
+	} else {
+		HSI_CHST_WR_SET(channel, HSI_CHST_WRITEOFF);
+		channel->poll_event |= (POLLOUT | POLLWRNORM);
+	}
 	spin_unlock_bh(&channel->lock);
 
-	return ret;
+	if (bytes)
+		return bytes;
+
+	return cerr ? cerr : err;
+}
+
+static ssize_t hsi_char_read(struct file *file, char __user *buf,
+						size_t len, loff_t *ppos)
+{
+	struct hsi_char_channel *channel = file->private_data;
+	struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+	channel->poll_event &= ~POLLPRI;
+	if (len == 0)
+		return 0;
+
+	return hsi_char_xfer(channel, &iov, 1, HSI_CHAR_RX);
+}
+
+static ssize_t hsi_char_write(struct file *file, const char __user *buf,
+						size_t len, loff_t *ppos)
+{
+	struct hsi_char_channel *channel = file->private_data;
+	struct iovec iov = { .iov_base = (void __user *)buf, .iov_len = len };
+
+	if (len == 0)
+		return -EINVAL;
+
+	return hsi_char_xfer(channel, &iov, 1, HSI_CHAR_TX);
+}
+
+/*
+ * readv/writev and io_submit end up here. The whole vector is queued at
+ * once and the request completes synchronously.
+ */
+static ssize_t hsi_char_aio_read(struct kiocb *iocb, const struct iovec *iov,
+					unsigned long nr_segs, loff_t pos)
+{
+	struct hsi_char_channel *channel = iocb->ki_filp->private_data;
+
+	channel->poll_event &= ~POLLPRI;
+
+	return hsi_char_xfer(channel, iov, nr_segs, HSI_CHAR_RX);
+}
+
+static ssize_t hsi_char_aio_write(struct kiocb *iocb, const struct iovec *iov,
+					unsigned long nr_segs, loff_t pos)
+{
+	struct hsi_char_channel *channel = iocb->ki_filp->private_data;
+
+	if (!iov_length(iov, nr_segs))
+		return -EINVAL;
+
+	return hsi_char_xfer(channel, iov, nr_segs, HSI_CHAR_TX);
 }
 
 static unsigned int hsi_char_poll(struct file *file, poll_table *wait)
@@ -842,6 +925,7 @@ static int hsi_char_ioctl(struct inode *inode, struct file *file,
 	struct hsi_config cfg;
 	struct hsc_rx_config rx_cfg;
 	struct hsc_tx_config tx_cfg;
+	struct hsc_stats stats;
 	int ret = 0;
 
 	if (HSI_CHST_OC(channel) != HSI_CHST_OPENED)
@@ -891,6 +975,13 @@ static int hsi_char_ioctl(struct inode *inode, struct file *file,
 		if (copy_to_user((void __user *)arg, &tx_cfg, sizeof(tx_cfg)))
 			return -EFAULT;
 		break;
+	case HSC_GET_STATS:
+		spin_lock_bh(&channel->lock);
+		stats = channel->stats;
+		spin_unlock_bh(&channel->lock);
+		if (copy_to_user((void __user *)arg, &stats, sizeof(stats)))
+			return -EFAULT;
+		break;
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -940,6 +1031,8 @@ static int hsi_char_open(struct inode *inode, struct file *file)
 		ret = -ENODEV;
 		goto out;
 	}
+	memset(&channel->stats, 0, sizeof(channel->stats));
+	channel->stats.queue_depth = queue_depth[channel->ch] ?: HSI_CHAR_MSGS;
 	ret = hsi_char_msgs_alloc(channel);
 
 	if (ret < 0) {
@@ -984,6 +1077,8 @@ static const struct file_operations hsi_char_fops = {
 	.owner		= THIS_MODULE,
 	.read		= hsi_char_read,
 	.write		= hsi_char_write,
+	.aio_read	= hsi_char_aio_read,
+	.aio_write	= hsi_char_aio_write,
 	.poll		= hsi_char_poll,
 	.ioctl		= hsi_char_ioctl,
 	.open		= hsi_char_open,
@@ -1028,6 +1123,14 @@ static int __init hsi_char_init(void)
 		return -EINVAL;
 	}
 
+	for (i = 0; i < HSI_CHAR_DEVS; i++) {
+		if (queue_depth[i] && ((queue_depth[i] < 2) ||
+				(queue_depth[i] > HSI_CHAR_MAX_MSGS))) {
+			pr_err("Invalid queue depth for channel %u", i);
+			return -EINVAL;
+		}
+	}
+
 	for (i = 0; i < HSI_CHAR_DEVS && channels_map[i] >= 0; i++) {
 		if (channels_map[i] >= HSI_CHAR_DEVS) {
 			pr_err("Invalid HSI/SSI channel specified");
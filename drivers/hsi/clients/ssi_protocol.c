@@ -36,6 +36,7 @@
 #include <linux/irq.h>
 #include <linux/list.h>
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/netdevice.h>
 #include <linux/notifier.h>
 #include <linux/scatterlist.h>
@@ -57,6 +58,9 @@
 #define SSIP_MAX_CMDS		5 /* Number of pre-allocated commands buffers */
 #define SSIP_BYTES_TO_FRAMES(x) ((((x) - 1) >> 2) + 1)
 #define SSIP_CMT_LOADER_SYNC	0x11223344
+#define SSIP_NAPI_WEIGHT	16
+#define SSIP_AGGR_HDR_LEN	4	/* Length word before each packet */
+#define SSIP_AGGR_MAX_LEN	16384	/* Max bytes per aggregated transfer */
 /*
  * SSI protocol command definitions
  */
@@ -71,23 +75,30 @@
 #define SSIP_READY		5
 /* Payloads */
 #define SSIP_DATA_VERSION(data)	((data) & 0xff)
+#define SSIP_DATA_CAPS(data)	(((data) >> 8) & 0xff)
 #define SSIP_LOCAL_VERID	1
+#define SSIP_CAP_AGGR		0x01	/* Accepts aggregated transfers */
 #define SSIP_WAKETEST_OK	0
 #define SSIP_WAKETEST_FAILED	1
 #define SSIP_PDU_LENGTH(data)	(((data) >> 8) & 0xffff)
 #define SSIP_MSG_ID(data)	((data) & 0xff)
+#define SSIP_AGGR		(1 << 24) /* START_TRANS of many packets */
 /* Generic Command */
 #define SSIP_CMD(cmd, payload)	(((cmd) << 28) | ((payload) & 0xfffffff))
 /* Commands for the control channel */
-#define SSIP_BOOTINFO_REQ_CMD(ver) \
-		SSIP_CMD(SSIP_BOOTINFO_REQ, SSIP_DATA_VERSION(ver))
-#define SSIP_BOOTINFO_RESP_CMD(ver) \
-		SSIP_CMD(SSIP_BOOTINFO_RESP, SSIP_DATA_VERSION(ver))
+#define SSIP_BOOTINFO_REQ_CMD(ver, caps) \
+	SSIP_CMD(SSIP_BOOTINFO_REQ, SSIP_DATA_VERSION(ver) | ((caps) << 8))
+#define SSIP_BOOTINFO_RESP_CMD(ver, caps) \
+	SSIP_CMD(SSIP_BOOTINFO_RESP, SSIP_DATA_VERSION(ver) | ((caps) << 8))
 #define SSIP_START_TRANS_CMD(pdulen, id) \
 		SSIP_CMD(SSIP_START_TRANS, (((pdulen) << 8) | SSIP_MSG_ID(id)))
 #define SSIP_READY_CMD		SSIP_CMD(SSIP_READY, 0)
 #define SSIP_SWBREAK_CMD	SSIP_CMD(SSIP_SW_BREAK, 0)
 
+static unsigned int aggr_max = 16;
+module_param(aggr_max, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(aggr_max, "Max packets per TX transfer (<= 1 disables it)");
+
 /* Main state machine states */
 enum {
 	INIT,
@@ -117,6 +128,7 @@ enum {
  * @send_state: TX state machine
  * @recv_state: RX state machine
  * @waketest: Flag to follow wake line test
+ * @aggr: Set when the CMT accepts aggregated transfers
  * @rxid: RX data id
  * @txid: TX data id
  * @txqueue_len: TX queue length
@@ -128,6 +140,8 @@ enum {
  * @nb: CMT reset notification block
  * @cmt: Reference to the CMT device
  * @txqueue: TX data queue
+ * @rxqueue: RX packets waiting for the NAPI poll
+ * @napi: NAPI context for the Phonet netdev
  * @cmdqueue: Queue of free commands
  * @cl: HSI client own reference
  * @link: Link for ssip_list
@@ -138,6 +152,7 @@ struct ssi_protocol {
 	unsigned int		send_state;
 	unsigned int		recv_state;
 	unsigned int		waketest:1;
+	unsigned int		aggr:1;
 	u8			rxid;
 	u8			txid;
 	unsigned int		txqueue_len;
@@ -149,6 +164,8 @@ struct ssi_protocol {
 	struct notifier_block	nb;
 	struct cmt_device	*cmt;
 	struct list_head	txqueue;
+	struct sk_buff_head	rxqueue;
+	struct napi_struct	napi;
 	struct list_head	cmdqueue;
 	struct hsi_client	*cl;
 	struct list_head	link;
@@ -159,6 +176,7 @@ struct ssi_protocol {
 static LIST_HEAD(ssip_list);
 
 static void ssip_rxcmd_complete(struct hsi_msg *msg);
+static void ssip_tx_data_complete(struct hsi_msg *msg);
 
 static inline void ssip_set_cmd(struct hsi_msg *msg, u32 cmd)
 {
@@ -177,6 +195,11 @@ static inline u32 ssip_get_cmd(struct hsi_msg *msg)
 	return *data;
 }
 
+static inline u32 ssip_local_caps(void)
+{
+	return (aggr_max > 1) ? SSIP_CAP_AGGR : 0;
+}
+
 static void ssip_skb_to_msg(struct sk_buff *skb, struct hsi_msg *msg)
 {
 	skb_frag_t *frag;
@@ -418,6 +441,7 @@ static void ssip_reset(struct hsi_client *cl)
 	ssi->send_state = 0;
 	ssi->recv_state = 0;
 	ssi->waketest = 0;
+	ssi->aggr = 0;
 	ssi->rxid = 0;
 	ssi->txid = 0;
 	list_for_each_safe(head, tmp, &ssi->txqueue) {
@@ -442,6 +466,7 @@ static void ssip_dump_state(struct hsi_client *cl)
 	dev_err(&cl->device, "CMT %s\n", (ssi->main_state == ACTIVE) ?
 							"Online" : "Offline");
 	dev_err(&cl->device, "Wake test %d\n", ssi->waketest);
+	dev_err(&cl->device, "Aggregation %d\n", ssi->aggr);
 	dev_err(&cl->device, "Data RX id: %d\n", ssi->rxid);
 	dev_err(&cl->device, "Data TX id: %d\n", ssi->txid);
 
@@ -553,11 +578,72 @@ static void ssip_strans_complete(struct hsi_msg *msg)
 	hsi_async_write(cl, data);
 }
 
+/*
+ * Pack dmsg and the packets queued after it into one transfer. Each packet
+ * is preceded by a 32-bit word holding its length in bytes and padded to
+ * 32 bits. Returns NULL if there is nothing to aggregate or no memory, in
+ * which case dmsg is sent alone.
+ * Must be called with ssi->lock held.
+ */
+static struct hsi_msg *ssip_aggregate(struct ssi_protocol *ssi,
+							struct hsi_msg *dmsg)
+{
+	struct sk_buff *skb = dmsg->context;
+	struct sk_buff *aggr;
+	struct hsi_msg *msg, *tmp;
+	unsigned int len = SSIP_AGGR_HDR_LEN + ALIGN(skb->len, 4);
+	unsigned int plen;
+	unsigned int n = 1;
+	u8 *p;
+
+	list_for_each_entry(msg, &ssi->txqueue, link) {
+		skb = msg->context;
+		plen = SSIP_AGGR_HDR_LEN + ALIGN(skb->len, 4);
+		if ((n >= aggr_max) || (len + plen > SSIP_AGGR_MAX_LEN))
+			break;
+		len += plen;
+		n++;
+	}
+	if (n == 1)
+		return NULL;
+	aggr = alloc_skb(len, GFP_ATOMIC);
+	if (!aggr)
+		return NULL;
+	skb_put(aggr, len);
+	msg = ssip_alloc_data(aggr, GFP_ATOMIC);
+	if (!msg) {
+		dev_kfree_skb(aggr);
+		return NULL;
+	}
+	msg->complete = ssip_tx_data_complete;
+
+	p = aggr->data;
+	list_add(&dmsg->link, &ssi->txqueue);
+	ssi->txqueue_len++;
+	list_for_each_entry_safe(dmsg, tmp, &ssi->txqueue, link) {
+		if (!n--)
+			break;
+		skb = dmsg->context;
+		plen = ALIGN(skb->len, 4);
+		*(u32 *)p = skb->len;
+		p += SSIP_AGGR_HDR_LEN;
+		skb_copy_bits(skb, 0, p, skb->len);
+		memset(p + skb->len, 0, plen - skb->len);
+		p += plen;
+		list_del(&dmsg->link);
+		ssi->txqueue_len--;
+		ssip_free_data(dmsg);
+	}
+
+	return msg;
+}
+
 static int ssip_xmit(struct hsi_client *cl)
 {
 	struct ssi_protocol *ssi = hsi_client_drvdata(cl);
-	struct hsi_msg *msg, *dmsg;
+	struct hsi_msg *msg, *dmsg, *amsg = NULL;
 	struct sk_buff *skb;
+	u32 cmd;
 
 	spin_lock_bh(&ssi->lock);
 	if (list_empty(&ssi->txqueue)) {
@@ -567,6 +653,10 @@ static int ssip_xmit(struct hsi_client *cl)
 	dmsg = list_first_entry(&ssi->txqueue, struct hsi_msg, link);
 	list_del(&dmsg->link);
 	ssi->txqueue_len--;
+	if (ssi->aggr && !list_empty(&ssi->txqueue))
+		amsg = ssip_aggregate(ssi, dmsg);
+	if (amsg)
+		dmsg = amsg;
 	spin_unlock_bh(&ssi->lock);
 
 	msg = ssip_claim_cmd(ssi);
@@ -576,8 +666,10 @@ static int ssip_xmit(struct hsi_client *cl)
 	msg->destructor = ssip_free_strans;
 
 	spin_lock_bh(&ssi->lock);
-	ssip_set_cmd(msg, SSIP_START_TRANS_CMD(SSIP_BYTES_TO_FRAMES(skb->len),
-								ssi->txid));
+	cmd = SSIP_START_TRANS_CMD(SSIP_BYTES_TO_FRAMES(skb->len), ssi->txid);
+	if (amsg)
+		cmd |= SSIP_AGGR;
+	ssip_set_cmd(msg, cmd);
 	ssi->txid++;
 	ssip_set_txstate(ssi, SENDING);
 	spin_unlock_bh(&ssi->lock);
@@ -588,7 +680,7 @@ static int ssip_xmit(struct hsi_client *cl)
 	return hsi_async_write(cl, msg);
 }
 
-/* In soft IRQ context */
+/* In NAPI poll context */
 static void ssip_pn_rx(struct sk_buff *skb)
 {
 	struct net_device *dev = skb->dev;
@@ -616,7 +708,39 @@ static void ssip_pn_rx(struct sk_buff *skb)
 	skb->protocol = htons(ETH_P_PHONET);
 	skb_reset_mac_header(skb);
 	__skb_pull(skb, 1);
-	netif_rx(skb);
+	netif_receive_skb(skb);
+}
+
+static int ssip_pn_poll(struct napi_struct *napi, int budget)
+{
+	struct ssi_protocol *ssi = container_of(napi, struct ssi_protocol,
+									napi);
+	struct sk_buff *skb;
+	int done = 0;
+
+	while (done < budget) {
+		skb = skb_dequeue(&ssi->rxqueue);
+		if (!skb)
+			break;
+		ssip_pn_rx(skb);
+		done++;
+	}
+	if (done < budget) {
+		napi_complete(napi);
+		/* Catch packets queued after the queue was found empty */
+		if (!skb_queue_empty(&ssi->rxqueue))
+			napi_schedule(napi);
+	}
+
+	return done;
+}
+
+/* Hand a received packet to the NAPI poll. In soft IRQ context */
+static inline void ssip_rx_queue(struct ssi_protocol *ssi,
+							struct sk_buff *skb)
+{
+	skb_queue_tail(&ssi->rxqueue, skb);
+	napi_schedule(&ssi->napi);
 }
 
 static void ssip_rx_data_complete(struct hsi_msg *msg)
@@ -633,10 +757,59 @@ static void ssip_rx_data_complete(struct hsi_msg *msg)
 	}
 	del_timer(&ssi->rx_wd); /* FIXME: Revisit */
 	skb = msg->context;
-	ssip_pn_rx(skb);
+	ssip_rx_queue(ssi, skb);
 	hsi_free_msg(msg);
 }
 
+/* Split an aggregated transfer back into packets (see ssip_aggregate) */
+static void ssip_rx_aggr_complete(struct hsi_msg *msg)
+{
+	struct hsi_client *cl = msg->cl;
+	struct ssi_protocol *ssi = hsi_client_drvdata(cl);
+	struct net_device *dev = ssi->netdev;
+	struct sk_buff *skb, *pskb;
+	unsigned int left, len;
+	u8 *p;
+
+	if (msg->status == HSI_STATUS_ERROR) {
+		dev_err(&cl->device, "RX data error\n");
+		ssip_free_data(msg);
+		ssip_error(cl);
+		return;
+	}
+	del_timer(&ssi->rx_wd); /* FIXME: Revisit */
+	skb = msg->context;
+	p = skb->data;
+	left = skb->len;
+	while (left > SSIP_AGGR_HDR_LEN) {
+		len = *(u32 *)p;
+		p += SSIP_AGGR_HDR_LEN;
+		left -= SSIP_AGGR_HDR_LEN;
+		if (!len)
+			break; /* Padding */
+		if (len > left) {
+			dev_dbg(&cl->device, "Bad aggregated length %u\n", len);
+			dev->stats.rx_errors++;
+			dev->stats.rx_length_errors++;
+			break;
+		}
+		pskb = netdev_alloc_skb(dev, len);
+		if (unlikely(!pskb)) {
+			dev->stats.rx_dropped++;
+		} else {
+			pskb->dev = dev;
+			memcpy(skb_put(pskb, len), p, len);
+			ssip_rx_queue(ssi, pskb);
+		}
+		len = ALIGN(len, 4);
+		if (len >= left)
+			break;
+		p += len;
+		left -= len;
+	}
+	ssip_free_data(msg);
+}
+
 static void ssip_rx_bootinforeq(struct hsi_client *cl, u32 cmd)
 {
 	struct ssi_protocol *ssi = hsi_client_drvdata(cl);
@@ -655,6 +828,7 @@ static void ssip_rx_bootinforeq(struct hsi_client *cl, u32 cmd)
 	case HANDSHAKE:
 		spin_lock(&ssi->lock);
 		ssi->main_state = HANDSHAKE;
+		ssi->aggr = !!(SSIP_DATA_CAPS(cmd) & SSIP_CAP_AGGR);
 		if (!ssi->waketest) {
 			ssi->waketest = 1;
 			ssi_waketest(cl, 1); /* FIXME: To be removed */
@@ -666,7 +840,8 @@ static void ssip_rx_bootinforeq(struct hsi_client *cl, u32 cmd)
 		if (SSIP_DATA_VERSION(cmd) != SSIP_LOCAL_VERID)
 			dev_warn(&cl->device, "boot info req verid mismatch\n");
 		msg = ssip_claim_cmd(ssi);
-		ssip_set_cmd(msg, SSIP_BOOTINFO_RESP_CMD(SSIP_LOCAL_VERID));
+		ssip_set_cmd(msg, SSIP_BOOTINFO_RESP_CMD(SSIP_LOCAL_VERID,
+							ssip_local_caps()));
 		msg->complete = ssip_release_cmd;
 		hsi_async_write(cl, msg);
 		break;
@@ -684,10 +859,11 @@ static void ssip_rx_bootinforesp(struct hsi_client *cl, u32 cmd)
 		dev_warn(&cl->device, "boot info resp verid mismatch\n");
 
 	spin_lock(&ssi->lock);
-	if (ssi->main_state != ACTIVE)
+	if (ssi->main_state != ACTIVE) {
+		ssi->aggr = !!(SSIP_DATA_CAPS(cmd) & SSIP_CAP_AGGR);
 		/* Use tx_wd as a boot watchdog in non ACTIVE state */
 		mod_timer(&ssi->tx_wd, jiffies + msecs_to_jiffies(SSIP_WDTOUT));
-	else
+	} else
 		dev_dbg(&cl->device, "boot info resp ignored M(%d)\n",
 							ssi->main_state);
 	spin_unlock(&ssi->lock);
@@ -781,7 +957,10 @@ static void ssip_rx_strans(struct hsi_client *cl, u32 cmd)
 		dev_err(&cl->device, "No memory for RX data msg\n");
 		goto out2;
 	}
-	msg->complete = ssip_rx_data_complete;
+	if (cmd & SSIP_AGGR)
+		msg->complete = ssip_rx_aggr_complete;
+	else
+		msg->complete = ssip_rx_data_complete;
 	hsi_async_read(cl, msg);
 
 	return;
@@ -894,6 +1073,7 @@ static int ssip_pn_open(struct net_device *dev)
 	}
 	dev_dbg(&cl->device, "Configuring SSI port\n");
 	hsi_setup(cl);
+	napi_enable(&ssi->napi);
 	spin_lock_bh(&ssi->lock);
 	if (!ssi->waketest) {
 		ssi->waketest = 1;
@@ -903,7 +1083,8 @@ static int ssip_pn_open(struct net_device *dev)
 	spin_unlock_bh(&ssi->lock);
 	dev_dbg(&cl->device, "Issuing BOOT INFO REQ command\n");
 	msg = ssip_claim_cmd(ssi);
-	ssip_set_cmd(msg, SSIP_BOOTINFO_REQ_CMD(SSIP_LOCAL_VERID));
+	ssip_set_cmd(msg, SSIP_BOOTINFO_REQ_CMD(SSIP_LOCAL_VERID,
+							ssip_local_caps()));
 	msg->complete = ssip_release_cmd;
 	hsi_async_write(cl, msg);
 	dev_dbg(&cl->device, "Issuing RX command\n");
@@ -919,6 +1100,8 @@ static int ssip_pn_open(struct net_device *dev)
 	return err;
 out:
 	ssip_reset(cl);
+	napi_disable(&ssi->napi);
+	skb_queue_purge(&ssi->rxqueue);
 	hsi_release_port(cl);
 
 	return err;
@@ -931,6 +1114,8 @@ static int ssip_pn_stop(struct net_device *dev)
 
 	cmt_notifier_unregister(ssi->cmt, &ssi->nb);
 	ssip_reset(cl);
+	napi_disable(&ssi->napi);
+	skb_queue_purge(&ssi->rxqueue);
 	hsi_release_port(cl);
 
 	return 0;
@@ -945,15 +1130,41 @@ static int ssip_pn_set_mtu(struct net_device *dev, int new_mtu)
 	return 0;
 }
 
+/*
+ * Fragments are handed to the controller as they are, so every piece must
+ * start on and cover whole 32-bit frames.
+ */
+static int ssip_skb_sg_ok(struct sk_buff *skb)
+{
+	int i;
+
+	if (((unsigned long)skb->data | skb_headlen(skb)) & 3)
+		return 0;
+	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
+		skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+
+		if ((frag->page_offset | frag->size) & 3)
+			return 0;
+	}
+
+	return 1;
+}
+
 static int ssip_pn_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct hsi_client *cl = to_hsi_client(dev->dev.parent);
 	struct ssi_protocol *ssi = hsi_client_drvdata(cl);
 	struct hsi_msg *msg;
+	unsigned int len;
 
 	if ((skb->protocol != htons(ETH_P_PHONET)) ||
 					(skb->len < SSIP_MIN_PN_HDR))
 		goto drop;
+	if (unlikely(!pskb_may_pull(skb, SSIP_MIN_PN_HDR)))
+		goto drop;
+	if (skb_is_nonlinear(skb) && !ssip_skb_sg_ok(skb) &&
+							skb_linearize(skb))
+		goto drop;
 	/* Pad to 32-bits - FIXME: Revisit*/
 	if ((skb->len & 3) && skb_pad(skb, 4 - (skb->len & 3))) {
 		dev->stats.tx_dropped++;
@@ -975,6 +1186,8 @@ static int ssip_pn_xmit(struct sk_buff *skb, struct net_device *dev)
 		goto drop;
 	}
 	msg->complete = ssip_tx_data_complete;
+	/* Once queued, the skb may be aggregated and freed on another CPU */
+	len = skb->len;
 
 	spin_lock_bh(&ssi->lock);
 	if (unlikely(ssi->main_state != ACTIVE)) {
@@ -1003,7 +1216,7 @@ static int ssip_pn_xmit(struct sk_buff *skb, struct net_device *dev)
 		spin_unlock_bh(&ssi->lock);
 	}
 	dev->stats.tx_packets++;
-	dev->stats.tx_bytes += skb->len;
+	dev->stats.tx_bytes += len;
 
 	return 0;
 drop2:
@@ -1039,7 +1252,7 @@ static const struct net_device_ops ssip_pn_ops = {
 
 static void ssip_pn_setup(struct net_device *dev)
 {
-	dev->features		= 0;
+	dev->features		= NETIF_F_SG;
 	dev->netdev_ops		= &ssip_pn_ops;
 	dev->type		= ARPHRD_PHONET;
 	dev->flags		= IFF_POINTOPOINT | IFF_NOARP;
@@ -1076,6 +1289,7 @@ static int __init ssi_protocol_probe(struct device *dev)
 	ssi->keep_alive.data = (unsigned long)cl;
 	ssi->keep_alive.function = ssip_keep_alive;
 	INIT_LIST_HEAD(&ssi->txqueue);
+	skb_queue_head_init(&ssi->rxqueue);
 	INIT_LIST_HEAD(&ssi->cmdqueue);
 	ssi->nb.notifier_call = ssip_cmt_event;
 	ssi->nb.priority = INT_MAX;
@@ -1094,6 +1308,7 @@ static int __init ssi_protocol_probe(struct device *dev)
 		goto out1;
 	}
 	SET_NETDEV_DEV(ssi->netdev, dev);
+	netif_napi_add(ssi->netdev, &ssi->napi, ssip_pn_poll, SSIP_NAPI_WEIGHT);
 	netif_carrier_off(ssi->netdev);
 	err = register_netdev(ssi->netdev);
 	if (err < 0) {
@@ -0,0 +1,740 @@
+/*
+ * hsi_loopback.c
+ *
+ * Implements a software HSI controller with two ports looped back to
+ * each other, so HSI clients can be exercised without any hardware.
+ *
+ * Copyright (C) 2010 Nokia Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+#include <linux/compiler.h>
+#include <linux/err.h>
+#include <linux/device.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/scatterlist.h>
+#include <linux/interrupt.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/spinlock.h>
+#include <linux/debugfs.h>
+#include <linux/hsi/hsi.h>
+
+#define HSI_LB_NUM_PORTS	2
+#define HSI_LB_MODE_SLEEP	0
+#define HSI_LB_BUDGET		64
+#define HSI_LB_MAX_CLIENTS	4
+#define HSI_LB_NAME_SIZE	32
+#define HSI_LB_BYTES_TO_FRAMES(x) ((((x) - 1) >> 2) + 1)
+
+static int hsi_id = 1;
+module_param(hsi_id, int, S_IRUGO);
+MODULE_PARM_DESC(hsi_id, "HSI controller id used to match board info");
+
+static unsigned int channels = HSI_MAX_CHANNELS;
+module_param(channels, uint, S_IRUGO);
+MODULE_PARM_DESC(channels, "Number of channels per port (1..16)");
+
+static unsigned int frame_rate;
+module_param(frame_rate, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(frame_rate, "Link speed in frames/s (0 = unlimited)");
+
+static unsigned int error_rate;
+module_param(error_rate, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(error_rate, "Fail every Nth received message (0 = never)");
+
+static int strict_wake;
+module_param(strict_wake, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(strict_wake, "Only transmit while the TX wake line is high");
+
+static char *clients[HSI_LB_MAX_CLIENTS];
+static unsigned int num_clients;
+module_param_array(clients, charp, &num_clients, S_IRUGO);
+MODULE_PARM_DESC(clients, "Clients to create, as name:port[,name:port...]");
+
+/**
+ * struct hsi_lb_port - Loopback port data
+ * @port: HSI port
+ * @peer: The port receiving what this port transmits
+ * @txqueue: TX message queues
+ * @rxqueue: RX message queues
+ * @brkqueue: Queue of incoming break frame requests
+ * @done: Messages completed by the frame in flight
+ * @tx_mode: Current TX mode (SLEEP, STREAM or FRAME)
+ * @rx_mode: Current RX mode (SLEEP, STREAM or FRAME)
+ * @tx_channels: Number of TX channels configured
+ * @rx_channels: Number of RX channels configured
+ * @next_ch: Next TX channel to serve (round-robin arbitration)
+ * @wk_refcount: Reference count for the output wake line
+ * @wake: Output wake line state as last seen by the peer
+ * @busy: Set while the frame timer paces the link
+ * @brk: Set when a break frame is waiting to reach the peer
+ * @timer: Frame timer
+ * @tx_tasklet: Bottom half moving data from this port to the peer
+ * @wake_tasklet: Bottom half signalling wake line changes to the peer
+ * @tx_bytes: Bytes transmitted
+ * @tx_msgs: TX messages completed
+ * @rx_msgs: RX messages completed
+ * @rx_errors: RX messages failed by error injection
+ */
+struct hsi_lb_port {
+	struct hsi_port		*port;
+	struct hsi_lb_port	*peer;
+	struct list_head	txqueue[HSI_MAX_CHANNELS];
+	struct list_head	rxqueue[HSI_MAX_CHANNELS];
+	struct list_head	brkqueue;
+	struct list_head	done;
+	unsigned int		tx_mode;
+	unsigned int		rx_mode;
+	unsigned int		tx_channels;
+	unsigned int		rx_channels;
+	unsigned int		next_ch;
+	int			wk_refcount;
+	unsigned int		wake:1;
+	unsigned int		busy:1;
+	unsigned int		brk:1;
+	struct tasklet_hrtimer	timer;
+	struct tasklet_struct	tx_tasklet;
+	struct tasklet_struct	wake_tasklet;
+	u64			tx_bytes;
+	u32			tx_msgs;
+	u32			rx_msgs;
+	u32			rx_errors;
+};
+
+/**
+ * struct hsi_lb_controller - Loopback controller data
+ * @lock: Serialize access to both ports; data crosses between them
+ * @port: Ports of the controller
+ * @dir: Debugfs root directory
+ */
+struct hsi_lb_controller {
+	spinlock_t		lock;
+	struct hsi_lb_port	port[HSI_LB_NUM_PORTS];
+#ifdef CONFIG_DEBUG_FS
+	struct dentry		*dir;
+#endif
+};
+
+static struct hsi_controller *hsi_lb;
+
+static inline struct hsi_lb_controller *hsi_lb_ctrl(
+						struct hsi_lb_port *lb_port)
+{
+	return hsi_controller_drvdata(
+			to_hsi_controller(lb_port->port->device.parent));
+}
+
+/*
+ * Return the address of the next byte to transfer in msg and how many
+ * contiguous bytes follow it, or NULL if msg has no room left.
+ */
+static void *hsi_lb_msg_ptr(struct hsi_msg *msg, unsigned int *len)
+{
+	struct scatterlist *sg;
+	unsigned int offset = msg->actual_len;
+	unsigned int i;
+
+	for_each_sg(msg->sgt.sgl, sg, msg->sgt.nents, i) {
+		if (offset < sg->length) {
+			*len = sg->length - offset;
+			return sg_virt(sg) + offset;
+		}
+		offset -= sg->length;
+	}
+	*len = 0;
+
+	return NULL;
+}
+
+static unsigned int hsi_lb_copy(struct hsi_msg *tx, struct hsi_msg *rx)
+{
+	unsigned int copied = 0;
+	unsigned int txlen, rxlen, len;
+	void *src, *dst;
+
+	for (;;) {
+		src = hsi_lb_msg_ptr(tx, &txlen);
+		dst = hsi_lb_msg_ptr(rx, &rxlen);
+		if (!src || !dst)
+			break;
+		len = min(txlen, rxlen);
+		memcpy(dst, src, len);
+		tx->actual_len += len;
+		rx->actual_len += len;
+		copied += len;
+	}
+
+	return copied;
+}
+
+/*
+ * Move data from the head of one TX channel of tx_port into the matching
+ * RX channel of its peer. Finished messages are moved to done.
+ * Returns the number of bytes moved or -ENODATA if there was nothing to do.
+ */
+static int hsi_lb_move(struct hsi_lb_port *tx_port, struct list_head *done)
+{
+	struct hsi_lb_port *rx_port = tx_port->peer;
+	struct hsi_msg *tx, *rx;
+	unsigned int n = min(tx_port->tx_channels, rx_port->rx_channels);
+	unsigned int i, ch, len, left;
+
+	if ((tx_port->tx_mode == HSI_LB_MODE_SLEEP) ||
+		(rx_port->rx_mode == HSI_LB_MODE_SLEEP))
+		return -ENODATA;
+	if (strict_wake && !tx_port->wk_refcount)
+		return -ENODATA;
+
+	for (i = 0; i < n; i++) {
+		ch = (tx_port->next_ch + i) % n;
+		if (list_empty(&tx_port->txqueue[ch]) ||
+			list_empty(&rx_port->rxqueue[ch]))
+			continue;
+		tx = list_first_entry(&tx_port->txqueue[ch], struct hsi_msg,
+									link);
+		rx = list_first_entry(&rx_port->rxqueue[ch], struct hsi_msg,
+									link);
+		tx_port->next_ch = ch + 1;
+		/* Read without buffers: only signal that data is available */
+		if (!rx->sgt.nents) {
+			rx->status = HSI_STATUS_COMPLETED;
+			list_move_tail(&rx->link, done);
+			return 0;
+		}
+		tx->status = HSI_STATUS_PROCEEDING;
+		rx->status = HSI_STATUS_PROCEEDING;
+		len = hsi_lb_copy(tx, rx);
+		tx_port->tx_bytes += len;
+		if (!hsi_lb_msg_ptr(tx, &left)) {
+			tx->status = HSI_STATUS_COMPLETED;
+			list_move_tail(&tx->link, done);
+			tx_port->tx_msgs++;
+		}
+		if (!hsi_lb_msg_ptr(rx, &left)) {
+			rx_port->rx_msgs++;
+			if (error_rate && !(rx_port->rx_msgs % error_rate)) {
+				rx->status = HSI_STATUS_ERROR;
+				rx_port->rx_errors++;
+			} else {
+				rx->status = HSI_STATUS_COMPLETED;
+			}
+			list_move_tail(&rx->link, done);
+		}
+		return len;
+	}
+
+	return -ENODATA;
+}
+
+static void hsi_lb_complete(struct list_head *done)
+{
+	struct hsi_msg *msg, *tmp;
+
+	list_for_each_entry_safe(msg, tmp, done, link) {
+		list_del(&msg->link);
+		msg->complete(msg);
+	}
+}
+
+static void hsi_lb_tx_tasklet(unsigned long data)
+{
+	struct hsi_lb_port *tx_port = (struct hsi_lb_port *)data;
+	struct hsi_lb_controller *lb = hsi_lb_ctrl(tx_port);
+	unsigned int budget;
+	unsigned int rate;
+	struct hsi_msg *msg;
+	LIST_HEAD(done);
+	u64 ns;
+	int len;
+
+	spin_lock(&lb->lock);
+	if (tx_port->brk) {
+		tx_port->brk = 0;
+		list_for_each_entry(msg, &tx_port->peer->brkqueue, link)
+			msg->status = HSI_STATUS_COMPLETED;
+		list_splice_tail_init(&tx_port->peer->brkqueue, &done);
+	}
+	for (budget = HSI_LB_BUDGET; budget && !tx_port->busy; budget--) {
+		rate = frame_rate;
+		if (!rate) {
+			if (hsi_lb_move(tx_port, &done) < 0)
+				break;
+			continue;
+		}
+		/* Completions are held back until the frames are "sent" */
+		len = hsi_lb_move(tx_port, &tx_port->done);
+		if (len < 0)
+			break;
+		/* Nothing went on the wire (data available read): no pacing */
+		if (!len) {
+			list_splice_tail_init(&tx_port->done, &done);
+			continue;
+		}
+		ns = (u64)HSI_LB_BYTES_TO_FRAMES(len) * NSEC_PER_SEC;
+		ns = div_u64(ns, rate);
+		tx_port->busy = 1;
+		tasklet_hrtimer_start(&tx_port->timer, ns_to_ktime(ns),
+							HRTIMER_MODE_REL);
+	}
+	if (!budget)
+		tasklet_schedule(&tx_port->tx_tasklet);
+	spin_unlock(&lb->lock);
+
+	hsi_lb_complete(&done);
+}
+
+static enum hrtimer_restart hsi_lb_timer(struct hrtimer *timer)
+{
+	struct hsi_lb_port *tx_port = container_of(timer, struct hsi_lb_port,
+								timer.timer);
+	struct hsi_lb_controller *lb = hsi_lb_ctrl(tx_port);
+	LIST_HEAD(done);
+
+	spin_lock(&lb->lock);
+	tx_port->busy = 0;
+	list_splice_tail_init(&tx_port->done, &done);
+	spin_unlock(&lb->lock);
+
+	hsi_lb_complete(&done);
+	tasklet_schedule(&tx_port->tx_tasklet);
+
+	return HRTIMER_NORESTART;
+}
+
+static void hsi_lb_wake_tasklet(unsigned long data)
+{
+	struct hsi_lb_port *lb_port = (struct hsi_lb_port *)data;
+	struct hsi_lb_controller *lb = hsi_lb_ctrl(lb_port);
+	unsigned int wake;
+	int changed;
+
+	spin_lock(&lb->lock);
+	wake = !!lb_port->wk_refcount;
+	changed = (wake != lb_port->wake);
+	lb_port->wake = wake;
+	spin_unlock(&lb->lock);
+
+	if (!changed)
+		return;
+	dev_dbg(&lb_port->port->device, "Wake out %s\n", wake ? "high" : "low");
+	hsi_event(lb_port->peer->port,
+			wake ? HSI_EVENT_START_RX : HSI_EVENT_STOP_RX);
+}
+
+static int hsi_lb_async_break(struct hsi_msg *msg)
+{
+	struct hsi_port *port = hsi_get_port(msg->cl);
+	struct hsi_lb_port *lb_port = hsi_port_drvdata(port);
+	struct hsi_lb_controller *lb = hsi_lb_ctrl(lb_port);
+	int err = 0;
+
+	spin_lock_bh(&lb->lock);
+	if (msg->ttype == HSI_MSG_WRITE) {
+		if (lb_port->tx_mode != HSI_MODE_FRAME) {
+			err = -EINVAL;
+			goto out;
+		}
+		lb_port->brk = 1;
+		tasklet_schedule(&lb_port->tx_tasklet);
+		spin_unlock_bh(&lb->lock);
+		msg->status = HSI_STATUS_COMPLETED;
+		msg->complete(msg);
+		return 0;
+	}
+	if (lb_port->rx_mode != HSI_MODE_FRAME) {
+		err = -EINVAL;
+		goto out;
+	}
+	msg->status = HSI_STATUS_PROCEEDING;
+	list_add_tail(&msg->link, &lb_port->brkqueue);
+out:
+	spin_unlock_bh(&lb->lock);
+
+	return err;
+}
+
+static int hsi_lb_async(struct hsi_msg *msg)
+{
+	struct hsi_port *port = hsi_get_port(msg->cl);
+	struct hsi_lb_port *lb_port = hsi_port_drvdata(port);
+	struct hsi_lb_controller *lb = hsi_lb_ctrl(lb_port);
+	struct tasklet_struct *tasklet;
+	struct list_head *queue;
+
+	if (msg->break_frame)
+		return hsi_lb_async_break(msg);
+
+	spin_lock_bh(&lb->lock);
+	if (msg->ttype) {
+		if (msg->channel >= lb_port->tx_channels)
+			goto err;
+		queue = &lb_port->txqueue[msg->channel];
+		tasklet = &lb_port->tx_tasklet;
+	} else {
+		if (msg->channel >= lb_port->rx_channels)
+			goto err;
+		queue = &lb_port->rxqueue[msg->channel];
+		tasklet = &lb_port->peer->tx_tasklet;
+	}
+	msg->status = HSI_STATUS_QUEUED;
+	msg->actual_len = 0;
+	list_add_tail(&msg->link, queue);
+	tasklet_schedule(tasklet);
+	spin_unlock_bh(&lb->lock);
+	dev_dbg(&port->device, "msg status %d ttype %d ch %d\n",
+				msg->status, msg->ttype, msg->channel);
+
+	return 0;
+err:
+	spin_unlock_bh(&lb->lock);
+	dev_err(&port->device, "Invalid channel %d\n", msg->channel);
+
+	return -EINVAL;
+}
+
+/*
+ * Destroy the messages in queue that belong to cl, or to any client of
+ * port if cl is NULL.
+ */
+static void hsi_lb_flush_queue(struct list_head *queue, struct hsi_port *port,
+							struct hsi_client *cl)
+{
+	struct hsi_msg *msg, *tmp;
+
+	list_for_each_entry_safe(msg, tmp, queue, link) {
+		if ((cl) && (cl != msg->cl))
+			continue;
+		if ((!cl) && (port != hsi_get_port(msg->cl)))
+			continue;
+		list_del(&msg->link);
+		if (msg->destructor)
+			msg->destructor(msg);
+		else
+			hsi_free_msg(msg);
+	}
+}
+
+static void hsi_lb_flush_queues(struct hsi_lb_port *lb_port,
+							struct hsi_client *cl)
+{
+	struct hsi_port *port = lb_port->port;
+	unsigned int i;
+
+	for (i = 0; i < HSI_MAX_CHANNELS; i++) {
+		hsi_lb_flush_queue(&lb_port->txqueue[i], port, cl);
+		hsi_lb_flush_queue(&lb_port->rxqueue[i], port, cl);
+	}
+	hsi_lb_flush_queue(&lb_port->brkqueue, port, cl);
+	/* Frames in flight in either direction may carry our messages */
+	hsi_lb_flush_queue(&lb_port->done, port, cl);
+	hsi_lb_flush_queue(&lb_port->peer->done, port, cl);
+}
+
+static int hsi_lb_setup(struct hsi_client *cl)
+{
+	struct hsi_port *port = hsi_get_port(cl);
+	struct hsi_lb_port *lb_port = hsi_port_drvdata(port);
+	struct hsi_lb_controller *lb = hsi_lb_ctrl(lb_port);
+
+	if ((cl->tx_cfg.channels > channels) ||
+		(cl->rx_cfg.channels > channels)) {
+		dev_err(&cl->device, "Invalid channels TX %d RX %d (max %d)\n",
+			cl->tx_cfg.channels, cl->rx_cfg.channels, channels);
+		return -EINVAL;
+	}
+	spin_lock_bh(&lb->lock);
+	/* Cleanup the break queue if we leave FRAME mode */
+	if ((lb_port->rx_mode == HSI_MODE_FRAME) &&
+		(cl->rx_cfg.mode != HSI_MODE_FRAME))
+		hsi_lb_flush_queue(&lb_port->brkqueue, port, cl);
+	lb_port->tx_mode = cl->tx_cfg.mode;
+	lb_port->tx_channels = cl->tx_cfg.channels;
+	lb_port->rx_mode = cl->rx_cfg.mode;
+	lb_port->rx_channels = cl->rx_cfg.channels;
+	lb_port->next_ch = 0;
+	tasklet_schedule(&lb_port->tx_tasklet);
+	tasklet_schedule(&lb_port->peer->tx_tasklet);
+	spin_unlock_bh(&lb->lock);
+
+	return 0;
+}
+
+static int hsi_lb_flush(struct hsi_client *cl)
+{
+	struct hsi_port *port = hsi_get_port(cl);
+	struct hsi_lb_port *lb_port = hsi_port_drvdata(port);
+	struct hsi_lb_controller *lb = hsi_lb_ctrl(lb_port);
+
+	spin_lock_bh(&lb->lock);
+	hsi_lb_flush_queues(lb_port, NULL);
+	hrtimer_try_to_cancel(&lb_port->timer.timer);
+	lb_port->busy = 0;
+	lb_port->brk = 0;
+	tasklet_schedule(&lb_port->peer->tx_tasklet);
+	spin_unlock_bh(&lb->lock);
+
+	return 0;
+}
+
+static int hsi_lb_release(struct hsi_client *cl)
+{
+	struct hsi_port *port = hsi_get_port(cl);
+	struct hsi_lb_port *lb_port = hsi_port_drvdata(port);
+	struct hsi_lb_controller *lb = hsi_lb_ctrl(lb_port);
+
+	spin_lock_bh(&lb->lock);
+	hsi_lb_flush_queues(lb_port, cl);
+	/* If it is the last client of the port, stop TX/RX */
+	if (port->claimed <= 1) {
+		WARN_ON(lb_port->wk_refcount != 0);
+		lb_port->wk_refcount = 0;
+		lb_port->tx_mode = HSI_LB_MODE_SLEEP;
+		lb_port->rx_mode = HSI_LB_MODE_SLEEP;
+		tasklet_schedule(&lb_port->wake_tasklet);
+	}
+	spin_unlock_bh(&lb->lock);
+
+	return 0;
+}
+
+static int hsi_lb_start_tx(struct hsi_client *cl)
+{
+	struct hsi_port *port = hsi_get_port(cl);
+	struct hsi_lb_port *lb_port = hsi_port_drvdata(port);
+	struct hsi_lb_controller *lb = hsi_lb_ctrl(lb_port);
+
+	dev_dbg(&port->device, "Wake out high %d\n", lb_port->wk_refcount);
+
+	spin_lock_bh(&lb->lock);
+	if (!lb_port->wk_refcount++) {
+		tasklet_schedule(&lb_port->wake_tasklet);
+		tasklet_schedule(&lb_port->tx_tasklet);
+	}
+	spin_unlock_bh(&lb->lock);
+
+	return 0;
+}
+
+static int hsi_lb_stop_tx(struct hsi_client *cl)
+{
+	struct hsi_port *port = hsi_get_port(cl);
+	struct hsi_lb_port *lb_port = hsi_port_drvdata(port);
+	struct hsi_lb_controller *lb = hsi_lb_ctrl(lb_port);
+
+	dev_dbg(&port->device, "Wake out low %d\n", lb_port->wk_refcount);
+
+	spin_lock_bh(&lb->lock);
+	BUG_ON(!lb_port->wk_refcount);
+	if (!--lb_port->wk_refcount)
+		tasklet_schedule(&lb_port->wake_tasklet);
+	spin_unlock_bh(&lb->lock);
+
+	return 0;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int __init hsi_lb_debug_add_ctrl(struct hsi_controller *hsi)
+{
+	struct hsi_lb_controller *lb = hsi_controller_drvdata(hsi);
+	struct hsi_lb_port *lb_port;
+	struct dentry *dir;
+	unsigned int i;
+
+	lb->dir = debugfs_create_dir(dev_name(&hsi->device), NULL);
+	if (IS_ERR(lb->dir))
+		return PTR_ERR(lb->dir);
+
+	for (i = 0; i < hsi->num_ports; i++) {
+		lb_port = &lb->port[i];
+		dir = debugfs_create_dir(dev_name(&lb_port->port->device),
+								lb->dir);
+		if (IS_ERR(dir)) {
+			debugfs_remove_recursive(lb->dir);
+			return PTR_ERR(dir);
+		}
+		debugfs_create_u64("tx_bytes", S_IRUGO, dir,
+						&lb_port->tx_bytes);
+		debugfs_create_u32("tx_msgs", S_IRUGO, dir, &lb_port->tx_msgs);
+		debugfs_create_u32("rx_msgs", S_IRUGO, dir, &lb_port->rx_msgs);
+		debugfs_create_u32("rx_errors", S_IRUGO, dir,
+						&lb_port->rx_errors);
+	}
+
+	return 0;
+}
+
+static void hsi_lb_debug_remove_ctrl(struct hsi_controller *hsi)
+{
+	struct hsi_lb_controller *lb = hsi_controller_drvdata(hsi);
+
+	debugfs_remove_recursive(lb->dir);
+}
+#endif /* CONFIG_DEBUG_FS */
+
+static void __init hsi_lb_ports_init(struct hsi_controller *hsi)
+{
+	struct hsi_lb_controller *lb = hsi_controller_drvdata(hsi);
+	struct hsi_lb_port *lb_port;
+	struct hsi_port *port;
+	unsigned int i, ch;
+
+	for (i = 0; i < hsi->num_ports; i++) {
+		port = &hsi->port[i];
+		lb_port = &lb->port[i];
+		port->async = hsi_lb_async;
+		port->setup = hsi_lb_setup;
+		port->flush = hsi_lb_flush;
+		port->start_tx = hsi_lb_start_tx;
+		port->stop_tx = hsi_lb_stop_tx;
+		port->release = hsi_lb_release;
+		hsi_port_set_drvdata(port, lb_port);
+		lb_port->port = port;
+		lb_port->peer = &lb->port[(i + 1) % HSI_LB_NUM_PORTS];
+		for (ch = 0; ch < HSI_MAX_CHANNELS; ch++) {
+			INIT_LIST_HEAD(&lb_port->txqueue[ch]);
+			INIT_LIST_HEAD(&lb_port->rxqueue[ch]);
+		}
+		INIT_LIST_HEAD(&lb_port->brkqueue);
+		INIT_LIST_HEAD(&lb_port->done);
+		tasklet_hrtimer_init(&lb_port->timer, hsi_lb_timer,
+					CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		tasklet_init(&lb_port->tx_tasklet, hsi_lb_tx_tasklet,
+						(unsigned long)lb_port);
+		tasklet_init(&lb_port->wake_tasklet, hsi_lb_wake_tasklet,
+						(unsigned long)lb_port);
+	}
+}
+
+static void hsi_lb_ports_exit(struct hsi_controller *hsi)
+{
+	struct hsi_lb_controller *lb = hsi_controller_drvdata(hsi);
+	struct hsi_lb_port *lb_port;
+	unsigned int i;
+
+	for (i = 0; i < hsi->num_ports; i++) {
+		lb_port = &lb->port[i];
+		tasklet_hrtimer_cancel(&lb_port->timer);
+		tasklet_kill(&lb_port->tx_tasklet);
+		tasklet_kill(&lb_port->wake_tasklet);
+	}
+}
+
+/*
+ * Create the clients given as "name:port" in the clients parameter,
+ * using the same defaults for all of them. Clients may change their
+ * configuration later through hsi_setup().
+ */
+static void __init hsi_lb_add_clients(struct hsi_controller *hsi)
+{
+	struct hsi_board_info info;
+	char name[HSI_LB_NAME_SIZE];
+	unsigned long num;
+	unsigned int i;
+	char *sep;
+
+	for (i = 0; i < num_clients; i++) {
+		memset(&info, 0, sizeof(info));
+		info.hsi_id = hsi->id;
+		info.tx_cfg.mode = HSI_MODE_FRAME;
+		info.tx_cfg.channels = channels;
+		info.tx_cfg.arb_mode = HSI_ARB_RR;
+		info.rx_cfg.mode = HSI_MODE_FRAME;
+		info.rx_cfg.channels = channels;
+		strlcpy(name, clients[i], sizeof(name));
+		sep = strchr(name, ':');
+		if (sep) {
+			*sep++ = '\0';
+			if (strict_strtoul(sep, 0, &num) < 0 ||
+						num >= hsi->num_ports) {
+				pr_err("hsi_loopback: bad client %s\n",
+								clients[i]);
+				continue;
+			}
+			info.port = num;
+		}
+		info.name = name;
+		hsi_new_client(&hsi->port[info.port], &info);
+	}
+}
+
+static int __init hsi_lb_init(void)
+{
+	struct hsi_lb_controller *lb;
+	int err;
+
+	if (!channels || channels > HSI_MAX_CHANNELS) {
+		pr_err("hsi_loopback: invalid number of channels %u\n",
+								channels);
+		return -EINVAL;
+	}
+	hsi_lb = hsi_alloc_controller(HSI_LB_NUM_PORTS, GFP_KERNEL);
+	if (!hsi_lb)
+		return -ENOMEM;
+	lb = kzalloc(sizeof(*lb), GFP_KERNEL);
+	if (!lb) {
+		err = -ENOMEM;
+		goto out1;
+	}
+	spin_lock_init(&lb->lock);
+	hsi_lb->id = hsi_id;
+	hsi_lb->owner = THIS_MODULE;
+	dev_set_name(&hsi_lb->device, "hsi_lb%d", hsi_lb->id);
+	hsi_controller_set_drvdata(hsi_lb, lb);
+	hsi_lb_ports_init(hsi_lb);
+	err = hsi_register_controller(hsi_lb);
+	if (err < 0)
+		goto out2;
+#ifdef CONFIG_DEBUG_FS
+	err = hsi_lb_debug_add_ctrl(hsi_lb);
+	if (err < 0) {
+		hsi_unregister_controller(hsi_lb);
+		goto out2;
+	}
+#endif
+	hsi_lb_add_clients(hsi_lb);
+	pr_info("HSI loopback controller loaded\n");
+
+	return 0;
+out2:
+	hsi_lb_ports_exit(hsi_lb);
+	kfree(lb);
+out1:
+	hsi_free_controller(hsi_lb);
+
+	return err;
+}
+module_init(hsi_lb_init);
+
+static void __exit hsi_lb_exit(void)
+{
+	struct hsi_lb_controller *lb = hsi_controller_drvdata(hsi_lb);
+
+#ifdef CONFIG_DEBUG_FS
+	hsi_lb_debug_remove_ctrl(hsi_lb);
+#endif
+	hsi_unregister_controller(hsi_lb);
+	hsi_lb_ports_exit(hsi_lb);
+	kfree(lb);
+	hsi_free_controller(hsi_lb);
+	pr_info("HSI loopback controller removed\n");
+}
+module_exit(hsi_lb_exit);
+
+MODULE_DESCRIPTION("HSI software loopback controller");
+MODULE_LICENSE("GPL v2");
@@ -63,10 +63,12 @@ struct ssi_clk_res {
  * struct gdd_trn - GDD transaction data
  * @msg: Pointer to the HSI message being served
  * @sg: Pointer to the current sg entry being served
+ * @left: Number of mapped sg entries still to serve after @sg
  */
 struct gdd_trn {
 	struct hsi_msg		*msg;
 	struct scatterlist	*sg;
+	unsigned int		left;
 };
 
 /**
@@ -659,6 +661,25 @@ static int ssi_claim_lch(struct hsi_msg *msg)
 	return -EBUSY;
 }
 
+/*
+ * Return the word to be transferred next by PIO, or NULL once all the
+ * entries of the scatterlist have been served.
+ */
+static u32 *ssi_pio_buf(struct hsi_msg *msg)
+{
+	struct scatterlist *sg;
+	unsigned int offset = msg->actual_len;
+	unsigned int i;
+
+	for_each_sg(msg->sgt.sgl, sg, msg->sgt.nents, i) {
+		if (offset < sg->length)
+			return sg_virt(sg) + offset;
+		offset -= sg->length;
+	}
+
+	return NULL;
+}
+
 static int ssi_start_pio(struct hsi_msg *msg)
 {
 	struct hsi_port *port = hsi_get_port(msg->cl);
@@ -731,6 +752,8 @@ static int ssi_start_dma(struct hsi_msg *msg, int lch)
 		d_addr = omap_port->sst_dma +
 					SSI_SST_BUFFER_CH_REG(msg->channel);
 	}
+	/* dma_map_sg() returns the number of mapped entries */
+	omap_ssi->gdd_trn[lch].left = err - 1;
 	dev_dbg(&ssi->device, "lch %d cdsp %08x ccr %04x s_addr %08x"
 			" d_addr %08x\n", lch, csdp, ccr, s_addr, d_addr);
 	ssi_clk_enable(ssi); /* Hold clocks during the transfer */
@@ -738,7 +761,7 @@ static int ssi_start_dma(struct hsi_msg *msg, int lch)
 	__raw_writew(SSI_BLOCK_IE | SSI_TOUT_IE, gdd + SSI_GDD_CICR_REG(lch));
 	__raw_writel(d_addr, gdd + SSI_GDD_CDSA_REG(lch));
 	__raw_writel(s_addr, gdd + SSI_GDD_CSSA_REG(lch));
-	__raw_writew(SSI_BYTES_TO_FRAMES(msg->sgt.sgl->length),
+	__raw_writew(SSI_BYTES_TO_FRAMES(sg_dma_len(msg->sgt.sgl)),
 						gdd + SSI_GDD_CEN_REG(lch));
 
 	spin_lock_bh(&omap_ssi->lock);
@@ -747,11 +770,35 @@ static int ssi_start_dma(struct hsi_msg *msg, int lch)
 	__raw_writel(tmp, omap_ssi->sys + SSI_GDD_MPU_IRQ_ENABLE_REG);
 	spin_unlock_bh(&omap_ssi->lock);
 	__raw_writew(ccr, gdd + SSI_GDD_CCR_REG(lch));
+	msg->actual_len = 0;
 	msg->status = HSI_STATUS_PROCEEDING;
 
 	return 0;
 }
 
+/* Chain the next sg entry of a multi-entry transfer on the same lch */
+static void ssi_gdd_next(struct omap_ssi_controller *omap_ssi,
+							unsigned int lch)
+{
+	struct gdd_trn *trn = &omap_ssi->gdd_trn[lch];
+	void __iomem *gdd = omap_ssi->gdd;
+	u16 ccr;
+
+	trn->msg->actual_len += sg_dma_len(trn->sg);
+	trn->sg = sg_next(trn->sg);
+	trn->left--;
+	if (trn->msg->ttype == HSI_MSG_READ)
+		__raw_writel(sg_dma_address(trn->sg),
+					gdd + SSI_GDD_CDSA_REG(lch));
+	else
+		__raw_writel(sg_dma_address(trn->sg),
+					gdd + SSI_GDD_CSSA_REG(lch));
+	__raw_writew(SSI_BYTES_TO_FRAMES(sg_dma_len(trn->sg)),
+						gdd + SSI_GDD_CEN_REG(lch));
+	ccr = __raw_readw(gdd + SSI_GDD_CCR_REG(lch));
+	__raw_writew(ccr | SSI_CCR_ENABLE, gdd + SSI_GDD_CCR_REG(lch));
+}
+
 static int ssi_start_transfer(struct list_head *queue)
 {
 	struct hsi_msg *msg;
@@ -762,7 +809,8 @@ static int ssi_start_transfer(struct list_head *queue)
 	msg = list_first_entry(queue, struct hsi_msg, link);
 	if (msg->status != HSI_STATUS_QUEUED)
 		return 0;
-	if ((msg->sgt.nents) && (msg->sgt.sgl->length > sizeof(u32)))
+	if ((msg->sgt.nents > 1) ||
+		((msg->sgt.nents) && (msg->sgt.sgl->length > sizeof(u32))))
 		lch = ssi_claim_lch(msg);
 	if (lch >= 0)
 		return ssi_start_dma(msg, lch);
@@ -911,13 +959,28 @@ static int ssi_clk_event(struct notifier_block *nb, unsigned long event,
  * FIXME: Horrible HACK needed until we remove the useless wakeline test
  * in the CMT. To be removed !!!!
  */
+static int ssi_async(struct hsi_msg *msg);
+
 void ssi_waketest(struct hsi_client *cl, unsigned int enable)
 {
 	struct hsi_port *port = hsi_get_port(cl);
-	struct omap_ssi_port *omap_port = hsi_port_drvdata(port);
+	struct omap_ssi_port *omap_port;
 	struct hsi_controller *ssi = to_hsi_controller(port->device.parent);
-	struct omap_ssi_controller *omap_ssi = hsi_controller_drvdata(ssi);
+	struct omap_ssi_controller *omap_ssi;
 
+	/*
+	 * Clients on other controllers (e.g. hsi_loopback) just get a wake.
+	 * The owner module cannot tell them apart when both are built in.
+	 */
+	if (port->async != ssi_async) {
+		if (enable)
+			port->start_tx(cl);
+		else
+			port->stop_tx(cl);
+		return;
+	}
+	omap_port = hsi_port_drvdata(port);
+	omap_ssi = hsi_controller_drvdata(ssi);
 	omap_port->wktest = !!enable;
 	if (omap_port->wktest) {
 		ssi_clk_enable(ssi);
@@ -1065,8 +1128,16 @@ static int ssi_async(struct hsi_msg *msg)
 
 	BUG_ON(!msg);
 
-	if (msg->sgt.nents > 1)
-		return -ENOSYS; /* TODO: Add sg support */
+	if (msg->sgt.nents > 1) {
+		struct scatterlist *sg;
+		unsigned int i;
+
+		/* GDD moves whole frames: only the last entry may be short */
+		for_each_sg(msg->sgt.sgl, sg, msg->sgt.nents, i)
+			if ((sg->offset & 3) || ((sg->length & 3) &&
+						(i < msg->sgt.nents - 1)))
+				return -EINVAL;
+	}
 
 	if (msg->break_frame)
 		return ssi_async_break(msg);
@@ -1437,7 +1508,7 @@ static void ssi_pio_complete(struct hsi_port *port, struct list_head *queue)
 	else
 		val = SSI_DATAAVAILABLE(msg->channel);
 	if (msg->status == HSI_STATUS_PROCEEDING) {
-		buf = sg_virt(msg->sgt.sgl) + msg->actual_len;
+		buf = ssi_pio_buf(msg);
 		if (msg->ttype == HSI_MSG_WRITE)
 			__raw_writel(*buf, omap_port->sst_base +
 					SSI_SST_BUFFER_CH_REG(msg->channel));
@@ -1447,7 +1518,7 @@ static void ssi_pio_complete(struct hsi_port *port, struct list_head *queue)
 		dev_dbg(&port->device, "ch %d ttype %d 0x%08x\n", msg->channel,
 							msg->ttype, *buf);
 		msg->actual_len += sizeof(*buf);
-		if (msg->actual_len >= msg->sgt.sgl->length)
+		if (!ssi_pio_buf(msg))
 			msg->status = HSI_STATUS_COMPLETED;
 		/*
 		 * Wait for the last written frame to be really sent before
@@ -1489,6 +1560,12 @@ static void ssi_gdd_complete(struct hsi_controller *ssi, unsigned int lch)
 
 	spin_lock(&omap_ssi->lock);
 
+	csr = __raw_readw(omap_ssi->gdd + SSI_GDD_CSR_REG(lch));
+	if (!(csr & SSI_CSR_TOUR) && omap_ssi->gdd_trn[lch].left) {
+		ssi_gdd_next(omap_ssi, lch);
+		spin_unlock(&omap_ssi->lock);
+		return;
+	}
 	val = __raw_readl(omap_ssi->sys + SSI_GDD_MPU_IRQ_ENABLE_REG);
 	val &= ~SSI_GDD_LCH(lch);
 	__raw_writel(val, omap_ssi->sys + SSI_GDD_MPU_IRQ_ENABLE_REG);
@@ -1503,7 +1580,7 @@ static void ssi_gdd_complete(struct hsi_controller *ssi, unsigned int lch)
 		/* Keep clocks reference for write pio event */
 	}
 	dma_unmap_sg(&ssi->device, msg->sgt.sgl, msg->sgt.nents, dir);
-	csr = __raw_readw(omap_ssi->gdd + SSI_GDD_CSR_REG(lch));
+	msg->actual_len += sg_dma_len(omap_ssi->gdd_trn[lch].sg);
 	omap_ssi->gdd_trn[lch].msg = NULL; /* release GDD lch */
 	dev_dbg(&port->device, "DMA completed ch %d ttype %d\n",
 				msg->channel, msg->ttype);
@@ -1523,7 +1600,6 @@ static void ssi_gdd_complete(struct hsi_controller *ssi, unsigned int lch)
 	spin_unlock(&omap_port->lock);
 
 	msg->status = HSI_STATUS_COMPLETED;
-	msg->actual_len = sg_dma_len(msg->sgt.sgl);
 }
 
 static void ssi_gdd_tasklet(unsigned long dev)
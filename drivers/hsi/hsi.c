@@ -79,14 +79,25 @@ static void hsi_client_release(struct device *dev)
 	kfree(to_hsi_client(dev));
 }
 
-static void hsi_new_client(struct hsi_port *port, struct hsi_board_info *info)
+/**
+ * hsi_new_client - Create a new HSI client on a port
+ * @port: The HSI port where the client sits
+ * @info: The board info describing the client
+ *
+ * Controllers call this for clients that are not declared in the board
+ * files, e.g. clients attached to a software controller.
+ *
+ * Return NULL on failure or a pointer to the new hsi_client on success.
+ */
+struct hsi_client *hsi_new_client(struct hsi_port *port,
+						struct hsi_board_info *info)
 {
 	struct hsi_client *cl;
 	unsigned long flags;
 
 	cl = kzalloc(sizeof(*cl), GFP_KERNEL);
 	if (!cl)
-		return;
+		return NULL;
 	cl->device.type = &hsi_cl;
 	cl->tx_cfg = info->tx_cfg;
 	cl->rx_cfg = info->rx_cfg;
@@ -102,9 +113,16 @@ static void hsi_new_client(struct hsi_port *port, struct hsi_board_info *info)
 		cl->device.archdata = *info->archdata;
 	if (device_register(&cl->device) < 0) {
 		pr_err("hsi: failed to register client: %s\n", info->name);
+		spin_lock_irqsave(&port->clock, flags);
+		list_del(&cl->link);
+		spin_unlock_irqrestore(&port->clock, flags);
 		kfree(cl);
+		return NULL;
 	}
+
+	return cl;
 }
+EXPORT_SYMBOL_GPL(hsi_new_client);
 
 static void hsi_scan_board_info(struct hsi_controller *hsi)
 {
@@ -430,6 +430,10 @@ static long hist_ioctl(struct v4l2_subdev *sd, unsigned int cmd, void *arg)
 		return omap3isp_stat_config(stat, arg);
 	case VIDIOC_OMAP3ISP_STAT_REQ:
 		return omap3isp_stat_request_statistics(stat, arg);
+	case VIDIOC_OMAP3ISP_STAT_DQBUF:
+		return omap3isp_stat_dqbuf(stat, arg);
+	case VIDIOC_OMAP3ISP_STAT_QBUF:
+		return omap3isp_stat_qbuf(stat, arg);
 	case VIDIOC_OMAP3ISP_STAT_EN: {
 		int *en = arg;
 		return omap3isp_stat_enable(stat, !!*en);
@@ -453,6 +457,7 @@ static const struct v4l2_subdev_core_ops hist_subdev_core_ops = {
 	.ioctl = hist_ioctl,
 	.subscribe_event = omap3isp_stat_subscribe_event,
 	.unsubscribe_event = omap3isp_stat_unsubscribe_event,
+	.mmap = omap3isp_stat_mmap,
 };
 
 static const struct v4l2_subdev_video_ops hist_subdev_video_ops = {
@@ -26,7 +26,9 @@
  */
 
 #include <linux/dma-mapping.h>
+#include <linux/mm.h>
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 
 #include "isp.h"
 
@@ -214,9 +216,10 @@ __isp_stat_buf_find(struct ispstat *stat, int look_empty)
 
 		/*
 		 * Don't select the buffer which is being copied to
-		 * userspace or used by the module.
+		 * userspace, owned by userspace or used by the module.
 		 */
-		if (curr == stat->locked_buf || curr == stat->active_buf)
+		if (curr == stat->locked_buf || curr == stat->active_buf ||
+		    curr->dequeued)
 			continue;
 
 		/* Don't select uninitialised buffers if it's not required */
@@ -377,6 +380,7 @@ static void isp_stat_bufs_free(struct ispstat *stat)
 		buf->dma_addr = 0;
 		buf->virt_addr = NULL;
 		buf->empty = 1;
+		buf->dequeued = 0;
 	}
 
 	dev_dbg(stat->isp->dev, "%s: all buffers were freed.\n",
@@ -384,6 +388,7 @@ static void isp_stat_bufs_free(struct ispstat *stat)
 
 	stat->buf_alloc_size = 0;
 	stat->active_buf = NULL;
+	stat->dequeued_bufs = 0;
 }
 
 static int isp_stat_bufs_alloc_iommu(struct ispstat *stat, unsigned int size)
@@ -482,6 +487,15 @@ static int isp_stat_bufs_alloc(struct ispstat *stat, u32 size)
 		return -EBUSY;
 	}
 
+	/* Buffers can't be reallocated while userspace has them mapped. */
+	if (atomic_read(&stat->mmap_count)) {
+		dev_dbg(stat->isp->dev,
+			"%s: trying to reallocate mapped buffers\n",
+			stat->subdev.name);
+		spin_unlock_irqrestore(&stat->isp->stat_lock, flags);
+		return -EBUSY;
+	}
+
 	spin_unlock_irqrestore(&stat->isp->stat_lock, flags);
 
 	isp_stat_bufs_free(stat);
@@ -546,6 +560,207 @@ int omap3isp_stat_request_statistics(struct ispstat *stat,
 	return 0;
 }
 
+/*
+ * omap3isp_stat_dqbuf - Dequeue the oldest statistics buffer.
+ * @b: Pointer to return the buffer information.
+ *
+ * The buffer is handed over to userspace, which accesses it in place through
+ * its mmap() mapping until it's given back with omap3isp_stat_qbuf(). This
+ * doesn't block, userspace is expected to wait for the statistics event
+ * before dequeuing a buffer.
+ *
+ * Returns 0 if successful, -EBUSY if no buffer is available.
+ */
+int omap3isp_stat_dqbuf(struct ispstat *stat, struct omap3isp_stat_buffer *b)
+{
+	struct ispstat_buffer *buf;
+	unsigned long flags;
+
+	if (stat->state != ISPSTAT_ENABLED) {
+		dev_dbg(stat->isp->dev, "%s: engine not enabled.\n",
+			stat->subdev.name);
+		return -EINVAL;
+	}
+
+	mutex_lock(&stat->ioctl_lock);
+	spin_lock_irqsave(&stat->isp->stat_lock, flags);
+
+	if (stat->dequeued_bufs >= STAT_MAX_DEQUEUED_BUFS) {
+		spin_unlock_irqrestore(&stat->isp->stat_lock, flags);
+		mutex_unlock(&stat->ioctl_lock);
+		return -EBUSY;
+	}
+
+	while (1) {
+		buf = isp_stat_buf_find_oldest(stat);
+		if (!buf) {
+			spin_unlock_irqrestore(&stat->isp->stat_lock, flags);
+			mutex_unlock(&stat->ioctl_lock);
+			return -EBUSY;
+		}
+		if (!isp_stat_buf_check_magic(stat, buf))
+			break;
+
+		dev_dbg(stat->isp->dev, "%s: current buffer has "
+			"corrupted data\n.", stat->subdev.name);
+		buf->empty = 1;
+	}
+
+	buf->dequeued = 1;
+	stat->dequeued_bufs++;
+
+	spin_unlock_irqrestore(&stat->isp->stat_lock, flags);
+
+	isp_stat_buf_sync_for_cpu(stat, buf);
+
+	b->ts = buf->ts;
+	b->index = buf - stat->buf;
+	b->length = PAGE_ALIGN(stat->buf_alloc_size);
+	b->offset = b->index * b->length;
+	b->buf_size = buf->buf_size;
+	b->sequence = buf->frame_number;
+	b->config_counter = buf->config_counter;
+	b->reserved = 0;
+
+	mutex_unlock(&stat->ioctl_lock);
+
+	return 0;
+}
+
+/*
+ * omap3isp_stat_qbuf - Give a dequeued statistics buffer back to the driver.
+ * @b: Buffer information, only the index is used.
+ *
+ * Returns 0 if successful, -EINVAL if the buffer isn't owned by userspace.
+ */
+int omap3isp_stat_qbuf(struct ispstat *stat, struct omap3isp_stat_buffer *b)
+{
+	struct ispstat_buffer *buf;
+	unsigned long flags;
+	int ret = 0;
+
+	if (b->index >= STAT_MAX_BUFS)
+		return -EINVAL;
+
+	buf = &stat->buf[b->index];
+
+	mutex_lock(&stat->ioctl_lock);
+
+	if (!buf->dequeued) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	isp_stat_buf_sync_for_device(stat, buf);
+
+	spin_lock_irqsave(&stat->isp->stat_lock, flags);
+	buf->empty = 1;
+	buf->dequeued = 0;
+	stat->dequeued_bufs--;
+	spin_unlock_irqrestore(&stat->isp->stat_lock, flags);
+
+out:
+	mutex_unlock(&stat->ioctl_lock);
+	return ret;
+}
+
+static void isp_stat_vm_open(struct vm_area_struct *vma)
+{
+	struct ispstat *stat = vma->vm_private_data;
+
+	atomic_inc(&stat->mmap_count);
+}
+
+static void isp_stat_vm_close(struct vm_area_struct *vma)
+{
+	struct ispstat *stat = vma->vm_private_data;
+
+	atomic_dec(&stat->mmap_count);
+}
+
+static const struct vm_operations_struct isp_stat_vm_ops = {
+	.open = isp_stat_vm_open,
+	.close = isp_stat_vm_close,
+};
+
+static int isp_stat_mmap_iommu(struct ispstat *stat,
+			       struct ispstat_buffer *buf,
+			       struct vm_area_struct *vma)
+{
+	unsigned long size = vma->vm_end - vma->vm_start;
+	unsigned long offset;
+	int ret;
+
+	for (offset = 0; offset < size; offset += PAGE_SIZE) {
+		struct page *page = vmalloc_to_page(buf->virt_addr + offset);
+
+		ret = vm_insert_page(vma, vma->vm_start + offset, page);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * omap3isp_stat_mmap - Map a statistics buffer to userspace.
+ *
+ * Buffers are mapped one at a time, at the offset reported by
+ * omap3isp_stat_dqbuf(). Mappings are read-only.
+ */
+int omap3isp_stat_mmap(struct v4l2_subdev *subdev, struct vm_area_struct *vma)
+{
+	struct ispstat *stat = v4l2_get_subdevdata(subdev);
+	unsigned long size = vma->vm_end - vma->vm_start;
+	struct ispstat_buffer *buf;
+	unsigned int buf_pages;
+	unsigned int index;
+	int ret;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EACCES;
+
+	mutex_lock(&stat->ioctl_lock);
+
+	buf_pages = PAGE_ALIGN(stat->buf_alloc_size) >> PAGE_SHIFT;
+	if (buf_pages == 0 || vma->vm_pgoff % buf_pages ||
+	    size > PAGE_ALIGN(stat->buf_alloc_size)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	index = vma->vm_pgoff / buf_pages;
+	if (index >= STAT_MAX_BUFS) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	buf = &stat->buf[index];
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_RESERVED;
+
+	if (IS_COHERENT_BUF(stat)) {
+		/* dma_mmap_coherent() interprets vm_pgoff itself. */
+		vma->vm_pgoff = 0;
+		ret = dma_mmap_coherent(stat->isp->dev, vma, buf->virt_addr,
+					buf->dma_addr, stat->buf_alloc_size);
+	} else {
+		ret = isp_stat_mmap_iommu(stat, buf, vma);
+	}
+
+	if (ret < 0)
+		goto out;
+
+	vma->vm_ops = &isp_stat_vm_ops;
+	vma->vm_private_data = stat;
+	isp_stat_vm_open(vma);
+
+out:
+	mutex_unlock(&stat->ioctl_lock);
+	return ret;
+}
+
 /*
  * omap3isp_stat_config - Receives new statistic engine configuration.
  * @new_conf: Pointer to config structure.
@@ -1080,6 +1295,7 @@ int omap3isp_stat_init(struct ispstat *stat, const char *name,
 	isp_stat_buf_clear(stat);
 	mutex_init(&stat->ioctl_lock);
 	atomic_set(&stat->buf_err, 0);
+	atomic_set(&stat->mmap_count, 0);
 
 	return isp_stat_init_entities(stat, name, sd_ops);
 }
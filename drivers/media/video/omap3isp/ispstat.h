@@ -38,6 +38,8 @@
 
 #define STAT_MAX_BUFS		5
 #define STAT_NEVENTS		8
+/* Keep at least one buffer for the module and one for the next frame. */
+#define STAT_MAX_DEQUEUED_BUFS	(STAT_MAX_BUFS - 2)
 
 #define STAT_BUF_DONE		0	/* Buffer is ready */
 #define STAT_NO_BUF		1	/* An error has occurred */
@@ -55,6 +57,7 @@ struct ispstat_buffer {
 	u32 frame_number;
 	u16 config_counter;
 	u8 empty;
+	u8 dequeued;
 };
 
 struct ispstat_ops {
@@ -126,6 +129,10 @@ struct ispstat {
 	struct ispstat_buffer *buf;
 	struct ispstat_buffer *active_buf;
 	struct ispstat_buffer *locked_buf;
+
+	/* Userspace access to buffers through mmap() */
+	atomic_t mmap_count;
+	unsigned int dequeued_bufs;
 };
 
 struct ispstat_generic_config {
@@ -142,6 +149,9 @@ struct ispstat_generic_config {
 int omap3isp_stat_config(struct ispstat *stat, void *new_conf);
 int omap3isp_stat_request_statistics(struct ispstat *stat,
 				     struct omap3isp_stat_data *data);
+int omap3isp_stat_dqbuf(struct ispstat *stat, struct omap3isp_stat_buffer *b);
+int omap3isp_stat_qbuf(struct ispstat *stat, struct omap3isp_stat_buffer *b);
+int omap3isp_stat_mmap(struct v4l2_subdev *subdev, struct vm_area_struct *vma);
 int omap3isp_stat_init(struct ispstat *stat, const char *name,
 		       const struct v4l2_subdev_ops *sd_ops);
 void omap3isp_stat_free(struct ispstat *stat);
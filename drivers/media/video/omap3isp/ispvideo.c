@@ -25,7 +25,9 @@
 
 #include <asm/cacheflush.h>
 #include <linux/clk.h>
+#include <linux/highmem.h>
 #include <linux/mm.h>
+#include <linux/moduleparam.h>
 #include <linux/pagemap.h>
 #include <linux/scatterlist.h>
 #include <linux/sched.h>
@@ -420,6 +422,117 @@ isp_video_check_format(struct isp_video *video, struct isp_video_fh *vfh)
 	return ret;
 }
 
+/* -----------------------------------------------------------------------------
+ * Software loopback
+ *
+ * When the loopback_fps module parameter is set, capture video nodes don't
+ * touch the ISP pipeline. Buffers are instead completed by a kernel timer at
+ * the requested frame rate, after being filled with a synthetic pattern. They
+ * still go through the video queue operations and the
+ * omap3isp_video_buffer_next() completion path, so the mode can be used to
+ * measure the video node overhead without a sensor.
+ */
+
+#ifdef CONFIG_VIDEO_OMAP3_LOOPBACK
+
+static unsigned int loopback_fps;
+module_param(loopback_fps, uint, S_IRUGO);
+MODULE_PARM_DESC(loopback_fps,
+		 "Synthetic capture frame rate (0 to use the ISP hardware)");
+
+static bool isp_video_is_loopback(struct isp_video *video)
+{
+	return loopback_fps && video->type == V4L2_BUF_TYPE_VIDEO_CAPTURE;
+}
+
+/*
+ * isp_video_loopback_fill - Fill a buffer with a synthetic frame
+ * @buf: Video buffer
+ * @pattern: Byte value to fill the buffer with
+ *
+ * The buffer is accessed through its scatter list, as userspace buffers have
+ * no kernel mapping. Write the data back to memory as the buffer has been
+ * mapped for device access.
+ */
+static void isp_video_loopback_fill(struct isp_video_buffer *buf, u8 pattern)
+{
+	unsigned int size = buf->vbuf.bytesused;
+	struct scatterlist *sg;
+	unsigned int i;
+
+	for_each_sg(buf->sglist, sg, buf->sglen, i) {
+		unsigned int len = min(size, sg->length);
+		void *mem;
+
+		if (len == 0)
+			break;
+
+		mem = kmap_atomic(sg_page(sg), KM_SOFTIRQ0) + sg->offset;
+		memset(mem, pattern, len);
+		dmac_flush_range(mem, mem + len);
+		kunmap_atomic(mem - sg->offset, KM_SOFTIRQ0);
+
+		size -= len;
+	}
+}
+
+static void isp_video_loopback_timer(unsigned long data)
+{
+	struct isp_video *video = (struct isp_video *)data;
+	struct isp_pipeline *pipe = to_isp_pipeline(&video->video.entity);
+	struct isp_video_buffer *buf = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&video->queue->irqlock, flags);
+	if (!list_empty(&video->dmaqueue))
+		buf = list_first_entry(&video->dmaqueue,
+				       struct isp_video_buffer, irqlist);
+	spin_unlock_irqrestore(&video->queue->irqlock, flags);
+
+	/* Frames are dropped when no buffer is available, as the hardware
+	 * would do.
+	 */
+	if (buf != NULL) {
+		isp_video_loopback_fill(buf,
+					atomic_read(&pipe->frame_number) + 1);
+		omap3isp_video_buffer_next(video);
+	}
+
+	mod_timer(&video->loopback_timer, jiffies + video->loopback_period);
+}
+
+static void isp_video_loopback_start(struct isp_video *video)
+{
+	video->loopback_period = max_t(unsigned long, HZ / loopback_fps, 1);
+	mod_timer(&video->loopback_timer, jiffies + video->loopback_period);
+}
+
+static void isp_video_loopback_stop(struct isp_video *video)
+{
+	del_timer_sync(&video->loopback_timer);
+	video->loopback_period = 0;
+}
+
+static void isp_video_loopback_init(struct isp_video *video)
+{
+	setup_timer(&video->loopback_timer, isp_video_loopback_timer,
+		    (unsigned long)video);
+	video->loopback_period = 0;
+}
+
+#else
+
+static inline bool isp_video_is_loopback(struct isp_video *video)
+{
+	return false;
+}
+
+static inline void isp_video_loopback_start(struct isp_video *video) { }
+static inline void isp_video_loopback_stop(struct isp_video *video) { }
+static inline void isp_video_loopback_init(struct isp_video *video) { }
+
+#endif /* CONFIG_VIDEO_OMAP3_LOOPBACK */
+
 /* -----------------------------------------------------------------------------
  * IOMMU management
  */
@@ -506,6 +619,14 @@ static int isp_video_buffer_prepare(struct isp_video_buffer *buf)
 	struct isp_video *video = vfh->video;
 	unsigned long addr;
 
+	/* Loopback buffers are filled by the CPU, don't map them in the ISP
+	 * MMU.
+	 */
+	if (isp_video_is_loopback(video)) {
+		buf->vbuf.bytesused = vfh->format.fmt.pix.sizeimage;
+		return 0;
+	}
+
 	addr = ispmmu_vmap(video->isp, buf->sglist, buf->sglen);
 	if (IS_ERR_VALUE(addr))
 		return -EIO;
@@ -545,6 +666,10 @@ static void isp_video_buffer_queue(struct isp_video_buffer *buf)
 	empty = list_empty(&video->dmaqueue);
 	list_add_tail(&buffer->buffer.irqlist, &video->dmaqueue);
 
+	/* The loopback timer picks buffers from the DMA queue by itself. */
+	if (isp_video_is_loopback(video))
+		return;
+
 	if (empty) {
 		if (video->type == V4L2_BUF_TYPE_VIDEO_CAPTURE)
 			state = ISP_PIPELINE_QUEUE_OUTPUT;
@@ -920,6 +1045,49 @@ isp_video_dqbuf(struct file *file, void *fh, struct v4l2_buffer *b)
 					  file->f_flags & O_NONBLOCK);
 }
 
+/*
+ * isp_video_streamon_loopback - Start streaming in software loopback mode
+ *
+ * The format configured on the file handle is used as-is, there's no
+ * connected subdev to validate it against. Must be called with the stream
+ * lock held.
+ */
+static int isp_video_streamon_loopback(struct isp_video *video,
+				       struct isp_video_fh *vfh,
+				       struct isp_pipeline *pipe)
+{
+	unsigned long flags;
+	int ret;
+
+	if (vfh->format.fmt.pix.sizeimage == 0)
+		return -EINVAL;
+
+	video->bpl_padding = 0;
+	video->bpl_value = vfh->format.fmt.pix.bytesperline;
+
+	pipe->input = NULL;
+	pipe->output = video;
+	pipe->entities = 0;
+	pipe->error = false;
+	pipe->do_propagation = false;
+
+	spin_lock_irqsave(&pipe->lock, flags);
+	pipe->state = ISP_PIPELINE_STREAM_OUTPUT | ISP_PIPELINE_IDLE_OUTPUT;
+	pipe->stream_state = ISP_PIPELINE_STREAM_CONTINUOUS;
+	spin_unlock_irqrestore(&pipe->lock, flags);
+
+	video->queue = &vfh->queue;
+	INIT_LIST_HEAD(&video->dmaqueue);
+	atomic_set(&pipe->frame_number, -1);
+
+	ret = omap3isp_video_queue_streamon(&vfh->queue);
+	if (ret < 0)
+		return ret;
+
+	isp_video_loopback_start(video);
+	return 0;
+}
+
 /*
  * Stream management
  *
@@ -979,6 +1147,11 @@ isp_video_streamon(struct file *file, void *fh, enum v4l2_buf_type type)
 	     ? to_isp_pipeline(&video->video.entity) : &video->pipe;
 	media_entity_pipeline_start(&video->video.entity, &pipe->pipe);
 
+	if (isp_video_is_loopback(video)) {
+		ret = isp_video_streamon_loopback(video, vfh, pipe);
+		goto error;
+	}
+
 	/* Verify that the currently configured format matches the output of
 	 * the connected subdev.
 	 */
@@ -1117,7 +1290,13 @@ isp_video_streamoff(struct file *file, void *fh, enum v4l2_buf_type type)
 	spin_unlock_irqrestore(&pipe->lock, flags);
 
 	/* Stop the stream. */
-	omap3isp_pipeline_set_stream(pipe, ISP_PIPELINE_STREAM_STOPPED);
+	if (isp_video_is_loopback(video)) {
+		isp_video_loopback_stop(video);
+		pipe->stream_state = ISP_PIPELINE_STREAM_STOPPED;
+	} else {
+		omap3isp_pipeline_set_stream(pipe,
+					     ISP_PIPELINE_STREAM_STOPPED);
+	}
 	omap3isp_video_queue_streamoff(&vfh->queue);
 	video->queue = NULL;
 	video->streaming = 0;
@@ -1313,6 +1492,7 @@ int omap3isp_video_init(struct isp_video *video, const char *name)
 
 	spin_lock_init(&video->pipe.lock);
 	mutex_init(&video->stream_lock);
+	isp_video_loopback_init(video);
 
 	/* Initialize the video device. */
 	if (video->ops == NULL)
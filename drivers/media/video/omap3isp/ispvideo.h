@@ -26,6 +26,7 @@
 #ifndef OMAP3_ISP_VIDEO_H
 #define OMAP3_ISP_VIDEO_H
 
+#include <linux/timer.h>
 #include <linux/v4l2-mediabus.h>
 #include <linux/version.h>
 #include <media/media-entity.h>
@@ -181,6 +182,12 @@ struct isp_video {
 	enum isp_video_dmaqueue_flags dmaqueue_flags;
 
 	const struct isp_video_operations *ops;
+
+#ifdef CONFIG_VIDEO_OMAP3_LOOPBACK
+	/* Software loopback mode */
+	struct timer_list loopback_timer;
+	unsigned long loopback_period;	/* in jiffies, 0 if disabled */
+#endif
 };
 
 #define to_isp_video(vdev)	container_of(vdev, struct isp_video, video)
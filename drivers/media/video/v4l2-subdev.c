@@ -294,12 +294,23 @@ static unsigned int subdev_poll(struct file *file, poll_table *wait)
 	return 0;
 }
 
+static int subdev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct video_device *vdev = video_devdata(file);
+	struct v4l2_subdev *sd = vdev_to_v4l2_subdev(vdev);
+	int ret;
+
+	ret = v4l2_subdev_call(sd, core, mmap, vma);
+	return ret == -ENOIOCTLCMD ? -ENODEV : ret;
+}
+
 const struct v4l2_file_operations v4l2_subdev_fops = {
 	.owner = THIS_MODULE,
 	.open = subdev_open,
 	.unlocked_ioctl = subdev_ioctl,
 	.release = subdev_close,
 	.poll = subdev_poll,
+	.mmap = subdev_mmap,
 };
 
 void v4l2_subdev_init(struct v4l2_subdev *sd, const struct v4l2_subdev_ops *ops)
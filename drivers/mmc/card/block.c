@@ -51,6 +51,20 @@ MODULE_ALIAS("mmc:block");
 
 static DECLARE_BITMAP(dev_use, MMC_NUM_MINORS);
 
+/*
+ * Writes smaller than this many sectors are gathered with the writes that
+ * directly follow them into one multi-block transfer.
+ */
+#define MMC_BLK_BATCH_SMALL	64
+
+/*
+ * How long an asynchronous small write may wait for followers when the
+ * queue has run dry. Synchronous writes never wait.
+ */
+static unsigned int write_batch_ms = 2;
+module_param(write_batch_ms, uint, 0644);
+MODULE_PARM_DESC(write_batch_ms, "Time to wait for writes to batch (ms)");
+
 /*
  * There is one mmc_blk_data per slot.
  */
@@ -61,6 +75,16 @@ struct mmc_blk_data {
 
 	unsigned int	usage;
 	unsigned int	read_only;
+
+	/* Write batching statistics, protected by lock */
+	unsigned long	writes;		/* write requests */
+	unsigned long	write_xfers;	/* write transfers issued */
+	unsigned long	batched;	/* writes merged into a transfer */
+	unsigned long	batch_errors;	/* batches redone one by one */
+
+	/* Data transfer statistics, protected by lock */
+	u64		bounce_bytes;	/* copied through the bounce buffer */
+	u64		direct_bytes;	/* mapped for the host directly */
 };
 
 static DEFINE_MUTEX(open_lock);
@@ -333,16 +357,211 @@ static void mmc_blk_issue_rw_rq_debug(struct request *req, u32 arg, u32 blocks)
 	}
 }
 
+/*
+ * Adjust the sg list so it is the same size as the data, which may have
+ * been cut short to the host's max_blk_count.
+ */
+static void mmc_blk_trim_sg(struct mmc_data *data, struct request *req)
+{
+	int i, data_size = data->blocks << 9;
+	struct scatterlist *sg;
+
+	if (data->blocks == blk_rq_sectors(req))
+		return;
+
+	for_each_sg(data->sg, sg, data->sg_len, i) {
+		data_size -= sg->length;
+		if (data_size <= 0) {
+			sg->length += data_size;
+			i++;
+			break;
+		}
+	}
+	data->sg_len = i;
+}
+
+/*
+ * Fetch the next request while the current one is on the bus and let the
+ * host map its data, so that dma_map_sg() and the cache maintenance that
+ * goes with it overlap the current transfer instead of following it.
+ */
+static void mmc_blk_prep_next(struct mmc_queue *mq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_data *data = &mq->next_data;
+	struct mmc_request mrq;
+	struct request *req = NULL;
+
+	if (!mq->next_sg || mq->next_req)
+		return;
+
+	spin_lock_irq(&md->lock);
+	if (!blk_queue_plugged(mq->queue))
+		req = blk_fetch_request(mq->queue);
+	mq->next_req = req;
+	spin_unlock_irq(&md->lock);
+
+	/* Small writes are left for mmc_blk_gather_writes() */
+	if (!req || blk_discard_rq(req) || mmc_blk_want_batch(mq, req))
+		return;
+
+	memset(data, 0, sizeof(struct mmc_data));
+	data->blksz = 512;
+	data->blocks = min(blk_rq_sectors(req), card->host->max_blk_count);
+	if (rq_data_dir(req) == READ)
+		data->flags = MMC_DATA_READ;
+	else
+		data->flags = MMC_DATA_WRITE;
+	data->sg = mq->next_sg;
+	data->sg_len = blk_rq_map_sg(mq->queue, req, mq->next_sg);
+	mmc_blk_trim_sg(data, req);
+
+	memset(&mrq, 0, sizeof(struct mmc_request));
+	mrq.data = data;
+	mmc_pre_req(card->host, &mrq, false);
+	mq->next_prepared = true;
+}
+
+static bool mmc_blk_can_batch(struct request *req)
+{
+	return blk_fs_request(req) && rq_data_dir(req) == WRITE &&
+	       !blk_discard_rq(req) && !blk_barrier_rq(req) &&
+	       !blk_fua_rq(req);
+}
+
+static bool mmc_blk_want_batch(struct mmc_queue *mq, struct request *req)
+{
+	return !mq->bounce_buf && mmc_blk_can_batch(req) &&
+	       blk_rq_sectors(req) < MMC_BLK_BATCH_SMALL;
+}
+
+/*
+ * Move the writes that continue @req from the head of the queue onto
+ * mq->batch, without crossing the queue's alignment boundary or the
+ * host's transfer limits. Returns the number of sectors in the batch,
+ * @req included.
+ */
+static unsigned int mmc_blk_gather_writes(struct mmc_queue *mq,
+					  struct request *req)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_host *host = mq->card->host;
+	struct request_queue *q = mq->queue;
+	unsigned int mask = q->limits.align_mask;
+	unsigned int sectors = blk_rq_sectors(req);
+	unsigned int segs = req->nr_phys_segments;
+	unsigned int max_sectors, max_segs;
+	struct request *next;
+	bool waited = false;
+
+	max_sectors = min(host->max_blk_count, host->max_req_size >> 9);
+	if (mask)
+		max_sectors = min(max_sectors,
+				  (mask + 1) - (blk_rq_pos(req) & mask));
+	max_segs = min_t(unsigned int, host->max_hw_segs, host->max_phys_segs);
+
+	for (;;) {
+		spin_lock_irq(&md->lock);
+		if (blk_queue_plugged(q))
+			blk_remove_plug(q);
+		while ((next = blk_peek_request(q)) != NULL) {
+			if (!mmc_blk_can_batch(next) ||
+			    blk_rq_pos(next) != blk_rq_pos(req) + sectors ||
+			    sectors + blk_rq_sectors(next) > max_sectors ||
+			    segs + next->nr_phys_segments > max_segs)
+				break;
+			blk_start_request(next);
+			list_add_tail(&next->queuelist, &mq->batch);
+			sectors += blk_rq_sectors(next);
+			segs += next->nr_phys_segments;
+		}
+		spin_unlock_irq(&md->lock);
+
+		if (next || waited || !write_batch_ms || rq_is_sync(req) ||
+		    sectors >= max_sectors)
+			break;
+
+		schedule_timeout_uninterruptible(
+				msecs_to_jiffies(write_batch_ms));
+		waited = true;
+	}
+
+	return sectors;
+}
+
+/*
+ * Map the request and the writes batched with it into one sg list.
+ */
+static unsigned int mmc_blk_map_batch(struct mmc_queue *mq)
+{
+	struct request *rq;
+	unsigned int sg_len;
+
+	sg_len = blk_rq_map_sg(mq->queue, mq->req, mq->sg);
+	list_for_each_entry(rq, &mq->batch, queuelist) {
+		sg_unmark_end(&mq->sg[sg_len - 1]);
+		sg_len += blk_rq_map_sg(mq->queue, rq, mq->sg + sg_len);
+	}
+
+	return sg_len;
+}
+
+/*
+ * A batched transfer failed. Put the batched writes back at the head of
+ * the queue, ahead of a request fetched by mmc_blk_prep_next(), so that
+ * they are redone one by one in their original order.
+ */
+static void mmc_blk_requeue_batch(struct mmc_queue *mq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct request *rq;
+
+	if (mq->next_prepared) {
+		struct mmc_request mrq;
+
+		memset(&mrq, 0, sizeof(struct mmc_request));
+		mrq.data = &mq->next_data;
+		mmc_post_req(mq->card->host, &mrq, -EIO);
+		mq->next_prepared = false;
+	}
+
+	spin_lock_irq(&md->lock);
+	if (mq->next_req) {
+		blk_requeue_request(mq->queue, mq->next_req);
+		mq->next_req = NULL;
+	}
+	while (!list_empty(&mq->batch)) {
+		rq = list_entry(mq->batch.prev, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		blk_requeue_request(mq->queue, rq);
+	}
+	md->batch_errors++;
+	spin_unlock_irq(&md->lock);
+}
+
 static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 {
 	struct mmc_blk_data *md = mq->data;
 	struct mmc_card *card = md->queue.card;
 	struct mmc_blk_request brq;
 	int ret = 1, retrying = 0;
+	bool prepared = mq->next_prepared;
+	bool may_batch = !prepared && mmc_blk_want_batch(mq, req);
+	bool batched = false;
+
+	mq->next_prepared = false;
+
+	if (rq_data_dir(req) == WRITE) {
+		spin_lock_irq(&md->lock);
+		md->writes++;
+		spin_unlock_irq(&md->lock);
+	}
 
 	mmc_claim_host(card->host);
 
 	do {
+		DECLARE_COMPLETION_ONSTACK(complete);
 		struct mmc_command cmd;
 		u32 readcmd, writecmd, status = 0;
 		unsigned int blocks;
@@ -378,6 +597,15 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 		if (blocks > card->host->max_blk_count)
 			blocks = card->host->max_blk_count;
 
+		if (may_batch) {
+			unsigned int sectors = mmc_blk_gather_writes(mq, req);
+
+			may_batch = false;
+			batched = !list_empty(&mq->batch);
+			if (batched)
+				blocks = sectors;
+		}
+
 		brq.data.blocks = blocks;
 
 		if (brq.data.blocks > 1) {
@@ -405,33 +633,38 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 
 		mmc_set_data_timeout(&brq.data, card);
 
-		brq.data.sg = mq->sg;
-		brq.data.sg_len = mmc_queue_map_sg(mq);
-
-		/*
-		 * Adjust the sg list so it is the same size as the
-		 * request.
-		 */
-		if (brq.data.blocks != blk_rq_sectors(req)) {
-			int i, data_size = brq.data.blocks << 9;
-			struct scatterlist *sg;
-
-			for_each_sg(brq.data.sg, sg, brq.data.sg_len, i) {
-				data_size -= sg->length;
-				if (data_size <= 0) {
-					sg->length += data_size;
-					i++;
-					break;
-				}
-			}
-			brq.data.sg_len = i;
+		if (prepared) {
+			/* Mapped by mmc_blk_prep_next() */
+			brq.data.sg = mq->next_data.sg;
+			brq.data.sg_len = mq->next_data.sg_len;
+			brq.data.host_cookie = mq->next_data.host_cookie;
+			prepared = false;
+		} else if (batched) {
+			brq.data.sg = mq->sg;
+			brq.data.sg_len = mmc_blk_map_batch(mq);
+		} else {
+			brq.data.sg = mq->sg;
+			brq.data.sg_len = mmc_queue_map_sg(mq);
+			mmc_blk_trim_sg(&brq.data, req);
 		}
 
 		mmc_blk_issue_rw_rq_debug(req, brq.cmd.arg, brq.data.blocks);
 
 		mmc_queue_bounce_pre(mq);
 
-		mmc_wait_for_req(card->host, &brq.mrq);
+		spin_lock_irq(&md->lock);
+		if (rq_data_dir(req) == WRITE)
+			md->write_xfers++;
+		if (mq->bounce_used)
+			md->bounce_bytes += brq.data.blocks << 9;
+		else
+			md->direct_bytes += brq.data.blocks << 9;
+		spin_unlock_irq(&md->lock);
+
+		mmc_start_req(card->host, &brq.mrq, &complete);
+		mmc_blk_prep_next(mq);
+		wait_for_completion(&complete);
+		mmc_post_req(card->host, &brq.mrq, 0);
 
 		mmc_queue_bounce_post(mq);
 
@@ -509,6 +742,28 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 #endif
 		}
 
+		if (batched) {
+			struct request *rq, *tmp;
+
+			batched = false;
+			if (brq.cmd.error || brq.stop.error || brq.data.error) {
+				/* Redo this request on its own */
+				mmc_blk_requeue_batch(mq);
+				continue;
+			}
+
+			spin_lock_irq(&md->lock);
+			list_for_each_entry_safe(rq, tmp, &mq->batch,
+						 queuelist) {
+				list_del_init(&rq->queuelist);
+				__blk_end_request_all(rq, 0);
+				md->batched++;
+			}
+			ret = __blk_end_request(req, 0, blk_rq_bytes(req));
+			spin_unlock_irq(&md->lock);
+			continue;
+		}
+
 		if (brq.cmd.error || brq.stop.error || brq.data.error) {
 			if (!retrying)
 				goto cmd_err;
@@ -545,8 +800,14 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 	 * If the card is not SD, we can still ok written sectors
 	 * as reported by the controller (which might be less than
 	 * the real number of written sectors, but never more).
+	 *
+	 * Neither count can be split between the writes of a batch, so a
+	 * failed batch fails this request as a whole and puts the writes
+	 * batched with it back on the queue.
 	 */
-	if (mmc_card_sd(card)) {
+	if (!list_empty(&mq->batch)) {
+		mmc_blk_requeue_batch(mq);
+	} else if (mmc_card_sd(card)) {
 		u32 blocks;
 
 		blocks = mmc_sd_num_wr_blocks(card);
@@ -583,6 +844,41 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 	}
 }
 
+static ssize_t mmc_blk_write_batch_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct mmc_blk_data *md = dev_to_disk(dev)->private_data;
+	ssize_t len;
+
+	spin_lock_irq(&md->lock);
+	len = sprintf(buf, "writes %lu transfers %lu merged %lu errors %lu\n",
+		      md->writes, md->write_xfers, md->batched,
+		      md->batch_errors);
+	spin_unlock_irq(&md->lock);
+
+	return len;
+}
+
+static DEVICE_ATTR(write_batch, S_IRUGO, mmc_blk_write_batch_show, NULL);
+
+static ssize_t mmc_blk_bounce_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct mmc_blk_data *md = dev_to_disk(dev)->private_data;
+	ssize_t len;
+
+	spin_lock_irq(&md->lock);
+	len = sprintf(buf, "bounced %llu direct %llu\n",
+		      (unsigned long long)md->bounce_bytes,
+		      (unsigned long long)md->direct_bytes);
+	spin_unlock_irq(&md->lock);
+
+	return len;
+}
+
+static DEVICE_ATTR(bounce, S_IRUGO, mmc_blk_bounce_show, NULL);
+
 static inline int mmc_blk_readonly(struct mmc_card *card)
 {
 	return mmc_card_readonly(card) ||
@@ -730,6 +1026,13 @@ static int mmc_blk_probe(struct mmc_card *card)
 
 	mmc_set_drvdata(card, md);
 	add_disk(md->disk);
+
+	if (device_create_file(disk_to_dev(md->disk), &dev_attr_write_batch))
+		printk(KERN_WARNING "%s: failed to create write_batch\n",
+		       md->disk->disk_name);
+	if (device_create_file(disk_to_dev(md->disk), &dev_attr_bounce))
+		printk(KERN_WARNING "%s: failed to create bounce\n",
+		       md->disk->disk_name);
 	return 0;
 
  out:
@@ -744,6 +1047,10 @@ static void mmc_blk_remove(struct mmc_card *card)
 	struct mmc_blk_data *md = mmc_get_drvdata(card);
 
 	if (md) {
+		device_remove_file(disk_to_dev(md->disk),
+				   &dev_attr_write_batch);
+		device_remove_file(disk_to_dev(md->disk), &dev_attr_bounce);
+
 		/* Stop new requests from getting into the queue */
 		del_gendisk(md->disk);
 
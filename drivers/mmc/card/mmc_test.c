@@ -18,6 +18,7 @@
 #include <linux/scatterlist.h>
 #include <linux/swap.h>		/* For nr_free_buffer_pages() */
 #include <linux/list.h>
+#include <linux/completion.h>
 
 #include <linux/debugfs.h>
 #include <linux/uaccess.h>
@@ -1969,6 +1970,140 @@ static int mmc_test_large_seq_write_perf(struct mmc_test_card *test)
 	return mmc_test_large_seq_perf(test, 1);
 }
 
+/*
+ * One of the two requests kept in flight by the pipelined tests.
+ */
+struct mmc_test_async_req {
+	struct mmc_request mrq;
+	struct mmc_command cmd;
+	struct mmc_command stop;
+	struct mmc_data data;
+};
+
+/*
+ * Wait for a pipelined request and let the host release what it set up
+ * in pre_req().
+ */
+static int mmc_test_async_finish(struct mmc_test_card *test,
+				 struct mmc_test_async_req *areq,
+				 struct completion *done)
+{
+	int ret;
+
+	wait_for_completion(done);
+	mmc_test_wait_busy(test);
+	ret = mmc_test_check_result(test, &areq->mrq);
+	mmc_post_req(test->card->host, &areq->mrq, ret);
+
+	return ret;
+}
+
+/*
+ * Transfer cnt chunks of the mapped test area back to back, preparing
+ * each request with mmc_pre_req() while the previous one is on the bus.
+ * Both requests use the same scatterlist; the data is not checked.
+ */
+static int mmc_test_area_io_seq_async(struct mmc_test_card *test,
+				      unsigned int dev_addr, int write,
+				      unsigned int cnt)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_host *host = test->card->host;
+	struct mmc_test_async_req areq[2];
+	struct mmc_test_async_req *cur = NULL, *next;
+	DECLARE_COMPLETION_ONSTACK(done);
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < cnt; i++) {
+		next = &areq[i & 1];
+		memset(next, 0, sizeof(*next));
+		next->mrq.cmd = &next->cmd;
+		next->mrq.data = &next->data;
+		next->mrq.stop = &next->stop;
+		mmc_test_prepare_mrq(test, &next->mrq, t->sg, t->sg_len,
+				     dev_addr, t->blocks, 512, write);
+		mmc_pre_req(host, &next->mrq, !cur);
+
+		if (cur) {
+			ret = mmc_test_async_finish(test, cur, &done);
+			if (ret) {
+				mmc_post_req(host, &next->mrq, ret);
+				return ret;
+			}
+			INIT_COMPLETION(done);
+		}
+
+		mmc_start_req(host, &next->mrq, &done);
+		cur = next;
+		dev_addr += t->blocks;
+	}
+
+	if (cur)
+		return mmc_test_async_finish(test, cur, &done);
+
+	return 0;
+}
+
+static int mmc_test_seq_async_perf(struct mmc_test_card *test, int write,
+				   unsigned long sz)
+{
+	struct timespec ts1, ts2;
+	unsigned int cnt;
+	int ret;
+
+	if (write) {
+		ret = mmc_test_area_erase(test);
+		if (ret)
+			return ret;
+	}
+
+	ret = mmc_test_area_map(test, sz, 0);
+	if (ret)
+		return ret;
+
+	cnt = test->area.max_sz / sz;
+	getnstimeofday(&ts1);
+	ret = mmc_test_area_io_seq_async(test, test->area.dev_addr, write, cnt);
+	if (ret)
+		return ret;
+	getnstimeofday(&ts2);
+
+	mmc_test_print_avg_rate(test, sz, cnt, &ts1, &ts2);
+	return 0;
+}
+
+static int mmc_test_profile_seq_async_perf(struct mmc_test_card *test,
+					   int write)
+{
+	unsigned long sz;
+	int ret;
+
+	for (sz = 512; sz < test->area.max_tfr; sz <<= 1) {
+		ret = mmc_test_seq_async_perf(test, write, sz);
+		if (ret)
+			return ret;
+	}
+	sz = test->area.max_tfr;
+	return mmc_test_seq_async_perf(test, write, sz);
+}
+
+/*
+ * Pipelined consecutive read performance by transfer size.
+ */
+static int mmc_test_profile_seq_read_async_perf(struct mmc_test_card *test)
+{
+	return mmc_test_profile_seq_async_perf(test, 0);
+}
+
+/*
+ * Pipelined consecutive write performance by transfer size.
+ */
+static int mmc_test_profile_seq_write_async_perf(struct mmc_test_card *test)
+{
+	return mmc_test_profile_seq_async_perf(test, 1);
+}
+
 static const struct mmc_test_case mmc_test_cases[] = {
 	{
 		.name = "Basic write (no data verification)",
@@ -2236,6 +2371,20 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.cleanup = mmc_test_area_cleanup,
 	},
 
+	{
+		.name = "Pipelined read performance by transfer size",
+		.prepare = mmc_test_area_prepare_fill,
+		.run = mmc_test_profile_seq_read_async_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Pipelined write performance by transfer size",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_profile_seq_write_async_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
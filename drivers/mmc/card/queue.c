@@ -127,7 +127,18 @@ static int mmc_queue_thread(void *d)
 
 		spin_lock_irq(q->queue_lock);
 		set_current_state(TASK_INTERRUPTIBLE);
-		if (!blk_queue_plugged(q))
+		if (mq->next_req) {
+			/*
+			 * Fetched while the previous request was on the bus;
+			 * its data was mapped into next_sg.
+			 */
+			struct scatterlist *sg = mq->sg;
+
+			req = mq->next_req;
+			mq->next_req = NULL;
+			mq->sg = mq->next_sg;
+			mq->next_sg = sg;
+		} else if (!blk_queue_plugged(q))
 			req = blk_fetch_request(q);
 		mq->req = req;
 		spin_unlock_irq(q->queue_lock);
@@ -199,6 +210,7 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
 	mq->queue->queuedata = mq;
 	mq->queue->backing_dev_info.ra_pages = 512 >> (PAGE_CACHE_SHIFT - 10);
 	mq->req = NULL;
+	INIT_LIST_HEAD(&mq->batch);
 
 	blk_queue_prep_rq(mq->queue, mmc_prep_request);
 	blk_queue_ordered(mq->queue, QUEUE_ORDERED_DRAIN, NULL);
@@ -279,6 +291,21 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
 			goto cleanup_queue;
 		}
 		sg_init_table(mq->sg, host->max_phys_segs);
+
+		/*
+		 * Hosts that can map a request ahead of time get a second
+		 * sg list, so the next request can be prepared while the
+		 * current one is transferring.
+		 */
+		if (host->ops->pre_req) {
+			mq->next_sg = kmalloc(sizeof(struct scatterlist) *
+				host->max_phys_segs, GFP_KERNEL);
+			if (!mq->next_sg) {
+				ret = -ENOMEM;
+				goto cleanup_queue;
+			}
+			sg_init_table(mq->next_sg, host->max_phys_segs);
+		}
 	}
 
 	if (is_power_of_2(queue_max_sectors(mq->queue)) &&
@@ -308,6 +335,8 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
  	if (mq->sg)
 		kfree(mq->sg);
 	mq->sg = NULL;
+	kfree(mq->next_sg);
+	mq->next_sg = NULL;
 	if (mq->bounce_buf)
 		kfree(mq->bounce_buf);
 	mq->bounce_buf = NULL;
@@ -339,6 +368,9 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 	kfree(mq->sg);
 	mq->sg = NULL;
 
+	kfree(mq->next_sg);
+	mq->next_sg = NULL;
+
 	if (mq->bounce_buf)
 		kfree(mq->bounce_buf);
 	mq->bounce_buf = NULL;
@@ -391,6 +423,25 @@ void mmc_queue_resume(struct mmc_queue *mq)
 	}
 }
 
+/*
+ * Can the host reach this segment without going through the bounce
+ * buffer? The queue bounce limit is lifted when a bounce buffer is in
+ * use, so check the host's DMA mask here.
+ */
+static int mmc_queue_sg_direct(struct mmc_queue *mq, struct scatterlist *sg)
+{
+	struct device *dev = mmc_dev(mq->card->host);
+
+	if (PageHighMem(sg_page(sg)))
+		return 0;
+
+	if (dev->dma_mask && *dev->dma_mask &&
+	    sg_phys(sg) + sg->length - 1 > *dev->dma_mask)
+		return 0;
+
+	return 1;
+}
+
 /*
  * Prepare the sg list(s) to be handed of to the host driver
  */
@@ -401,6 +452,8 @@ unsigned int mmc_queue_map_sg(struct mmc_queue *mq)
 	struct scatterlist *sg;
 	int i;
 
+	mq->bounce_used = 0;
+
 	if (!mq->bounce_buf)
 		return blk_rq_map_sg(mq->queue, mq->req, mq->sg);
 
@@ -410,6 +463,18 @@ unsigned int mmc_queue_map_sg(struct mmc_queue *mq)
 
 	mq->bounce_sg_len = sg_len;
 
+	/*
+	 * The host can only take one segment. If that is all the request
+	 * has, hand the segment over as is instead of copying it.
+	 */
+	if (sg_len == 1 && mmc_queue_sg_direct(mq, mq->bounce_sg)) {
+		sg_set_page(mq->sg, sg_page(mq->bounce_sg),
+			    mq->bounce_sg->length, mq->bounce_sg->offset);
+		return 1;
+	}
+
+	mq->bounce_used = 1;
+
 	buflen = 0;
 	for_each_sg(mq->bounce_sg, sg, sg_len, i)
 		buflen += sg->length;
@@ -427,7 +492,7 @@ void mmc_queue_bounce_pre(struct mmc_queue *mq)
 {
 	unsigned long flags;
 
-	if (!mq->bounce_buf)
+	if (!mq->bounce_used)
 		return;
 
 	if (rq_data_dir(mq->req) != WRITE)
@@ -447,7 +512,7 @@ void mmc_queue_bounce_post(struct mmc_queue *mq)
 {
 	unsigned long flags;
 
-	if (!mq->bounce_buf)
+	if (!mq->bounce_used)
 		return;
 
 	if (rq_data_dir(mq->req) != READ)
@@ -15,9 +15,15 @@ struct mmc_queue {
 	struct request_queue	*queue;
 	make_request_fn		*saved_make_request_fn;
 	struct scatterlist	*sg;
+	struct request		*next_req;	/* fetched during req */
+	struct scatterlist	*next_sg;	/* sg list of next_req */
+	struct mmc_data		next_data;	/* host-mapped next_req data */
+	bool			next_prepared;	/* next_data is valid */
+	struct list_head	batch;		/* writes sent along with req */
 	char			*bounce_buf;
 	struct scatterlist	*bounce_sg;
 	unsigned int		bounce_sg_len;
+	int			bounce_used;	/* req goes via bounce_buf */
 };
 
 extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *);
@@ -107,6 +107,11 @@
  *				to work correctly.  You should set it
  *				to true.
  *
+ *	num_buffers	Depth of the I/O buffer ring (anywhere from 2
+ *				to FSG_NUM_BUFFERS).  Zero selects
+ *				FSG_NUM_BUFFERS.  Each buffer takes
+ *				FSG_BUFLEN bytes of memory.
+ *
  * If "removable" is not set for a LUN then a backing file must be
  * specified.  If it is set, then NULL filename means the LUN's medium
  * is not loaded (an empty string as "filename" in the fsg_config
@@ -136,6 +141,8 @@
  *				USB device controller (usually true),
  *				boolean to permit the driver to halt
  *				bulk endpoints.
+ *	buffers=N	Default N = 0 (FSG_NUM_BUFFERS), depth of the
+ *				I/O buffer ring.
  *
  * The module parameters may be prefixed with some string.  You need
  * to consult gadget's documentation or source to verify whether it is
@@ -284,12 +291,14 @@
 #include <linux/kref.h>
 #include <linux/kthread.h>
 #include <linux/limits.h>
+#include <linux/pagemap.h>
 #include <linux/rwsem.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/string.h>
 #include <linux/freezer.h>
 #include <linux/utsname.h>
+#include <linux/writeback.h>
 
 #include <linux/usb/ch9.h>
 #include <linux/usb/gadget.h>
@@ -364,6 +373,7 @@ struct fsg_common {
 	struct fsg_buffhd	*next_buffhd_to_fill;
 	struct fsg_buffhd	*next_buffhd_to_drain;
 	struct fsg_buffhd	buffhds[FSG_NUM_BUFFERS];
+	unsigned int		num_buffers;
 
 	int			cmnd_size;
 	u8			cmnd[MAX_COMMAND_SIZE];
@@ -384,6 +394,15 @@ struct fsg_common {
 	u32			residue;
 	u32			usb_amount_left;
 
+	/*
+	 * Backing file range to read ahead or write back once the
+	 * status of the current command has been queued.
+	 */
+	struct fsg_lun		*bg_lun;
+	enum data_direction	bg_dir;
+	loff_t			bg_offset;
+	u32			bg_length;
+
 	unsigned int		can_stall:1;
 	unsigned int		free_storage_on_release:1;
 	unsigned int		phase_error:1;
@@ -432,6 +451,7 @@ struct fsg_config {
 	u16 release;
 
 	char			can_stall;
+	unsigned int		num_buffers;	/* 0 means FSG_NUM_BUFFERS */
 };
 
 struct fsg_dev {
@@ -851,8 +871,14 @@ static int do_read(struct fsg_common *common)
 			break;
 		}
 
-		if (amount_left == 0)
+		if (amount_left == 0) {
+			/* Guess that the host reads sequentially */
+			common->bg_lun = curlun;
+			common->bg_dir = DATA_DIR_TO_HOST;
+			common->bg_offset = file_offset;
+			common->bg_length = common->data_size_from_cmnd;
 			break;		/* No more left to read */
+		}
 
 		/* Send this buffer and go read some more */
 		bh->inreq->zero = 0;
@@ -1062,20 +1088,95 @@ static int do_write(struct fsg_common *common)
 			return rc;
 	}
 
+	/*
+	 * Unless FUA already forced the data out, start writing back
+	 * what we've got; SYNCHRONIZE CACHE will wait for it.
+	 */
+	if (file_offset > ((loff_t) lba) << 9 &&
+	    !(curlun->filp->f_flags & O_SYNC)) {
+		common->bg_lun = curlun;
+		common->bg_dir = DATA_DIR_FROM_HOST;
+		common->bg_offset = ((loff_t) lba) << 9;
+		common->bg_length = file_offset - common->bg_offset;
+	}
+
 	return -EIO;		/* No default reply */
 }
 
 
+/*-------------------------------------------------------------------------*/
+
+/*
+ * Kick off the readahead or write-behind set up by the last READ or
+ * WRITE.  This runs after the status has been queued, so the backing
+ * storage works while the host is busy sending the next command.
+ */
+static void start_background_io(struct fsg_common *common)
+{
+	struct fsg_lun		*curlun = common->bg_lun;
+	struct address_space	*mapping;
+	loff_t			offset = common->bg_offset;
+	u32			amount = common->bg_length;
+	pgoff_t			index, last;
+
+	common->bg_lun = NULL;
+	if (!curlun || amount == 0)
+		return;
+
+	down_read(&common->filesem);
+	if (!fsg_lun_is_open(curlun) || offset >= curlun->file_length)
+		goto out;
+	amount = min((loff_t)amount, curlun->file_length - offset);
+	mapping = curlun->filp->f_mapping;
+
+	if (common->bg_dir == DATA_DIR_TO_HOST) {
+		index = offset >> PAGE_CACHE_SHIFT;
+		last = (offset + amount - 1) >> PAGE_CACHE_SHIFT;
+		page_cache_sync_readahead(mapping, &curlun->filp->f_ra,
+					  curlun->filp, index,
+					  last - index + 1);
+		VLDBG(curlun, "readahead %u @ %llu\n", amount,
+		      (unsigned long long)offset);
+	} else {
+		__filemap_fdatawrite_range(mapping, offset,
+					   offset + amount - 1, WB_SYNC_NONE);
+		VLDBG(curlun, "write-behind %u @ %llu\n", amount,
+		      (unsigned long long)offset);
+	}
+out:
+	up_read(&common->filesem);
+}
+
+
 /*-------------------------------------------------------------------------*/
 
 static int do_synchronize_cache(struct fsg_common *common)
 {
 	struct fsg_lun	*curlun = common->curlun;
-	int		rc;
+	struct file	*filp = curlun->filp;
+	u32		lba, num_blocks;
+	loff_t		start, end;
+	int		rc = 0;
 
-	/* We ignore the requested LBA and write out all file's
-	 * dirty data buffers. */
-	rc = fsg_lun_fsync_sub(curlun);
+	lba = get_unaligned_be32(&common->cmnd[2]);
+	num_blocks = get_unaligned_be16(&common->cmnd[7]);
+	if (lba >= curlun->num_sectors) {
+		curlun->sense_data = SS_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
+		return -EINVAL;
+	}
+
+	/*
+	 * Wait for the write-behind started by earlier WRITEs on the
+	 * requested range (zero blocks means up to the end of the
+	 * medium) and flush the backing device's cache.
+	 */
+	start = ((loff_t) lba) << 9;
+	if (num_blocks == 0 || lba + (loff_t) num_blocks > curlun->num_sectors)
+		end = curlun->file_length - 1;
+	else
+		end = ((lba + (loff_t) num_blocks) << 9) - 1;
+	if (!curlun->ro)
+		rc = vfs_fsync_range(filp, filp->f_path.dentry, start, end, 1);
 	if (rc)
 		curlun->sense_data = SS_WRITE_ERROR;
 	return 0;
@@ -1997,6 +2098,7 @@ static int do_scsi_command(struct fsg_common *common)
 	}
 	common->phase_error = 0;
 	common->short_packet_received = 0;
+	common->bg_lun = NULL;
 
 	down_read(&common->filesem);	/* We're using the backing file */
 	switch (common->cmnd[0]) {
@@ -2398,7 +2500,7 @@ reset:
 	if (common->fsg) {
 		fsg = common->fsg;
 
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->num_buffers; ++i) {
 			struct fsg_buffhd *bh = &common->buffhds[i];
 
 			if (bh->inreq) {
@@ -2450,7 +2552,7 @@ reset:
 	clear_bit(IGNORE_BULK_OUT, &fsg->atomic_bitflags);
 
 	/* Allocate the requests */
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->num_buffers; ++i) {
 		struct fsg_buffhd	*bh = &common->buffhds[i];
 
 		rc = alloc_request(common, fsg->bulk_in, &bh->inreq);
@@ -2519,7 +2621,7 @@ static void handle_exception(struct fsg_common *common)
 
 	/* Cancel all the pending transfers */
 	if (likely(common->fsg)) {
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->num_buffers; ++i) {
 			bh = &common->buffhds[i];
 			if (bh->inreq_busy)
 				usb_ep_dequeue(common->fsg->bulk_in, bh->inreq);
@@ -2531,7 +2633,7 @@ static void handle_exception(struct fsg_common *common)
 		/* Wait until everything is idle */
 		for (;;) {
 			int num_active = 0;
-			for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+			for (i = 0; i < common->num_buffers; ++i) {
 				bh = &common->buffhds[i];
 				num_active += bh->inreq_busy + bh->outreq_busy;
 			}
@@ -2554,7 +2656,7 @@ static void handle_exception(struct fsg_common *common)
 	 */
 	spin_lock_irq(&common->lock);
 
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->num_buffers; ++i) {
 		bh = &common->buffhds[i];
 		bh->state = BUF_STATE_EMPTY;
 	}
@@ -2694,6 +2796,8 @@ static int fsg_main_thread(void *common_)
 		if (send_status(common))
 			continue;
 
+		start_background_io(common);
+
 		spin_lock_irq(&common->lock);
 		if (!exception_in_progress(common))
 			common->state = FSG_STATE_IDLE;
@@ -2857,8 +2961,10 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 	common->nluns = nluns;
 
 	/* Data buffers cyclic list */
+	common->num_buffers = clamp(cfg->num_buffers ?: FSG_NUM_BUFFERS,
+				    2u, (unsigned)FSG_NUM_BUFFERS);
 	bh = common->buffhds;
-	i = FSG_NUM_BUFFERS;
+	i = common->num_buffers;
 	goto buffhds_first_it;
 	do {
 		bh->next = bh + 1;
@@ -2984,10 +3090,11 @@ static void fsg_common_release(struct kref *ref)
 
 	{
 		struct fsg_buffhd *bh = common->buffhds;
-		unsigned i = FSG_NUM_BUFFERS;
-		do {
+		unsigned i = common->num_buffers;
+
+		/* In error recovery common->num_buffers may be zero. */
+		for (; i; --i, ++bh)
 			kfree(bh->buf);
-		} while (++bh, --i);
 	}
 
 	if (common->free_storage_on_release)
@@ -3136,6 +3243,7 @@ struct fsg_module_parameters {
 	unsigned int	nofua_count;
 	unsigned int	luns;	/* nluns */
 	int		stall;	/* can_stall */
+	unsigned int	buffers;	/* num_buffers */
 };
 
 #define _FSG_MODULE_PARAM_ARRAY(prefix, params, name, type, desc)	\
@@ -3163,7 +3271,9 @@ struct fsg_module_parameters {
 	_FSG_MODULE_PARAM(prefix, params, luns, uint,			\
 			  "number of LUNs");				\
 	_FSG_MODULE_PARAM(prefix, params, stall, bool,			\
-			  "false to prevent bulk stalls")
+			  "false to prevent bulk stalls");		\
+	_FSG_MODULE_PARAM(prefix, params, buffers, uint,		\
+			  "number of I/O buffers in the ring")
 
 static void
 fsg_config_from_params(struct fsg_config *cfg,
@@ -3199,6 +3309,7 @@ fsg_config_from_params(struct fsg_config *cfg,
 
 	/* Finalise */
 	cfg->can_stall = params->stall;
+	cfg->num_buffers = params->buffers;
 }
 
 static inline struct fsg_common *
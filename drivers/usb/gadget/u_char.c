@@ -24,6 +24,8 @@
 #include <linux/vmalloc.h>
 #include <linux/interrupt.h>
 #include <linux/kfifo.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
 #include "u_char.h"
 
 /* Max simultaneous gchar devices. Increase if you need more */
@@ -35,6 +37,9 @@
 /* size in bytes of RX and TX FIFOs */
 #define GC_BUF_SIZE		65536
 
+/* size in bytes of each USB request */
+#define GC_REQ_SIZE		PAGE_SIZE
+
 static unsigned max_devs = GC_MAX_DEVICES;
 module_param(max_devs, uint, 0);
 MODULE_PARM_DESC(max_devs, "Max number of devices to create. Default 4");
@@ -47,6 +52,10 @@ static unsigned buflen = GC_BUF_SIZE;
 module_param(buflen, uint, 0);
 MODULE_PARM_DESC(buflen, "kfifo buffer size. Default 65536");
 
+static unsigned req_len = GC_REQ_SIZE;
+module_param(req_len, uint, 0);
+MODULE_PARM_DESC(req_len, "Size of each USB request. Default PAGE_SIZE");
+
 enum gc_buf_state {
 	BUF_EMPTY = 0,
 	BUF_FULL,
@@ -107,8 +116,8 @@ static int gc_alloc_requests(struct usb_ep *ep, struct gc_buf *queue,
 	 * do quite that many this time, don't fail ... we just won't
 	 * be as speedy as we might otherwise be.
 	 */
-	for (i = 0; i < GC_QUEUE_SIZE; i++) {
-		req = gc_alloc_req(ep, PAGE_SIZE, GFP_ATOMIC);
+	for (i = 0; i < queue_size; i++) {
+		req = gc_alloc_req(ep, req_len, GFP_ATOMIC);
 		if (!req)
 			break;
 		req->complete = fn;
@@ -128,7 +137,7 @@ static void gc_free_requests(struct usb_ep *ep, struct gc_buf *queue)
 	struct usb_request      *req;
 	int i;
 
-	for (i = 0; i < GC_QUEUE_SIZE; i++) {
+	for (i = 0; i < queue_size; i++) {
 		req = queue[i].r;
 		if (!req)
 			break;
@@ -165,7 +174,7 @@ struct gc_dev {
 	struct tasklet_struct	rx_task;
 	wait_queue_head_t	rx_wait;	/* wait for data in RX buf */
 	unsigned int		rx_queued;	/* no. of queued requests */
-	struct gc_buf		rx_queue[GC_QUEUE_SIZE];
+	struct gc_buf		*rx_queue;	/* queue_size entries */
 	struct gc_buf		*rx_next;
 	bool			rx_cancel;
 
@@ -178,7 +187,7 @@ struct gc_dev {
 	int			tx_last_size;	/*last tx packet's size*/
 	struct tasklet_struct	tx_task;
 	struct tasklet_struct	tx_abort_task;
-	struct gc_buf		tx_queue[GC_QUEUE_SIZE];
+	struct gc_buf		*tx_queue;	/* queue_size entries */
 	unsigned int		tx_queued;
 	struct gc_buf		*tx_next;
 	bool			tx_cancel;
@@ -309,8 +318,8 @@ static int gc_do_tx(struct gc_dev *gc)
 			break;
 
 		req->zero = 0;
-		if (len > PAGE_SIZE) {
-			len = PAGE_SIZE;
+		if (len > req_len) {
+			len = req_len;
 			gc->tx_last_size = 0;	/* not the last packet */
 		} else {
 			/* this is last packet in TX buf. send ZLP/SLP
@@ -401,7 +410,7 @@ static void gc_tx_abort_task(unsigned long _gc)
 	}
 	
 	gc->tx_cancel = true;
-	for (i = 0 ; i < GC_QUEUE_SIZE ; i++) {
+	for (i = 0 ; i < queue_size ; i++) {
 		queue = &gc->tx_queue[i];
 		if (queue->busy) {
 			spin_unlock_irq(&gc->tx_lock);
@@ -442,7 +451,7 @@ static int gc_do_rx(struct gc_dev *gc)
 		int                     status;
 
 		req = queue->r;
-		req->length = PAGE_SIZE;
+		req->length = req_len;
 
 		/* check if space is available in RX buf for this request */
 		if (kfifo_avail(&gc->rx_fifo) <
@@ -574,6 +583,27 @@ static int gc_can_read(struct gc_dev *gc)
 	return ret;
 }
 
+/* Wait till there is some data in the RX buffer */
+static int gc_wait_rx_data(struct gc_dev *gc, bool nonblock)
+{
+	int ret;
+
+	if (kfifo_len(&gc->rx_fifo))
+		return 0;
+
+	/* if NONBLOCK then return immediately */
+	if (nonblock)
+		return -EAGAIN;
+
+	/* sleep till we have some data */
+	ret = wait_event_interruptible(gc->rx_wait, gc_can_read(gc));
+	if (gc->need_reopen)
+		ret = -EIO;
+	else if (!gc->gchar)
+		ret = -EINVAL;
+	return ret;
+}
+
 static ssize_t gc_read(struct file *filp, char __user *buff,
 				size_t len, loff_t *o)
 {
@@ -590,22 +620,9 @@ static ssize_t gc_read(struct file *filp, char __user *buff,
 	}
 
 	if (len) {
-		read = kfifo_len(&gc->rx_fifo);
-		if (!read) {
-			/* if NONBLOCK then return immediately */
-			if (filp->f_flags & O_NONBLOCK)
-				return -EAGAIN;
-
-			/* sleep till we have some data */
-			ret = wait_event_interruptible(gc->rx_wait,
-							gc_can_read(gc));
-			if (gc->need_reopen)
-				ret = -EIO;
-			else if (!gc->gchar)
-				ret = -EINVAL;
-			if (ret < 0)
-				return ret;
-		}
+		ret = gc_wait_rx_data(gc, filp->f_flags & O_NONBLOCK);
+		if (ret < 0)
+			return ret;
 		ret = kfifo_to_user(&gc->rx_fifo, buff, len, &read);
 		if (ret < 0)
 			dev_warn(gc->dev, "%s fault %d\n", __func__, ret);
@@ -632,6 +649,26 @@ static int gc_can_write(struct gc_dev *gc)
 	return ret;
 }
 
+/* Wait till there is some space in the TX buffer */
+static int gc_wait_tx_space(struct gc_dev *gc, bool nonblock)
+{
+	int ret;
+
+	if (!kfifo_is_full(&gc->tx_fifo))
+		return 0;
+
+	if (nonblock)
+		return -EAGAIN;
+
+	/* sleep till we have some space to write into */
+	ret = wait_event_interruptible(gc->tx_wait, gc_can_write(gc));
+	if (gc->need_reopen || gc->abort_write)
+		ret = -EIO;
+	else if (!gc->gchar)
+		ret = -EINVAL;
+	return ret;
+}
+
 static ssize_t gc_write(struct file *filp, const char __user *buff,
 						size_t len, loff_t *o)
 {
@@ -648,20 +685,9 @@ static ssize_t gc_write(struct file *filp, const char __user *buff,
 	}
 
 	if (len) {
-		if (kfifo_is_full(&gc->tx_fifo)) {
-			if (filp->f_flags & O_NONBLOCK)
-				return -EAGAIN;
-
-			/* sleep till we have some space to write into */
-			ret = wait_event_interruptible(gc->tx_wait,
-						gc_can_write(gc));
-			if (gc->need_reopen || gc->abort_write)
-				ret = -EIO;
-			else if (!gc->gchar)
-				ret = -EINVAL;
-			if (ret < 0)
-				return ret;
-		}
+		ret = gc_wait_tx_space(gc, filp->f_flags & O_NONBLOCK);
+		if (ret < 0)
+			return ret;
 		ret = kfifo_from_user(&gc->tx_fifo, buff, len, &wrote);
 		if (ret < 0)
 			dev_warn(gc->dev, "%s fault %d\n", __func__, ret);
@@ -679,6 +705,178 @@ static ssize_t gc_write(struct file *filp, const char __user *buff,
 	return wrote;
 }
 
+/*
+ * Splice support
+ *
+ * Moving file data with splice() avoids bouncing it through a userspace
+ * buffer: pages from the pipe are copied straight into the TX buffer, and
+ * data from the RX buffer straight into pages handed to the pipe. The USB
+ * requests are kicked once per pipe buffer instead of once per write().
+ */
+
+static void gc_pipe_buf_release(struct pipe_inode_info *pipe,
+				struct pipe_buffer *buf)
+{
+	__free_page(buf->page);
+}
+
+static const struct pipe_buf_operations gc_pipe_buf_ops = {
+	.can_merge	= 0,
+	.map		= generic_pipe_buf_map,
+	.unmap		= generic_pipe_buf_unmap,
+	.confirm	= generic_pipe_buf_confirm,
+	.release	= gc_pipe_buf_release,
+	.steal		= generic_pipe_buf_steal,
+	.get		= generic_pipe_buf_get,
+};
+
+static void gc_spd_release_page(struct splice_pipe_desc *spd, unsigned int i)
+{
+	__free_page(spd->pages[i]);
+}
+
+/*
+ * Returns how many buffers @pipe can take right now, waiting for room
+ * unless @nonblock.  gc_splice_read() only pulls that much out of the RX
+ * fifo: pages splice_to_pipe() cannot queue are released, and the USB
+ * data they hold would be lost.
+ */
+static int gc_pipe_room(struct pipe_inode_info *pipe, bool nonblock)
+{
+	int room;
+
+	for (;;) {
+		pipe_lock(pipe);
+		if (!pipe->readers) {
+			pipe_unlock(pipe);
+			send_sig(SIGPIPE, current, 0);
+			return -EPIPE;
+		}
+		room = PIPE_BUFFERS - pipe->nrbufs;
+		pipe_unlock(pipe);
+
+		if (room)
+			return room;
+		if (nonblock)
+			return -EAGAIN;
+		if (wait_event_interruptible(pipe->wait,
+				pipe->nrbufs < PIPE_BUFFERS || !pipe->readers))
+			return -ERESTARTSYS;
+	}
+}
+
+static ssize_t gc_splice_read(struct file *filp, loff_t *ppos,
+		struct pipe_inode_info *pipe, size_t len, unsigned int flags)
+{
+	struct gc_dev		*gc = filp->private_data;
+	struct page		*pages[PIPE_BUFFERS];
+	struct partial_page	partial[PIPE_BUFFERS];
+	struct splice_pipe_desc	spd = {
+		.pages		= pages,
+		.partial	= partial,
+		.flags		= flags,
+		.ops		= &gc_pipe_buf_ops,
+		.spd_release	= gc_spd_release_page,
+	};
+	bool			nonblock;
+	ssize_t			ret;
+	int			room;
+
+	if (gc->need_reopen)
+		return -EIO;
+
+	if (!gc->gchar || !gc->gchar->ep_out)
+		return -EINVAL;
+
+	nonblock = (filp->f_flags & O_NONBLOCK) || (flags & SPLICE_F_NONBLOCK);
+
+	ret = gc_wait_rx_data(gc, nonblock);
+	if (ret < 0)
+		return ret;
+
+	room = gc_pipe_room(pipe, nonblock);
+	if (room < 0)
+		return room;
+
+	len = min_t(size_t, len, kfifo_len(&gc->rx_fifo));
+
+	while (len && spd.nr_pages < room) {
+		struct page	*page;
+		unsigned int	n;
+
+		page = alloc_page(GFP_KERNEL);
+		if (!page)
+			break;
+
+		n = kfifo_out(&gc->rx_fifo, page_address(page),
+			      min_t(size_t, len, PAGE_SIZE));
+		if (!n) {
+			__free_page(page);
+			break;
+		}
+
+		pages[spd.nr_pages] = page;
+		partial[spd.nr_pages].offset = 0;
+		partial[spd.nr_pages].len = n;
+		spd.nr_pages++;
+		len -= n;
+	}
+
+	if (!spd.nr_pages)
+		return -ENOMEM;
+
+	/* The RX buffer has room again, queue more USB requests */
+	spin_lock_irq(&gc->rx_lock);
+	gc_do_rx(gc);
+	spin_unlock_irq(&gc->rx_lock);
+
+	return splice_to_pipe(pipe, &spd);
+}
+
+static int gc_pipe_to_fifo(struct pipe_inode_info *pipe,
+		struct pipe_buffer *buf, struct splice_desc *sd)
+{
+	struct gc_dev	*gc = sd->u.file->private_data;
+	unsigned int	wrote;
+	void		*data;
+	int		ret;
+
+	ret = buf->ops->confirm(pipe, buf);
+	if (ret)
+		return ret;
+
+	ret = gc_wait_tx_space(gc, sd->u.file->f_flags & O_NONBLOCK);
+	if (ret < 0)
+		return ret;
+
+	data = buf->ops->map(pipe, buf, 0);
+	wrote = kfifo_in(&gc->tx_fifo, data + buf->offset, sd->len);
+	buf->ops->unmap(pipe, buf, data);
+
+	spin_lock_irq(&gc->tx_lock);
+	gc_do_tx(gc);
+	spin_unlock_irq(&gc->tx_lock);
+
+	if (gc->abort_write)
+		return -EIO;
+
+	return wrote;
+}
+
+static ssize_t gc_splice_write(struct pipe_inode_info *pipe, struct file *filp,
+		loff_t *ppos, size_t len, unsigned int flags)
+{
+	struct gc_dev	*gc = filp->private_data;
+
+	if (gc->need_reopen || gc->abort_write)
+		return -EIO;
+
+	if (!gc->gchar || !gc->gchar->ep_in)
+		return -EINVAL;
+
+	return splice_from_pipe(pipe, filp, ppos, len, flags, gc_pipe_to_fifo);
+}
+
 static long gc_ioctl(struct file *filp, unsigned code, unsigned long value)
 {
 	struct gc_dev			*gc = filp->private_data;
@@ -804,6 +1002,8 @@ static const struct file_operations gc_fops = {
 	.release	= gc_release,
 	.read		= gc_read,
 	.write		= gc_write,
+	.splice_read	= gc_splice_read,
+	.splice_write	= gc_splice_write,
 	.fsync		= gc_fsync,
 };
 
@@ -833,6 +1033,14 @@ int __init gchar_setup(struct usb_gadget *g, u8 devs_num)
 	if (devs_num == 0 || devs_num > max_devs)
 		return -EINVAL;
 
+	/* gc_do_rx() needs room for all queued requests plus two more */
+	req_len = PAGE_ALIGN(req_len);
+	if (!queue_size || (queue_size + 2) * req_len > buflen) {
+		pr_err("%s: buflen %u too small for %u requests of %u bytes\n",
+				__func__, buflen, queue_size, req_len);
+		return -EINVAL;
+	}
+
 	gcdata.gcdevs = kzalloc(sizeof(struct gc_dev) * devs_num, GFP_KERNEL);
 	if (!gcdata.gcdevs)
 		return -ENOMEM;
@@ -899,6 +1107,18 @@ int __init gchar_setup(struct usb_gadget *g, u8 devs_num)
 		kfifo_init(&gc->rx_fifo,
 				gc->rx_fifo_buf, buflen);
 
+		/* Allocate request queues */
+		gc->rx_queue = kcalloc(queue_size, sizeof(struct gc_buf),
+					GFP_KERNEL);
+		gc->tx_queue = kcalloc(queue_size, sizeof(struct gc_buf),
+					GFP_KERNEL);
+		if (!gc->rx_queue || !gc->tx_queue) {
+			kfree(gc->rx_queue);
+			kfree(gc->tx_queue);
+			vfree(gc->tx_fifo_buf);
+			vfree(gc->rx_fifo_buf);
+			goto fail5;
+		}
 	}
 
 	gcdata.gadget = g;
@@ -914,6 +1134,8 @@ fail4:
 			MKDEV(MAJOR(gcdata.dev), MINOR(gcdata.dev) + i));
 		vfree(gc->tx_fifo_buf);
 		vfree(gc->rx_fifo_buf);
+		kfree(gc->rx_queue);
+		kfree(gc->tx_queue);
 	}
 	class_destroy(gcdata.class);
 fail3:
@@ -964,6 +1186,8 @@ void gchar_cleanup(void)
 		wait_event(gc->close_wait, gc_closed(gc));
 		vfree(gc->tx_fifo_buf);
 		vfree(gc->rx_fifo_buf);
+		kfree(gc->rx_queue);
+		kfree(gc->tx_queue);
 	}
 
 	cdev_del(&gcdata.chdev);
@@ -1251,7 +1475,7 @@ void gchar_clear_fifos(struct gchar *gchar)
 		tasklet_kill(&gc->tx_task);
 		spin_lock_irq(&gc->tx_lock);
 
-		for (i = 0 ; i < GC_QUEUE_SIZE ; i++) {
+		for (i = 0 ; i < queue_size ; i++) {
 			queue = &gc->tx_queue[i];
 			if (queue->busy) {
 				spin_unlock_irq(&gc->tx_lock);
@@ -1275,7 +1499,7 @@ void gchar_clear_fifos(struct gchar *gchar)
 		tasklet_kill(&gc->rx_task);
 		spin_lock_irq(&gc->rx_lock);
 
-		for (i = 0 ; i < GC_QUEUE_SIZE; i++) {
+		for (i = 0 ; i < queue_size; i++) {
 			queue = &gc->rx_queue[i];
 			if (queue->busy) {
 				spin_unlock_irq(&gc->rx_lock);
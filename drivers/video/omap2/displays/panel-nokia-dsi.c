@@ -32,6 +32,9 @@
 #include <linux/regulator/consumer.h>
 #include <linux/semaphore.h>
 #include <linux/hrtimer.h>
+#include <linux/spinlock.h>
+
+#include <asm/div64.h>
 
 #include <plat/display.h>
 #include <plat/panel-nokia-dsi.h>
@@ -391,6 +394,10 @@ struct update_region {
  * @upd_state: two-part update state
  * @original_update_region: update region for original update call
  * @frame_timeout_work: timeout work for frame tranmission
+ * @damage_lock: lock for @damage and @damage_pending
+ * @damage: union of update requests not yet sent to the panel
+ * @damage_pending: true if an update caller still has to send @damage
+ * @upd_stats: update request, merge and DSI traffic counters
  * @update_te: tear effect in update, see &enum pnd_update_te
  * @update_mode: update mode, see &enum pnd_update_mode
  * @use_dsi_bl: if true, use %DCS_BRIGHTNESS command to adjust backlight
@@ -451,6 +458,18 @@ struct pnd_data {
 	struct update_region original_update_region;
 	struct update_region update_region;
 	struct delayed_work frame_timeout_work;
+
+	spinlock_t damage_lock;
+	struct update_region damage;
+	bool damage_pending;
+	struct {
+		u32 requests;
+		u32 merged;
+		u32 frames;
+		u32 frame_bytes;	/* bytes of the frame being sent */
+		u32 last_frame_bytes;
+		u64 total_bytes;
+	} upd_stats;
 	enum pnd_update_te update_te;
 	enum pnd_update_mode update_mode;
 
@@ -1892,6 +1911,28 @@ out:
 
 	return ret;
 }
+static ssize_t pnd_show_update_stats(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct omap_dss_device *dssdev = to_dss_device(dev);
+	struct pnd_data *td = dev_get_drvdata(&dssdev->dev);
+	u64 avg;
+	ssize_t len;
+
+	spin_lock_irq(&td->damage_lock);
+	avg = td->upd_stats.total_bytes;
+	if (td->upd_stats.frames)
+		do_div(avg, td->upd_stats.frames);
+	len = snprintf(buf, PAGE_SIZE,
+			"requests %u merged %u frames %u\n"
+			"bytes %llu last_frame %u avg_frame %llu\n",
+			td->upd_stats.requests, td->upd_stats.merged,
+			td->upd_stats.frames, td->upd_stats.total_bytes,
+			td->upd_stats.last_frame_bytes, avg);
+	spin_unlock_irq(&td->damage_lock);
+
+	return len;
+}
 
 /* generic attributes */
 static DEVICE_ATTR(num_dsi_errors, S_IRUGO, pnd_show_num_errors, NULL);
@@ -1905,6 +1946,7 @@ static DEVICE_ATTR(ulps_timeout, S_IRUGO | S_IWUSR,
 static DEVICE_ATTR(self_diag, S_IRUGO, pnd_show_self_diag, NULL);
 static DEVICE_ATTR(dimming, S_IRUGO | S_IWUSR,
 		pnd_show_dimming, pnd_store_dimming);
+static DEVICE_ATTR(update_stats, S_IRUGO, pnd_show_update_stats, NULL);
 
 static struct attribute *pnd_attrs[] = {
 	&dev_attr_num_dsi_errors.attr,
@@ -1914,6 +1956,7 @@ static struct attribute *pnd_attrs[] = {
 	&dev_attr_ulps_timeout.attr,
 	&dev_attr_self_diag.attr,
 	&dev_attr_dimming.attr,
+	&dev_attr_update_stats.attr,
 	NULL,
 };
 
@@ -2206,6 +2249,7 @@ static int pnd_probe(struct omap_dss_device *dssdev)
 	sema_init(&td->lock, 1);
 
 	atomic_set(&td->upd_state, PND_UPD_STATE_NONE);
+	spin_lock_init(&td->damage_lock);
 
 	r = init_regulators(dssdev, panel_config->regulators,
 			panel_config->num_regulators);
@@ -3097,10 +3141,17 @@ static int pnd_start_update(struct omap_dss_device *dssdev,
 	u16 y = td->update_region.y;
 	u16 w = td->update_region.w;
 	u16 h = td->update_region.h;
+	unsigned long flags;
 	int r;
 
 	r = omap_dsi_update(dssdev, TCH, x, y, w, h,
 			callback, dssdev);
+	if (!r) {
+		spin_lock_irqsave(&td->damage_lock, flags);
+		td->upd_stats.frame_bytes +=
+			w * h * dssdev->ctrl.pixel_size / 8;
+		spin_unlock_irqrestore(&td->damage_lock, flags);
+	}
 	return r;
 }
 
@@ -3108,6 +3159,7 @@ static void pnd_framedone_cb_2(int err, void *data)
 {
 	struct omap_dss_device *dssdev = data;
 	struct pnd_data *td = dev_get_drvdata(&dssdev->dev);
+	unsigned long flags;
 	int old;
 
 	mark_phase(dssdev, 4);
@@ -3141,6 +3193,13 @@ static void pnd_framedone_cb_2(int err, void *data)
 
 	BUG_ON(old != PND_UPD_STATE_FRAME2_ONGOING);
 
+	spin_lock_irqsave(&td->damage_lock, flags);
+	td->upd_stats.frames++;
+	td->upd_stats.last_frame_bytes = td->upd_stats.frame_bytes;
+	td->upd_stats.total_bytes += td->upd_stats.frame_bytes;
+	td->upd_stats.frame_bytes = 0;
+	spin_unlock_irqrestore(&td->damage_lock, flags);
+
 	cancel_delayed_work(&td->frame_timeout_work);
 	omap_dss_unlock_cache();
 
@@ -3304,6 +3363,32 @@ static void pnd_frame_timeout_work_callback(struct work_struct *work)
 	pnd_update_error(dssdev);
 }
 
+/*
+ * Add a rectangle to the pending damage. Called with damage_lock held.
+ */
+static void pnd_damage_add(struct update_region *d, u16 x, u16 y, u16 w, u16 h)
+{
+	u16 x2, y2;
+
+	if (w == 0 || h == 0)
+		return;
+
+	if (d->w == 0 || d->h == 0) {
+		d->x = x;
+		d->y = y;
+		d->w = w;
+		d->h = h;
+		return;
+	}
+
+	x2 = max(d->x + d->w, x + w);
+	y2 = max(d->y + d->h, y + h);
+	d->x = min(d->x, x);
+	d->y = min(d->y, y);
+	d->w = x2 - d->x;
+	d->h = y2 - d->y;
+}
+
 static int pnd_update(struct omap_dss_device *dssdev,
 		u16 x, u16 y, u16 w, u16 h)
 {
@@ -3315,8 +3400,39 @@ static int pnd_update(struct omap_dss_device *dssdev,
 
 	dev_dbg(&dssdev->dev, "update %d, %d, %d x %d\n", x, y, w, h);
 
+	/*
+	 * Requests that arrive while a frame is in flight wait on td->lock.
+	 * Accumulate them into one damage rectangle; the first waiter to get
+	 * the lock sends the union, and the others find nothing left to do.
+	 */
+	spin_lock_irq(&td->damage_lock);
+	pnd_damage_add(&td->damage, x, y, w, h);
+	td->damage_pending = true;
+	td->upd_stats.requests++;
+	spin_unlock_irq(&td->damage_lock);
+
 	down(&td->lock);
 
+	spin_lock_irq(&td->damage_lock);
+	if (!td->damage_pending) {
+		td->upd_stats.merged++;
+		spin_unlock_irq(&td->damage_lock);
+		up(&td->lock);
+		return 0;
+	}
+	x = td->damage.x;
+	y = td->damage.y;
+	w = td->damage.w;
+	h = td->damage.h;
+	td->damage.w = 0;
+	td->damage.h = 0;
+	td->damage_pending = false;
+	spin_unlock_irq(&td->damage_lock);
+
+	if (w != 0 && h != 0)
+		dev_dbg(&dssdev->dev, "update damage %d, %d, %d x %d\n",
+				x, y, w, h);
+
 	if (td->lpm_pending) {
 		/* if there is a lpm scheduled, reschedule lpm work */
 		cancel_delayed_work(&td->lpm_work);
@@ -3427,6 +3543,17 @@ err3:
 err2:
 	omap_dss_unlock_cache();
 err1:
+	/*
+	 * The rectangle may include requests from callers still waiting on
+	 * td->lock. Put it back so one of them, or the next update, sends
+	 * it instead of them returning 0 with nothing sent.
+	 */
+	if (r) {
+		spin_lock_irq(&td->damage_lock);
+		pnd_damage_add(&td->damage, x, y, w, h);
+		td->damage_pending = true;
+		spin_unlock_irq(&td->damage_lock);
+	}
 	dsi_bus_unlock();
 	up(&td->lock);
 	return r;
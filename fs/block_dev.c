@@ -26,6 +26,7 @@
 #include <linux/namei.h>
 #include <linux/log2.h>
 #include <linux/kmemleak.h>
+#include <linux/ccache.h>
 #include <asm/uaccess.h>
 #include "internal.h"
 
@@ -64,8 +65,10 @@ static sector_t max_block(struct block_device *bdev)
 /* Kill _all_ buffers and pagecache , dirty or not.. */
 static void kill_bdev(struct block_device *bdev)
 {
-	if (bdev->bd_inode->i_mapping->nrpages == 0)
+	if (bdev->bd_inode->i_mapping->nrpages == 0) {
+		ccache_flush_mapping(bdev->bd_inode->i_mapping);
 		return;
+	}
 	invalidate_bh_lrus();
 	truncate_inode_pages(bdev->bd_inode->i_mapping, 0);
 }	
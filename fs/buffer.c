@@ -41,6 +41,7 @@
 #include <linux/bitops.h>
 #include <linux/mpage.h>
 #include <linux/bit_spinlock.h>
+#include <linux/ccache.h>
 
 static int fsync_buffers_list(spinlock_t *lock, struct list_head *list);
 
@@ -271,8 +272,11 @@ void invalidate_bdev(struct block_device *bdev)
 {
 	struct address_space *mapping = bdev->bd_inode->i_mapping;
 
-	if (mapping->nrpages == 0)
+	if (mapping->nrpages == 0) {
+		/* The media may have changed under compressed copies too */
+		ccache_flush_mapping(mapping);
 		return;
+	}
 
 	invalidate_bh_lrus();
 	invalidate_mapping_pages(mapping, 0, -1);
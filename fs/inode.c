@@ -27,6 +27,7 @@
 #include <linux/mount.h>
 #include <linux/async.h>
 #include <linux/posix_acl.h>
+#include <linux/ccache.h>
 
 /*
  * This is needed for the following functions:
@@ -235,6 +236,8 @@ static struct inode *alloc_inode(struct super_block *sb)
 void __destroy_inode(struct inode *inode)
 {
 	BUG_ON(inode_has_buffers(inode));
+	/* The mapping's address may be reused as a cache key. */
+	ccache_flush_mapping(&inode->i_data);
 	ima_inode_free(inode);
 	security_inode_free(inode);
 	fsnotify_inode_delete(inode);
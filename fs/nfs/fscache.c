@@ -17,6 +17,7 @@
 #include <linux/nfs_fs_sb.h>
 #include <linux/in6.h>
 #include <linux/seq_file.h>
+#include <linux/ccache.h>
 
 #include "internal.h"
 #include "iostat.h"
@@ -263,6 +264,8 @@ static void nfs_fscache_disable_inode_cookie(struct inode *inode)
 		 */
 		if (inode->i_mapping && inode->i_mapping->nrpages)
 			invalidate_inode_pages2(inode->i_mapping);
+		else if (inode->i_mapping)
+			ccache_flush_mapping(inode->i_mapping);
 
 		nfs_fscache_zap_inode_cookie(inode);
 	}
@@ -36,6 +36,7 @@
 #include <linux/vfs.h>
 #include <linux/inet.h>
 #include <linux/nfs_xdr.h>
+#include <linux/ccache.h>
 
 #include <asm/system.h>
 #include <asm/uaccess.h>
@@ -787,7 +788,8 @@ static int nfs_invalidate_mapping_nolock(struct inode *inode, struct address_spa
 		int ret = invalidate_inode_pages2(mapping);
 		if (ret < 0)
 			return ret;
-	}
+	} else
+		ccache_flush_mapping(mapping);
 	spin_lock(&inode->i_lock);
 	nfsi->cache_validity &= ~NFS_INO_INVALID_DATA;
 	if (S_ISDIR(inode->i_mode))
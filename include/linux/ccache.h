@@ -0,0 +1,69 @@
+#ifndef _LINUX_CCACHE_H
+#define _LINUX_CCACHE_H
+
+/*
+ * Compressed second-chance cache for clean page cache pages.
+ *
+ * Page reclaim hands clean file pages to ccache_put_page() just before
+ * dropping them from the page cache; the read and fault paths call
+ * ccache_readpage() before issuing I/O for a page that is not cached.
+ * Anything that makes the backing data differ from what was cached
+ * (truncate, invalidate, direct I/O, inode teardown) must flush the
+ * affected range.
+ */
+
+#include <linux/types.h>
+#include <linux/errno.h>
+
+struct page;
+struct address_space;
+struct ctl_table;
+
+#ifdef CONFIG_CCACHE
+
+extern int sysctl_ccache_max_pages;
+extern int ccache_max_pages_handler(struct ctl_table *, int,
+					void __user *, size_t *, loff_t *);
+
+extern void ccache_put_page(struct page *page);
+extern int ccache_readpage(struct page *page);
+extern int ccache_contains(struct address_space *mapping, pgoff_t index);
+extern void ccache_flush_range(struct address_space *mapping,
+				pgoff_t start, pgoff_t end);
+
+#else
+
+static inline void ccache_put_page(struct page *page)
+{
+}
+
+static inline int ccache_readpage(struct page *page)
+{
+	return -ENODATA;
+}
+
+static inline int ccache_contains(struct address_space *mapping,
+				pgoff_t index)
+{
+	return 0;
+}
+
+static inline void ccache_flush_range(struct address_space *mapping,
+				pgoff_t start, pgoff_t end)
+{
+}
+
+#endif /* CONFIG_CCACHE */
+
+static inline void ccache_flush_page(struct address_space *mapping,
+				pgoff_t index)
+{
+	ccache_flush_range(mapping, index, index);
+}
+
+static inline void ccache_flush_mapping(struct address_space *mapping)
+{
+	ccache_flush_range(mapping, 0, ~(pgoff_t)0);
+}
+
+#endif /* _LINUX_CCACHE_H */
@@ -34,7 +34,7 @@
 #define CS_DEV_FILE_NAME		"/dev/cmt_speech"
 
 /* user-space API versioning */
-#define CS_IF_VERSION			2
+#define CS_IF_VERSION			3
 
 /* APE kernel <-> user space messages */
 #define CS_CMD_SHIFT			28
@@ -59,6 +59,7 @@
 /* parameters to CS_CONFIG_BUFS ioctl */
 #define CS_FEAT_TSTAMP_RX_CTRL		(1 << 0)
 #define CS_FEAT_ROLLING_RX_COUNTER	(2 << 0)
+#define CS_FEAT_RING			(4 << 0)
 
 /* parameters to CS_GET_STATE ioctl */
 #define CS_STATE_CLOSED			0
@@ -93,7 +94,9 @@ struct cs_mmap_config_block {
 	__u32 tx_offsets[CS_MAX_BUFFERS];
 	__u32 rx_ptr;
 	__u32 rx_ptr_boundary;
-	__u32 reserved3[2];
+	/* if enabled with CS_FEAT_RING, offset of struct cs_mmap_ring_block */
+	__u32 ring_offset;
+	__u32 reserved3;
 	/*
 	 * if enabled with CS_FEAT_TSTAMP_RX_CTRL, monotonic
 	 * timestamp taken when the last control command was received
@@ -101,6 +104,33 @@ struct cs_mmap_config_block {
 	struct timespec tstamp_rx_ctrl;
 };
 
+/*
+ * Frame descriptor of the CS_FEAT_RING ring. The driver fills in the
+ * descriptor of a slot before publishing its sequence number in the ring
+ * block, so a reader that sees a counter advance may read the matching
+ * descriptors (and buffers) without further synchronization.
+ */
+struct cs_ring_desc {
+	__u32 seq;		/* frame sequence number, starts at 1 */
+	__u32 len;		/* bytes transferred */
+	struct timespec tstamp;	/* monotonic transfer completion time */
+};
+
+/*
+ * Single-producer/single-consumer frame ring shared through the mmap
+ * area. The RX descriptor of frame 'seq' is rx_desc[(seq - 1) % rx_bufs]
+ * and describes the RX buffer of the same index. TX descriptors are
+ * indexed by the buffer slot given to CS_TX_DATA_READY.
+ */
+struct cs_mmap_ring_block {
+	__u32 rx_head;		/* driver: sequence of last received frame */
+	__u32 rx_tail;		/* application: sequence of last consumed */
+	__u32 tx_done;		/* driver: sequence of last sent frame */
+	__u32 rx_overruns;	/* driver: frames received while ring full */
+	struct cs_ring_desc rx_desc[CS_MAX_BUFFERS];
+	struct cs_ring_desc tx_desc[CS_MAX_BUFFERS];
+};
+
 #define CS_IO_MAGIC		'C'
 
 #define CS_IOW(num, dtype)	_IOW(CS_IO_MAGIC, num, dtype)
@@ -237,6 +237,8 @@ struct hsi_port {
 #define to_hsi_port(dev) container_of(dev, struct hsi_port, device)
 #define hsi_get_port(cl) to_hsi_port((cl)->device.parent)
 
+struct hsi_client *hsi_new_client(struct hsi_port *port,
+						struct hsi_board_info *info);
 void hsi_event(struct hsi_port *port, unsigned int event);
 int hsi_claim_port(struct hsi_client *cl, unsigned int share);
 void hsi_release_port(struct hsi_client *cl);
@@ -39,6 +39,7 @@
 #define HSC_GET_RX		HSC_IOW(20, struct hsc_rx_config)
 #define HSC_SET_TX		HSC_IOW(21, struct hsc_tx_config)
 #define HSC_GET_TX		HSC_IOW(22, struct hsc_tx_config)
+#define HSC_GET_STATS		HSC_IOR(23, struct hsc_stats)
 
 #define HSC_PM_DISABLE		0
 #define HSC_PM_ENABLE		1
@@ -63,4 +64,17 @@ struct hsc_tx_config {
 	uint32_t arb_mode;
 };
 
+/* Per-channel message counters, reset on open */
+struct hsc_stats {
+	uint32_t queue_depth;		/* messages allocated to the channel */
+	uint32_t rx_msgs;		/* completed reads */
+	uint32_t tx_msgs;		/* completed writes */
+	uint32_t rx_errors;
+	uint32_t tx_errors;
+	uint32_t rx_inflight;		/* reads queued in the controller */
+	uint32_t tx_inflight;		/* writes queued in the controller */
+	uint32_t rx_inflight_max;	/* high watermarks of the above */
+	uint32_t tx_inflight_max;
+};
+
 #endif /* __HSI_CHAR_H */
@@ -39,6 +39,8 @@
  * VIDIOC_OMAP3ISP_AF_CFG: Set auto-focus module configuration
  * VIDIOC_OMAP3ISP_STAT_REQ: Read statistics (AEWB/AF/histogram) data
  * VIDIOC_OMAP3ISP_STAT_EN: Enable/disable a statistics module
+ * VIDIOC_OMAP3ISP_STAT_DQBUF: Dequeue a statistics buffer for in-place access
+ * VIDIOC_OMAP3ISP_STAT_QBUF: Give a dequeued statistics buffer back
  */
 
 #define VIDIOC_OMAP3ISP_CCDC_CFG \
@@ -55,6 +57,10 @@
 	_IOWR('V', BASE_VIDIOC_PRIVATE + 6, struct omap3isp_stat_data)
 #define VIDIOC_OMAP3ISP_STAT_EN \
 	_IOWR('V', BASE_VIDIOC_PRIVATE + 7, unsigned long)
+#define VIDIOC_OMAP3ISP_STAT_DQBUF \
+	_IOWR('V', BASE_VIDIOC_PRIVATE + 8, struct omap3isp_stat_buffer)
+#define VIDIOC_OMAP3ISP_STAT_QBUF \
+	_IOW('V', BASE_VIDIOC_PRIVATE + 9, struct omap3isp_stat_buffer)
 
 /*
  * Events
@@ -173,6 +179,31 @@ struct omap3isp_stat_data {
 	__u16 config_counter;
 };
 
+/**
+ * struct omap3isp_stat_buffer - Statistic buffer shared with user
+ * @ts: Timestamp of the statistics.
+ * @index: Index of the buffer in the statistics buffers ring.
+ * @offset: Offset to pass to mmap() to map the buffer.
+ * @length: Size of the mapping, identical for all buffers.
+ * @buf_size: Size of the statistics data stored in the buffer.
+ * @sequence: Frame number of the statistics.
+ * @config_counter: Number of the configuration associated with the data.
+ *
+ * Buffers returned by VIDIOC_OMAP3ISP_STAT_DQBUF are owned by userspace and
+ * will not be written to by the driver until they are handed back with
+ * VIDIOC_OMAP3ISP_STAT_QBUF. Only @index is used by VIDIOC_OMAP3ISP_STAT_QBUF.
+ */
+struct omap3isp_stat_buffer {
+	struct timeval ts;
+	__u32 index;
+	__u32 offset;
+	__u32 length;
+	__u32 buf_size;
+	__u32 sequence;
+	__u16 config_counter;
+	__u16 reserved;
+};
+
 
 /* Histogram related structs */
 
@@ -52,6 +52,10 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		UNEVICTABLE_PGCLEARED,	/* on COW, page truncate */
 		UNEVICTABLE_PGSTRANDED,	/* unable to isolate on unlock */
 		UNEVICTABLE_MLOCKFREED,
+#ifdef CONFIG_CCACHE
+		CCACHE_HIT, CCACHE_MISS, CCACHE_PUT, CCACHE_REJECT,
+		CCACHE_EVICT,
+#endif
 		NR_VM_EVENT_ITEMS
 };
 
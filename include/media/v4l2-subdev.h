@@ -131,6 +131,7 @@ struct v4l2_subdev_core_ops {
 			       struct v4l2_event_subscription *sub);
 	int (*unsubscribe_event)(struct v4l2_subdev *sd, struct v4l2_fh *fh,
 				 struct v4l2_event_subscription *sub);
+	int (*mmap)(struct v4l2_subdev *sd, struct vm_area_struct *vma);
 };
 
 /* s_mode: switch the tuner to a specific tuner mode. Replacement of s_radio.
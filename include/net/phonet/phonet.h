@@ -37,6 +37,7 @@ struct pn_sock {
 	struct sock	sk;
 	u16		sobject;
 	u8		resource;
+	struct rcu_head	rcu;
 };
 
 static inline struct pn_sock *pn_sk(struct sock *sk)
@@ -50,6 +51,7 @@ void pn_sock_init(void);
 struct sock *pn_find_sock_by_sa(struct net *net, const struct sockaddr_pn *sa);
 void pn_deliver_sock_broadcast(struct net *net, struct sk_buff *skb);
 void phonet_get_local_port_range(int *min, int *max);
+int phonet_pipe_credits(void);
 void pn_sock_hash(struct sock *sk);
 void pn_sock_unhash(struct sock *sk);
 int pn_sock_get_port(struct sock *sk, unsigned short sport);
@@ -50,6 +50,7 @@
 #include <linux/ftrace.h>
 #include <linux/slow-work.h>
 #include <linux/perf_event.h>
+#include <linux/ccache.h>
 
 #include <asm/uaccess.h>
 #include <asm/processor.h>
@@ -1400,6 +1401,17 @@ static struct ctl_table vm_table[] = {
 		.mode		= 0644,
 		.proc_handler	= &scan_unevictable_handler,
 	},
+#ifdef CONFIG_CCACHE
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "ccache_max_pages",
+		.data		= &sysctl_ccache_max_pages,
+		.maxlen		= sizeof(sysctl_ccache_max_pages),
+		.mode		= 0644,
+		.proc_handler	= &ccache_max_pages_handler,
+		.extra1		= &zero,
+	},
+#endif
 #ifdef CONFIG_MEMORY_FAILURE
 	{
 		.ctl_name	= CTL_UNNUMBERED,
@@ -0,0 +1,423 @@
+/*
+ * Compressed cache for clean page cache pages.
+ *
+ * When page reclaim is about to drop a clean, uptodate file page it
+ * offers the page here first.  The page is LZO-compressed and, if it
+ * compresses well enough, kept in RAM keyed by (mapping, index).  The
+ * next read or fault on that page finds it via ccache_readpage() and is
+ * served by decompression instead of a trip to the backing device.
+ *
+ * The cache is exclusive: a hit removes the compressed copy, since the
+ * page is back in the page cache and will be offered again when it is
+ * next reclaimed.  Entries are evicted in LRU order to stay within
+ * vm.ccache_max_pages worth of RAM, and a shrinker lets reclaim take
+ * memory back under pressure.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/spinlock.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/sysctl.h>
+#include <linux/vmstat.h>
+#include <linux/lzo.h>
+#include <linux/ccache.h>
+
+/* Pages that do not compress below this are not worth keeping. */
+#define CCACHE_MAX_LEN		(PAGE_SIZE * 3 / 4)
+
+struct ccache_entry {
+	struct rb_node node;
+	struct list_head lru;
+	struct address_space *mapping;
+	pgoff_t index;
+	unsigned int len;
+	u8 data[0];
+};
+
+/* Protects the tree, the LRU list and the counters below. */
+static DEFINE_SPINLOCK(ccache_lock);
+static struct rb_root ccache_tree = RB_ROOT;
+static LIST_HEAD(ccache_lru);
+static unsigned long ccache_nr_entries;
+static unsigned long ccache_bytes;
+
+/* RAM budget for compressed data, in pages; 0 disables the cache. */
+int sysctl_ccache_max_pages;
+
+static int ccache_ready;
+static DEFINE_PER_CPU(void *, ccache_wrkmem);
+static DEFINE_PER_CPU(u8 *, ccache_dst);
+
+static inline int ccache_cmp(struct address_space *mapping, pgoff_t index,
+			     struct ccache_entry *entry)
+{
+	if (mapping != entry->mapping)
+		return mapping < entry->mapping ? -1 : 1;
+	if (index != entry->index)
+		return index < entry->index ? -1 : 1;
+	return 0;
+}
+
+static struct ccache_entry *ccache_lookup(struct address_space *mapping,
+					  pgoff_t index)
+{
+	struct rb_node *n = ccache_tree.rb_node;
+
+	while (n) {
+		struct ccache_entry *entry;
+		int cmp;
+
+		entry = rb_entry(n, struct ccache_entry, node);
+		cmp = ccache_cmp(mapping, index, entry);
+		if (cmp < 0)
+			n = n->rb_left;
+		else if (cmp > 0)
+			n = n->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * Insert @new, returning the entry it replaces (already unlinked from
+ * the tree) or NULL.  Called with ccache_lock held.
+ */
+static struct ccache_entry *ccache_insert(struct ccache_entry *new)
+{
+	struct rb_node **p = &ccache_tree.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		struct ccache_entry *entry;
+		int cmp;
+
+		parent = *p;
+		entry = rb_entry(parent, struct ccache_entry, node);
+		cmp = ccache_cmp(new->mapping, new->index, entry);
+		if (cmp < 0) {
+			p = &parent->rb_left;
+		} else if (cmp > 0) {
+			p = &parent->rb_right;
+		} else {
+			rb_replace_node(parent, &new->node, &ccache_tree);
+			list_del(&entry->lru);
+			list_add(&new->lru, &ccache_lru);
+			ccache_bytes += ksize(new) - ksize(entry);
+			return entry;
+		}
+	}
+
+	rb_link_node(&new->node, parent, p);
+	rb_insert_color(&new->node, &ccache_tree);
+	list_add(&new->lru, &ccache_lru);
+	ccache_nr_entries++;
+	ccache_bytes += ksize(new);
+	return NULL;
+}
+
+/* Called with ccache_lock held. */
+static void ccache_unlink(struct ccache_entry *entry)
+{
+	rb_erase(&entry->node, &ccache_tree);
+	list_del(&entry->lru);
+	ccache_nr_entries--;
+	ccache_bytes -= ksize(entry);
+}
+
+static void ccache_free_list(struct list_head *list, int evicted)
+{
+	struct ccache_entry *entry, *next;
+
+	list_for_each_entry_safe(entry, next, list, lru) {
+		kfree(entry);
+		if (evicted)
+			count_vm_event(CCACHE_EVICT);
+	}
+}
+
+/*
+ * Evict from the cold end until at most @limit bytes are in use, or
+ * until @nr entries have gone if @nr is non-zero.  Called with
+ * ccache_lock held; the victims are moved to @list for the caller to
+ * free.
+ */
+static void ccache_evict(unsigned long limit, unsigned long nr,
+			 struct list_head *list)
+{
+	unsigned long evicted = 0;
+
+	while (!list_empty(&ccache_lru)) {
+		struct ccache_entry *entry;
+
+		if (nr ? evicted >= nr : ccache_bytes <= limit)
+			break;
+		entry = list_entry(ccache_lru.prev, struct ccache_entry, lru);
+		ccache_unlink(entry);
+		list_add(&entry->lru, list);
+		evicted++;
+	}
+}
+
+static inline unsigned long ccache_limit(void)
+{
+	return (unsigned long)sysctl_ccache_max_pages << PAGE_SHIFT;
+}
+
+static void ccache_trim(void)
+{
+	LIST_HEAD(victims);
+
+	spin_lock(&ccache_lock);
+	ccache_evict(ccache_limit(), 0, &victims);
+	spin_unlock(&ccache_lock);
+	ccache_free_list(&victims, 1);
+}
+
+/**
+ * ccache_put_page - offer a clean page that reclaim is about to drop
+ * @page: locked, clean and uptodate page still in its mapping
+ *
+ * Any older copy of the same page is replaced; if @page cannot be
+ * stored, the older copy is dropped so a later read never sees stale
+ * data.
+ */
+void ccache_put_page(struct page *page)
+{
+	struct address_space *mapping = page->mapping;
+	struct ccache_entry *entry, *old;
+	LIST_HEAD(victims);
+	size_t clen;
+	void *src;
+	u8 *dst;
+	int cpu, ret;
+
+	if (!ccache_ready || !sysctl_ccache_max_pages)
+		return;
+	if (!mapping || !mapping->a_ops->readpage || PageSwapBacked(page))
+		return;
+	VM_BUG_ON(!PageLocked(page));
+	if (PageDirty(page))
+		goto reject;
+
+	cpu = get_cpu();
+	dst = per_cpu(ccache_dst, cpu);
+	src = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, &clen,
+			       per_cpu(ccache_wrkmem, cpu));
+	kunmap_atomic(src, KM_USER0);
+	if (ret != LZO_E_OK || clen > CCACHE_MAX_LEN) {
+		put_cpu();
+		goto reject;
+	}
+
+	/*
+	 * We are in reclaim: never wait, and never dip into the emergency
+	 * reserves to cache something that can be read back from disk.
+	 */
+	entry = kmalloc(sizeof(*entry) + clen,
+			GFP_NOWAIT | __GFP_NOMEMALLOC | __GFP_NOWARN);
+	if (!entry) {
+		put_cpu();
+		goto reject;
+	}
+	memcpy(entry->data, dst, clen);
+	put_cpu();
+
+	entry->mapping = mapping;
+	entry->index = page->index;
+	entry->len = clen;
+
+	spin_lock(&ccache_lock);
+	old = ccache_insert(entry);
+	ccache_evict(ccache_limit(), 0, &victims);
+	spin_unlock(&ccache_lock);
+
+	kfree(old);
+	ccache_free_list(&victims, 1);
+	count_vm_event(CCACHE_PUT);
+	return;
+
+reject:
+	ccache_flush_page(mapping, page->index);
+	count_vm_event(CCACHE_REJECT);
+}
+
+/**
+ * ccache_readpage - fill a page from the compressed cache
+ * @page: locked, !uptodate page just added to its mapping
+ *
+ * On a hit the page is made uptodate and unlocked, exactly as a
+ * completed ->readpage() would leave it, and 0 is returned.  Otherwise
+ * the page is left alone and the caller must issue the real read.
+ */
+int ccache_readpage(struct page *page)
+{
+	struct ccache_entry *entry;
+	size_t len = PAGE_SIZE;
+	void *dst;
+	int ret;
+
+	if (!ccache_ready || !sysctl_ccache_max_pages)
+		return -ENODATA;
+
+	spin_lock(&ccache_lock);
+	entry = ccache_lookup(page->mapping, page->index);
+	if (entry)
+		ccache_unlink(entry);
+	spin_unlock(&ccache_lock);
+
+	if (!entry) {
+		count_vm_event(CCACHE_MISS);
+		return -ENODATA;
+	}
+
+	dst = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_decompress_safe(entry->data, entry->len, dst, &len);
+	kunmap_atomic(dst, KM_USER0);
+	kfree(entry);
+
+	if (WARN_ON_ONCE(ret != LZO_E_OK || len != PAGE_SIZE)) {
+		count_vm_event(CCACHE_MISS);
+		return -EIO;
+	}
+
+	flush_dcache_page(page);
+	SetPageUptodate(page);
+	unlock_page(page);
+	count_vm_event(CCACHE_HIT);
+	return 0;
+}
+
+/**
+ * ccache_contains - check whether a page is held in the compressed cache
+ * @mapping: the address_space
+ * @index: page index
+ *
+ * Only a hint: the entry may be gone by the time ccache_readpage() runs.
+ */
+int ccache_contains(struct address_space *mapping, pgoff_t index)
+{
+	int ret;
+
+	if (RB_EMPTY_ROOT(&ccache_tree))
+		return 0;
+
+	spin_lock(&ccache_lock);
+	ret = ccache_lookup(mapping, index) != NULL;
+	spin_unlock(&ccache_lock);
+	return ret;
+}
+
+/**
+ * ccache_flush_range - drop cached copies of a range of a mapping
+ * @mapping: the address_space
+ * @start: first page index to drop
+ * @end: last page index to drop, inclusive
+ */
+void ccache_flush_range(struct address_space *mapping,
+			pgoff_t start, pgoff_t end)
+{
+	struct ccache_entry *entry;
+	struct rb_node *n, *first = NULL;
+	LIST_HEAD(victims);
+
+	if (RB_EMPTY_ROOT(&ccache_tree))
+		return;
+
+	spin_lock(&ccache_lock);
+	/* Find the leftmost entry at or after (mapping, start). */
+	n = ccache_tree.rb_node;
+	while (n) {
+		entry = rb_entry(n, struct ccache_entry, node);
+		if (ccache_cmp(mapping, start, entry) <= 0) {
+			first = n;
+			n = n->rb_left;
+		} else {
+			n = n->rb_right;
+		}
+	}
+
+	while (first) {
+		entry = rb_entry(first, struct ccache_entry, node);
+		if (entry->mapping != mapping || entry->index > end)
+			break;
+		first = rb_next(first);
+		ccache_unlink(entry);
+		list_add(&entry->lru, &victims);
+	}
+	spin_unlock(&ccache_lock);
+
+	ccache_free_list(&victims, 0);
+}
+EXPORT_SYMBOL(ccache_flush_range);
+
+int ccache_max_pages_handler(struct ctl_table *table, int write,
+			     void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+	ccache_trim();
+	return 0;
+}
+
+static int ccache_shrink(int nr_to_scan, gfp_t gfp_mask)
+{
+	if (nr_to_scan) {
+		LIST_HEAD(victims);
+
+		spin_lock(&ccache_lock);
+		ccache_evict(0, nr_to_scan, &victims);
+		spin_unlock(&ccache_lock);
+		ccache_free_list(&victims, 1);
+	}
+	return ccache_nr_entries;
+}
+
+static struct shrinker ccache_shrinker = {
+	.shrink = ccache_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init ccache_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		void *wrkmem;
+		u8 *dst;
+
+		wrkmem = kmalloc(LZO1X_1_MEM_COMPRESS, GFP_KERNEL);
+		dst = kmalloc(lzo1x_worst_compress(PAGE_SIZE), GFP_KERNEL);
+		per_cpu(ccache_wrkmem, cpu) = wrkmem;
+		per_cpu(ccache_dst, cpu) = dst;
+		if (!wrkmem || !dst)
+			goto fail;
+	}
+
+	sysctl_ccache_max_pages = totalram_pages / 10;
+	register_shrinker(&ccache_shrinker);
+	ccache_ready = 1;
+	return 0;
+
+fail:
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(ccache_wrkmem, cpu));
+		kfree(per_cpu(ccache_dst, cpu));
+	}
+	printk(KERN_WARNING "ccache: out of memory, disabled\n");
+	return -ENOMEM;
+}
+module_init(ccache_init)
@@ -34,6 +34,7 @@
 #include <linux/hardirq.h> /* for BUG_ON(!in_atomic()) only */
 #include <linux/memcontrol.h>
 #include <linux/mm_inline.h> /* for page_is_file_cache() */
+#include <linux/ccache.h>
 #include "internal.h"
 
 /*
@@ -1131,7 +1132,9 @@ readpage:
 		 */
 		ClearPageError(page);
 		/* Start the actual read. The read will unlock the page. */
-		error = mapping->a_ops->readpage(filp, page);
+		error = ccache_readpage(page);
+		if (error)
+			error = mapping->a_ops->readpage(filp, page);
 
 		if (unlikely(error)) {
 			if (error == AOP_TRUNCATED_PAGE) {
@@ -1412,9 +1415,11 @@ static int page_cache_read(struct file *file, pgoff_t offset)
 			return -ENOMEM;
 
 		ret = add_to_page_cache_lru(page, mapping, offset, GFP_KERNEL);
-		if (ret == 0)
-			ret = mapping->a_ops->readpage(file, page);
-		else if (ret == -EEXIST)
+		if (ret == 0) {
+			ret = ccache_readpage(page);
+			if (ret)
+				ret = mapping->a_ops->readpage(file, page);
+		} else if (ret == -EEXIST)
 			ret = 0; /* losing race to add is OK */
 
 		page_cache_release(page);
@@ -2163,6 +2168,9 @@ generic_file_direct_write(struct kiocb *iocb, const struct iovec *iov,
 	if (mapping->nrpages) {
 		invalidate_inode_pages2_range(mapping,
 					      pos >> PAGE_CACHE_SHIFT, end);
+	} else {
+		/* Compressed copies live outside the page cache proper. */
+		ccache_flush_range(mapping, pos >> PAGE_CACHE_SHIFT, end);
 	}
 
 	if (written > 0) {
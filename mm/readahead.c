@@ -16,6 +16,7 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
+#include <linux/ccache.h>
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
@@ -105,12 +106,43 @@ int read_cache_pages(struct address_space *mapping, struct list_head *pages,
 
 EXPORT_SYMBOL(read_cache_pages);
 
+/*
+ * Fill whatever the compressed cache holds before building I/O for the
+ * rest, so that the hits do not get caught up in ->readpages().  Falls
+ * back to ->readpage() if an entry went away meanwhile.  Returns the
+ * number of pages taken off @pages.
+ */
+static unsigned read_pages_ccache(struct address_space *mapping,
+		struct file *filp, struct list_head *pages)
+{
+	struct page *page, *next;
+	unsigned nr = 0;
+
+	list_for_each_entry_safe(page, next, pages, lru) {
+		if (!ccache_contains(mapping, page->index))
+			continue;
+		list_del(&page->lru);
+		if (!add_to_page_cache_lru(page, mapping,
+					page->index, GFP_KERNEL)) {
+			if (ccache_readpage(page))
+				mapping->a_ops->readpage(filp, page);
+		}
+		page_cache_release(page);
+		nr++;
+	}
+	return nr;
+}
+
 static int read_pages(struct address_space *mapping, struct file *filp,
 		struct list_head *pages, unsigned nr_pages)
 {
 	unsigned page_idx;
 	int ret;
 
+	nr_pages -= read_pages_ccache(mapping, filp, pages);
+	if (!nr_pages)
+		return 0;
+
 	if (mapping->a_ops->readpages) {
 		ret = mapping->a_ops->readpages(filp, mapping, pages, nr_pages);
 		/* Clean up the remaining pages */
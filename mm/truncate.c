@@ -16,6 +16,7 @@
 #include <linux/highmem.h>
 #include <linux/pagevec.h>
 #include <linux/task_io_accounting_ops.h>
+#include <linux/ccache.h>
 #include <linux/buffer_head.h>	/* grr. try_to_release_page,
 				   do_invalidatepage */
 #include "internal.h"
@@ -215,7 +216,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	int i;
 
 	if (mapping->nrpages == 0)
-		return;
+		goto out;
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
 	end = (lend >> PAGE_CACHE_SHIFT);
@@ -287,6 +288,9 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		}
 		pagevec_release(&pvec);
 	}
+out:
+	ccache_flush_range(mapping, lstart >> PAGE_CACHE_SHIFT,
+			   lend >> PAGE_CACHE_SHIFT);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
 
@@ -356,6 +360,7 @@ unsigned long invalidate_mapping_pages(struct address_space *mapping,
 		pagevec_release(&pvec);
 		cond_resched();
 	}
+	ccache_flush_range(mapping, start, end);
 	return ret;
 }
 EXPORT_SYMBOL(invalidate_mapping_pages);
@@ -480,6 +485,7 @@ int invalidate_inode_pages2_range(struct address_space *mapping,
 		pagevec_release(&pvec);
 		cond_resched();
 	}
+	ccache_flush_range(mapping, start, end);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(invalidate_inode_pages2_range);
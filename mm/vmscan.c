@@ -40,6 +40,7 @@
 #include <linux/memcontrol.h>
 #include <linux/delayacct.h>
 #include <linux/sysctl.h>
+#include <linux/ccache.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -758,9 +759,21 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping)
 			goto keep_locked;
 
+		/*
+		 * Offer clean file pages to the compressed cache before
+		 * they go; if the page cannot be freed after all, drop the
+		 * copy again so it can never go stale.
+		 */
+		if (!PageAnon(page) && PageUptodate(page))
+			ccache_put_page(page);
+		if (!__remove_mapping(mapping, page)) {
+			ccache_flush_page(mapping, page->index);
+			goto keep_locked;
+		}
+
 		/*
 		 * At this point, we have no other references and there is
 		 * no way to pick any more up (removed from LRU, removed
@@ -712,6 +712,13 @@ static const char * const vmstat_text[] = {
 	"unevictable_pgs_cleared",
 	"unevictable_pgs_stranded",
 	"unevictable_pgs_mlockfreed",
+#ifdef CONFIG_CCACHE
+	"ccache_hit",
+	"ccache_miss",
+	"ccache_put",
+	"ccache_reject",
+	"ccache_evict",
+#endif
 #endif
 };
 
@@ -25,6 +25,10 @@
 
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <asm/local.h>
 #include <asm/unaligned.h>
 #include <net/sock.h>
 
@@ -40,6 +44,40 @@ MODULE_PARM_DESC(phonet_gid, "Group id for phonet access control (default 0)");
 /* Transport protocol registration */
 static struct phonet_protocol *proto_tab[PHONET_NPROTO] __read_mostly;
 
+/* Packet counters, kept per CPU and summed in /proc/net/phonet_stat */
+enum {
+	PN_MIB_INPKTS,
+	PN_MIB_INDELIVERS,
+	PN_MIB_INNOSOCKS,
+	PN_MIB_INNOROUTES,
+	PN_MIB_FORWARDED,
+	PN_MIB_OUTPKTS,
+	PN_MIB_OUTNOROUTES,
+	PN_MIB_MAX
+};
+
+static const char *const pn_mib_names[PN_MIB_MAX] = {
+	"InPackets",
+	"InDelivers",
+	"InNoSockets",
+	"InNoRoutes",
+	"Forwarded",
+	"OutPackets",
+	"OutNoRoutes",
+};
+
+struct pn_mib {
+	local_t mibs[PN_MIB_MAX];
+};
+
+static DEFINE_PER_CPU(struct pn_mib, pn_mib);
+
+static inline void pn_inc_stats(int field)
+{
+	local_inc(&get_cpu_var(pn_mib).mibs[field]);
+	put_cpu_var(pn_mib);
+}
+
 /* Check credentials required for phonet access */
 int phonet_access_check()
 {
@@ -196,6 +234,7 @@ static int pn_send(struct sk_buff *skb, struct net_device *dev,
 	ph->pn_length = __cpu_to_be16(skb->len + 2 - sizeof(*ph));
 	ph->pn_robj = pn_obj(dst);
 	ph->pn_sobj = pn_obj(src);
+	pn_inc_stats(PN_MIB_OUTPKTS);
 
 	skb->protocol = htons(ETH_P_PHONET);
 	skb->priority = 0;
@@ -274,8 +313,10 @@ int pn_skb_send(struct sock *sk, struct sk_buff *skb,
 	} else
 		dev = phonet_route_output(net, daddr);
 
-	if (!dev || !(dev->flags & IFF_UP))
+	if (!dev || !(dev->flags & IFF_UP)) {
+		pn_inc_stats(PN_MIB_OUTNOROUTES);
 		goto drop;
+	}
 
 	saddr = phonet_address_get(dev, daddr);
 	if (saddr == PN_NO_ADDR)
@@ -383,6 +424,7 @@ static int phonet_rcv(struct sk_buff *skb, struct net_device *dev,
 
 	if (!net_eq(net, &init_net))
 		goto out;
+	pn_inc_stats(PN_MIB_INPKTS);
 	/* check we have at least a full Phonet header */
 	if (!pskb_pull(skb, sizeof(struct phonethdr)))
 		goto out;
@@ -405,6 +447,7 @@ static int phonet_rcv(struct sk_buff *skb, struct net_device *dev,
 
 	/* check if this is broadcasted */
 	if (pn_sockaddr_get_addr(&sa) == PNADDR_BROADCAST) {
+		pn_inc_stats(PN_MIB_INDELIVERS);
 		pn_deliver_sock_broadcast(net, skb);
 		goto out;
 	}
@@ -412,8 +455,10 @@ static int phonet_rcv(struct sk_buff *skb, struct net_device *dev,
 	/* resource routing */
 	if (pn_sockaddr_get_object(&sa) == 0) {
 		struct sock *sk = pn_find_sock_by_res(net, sa.spn_resource);
-		if (sk)
+		if (sk) {
+			pn_inc_stats(PN_MIB_INDELIVERS);
 			return sk_receive_skb(sk, skb, 0);
+		}
 	}
 
 	/* check if we are the destination */
@@ -421,9 +466,12 @@ static int phonet_rcv(struct sk_buff *skb, struct net_device *dev,
 		/* Phonet packet input */
 		struct sock *sk = pn_find_sock_by_sa(net, &sa);
 
-		if (sk)
+		if (sk) {
+			pn_inc_stats(PN_MIB_INDELIVERS);
 			return sk_receive_skb(sk, skb, 0);
+		}
 
+		pn_inc_stats(PN_MIB_INNOSOCKS);
 		if (can_respond(skb)) {
 			send_obj_unreachable(skb);
 			send_reset_indications(skb);
@@ -436,6 +484,7 @@ static int phonet_rcv(struct sk_buff *skb, struct net_device *dev,
 
 		out_dev = phonet_route_output(net, pn_sockaddr_get_addr(&sa));
 		if (!out_dev) {
+			pn_inc_stats(PN_MIB_INNOROUTES);
 			LIMIT_NETDEBUG(KERN_WARNING"No Phonet route to %02X\n",
 					pn_sockaddr_get_addr(&sa));
 			goto out;
@@ -457,6 +506,7 @@ static int phonet_rcv(struct sk_buff *skb, struct net_device *dev,
 			goto out_dev;
 		dev_queue_xmit(skb);
 		dev_put(out_dev);
+		pn_inc_stats(PN_MIB_FORWARDED);
 		return NET_RX_SUCCESS;
 out_dev:
 		dev_put(out_dev);
@@ -508,6 +558,39 @@ void phonet_proto_unregister(unsigned int protocol, struct phonet_protocol *pp)
 }
 EXPORT_SYMBOL(phonet_proto_unregister);
 
+static int pn_stat_seq_show(struct seq_file *seq, void *v)
+{
+	unsigned i;
+	int cpu;
+
+	seq_puts(seq, "Phonet:");
+	for (i = 0; i < PN_MIB_MAX; i++)
+		seq_printf(seq, " %s", pn_mib_names[i]);
+	seq_puts(seq, "\nPhonet:");
+	for (i = 0; i < PN_MIB_MAX; i++) {
+		unsigned long sum = 0;
+
+		for_each_possible_cpu(cpu)
+			sum += local_read(&per_cpu(pn_mib, cpu).mibs[i]);
+		seq_printf(seq, " %lu", sum);
+	}
+	seq_putc(seq, '\n');
+	return 0;
+}
+
+static int pn_stat_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pn_stat_seq_show, NULL);
+}
+
+static const struct file_operations pn_stat_seq_fops = {
+	.owner = THIS_MODULE,
+	.open = pn_stat_seq_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 /* Module registration */
 static int __init phonet_init(void)
 {
@@ -527,6 +610,7 @@ static int __init phonet_init(void)
 
 	dev_add_pack(&phonet_packet_type);
 	phonet_sysctl_init();
+	proc_net_fops_create(&init_net, "phonet_stat", 0, &pn_stat_seq_fops);
 
 	err = isi_register();
 	if (err)
@@ -534,6 +618,7 @@ static int __init phonet_init(void)
 	return 0;
 
 err:
+	proc_net_remove(&init_net, "phonet_stat");
 	phonet_sysctl_exit();
 	sock_unregister(PF_PHONET);
 	dev_remove_pack(&phonet_packet_type);
@@ -545,10 +630,12 @@ err_sock:
 static void __exit phonet_exit(void)
 {
 	isi_unregister();
+	proc_net_remove(&init_net, "phonet_stat");
 	phonet_sysctl_exit();
 	sock_unregister(PF_PHONET);
 	dev_remove_pack(&phonet_packet_type);
 	phonet_device_exit();
+	rcu_barrier(); /* wait for pn_sock_unhash() callbacks */
 }
 
 module_init(phonet_init);
@@ -33,6 +33,7 @@
 #include <net/phonet/gprs.h>
 
 #define GPRS_DEFAULT_MTU 1400
+#define GPRS_NAPI_WEIGHT 64
 
 struct gprs_dev {
 	struct sock		*sk;
@@ -41,6 +42,8 @@ struct gprs_dev {
 	void			(*old_write_space)(struct sock *);
 
 	struct net_device	*dev;
+	struct napi_struct	napi;
+	struct sk_buff_head	rxq;
 };
 
 static __be16 gprs_type_trans(struct sk_buff *skb)
@@ -85,6 +88,45 @@ static void gprs_state_change(struct sock *sk)
 	}
 }
 
+/*
+ * GRO compares ETH_HLEN bytes at the MAC header of every packet, and only
+ * merges linear or paged buffers. Give it a linear buffer with the IP
+ * header 4-byte aligned, preceded by a zeroed pseudo link-layer header
+ * that is the same for every packet on the interface.
+ */
+#define GPRS_RX_HLEN ALIGN(ETH_HLEN, 4)
+
+static struct sk_buff *gprs_rx_prepare(struct net_device *dev,
+					struct sk_buff *skb)
+{
+	unsigned int shift = skb_headroom(skb) & 3;
+
+	if (skb_is_nonlinear(skb) || skb_cloned(skb) ||
+	    skb_headroom(skb) < ETH_HLEN + shift) {
+		struct sk_buff *nskb;
+
+		nskb = netdev_alloc_skb(dev, GPRS_RX_HLEN + skb->len);
+		if (nskb) {
+			skb_reserve(nskb, GPRS_RX_HLEN);
+			skb_copy_bits(skb, 0, skb_put(nskb, skb->len),
+					skb->len);
+		}
+		dev_kfree_skb(skb);
+		if (!nskb)
+			return NULL;
+		skb = nskb;
+	} else if (shift) {
+		/* Phonet Pipe data header may be misaligned (3 bytes) */
+		memmove(skb->data - shift, skb->data, skb->len);
+		skb->data -= shift;
+		skb_set_tail_pointer(skb, skb->len);
+	}
+
+	memset(skb->data - ETH_HLEN, 0, ETH_HLEN);
+	skb_set_mac_header(skb, -ETH_HLEN);
+	return skb;
+}
+
 static int gprs_recv(struct gprs_dev *gp, struct sk_buff *skb)
 {
 	struct net_device *dev = gp->dev;
@@ -96,44 +138,19 @@ static int gprs_recv(struct gprs_dev *gp, struct sk_buff *skb)
 		goto drop;
 	}
 
-	if (skb_headroom(skb) & 3) {
-		struct sk_buff *rskb, *fs;
-		int flen = 0;
-
-		/* Phonet Pipe data header may be misaligned (3 bytes),
-		 * so wrap the IP packet as a single fragment of an head-less
-		 * socket buffer. The network stack will pull what it needs,
-		 * but at least, the whole IP payload is not memcpy'd. */
-		rskb = netdev_alloc_skb(dev, 0);
-		if (!rskb) {
-			err = -ENOBUFS;
-			goto drop;
-		}
-		skb_shinfo(rskb)->frag_list = skb;
-		rskb->len += skb->len;
-		rskb->data_len += rskb->len;
-		rskb->truesize += rskb->len;
-
-		/* Avoid nested fragments */
-		skb_walk_frags(skb, fs)
-			flen += fs->len;
-		skb->next = skb_shinfo(skb)->frag_list;
-		skb_frag_list_init(skb);
-		skb->len -= flen;
-		skb->data_len -= flen;
-		skb->truesize -= flen;
-
-		skb = rskb;
+	skb = gprs_rx_prepare(dev, skb);
+	if (!skb) {
+		dev->stats.rx_dropped++;
+		return -ENOBUFS;
 	}
 
 	skb->protocol = protocol;
-	skb_reset_mac_header(skb);
 	skb->dev = dev;
 
 	if (likely(dev->flags & IFF_UP)) {
 		dev->stats.rx_packets++;
 		dev->stats.rx_bytes += skb->len;
-		netif_rx(skb);
+		napi_gro_receive(&gp->napi, skb);
 		skb = NULL;
 	} else
 		err = -ENODEV;
@@ -146,15 +163,47 @@ drop:
 	return err;
 }
 
+/*
+ * Packets are drained from the pipe here and handed to the stack from the
+ * NAPI poll, so that consecutive TCP segments can be merged by GRO.
+ */
 static void gprs_data_ready(struct sock *sk, int len)
 {
 	struct gprs_dev *gp = sk->sk_user_data;
+	struct net_device *dev = gp->dev;
 	struct sk_buff *skb;
 
 	while ((skb = pep_read(sk)) != NULL) {
 		skb_orphan(skb);
+		if (unlikely(!netif_running(dev))) {
+			dev_kfree_skb(skb);
+			dev->stats.rx_dropped++;
+			continue;
+		}
+		skb_queue_tail(&gp->rxq, skb);
+	}
+	if (!skb_queue_empty(&gp->rxq))
+		napi_schedule(&gp->napi);
+}
+
+static int gprs_poll(struct napi_struct *napi, int budget)
+{
+	struct gprs_dev *gp = container_of(napi, struct gprs_dev, napi);
+	struct sk_buff *skb;
+	int work = 0;
+
+	while ((work < budget) && (skb = skb_dequeue(&gp->rxq))) {
 		gprs_recv(gp, skb);
+		work++;
+	}
+	if (work < budget) {
+		napi_complete(napi);
+		/* Catch packets queued before NAPI_STATE_SCHED was cleared */
+		if (!skb_queue_empty(&gp->rxq))
+			napi_reschedule(napi);
 	}
+
+	return work;
 }
 
 static void gprs_write_space(struct sock *sk)
@@ -173,13 +222,18 @@ static int gprs_open(struct net_device *dev)
 {
 	struct gprs_dev *gp = netdev_priv(dev);
 
+	napi_enable(&gp->napi);
 	gprs_writeable(gp);
 	return 0;
 }
 
 static int gprs_close(struct net_device *dev)
 {
+	struct gprs_dev *gp = netdev_priv(dev);
+
 	netif_stop_queue(dev);
+	napi_disable(&gp->napi);
+	skb_queue_purge(&gp->rxq);
 	return 0;
 }
 
@@ -236,7 +290,7 @@ static const struct net_device_ops gprs_netdev_ops = {
 
 static void gprs_setup(struct net_device *dev)
 {
-	dev->features		= NETIF_F_FRAGLIST;
+	dev->features		= NETIF_F_FRAGLIST | NETIF_F_GRO;
 	dev->type		= ARPHRD_PHONET_PIPE;
 	dev->flags		= IFF_POINTOPOINT | IFF_NOARP;
 	dev->mtu		= GPRS_DEFAULT_MTU;
@@ -273,6 +327,8 @@ int gprs_attach(struct sock *sk)
 	gp = netdev_priv(dev);
 	gp->sk = sk;
 	gp->dev = dev;
+	skb_queue_head_init(&gp->rxq);
+	netif_napi_add(dev, &gp->napi, gprs_poll, GPRS_NAPI_WEIGHT);
 
 	netif_stop_queue(dev);
 	err = register_netdev(dev);
@@ -46,8 +46,13 @@
  *  - pipe_handle: read only
  */
 
-#define CREDITS_MAX	10
-#define CREDITS_THR	7
+/* Credits are granted in batches of 70% of the window */
+static inline int pipe_credits_thr(int max)
+{
+	int thr = max * 7 / 10;
+
+	return thr ? thr : 1;
+}
 
 static const struct sockaddr_pn pipe_srv = {
 	.spn_family = AF_PHONET,
@@ -210,15 +215,18 @@ static void pipe_grant_credits(struct sock *sk)
 				PEP_IND_READY, GFP_ATOMIC);
 		pn->rx_credits = 1;
 		break;
-	case PN_MULTI_CREDIT_FLOW_CONTROL:
-		if ((pn->rx_credits + CREDITS_THR) > CREDITS_MAX)
+	case PN_MULTI_CREDIT_FLOW_CONTROL: {
+		int max = phonet_pipe_credits();
+
+		if ((pn->rx_credits + pipe_credits_thr(max)) > max)
 			break;
 		if (pipe_snd_status(sk, PN_PEP_IND_ID_MCFC_GRANT_CREDITS,
-					CREDITS_MAX - pn->rx_credits,
+					max - pn->rx_credits,
 					GFP_ATOMIC) == 0)
-			pn->rx_credits = CREDITS_MAX;
+			pn->rx_credits = max;
 		break;
 	}
+	}
 }
 
 static int pipe_rcv_status(struct sock *sk, struct sk_buff *skb)
@@ -33,6 +33,11 @@
 #include <net/netns/generic.h>
 #include <net/phonet/pn_dev.h>
 
+/*
+ * Routes are looked up under RCU. Updates serialize on the spinlock; a
+ * device reference dropped from process context is only released after
+ * a grace period, so that readers can still hold the device they found.
+ */
 struct phonet_routes {
 	spinlock_t		lock;
 	DECLARE_BITMAP(immutable, 64);
@@ -263,7 +268,7 @@ static int phonet_device_autoconf(struct net_device *dev)
 static void phonet_route_autodel(struct net_device *dev)
 {
 	struct phonet_net *pnn = net_generic(dev_net(dev), phonet_net_id);
-	unsigned i;
+	unsigned i, refs = 0;
 	DECLARE_BITMAP(deleted, 64);
 
 	/* Remove left-over Phonet routes */
@@ -273,10 +278,15 @@ static void phonet_route_autodel(struct net_device *dev)
 		if (dev == pnn->routes.table[i]) {
 			if (test_and_clear_bit(i, pnn->routes.immutable))
 				set_bit(i, deleted);
-			pnn->routes.table[i] = NULL;
-			dev_put(dev);
+			rcu_assign_pointer(pnn->routes.table[i], NULL);
+			refs++;
 		}
 	spin_unlock_bh(&pnn->routes.lock);
+
+	if (refs)
+		synchronize_rcu();
+	while (refs-- > 0)
+		dev_put(dev);
 	for (i = find_first_bit(deleted, 64); i < 64;
 			i = find_next_bit(deleted, 64, i + 1))
 		rtm_phonet_notify(RTM_DELROUTE, dev, i);
@@ -399,8 +409,13 @@ static int __phonet_route_add(struct net_device *dev, u8 daddr, u8 immutable)
 	if (!test_bit(daddr, routes->immutable)) {
 		struct net_device *old_dev = routes->table[daddr];
 
-		routes->table[daddr] = dev;
 		dev_hold(dev);
+		rcu_assign_pointer(routes->table[daddr], dev);
+		/*
+		 * May run in softirq context (route learning): no grace
+		 * period here. old_dev is still registered, otherwise its
+		 * routes would have been removed by phonet_route_autodel().
+		 */
 		if (old_dev)
 			dev_put(old_dev);
 		if (immutable)
@@ -426,11 +441,15 @@ int phonet_route_del(struct net_device *dev, u8 daddr)
 	spin_lock_bh(&routes->lock);
 	if (dev == routes->table[daddr] &&
 	    test_and_clear_bit(daddr, routes->immutable)) {
-		routes->table[daddr] = NULL;
-		dev_put(dev);
+		rcu_assign_pointer(routes->table[daddr], NULL);
 		err = 0;
 	}
 	spin_unlock_bh(&routes->lock);
+
+	if (!err) {
+		synchronize_rcu();
+		dev_put(dev);
+	}
 	return err;
 }
 
@@ -443,10 +462,10 @@ struct net_device *phonet_route_get(struct net *net, u8 daddr, u8 *immutable)
 	ASSERT_RTNL(); /* no need to hold the device */
 
 	daddr >>= 2;
-	spin_lock_bh(&routes->lock);
-	dev = routes->table[daddr];
+	rcu_read_lock();
+	dev = rcu_dereference(routes->table[daddr]);
 	*immutable = test_bit(daddr, routes->immutable);
-	spin_unlock_bh(&routes->lock);
+	rcu_read_unlock();
 	return dev;
 }
 
@@ -456,15 +475,20 @@ struct net_device *phonet_route_output(struct net *net, u8 daddr)
 	struct phonet_routes *routes = &pnn->routes;
 	struct net_device *dev;
 
-	spin_lock_bh(&routes->lock);
-	dev = routes->table[daddr >> 2];
+	rcu_read_lock();
+	dev = rcu_dereference(routes->table[daddr >> 2]);
 	if (dev)
 		dev_hold(dev);
-	spin_unlock_bh(&routes->lock);
+	rcu_read_unlock();
 	return dev;
 }
 
 int phonet_route_input(struct net_device *dev, u8 src)
 {
+	struct phonet_net *pnn = net_generic(dev_net(dev), phonet_net_id);
+
+	/* Common case: the route is already known, nothing to learn */
+	if (rcu_dereference(pnn->routes.table[src >> 2]) == dev)
+		return 0;
 	return __phonet_route_add(dev, src, 0);
 }
@@ -26,14 +26,22 @@
 #include <linux/sysctl.h>
 #include <linux/errno.h>
 #include <linux/init.h>
+#include <linux/module.h>
 
 #define DYNAMIC_PORT_MIN	0x40
 #define DYNAMIC_PORT_MAX	0x7f
 
+/* Credits fit in the 8-bit status field of a grant indication */
+#define PIPE_CREDITS_DEFAULT	10
+#define PIPE_CREDITS_MAX	255
+
 static DEFINE_SEQLOCK(local_port_range_lock);
 static int local_port_range_min[2] = {0, 0};
 static int local_port_range_max[2] = {1023, 1023};
 static int local_port_range[2] = {DYNAMIC_PORT_MIN, DYNAMIC_PORT_MAX};
+static int pipe_credits_min = 1;
+static int pipe_credits_max = PIPE_CREDITS_MAX;
+static int pipe_credits = PIPE_CREDITS_DEFAULT;
 static struct ctl_table_header *phonet_table_hrd;
 
 static void set_local_port_range(int range[2])
@@ -56,6 +64,13 @@ void phonet_get_local_port_range(int *min, int *max)
 	} while (read_seqretry(&local_port_range_lock, seq));
 }
 
+/* Multi-credit flow control receive window of pipes */
+int phonet_pipe_credits(void)
+{
+	return ACCESS_ONCE(pipe_credits);
+}
+EXPORT_SYMBOL(phonet_pipe_credits);
+
 static int proc_local_port_range(ctl_table *table, int write,
 				void __user *buffer,
 				size_t *lenp, loff_t *ppos)
@@ -92,6 +107,17 @@ static struct ctl_table phonet_table[] = {
 		.proc_handler	= proc_local_port_range,
 		.strategy	= NULL,
 	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "pipe_credits",
+		.data		= &pipe_credits,
+		.maxlen		= sizeof(pipe_credits),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.strategy	= NULL,
+		.extra1		= &pipe_credits_min,
+		.extra2		= &pipe_credits_max,
+	},
 	{ .ctl_name = 0 }
 };
 
@@ -31,7 +31,7 @@
 #include <linux/module.h>
 #include <linux/sched.h>
 #include <linux/kref.h>
-#include <linux/mutex.h>
+#include <linux/rwsem.h>
 #include <linux/capability.h>
 #include <linux/security.h>
 #include <linux/syscalls.h>
@@ -165,9 +165,11 @@ static const struct policy_creds policy_creds_init = {
 };
 
 /*
- * Mutual exclusion for policy structures
+ * Mutual exclusion for policy structures. Policies are only changed
+ * by load and unload, all other users (most importantly the execve
+ * path in credp_apply) only read them and can run concurrently.
  */
-static DEFINE_MUTEX(mutex);
+static DECLARE_RWSEM(policy_rwsem);
 
 #define BYID_HASH 37
 static struct list_head byid_hash[BYID_HASH];
@@ -581,25 +583,25 @@ static void *credp_seq_start(struct seq_file *m, loff_t *pos)
 {
 	struct policy *policy;
 
-	mutex_lock(&mutex);
+	down_read(&policy_rwsem);
 	policy = credp_seq_position(*pos);
 	if (policy)
 		return policy;
-	mutex_unlock(&mutex);
+	up_read(&policy_rwsem);
 	return NULL;
 }
 
 static void credp_seq_stop(struct seq_file *m, void *v)
 {
 	if (v)
-		mutex_unlock(&mutex);
+		up_read(&policy_rwsem);
 }
 
 static void *credp_seq_next(struct seq_file *m, void *v, loff_t *pos)
 {
 	struct policy *policy = credp_seq_position(++*pos);
 	if (policy == NULL)
-		mutex_unlock(&mutex);
+		up_read(&policy_rwsem);
 	return policy;
 }
 
@@ -1108,7 +1110,7 @@ int credp_apply(struct linux_binprm *bprm, bool *effective)
 		*effective = !cap_isclear(new->cap_permitted);
 	}
 
-	mutex_lock(&mutex);
+	down_read(&policy_rwsem);
 	/*
 	 * If being traced/debugged, just fall back to plain
 	 * inheritance, no policy applied, no elevated credentials,
@@ -1173,7 +1175,7 @@ no_policy:
 		put_group_info(groups);
 	}
 out:
-	mutex_unlock(&mutex);
+	up_read(&policy_rwsem);
 	return ret;
 }
 
@@ -1333,7 +1335,7 @@ long credp_kload(int flags, const char *path,
 		id2 = file->f_dentry->d_inode->i_ino;
 		fput(file);
 
-		mutex_lock(&mutex);
+		down_write(&policy_rwsem);
 		policy = find_policy_byname(path, &bucket);
 		size = strlen(path);
 		hashlist = &name_hash[bucket];
@@ -1344,7 +1346,7 @@ long credp_kload(int flags, const char *path,
 		id2 = restok_locate(path);
 		if (id2 <= 0)
 			goto out1;
-		mutex_lock(&mutex);
+		down_write(&policy_rwsem);
 		policy = find_policy_byid(id2, &bucket);
 		size = 0;
 		hashlist = &byid_hash[bucket];
@@ -1383,7 +1385,7 @@ long credp_kload(int flags, const char *path,
 		enforce_origin_checking = &policy->pcreds;
 	retval = 0;
 out2:
-	mutex_unlock(&mutex);
+	up_write(&policy_rwsem);
 out1:
 	policy_creds_clear(&pcreds);
 	return retval;
@@ -1401,7 +1403,7 @@ long credp_kunload(const char *path)
 	if (!authorized_p())
 		return -EPERM;
 
-	mutex_lock(&mutex);
+	down_write(&policy_rwsem);
 	policy = find_policy_bypath(path);
 	if (policy) {
 		list_del(&policy->list);
@@ -1413,7 +1415,7 @@ long credp_kunload(const char *path)
 		kfree(policy);
 		ret = 0;
 	}
-	mutex_unlock(&mutex);
+	up_write(&policy_rwsem);
 	return ret;
 }
 
@@ -1513,13 +1515,13 @@ long credp_kconfine(const char *path)
 	struct policy *policy;
 	long ret;
 
-	mutex_lock(&mutex);
+	down_read(&policy_rwsem);
 	policy = find_policy_bypath(path);
 	if (policy)
 		ret = set_current_from_pcreds(CREDP_TYPE_SET, &policy->pcreds);
 	else
 		ret = drop_credentials();
-	mutex_unlock(&mutex);
+	up_read(&policy_rwsem);
 	return ret;
 }
 
@@ -1545,7 +1547,7 @@ long credp_kconfine2(const char *path, int flags,
 	struct policy *policy;
 	long ret;
 
-	mutex_lock(&mutex);
+	down_read(&policy_rwsem);
 	policy = find_policy_bypath(path);
 
 	if (policy) {
@@ -1572,7 +1574,7 @@ long credp_kconfine2(const char *path, int flags,
 		policy_creds_clear(&pcreds);
 	}
 
-	mutex_unlock(&mutex);
+	up_read(&policy_rwsem);
 	return ret;
 }
 
@@ -1642,7 +1644,7 @@ int credp_check(long srcid, const struct cred *cred)
 
 	unsigned int i;
 
-	mutex_lock(&mutex);
+	down_read(&policy_rwsem);
 	if (!enforce_origin_checking)
 		goto out;
 
@@ -1705,9 +1707,10 @@ int credp_check(long srcid, const struct cred *cred)
 		}
 	}
 out:
-	mutex_unlock(&mutex);
+	up_read(&policy_rwsem);
 	return ret;
 }
+EXPORT_SYMBOL(credp_check);
 
 /**
  * credp_ioctl - Transfer operation from user space to kernel
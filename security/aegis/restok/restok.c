@@ -94,6 +94,8 @@
 #include <linux/namei.h>
 #include <linux/mutex.h>
 #include <linux/list.h>
+#include <linux/rculist.h>
+#include <linux/slab.h>
 #include <linux/aegis/restok.h>
 #include <linux/aegis/restokctl.h>
 
@@ -122,7 +124,9 @@ struct token {
 };
 
 /*
- * Mutex for the database access
+ * Mutex for the database updates. Tokens are never modified or
+ * removed once defined (until the module is unloaded), so lookups
+ * only need rcu_read_lock to see a consistent hash chain.
  */
 static DEFINE_MUTEX(mutex);
 
@@ -136,6 +140,18 @@ static DEFINE_MUTEX(mutex);
 #define TOKEN_HASH_SIZE 509
 static struct list_head token_hash[TOKEN_HASH_SIZE];
 
+/*
+ * Table of tokens indexed by identifier
+ *
+ * Identifiers are allocated sequentially, so the table is a two level
+ * array of pointers. The second level blocks are allocated on demand
+ * when the first identifier falling into them is defined.
+ */
+#define TOKEN_BLOCK_SIZE (PAGE_SIZE / sizeof(struct token *))
+#define TOKEN_BLOCKS \
+	DIV_ROUND_UP(RESTOK_GROUP_MAX - RESTOK_GROUP_MIN + 1, TOKEN_BLOCK_SIZE)
+static struct token **token_byid[TOKEN_BLOCKS];
+
 /*
  * Last allocated resource identifier.
  */
@@ -166,7 +182,8 @@ static struct dentry *restok_fs_token;
  * @owner: Owner (parent) of the token to find
  * @bucket: Return index of the hash bucket which applies to this search
  *
- * Find a token that has the given name and owner.
+ * Find a token that has the given name and owner. Caller must hold
+ * either the mutex or rcu_read_lock.
  *
  * Return the token, if found.
  *
@@ -185,7 +202,7 @@ static struct token *find_by_name_owner(const char *name, size_t len,
 	struct token *p;
 
 	*bucket = full_name_hash(name, len) % TOKEN_HASH_SIZE;
-	list_for_each_entry(p, &token_hash[*bucket], list)
+	list_for_each_entry_rcu(p, &token_hash[*bucket], list)
 		if ((p->owner == owner || p == owner) &&
 		    p->len == len && memcmp(name, p->name, len) == 0)
 			return p;
@@ -196,17 +213,49 @@ static struct token *find_by_name_owner(const char *name, size_t len,
  * find_by_id - Find token by it's assigned number
  * @id: The identification number
  *
+ * Does not need any locking, the token table is only ever extended
+ * and the entries are published with rcu_assign_pointer.
+ *
  * Return found token, or NULL if not found.
  */
 static struct token *find_by_id(long id)
 {
-	int i;
-	struct token *p;
-	for (i = 0; i < TOKEN_HASH_SIZE; ++i)
-		list_for_each_entry(p, &token_hash[i], list)
-			if (p->id == id)
-				return p;
-	return NULL;
+	struct token **block;
+	unsigned long index;
+
+	if (id < RESTOK_GROUP_MIN || id > RESTOK_GROUP_MAX)
+		return NULL;
+	index = id - RESTOK_GROUP_MIN;
+	block = rcu_dereference(token_byid[index / TOKEN_BLOCK_SIZE]);
+	if (!block)
+		return NULL;
+	return rcu_dereference(block[index % TOKEN_BLOCK_SIZE]);
+}
+
+/**
+ * set_by_id - Enter a new token into the identifier table
+ * @token: The token, with id already assigned
+ *
+ * Must be called with mutex held.
+ *
+ * Return 0 on success, or -ENOMEM if a new table block was needed
+ * and could not be allocated.
+ */
+static int set_by_id(struct token *token)
+{
+	const unsigned long index = token->id - RESTOK_GROUP_MIN;
+	struct token **block = token_byid[index / TOKEN_BLOCK_SIZE];
+
+	if (!block) {
+		block = kzalloc(TOKEN_BLOCK_SIZE * sizeof(*block),
+				GFP_KERNEL);
+		if (!block)
+			return -ENOMEM;
+		rcu_assign_pointer(token_byid[index / TOKEN_BLOCK_SIZE],
+				   block);
+	}
+	rcu_assign_pointer(block[index % TOKEN_BLOCK_SIZE], token);
+	return 0;
 }
 
 /**
@@ -289,7 +338,7 @@ long restok_locate(const char *name)
 	if (!name)
 		return -EINVAL;
 
-	mutex_lock(&mutex);
+	rcu_read_lock();
 	name = restok_follow_path(name, &token);
 	if (!name)
 		goto out;
@@ -298,7 +347,7 @@ long restok_locate(const char *name)
 	token = find_by_name_owner(name, strlen(name), token, &dummy);
 	retval = token ? token->id : 0;
 out:
-	mutex_unlock(&mutex);
+	rcu_read_unlock();
 	return retval;
 }
 EXPORT_SYMBOL(restok_locate);
@@ -353,12 +402,18 @@ long restok_define(const char *name, long owner_id)
 			retval = -ENOMEM;
 			goto out;
 		}
-		list_add_tail(&token->list, &token_hash[bucket]);
 		token->owner = owner;
 		token->len = len;
 		memcpy(token->name, name, len);
 		token->name[len] = 0;
-		token->id = ++resource_last;
+		token->id = resource_last + 1;
+		if (set_by_id(token)) {
+			kfree(token);
+			retval = -ENOMEM;
+			goto out;
+		}
+		++resource_last;
+		list_add_tail_rcu(&token->list, &token_hash[bucket]);
 	}
 	retval = token->id;
 out:
@@ -459,12 +514,10 @@ int restok_string(long id, __user char *str, size_t str_len)
 	char *path;
 	size_t actual, copy_len;
 
-	/* Because once allocated tokens are immutable,
-	 * mutex is only required while looking up...
+	/* Once allocated tokens are immutable and never released,
+	 * so no locking is required.
 	 */
-	mutex_lock(&mutex);
 	token = find_by_id(id);
-	mutex_unlock(&mutex);
 
 	if (!token)
 		/* FIXME: Misusing fs error code, because there does
@@ -573,12 +626,8 @@ static int restok_seq_show(struct seq_file *m, void *v)
 	char *path;
 	size_t len;
 
-	/* Because tokens are never deleted, only the searching needs
-	 * to be locked by mutex
-	 */
-	mutex_lock(&mutex);
+	/* Because tokens are never deleted, no locking is needed */
 	tkn = find_by_id((long)v);
-	mutex_unlock(&mutex);
 
 	path = restok_get_path(tkn, &len);
 
@@ -634,6 +683,10 @@ static inline void restok_cleanup(void)
 			kfree(p);
 		}
 	}
+	for (i = 0; i < TOKEN_BLOCKS; ++i) {
+		kfree(token_byid[i]);
+		token_byid[i] = NULL;
+	}
 }
 
 static int __init restok_init(void)
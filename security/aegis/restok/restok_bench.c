@@ -0,0 +1,244 @@
+/*
+ * This file is part of AEGIS
+ *
+ * Copyright (C) 2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/**
+ * DOC: Credential lookup microbenchmark
+ *
+ * Measures how many credential lookups per second the resource token
+ * database (and the credentials policy, when built in) can serve,
+ * with one thread per online CPU running the same lookup at once:
+ *
+ * locate	restok_locate() of a defined token, the lookup done for
+ *		every credential name passed to creds and pa
+ * miss		restok_locate() of an undefined name under a defined root
+ * check	credp_check() of the calling credentials against a source
+ *		id, done by the validator on every exec
+ *
+ * The benchmark runs when the module is loaded and prints the results.
+ * The tokens it defines, "restok-bench::tok<n>", stay defined until
+ * restok itself is unloaded, so repeated runs reuse them.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/jiffies.h>
+#include <linux/cpumask.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/cred.h>
+#include <linux/aegis/restok.h>
+#ifdef CONFIG_SECURITY_AEGIS_CREDP
+#include <linux/aegis/credp.h>
+#endif
+
+#define RESTOK_BENCH_NAME "restok_bench"
+#define RESTOK_BENCH_ROOT "restok-bench"
+#define RESTOK_BENCH_NAMELEN 32
+
+#define INFO(args...) pr_info(RESTOK_BENCH_NAME ": " args)
+#define ERR(args...) pr_err(RESTOK_BENCH_NAME ": " args)
+
+static unsigned int tokens = 256;
+module_param(tokens, uint, S_IRUGO);
+MODULE_PARM_DESC(tokens, "Number of tokens to define and look up");
+
+static unsigned int seconds = 2;
+module_param(seconds, uint, S_IRUGO);
+MODULE_PARM_DESC(seconds, "Duration of each test in seconds");
+
+static unsigned int threads;
+module_param(threads, uint, S_IRUGO);
+MODULE_PARM_DESC(threads, "Threads per test (0 = one per online CPU)");
+
+static char (*names)[RESTOK_BENCH_NAMELEN];
+static char (*misses)[RESTOK_BENCH_NAMELEN];
+static long *ids;
+
+/**
+ * struct bench_thread - State of one benchmark thread
+ * @test: The lookup to run; returns < 0 if it failed
+ * @end: Stop at this jiffies value
+ * @ops: Lookups completed
+ * @errors: Lookups that failed
+ * @done: Completed when the thread has stopped
+ */
+struct bench_thread {
+	int (*test)(unsigned int i);
+	unsigned long end;
+	unsigned long ops;
+	unsigned long errors;
+	struct completion done;
+};
+
+static int test_locate(unsigned int i)
+{
+	return restok_locate(names[i % tokens]) == ids[i % tokens] ? 0 : -1;
+}
+
+static int test_miss(unsigned int i)
+{
+	return restok_locate(misses[i % tokens]) == 0 ? 0 : -1;
+}
+
+#ifdef CONFIG_SECURITY_AEGIS_CREDP
+static int test_check(unsigned int i)
+{
+	credp_check(ids[i % tokens], current_cred());
+	return 0;
+}
+#endif
+
+static int bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	unsigned int i = 0;
+
+	while (time_before(jiffies, bt->end)) {
+		if (bt->test(i++) < 0)
+			bt->errors++;
+		bt->ops++;
+		if (!(i & 255))
+			cond_resched();
+	}
+	complete(&bt->done);
+
+	return 0;
+}
+
+/*
+ * Run test on nr threads at once, bound to CPUs in turn, and report the
+ * total rate.
+ */
+static int bench_run(const char *name, int (*test)(unsigned int i),
+		     unsigned int nr)
+{
+	struct bench_thread *bt;
+	struct task_struct *task;
+	unsigned long ops = 0, errors = 0;
+	unsigned long start;
+	unsigned int i, cpu;
+	int started = 0;
+	int retval = 0;
+
+	bt = kcalloc(nr, sizeof(*bt), GFP_KERNEL);
+	if (!bt)
+		return -ENOMEM;
+
+	start = jiffies + HZ / 10;
+	cpu = cpumask_first(cpu_online_mask);
+	for (i = 0; i < nr; i++) {
+		bt[i].test = test;
+		bt[i].end = start + seconds * HZ;
+		init_completion(&bt[i].done);
+		task = kthread_create(bench_thread_fn, &bt[i],
+				      RESTOK_BENCH_NAME "/%u", i);
+		if (IS_ERR(task)) {
+			retval = PTR_ERR(task);
+			break;
+		}
+		kthread_bind(task, cpu);
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		wake_up_process(task);
+		started++;
+	}
+	for (i = 0; i < started; i++) {
+		wait_for_completion(&bt[i].done);
+		ops += bt[i].ops;
+		errors += bt[i].errors;
+	}
+	if (!retval)
+		INFO("%-8s %u threads: %lu lookups/s, %lu errors\n", name, nr,
+		     ops / seconds, errors);
+	kfree(bt);
+	return retval;
+}
+
+static int __init define_tokens(void)
+{
+	long root;
+	unsigned int i;
+
+	root = restok_define(RESTOK_BENCH_ROOT, 0);
+	if (root <= 0)
+		return root ? root : -EINVAL;
+	for (i = 0; i < tokens; i++) {
+		snprintf(names[i], RESTOK_BENCH_NAMELEN, "tok%u", i);
+		ids[i] = restok_define(names[i], root);
+		if (ids[i] <= 0)
+			return ids[i] ? ids[i] : -EINVAL;
+		snprintf(names[i], RESTOK_BENCH_NAMELEN,
+			 RESTOK_BENCH_ROOT "::tok%u", i);
+		snprintf(misses[i], RESTOK_BENCH_NAMELEN,
+			 RESTOK_BENCH_ROOT "::miss%u", i);
+	}
+	return 0;
+}
+
+static int __init restok_bench_init(void)
+{
+	unsigned int nr = threads ? threads : num_online_cpus();
+	int retval;
+
+	if (!tokens || !seconds)
+		return -EINVAL;
+
+	names = kcalloc(tokens, sizeof(*names), GFP_KERNEL);
+	misses = kcalloc(tokens, sizeof(*misses), GFP_KERNEL);
+	ids = kcalloc(tokens, sizeof(*ids), GFP_KERNEL);
+	retval = -ENOMEM;
+	if (!names || !misses || !ids)
+		goto out;
+
+	retval = define_tokens();
+	if (retval) {
+		ERR("Cannot define tokens (%d)\n", retval);
+		goto out;
+	}
+
+	INFO("%u tokens, %u s per test\n", tokens, seconds);
+	retval = bench_run("locate", test_locate, 1);
+	if (!retval && nr > 1)
+		retval = bench_run("locate", test_locate, nr);
+	if (!retval)
+		retval = bench_run("miss", test_miss, nr);
+#ifdef CONFIG_SECURITY_AEGIS_CREDP
+	if (!retval)
+		retval = bench_run("check", test_check, nr);
+#endif
+out:
+	kfree(ids);
+	kfree(misses);
+	kfree(names);
+	return retval;
+}
+module_init(restok_bench_init);
+
+static void __exit restok_bench_exit(void)
+{
+}
+module_exit(restok_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Maemo Resource Token lookup benchmark");
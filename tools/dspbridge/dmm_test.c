@@ -0,0 +1,446 @@
+/*
+ * dmm_test - unit test of the DSP bridge DMM virtual address allocator
+ *
+ * Builds drivers/dsp/bridge/pmgr/dmm.c in userspace and runs random
+ * reserve, map, unmap and unreserve operations through its public
+ * interface, comparing every result with a simple page array model of
+ * the DSP virtual address space:
+ *
+ *  - a reservation must get the smallest free region that fits, the
+ *    lowest such region on ties, and fail only if none fits;
+ *  - unmapping returns the size that was mapped, and operations on
+ *    addresses that are not a chunk or mapping fail with DSP_ENOTFOUND;
+ *  - after every operation the free region trees must hold exactly the
+ *    free runs of the model, fully coalesced, in size and address
+ *    order, and the virtual_mapping_table entries must agree.
+ *
+ * A failing check prints the operation and seed and exits with status 1.
+ *
+ * Copyright (C) 2010 Nokia Corporation
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* The allocator's state is static, so the test is built around it */
+#include "dmm.c"
+
+#define BASE		0x11000000
+
+unsigned int mem_fail_after;
+
+/* Model of the address space: one entry per page */
+struct model_page {
+	u32 chunk;		/* Pages of the chunk starting here, or 0 */
+	u32 owner;		/* Start page of the owning chunk + 1, or 0 */
+	u32 map;		/* Pages of the mapping starting here, or 0 */
+	u32 mapped;		/* Page is covered by a mapping */
+};
+
+static struct model_page *model;
+static u32 pages;
+static struct dmm_object *dmm;
+
+static unsigned int seed = 1;
+static unsigned long op;
+static const char *op_name = "setup";
+static int cs_depth;
+
+static void fail(const char *fmt, ...)
+{
+	va_list ap;
+
+	fprintf(stderr, "op %lu (%s), seed %u: ", op, op_name, seed);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	exit(1);
+}
+
+/* Stand-ins for the bridge services dmm.c calls */
+dsp_status sync_initialize_cs(struct sync_csobject **phCSObj)
+{
+	*phCSObj = (struct sync_csobject *)&cs_depth;
+	return DSP_SOK;
+}
+
+dsp_status sync_delete_cs(struct sync_csobject *hCSObj)
+{
+	return DSP_SOK;
+}
+
+dsp_status sync_enter_cs(struct sync_csobject *hCSObj)
+{
+	if (cs_depth++)
+		fail("critical section entered twice\n");
+	return DSP_SOK;
+}
+
+dsp_status sync_leave_cs(struct sync_csobject *hCSObj)
+{
+	if (--cs_depth)
+		fail("critical section left unbalanced\n");
+	return DSP_SOK;
+}
+
+struct dev_object *dev_get_first(void)
+{
+	return NULL;
+}
+
+dsp_status dev_get_dmm_mgr(struct dev_object *hdev_obj,
+			   struct dmm_object **phMgr)
+{
+	*phMgr = dmm;
+	return DSP_SOK;
+}
+
+dsp_status proc_get_dev_object(void *hprocessor,
+			       struct dev_object **phDevObject)
+{
+	*phDevObject = NULL;
+	return DSP_SOK;
+}
+
+static u32 addr_of(u32 page)
+{
+	return BASE + page * PG_SIZE4K;
+}
+
+/* Next free run at or after *page in the model; returns its length */
+static u32 model_free_run(u32 *page)
+{
+	u32 i = *page, n;
+
+	while (i < pages && model[i].owner)
+		i++;
+	*page = i;
+	for (n = 0; i + n < pages && !model[i + n].owner; n++)
+		;
+	return n;
+}
+
+/* Where the model expects a reservation of n pages to go, or -1 */
+static long model_best_fit(u32 n)
+{
+	u32 i = 0, len, best_len = 0;
+	long best = -1;
+
+	while ((len = model_free_run(&i)) != 0) {
+		if (len >= n && (best < 0 || len < best_len)) {
+			best = i;
+			best_len = len;
+		}
+		i += len;
+	}
+	return best;
+}
+
+static void check(void)
+{
+	struct dmm_free_region *r, *prev = NULL;
+	struct rb_node *node;
+	u32 i = 0, len, nr = 0, nr_size = 0;
+
+	if (cs_depth)
+		fail("critical section still held\n");
+
+	/* Address order: exactly the model's free runs */
+	for (node = rb_first(&free_by_addr); node; node = rb_next(node)) {
+		r = rb_entry(node, struct dmm_free_region, addr_node);
+		len = model_free_run(&i);
+		if (!len || r->start != i || r->pages != len)
+			fail("free region %u+%u, model has %u+%u\n",
+			     r->start, r->pages, i, len);
+		if (virtual_mapping_table[i].reserved ||
+		    virtual_mapping_table[i].region_size != len)
+			fail("table entry %u does not head a free region\n", i);
+		i += len;
+		nr++;
+	}
+	if (model_free_run(&i))
+		fail("model free run at %u missing from the tree\n", i);
+
+	/* Size order: the same regions, sorted by (pages, start) */
+	for (node = rb_first(&free_by_size); node; node = rb_next(node)) {
+		r = rb_entry(node, struct dmm_free_region, size_node);
+		if (prev && (prev->pages > r->pages ||
+			     (prev->pages == r->pages &&
+			      prev->start >= r->start)))
+			fail("size tree out of order at %u+%u\n",
+			     r->start, r->pages);
+		prev = r;
+		nr_size++;
+	}
+	if (nr_size != nr)
+		fail("%u regions by size, %u by address\n", nr_size, nr);
+
+	for (i = 0; i < pages; i++) {
+		if (model[i].chunk &&
+		    (!virtual_mapping_table[i].reserved ||
+		     virtual_mapping_table[i].region_size != model[i].chunk))
+			fail("chunk %u+%u not reserved in the table\n", i,
+			     model[i].chunk);
+		if (!model[i].chunk && model[i].owner &&
+		    virtual_mapping_table[i].reserved)
+			fail("page %u reserved inside a chunk\n", i);
+		if (virtual_mapping_table[i].mapped != !!model[i].map ||
+		    virtual_mapping_table[i].mapped_size != model[i].map)
+			fail("page %u mapping %u/%u, expected %u\n", i,
+			     virtual_mapping_table[i].mapped,
+			     virtual_mapping_table[i].mapped_size,
+			     model[i].map);
+	}
+}
+
+static void reserve(u32 n)
+{
+	long expect = model_best_fit(n);
+	dsp_status status;
+	u32 addr = 0, i;
+
+	op_name = "reserve";
+	status = dmm_reserve_memory(dmm, n * PG_SIZE4K, &addr);
+	if (expect < 0) {
+		if (status != DSP_EMEMORY)
+			fail("reserve of %u pages should fail\n", n);
+		return;
+	}
+	if (DSP_FAILED(status))
+		fail("reserve of %u pages failed, page %ld was free\n", n,
+		     expect);
+	if (addr != addr_of(expect))
+		fail("reserve of %u pages got %x, best fit is %x\n", n, addr,
+		     addr_of(expect));
+	model[expect].chunk = n;
+	for (i = 0; i < n; i++)
+		model[expect + i].owner = expect + 1;
+}
+
+static void unreserve(u32 start)
+{
+	op_name = "unreserve";
+	if (DSP_FAILED(dmm_un_reserve_memory(dmm, addr_of(start))))
+		fail("unreserve of %x failed\n", addr_of(start));
+	/* Its mappings go with it */
+	memset(&model[start], 0, model[start].chunk * sizeof(*model));
+}
+
+static void map(u32 page, u32 n)
+{
+	u32 i;
+
+	op_name = "map";
+	if (DSP_FAILED(dmm_map_memory(dmm, addr_of(page), n * PG_SIZE4K)))
+		fail("map of %x failed\n", addr_of(page));
+	model[page].map = n;
+	for (i = 0; i < n; i++)
+		model[page + i].mapped = 1;
+}
+
+static void unmap(u32 page)
+{
+	u32 i, n = model[page].map, size = ~0;
+
+	op_name = "unmap";
+	if (DSP_FAILED(dmm_un_map_memory(dmm, addr_of(page), &size)))
+		fail("unmap of %x failed\n", addr_of(page));
+	if (size != n * PG_SIZE4K)
+		fail("unmap of %x returned size %x, mapped %x\n",
+		     addr_of(page), size, n * PG_SIZE4K);
+	model[page].map = 0;
+	for (i = 0; i < n; i++)
+		model[page + i].mapped = 0;
+}
+
+/* Map part of the chunk at start that is not mapped yet, if any */
+static void random_map(u32 start)
+{
+	u32 n = model[start].chunk, page, len;
+
+	page = start + rand() % n;
+	if (model[page].mapped)
+		return;
+	for (len = 1; page + len < start + n && !model[page + len].mapped;
+	     len++)
+		;
+	map(page, 1 + rand() % len);
+}
+
+/* Start of a random chunk, or ~0 if nothing is reserved */
+static u32 random_chunk(void)
+{
+	u32 page = rand() % pages, i;
+
+	for (i = 0; i < pages; i++, page = (page + 1) % pages)
+		if (model[page].owner)
+			return model[page].owner - 1;
+	return ~0;
+}
+
+static void random_ops(unsigned long ops)
+{
+	u32 page, n;
+	int r;
+
+	for (op = 0; op < ops; op++) {
+		r = rand() % 100;
+		if (r < 40) {
+			/* Mostly small buffers, a few large ones */
+			n = rand() % 8 ? 1 + rand() % 16 :
+					 1 + rand() % (pages / 4);
+			reserve(n);
+		} else if (r < 60) {
+			page = random_chunk();
+			if (page != ~0U)
+				random_map(page);
+		} else if (r < 70) {
+			page = rand() % pages;
+			if (model[page].map)
+				unmap(page);
+		} else {
+			page = random_chunk();
+			if (page != ~0U)
+				unreserve(page);
+		}
+		check();
+	}
+}
+
+/* Requests that must fail, and must leave everything as it was */
+static void error_paths(void)
+{
+	u32 size, addr;
+	dsp_status status;
+
+	op_name = "errors";
+	reserve(4);
+	reserve(4);
+	check();
+	if (dmm_un_reserve_memory(dmm, addr_of(1)) != DSP_ENOTFOUND)
+		fail("unreserve inside a chunk succeeded\n");
+	if (dmm_un_reserve_memory(dmm, addr_of(pages - 1)) != DSP_ENOTFOUND)
+		fail("unreserve of a free page succeeded\n");
+	if (dmm_un_reserve_memory(dmm, addr_of(pages)) != DSP_ENOTFOUND)
+		fail("unreserve past the table succeeded\n");
+	if (dmm_un_map_memory(dmm, addr_of(1), &size) != DSP_ENOTFOUND)
+		fail("unmap of an unmapped page succeeded\n");
+	if (dmm_map_memory(dmm, addr_of(pages), PG_SIZE4K) != DSP_ENOTFOUND)
+		fail("map past the table succeeded\n");
+	check();
+
+	/* Releasing may need a region node; failing that changes nothing */
+	mem_fail_after = 1;
+	status = dmm_un_reserve_memory(dmm, addr_of(0));
+	mem_fail_after = 0;
+	if (status != DSP_EMEMORY)
+		fail("unreserve without memory returned %x\n", status);
+	check();
+
+	if (dmm_reserve_memory(dmm, (pages + 1) * PG_SIZE4K, &addr) !=
+	    DSP_EMEMORY)
+		fail("reserve of more than the table succeeded\n");
+	unreserve(0);
+	unreserve(4);
+	check();
+}
+
+/* Fill the space, free every other chunk, then merge them all back */
+static void coalescing(void)
+{
+	u32 i;
+
+	op_name = "coalescing";
+	for (i = 0; i < pages; i++)
+		reserve(1);
+	check();
+	reserve(1);
+	for (i = 0; i < pages; i += 2)
+		unreserve(i);
+	check();
+	reserve(2);
+	for (i = 1; i < pages; i += 2)
+		unreserve(i);
+	check();
+	if (rb_first(&free_by_addr) != rb_last(&free_by_addr))
+		fail("free space not coalesced into one region\n");
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-p pages] [-n ops] [-s seed]\n"
+		"  -p  pages of DSP virtual address space (default 1024)\n"
+		"  -n  random operations (default 100000)\n"
+		"  -s  random seed (default 1)\n",
+		name);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long ops = 100000;
+	double t;
+	struct timespec ts;
+	int opt;
+
+	pages = 1024;
+	while ((opt = getopt(argc, argv, "p:n:s:")) != -1) {
+		switch (opt) {
+		case 'p':
+			pages = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			ops = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (pages < 8 || optind != argc)
+		usage(argv[0]);
+
+	model = calloc(pages, sizeof(*model));
+	if (!model) {
+		perror("calloc");
+		return 1;
+	}
+	srand(seed);
+
+	dmm_init();
+	if (DSP_FAILED(dmm_create(&dmm, NULL, NULL)))
+		fail("dmm_create failed\n");
+	/* A size that is not a page multiple is rounded up */
+	if (DSP_FAILED(dmm_create_tables(dmm, BASE, pages * PG_SIZE4K - 1)))
+		fail("dmm_create_tables failed\n");
+	check();
+
+	error_paths();
+	coalescing();
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t = ts.tv_sec + ts.tv_nsec / 1e9;
+	random_ops(ops);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t = ts.tv_sec + ts.tv_nsec / 1e9 - t;
+
+	if (DSP_FAILED(dmm_destroy(dmm)))
+		fail("dmm_destroy failed\n");
+	dmm_exit();
+	free(model);
+
+	printf("dmm_test: %u pages, %lu random operations checked in "
+	       "%.2f s\n", pages, ops, t);
+	return 0;
+}
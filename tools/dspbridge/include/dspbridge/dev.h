@@ -0,0 +1,15 @@
+/*
+ * Userspace stand-in for <dspbridge/dev.h>.
+ */
+#ifndef _DMM_TEST_DEV_H
+#define _DMM_TEST_DEV_H
+
+struct dev_object;
+
+#include <dspbridge/dmm.h>
+
+extern struct dev_object *dev_get_first(void);
+extern dsp_status dev_get_dmm_mgr(struct dev_object *hdev_obj,
+				  struct dmm_object **phMgr);
+
+#endif
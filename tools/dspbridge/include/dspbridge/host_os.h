@@ -0,0 +1,20 @@
+/*
+ * Userspace stand-in for <dspbridge/host_os.h>: the kernel services
+ * dmm.c uses, on top of the C library.
+ */
+#ifndef _DMM_TEST_HOST_OS_H
+#define _DMM_TEST_HOST_OS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <linux/kernel.h>
+
+#define KERN_INFO ""
+#define printk printf
+#define pr_err(fmt...) fprintf(stderr, fmt)
+#define dev_dbg(dev, fmt...) do { } while (0)
+
+#define kfree(p) free(p)
+#define vfree(p) free(p)
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Userspace stand-in for <dspbridge/mem.h>. mem_calloc() fails on the
+ * mem_fail_after'th call from now when that is set, so that the
+ * allocation failure paths can be tested.
+ */
+#ifndef _DMM_TEST_MEM_H
+#define _DMM_TEST_MEM_H
+
+#include <dspbridge/host_os.h>
+
+enum mem_poolattrs {
+	MEM_PAGED = 0,
+	MEM_NONPAGED = 1,
+	MEM_LARGEVIRTMEM = 2
+};
+
+extern unsigned int mem_fail_after;
+
+static inline void *mem_calloc(u32 size, enum mem_poolattrs type)
+{
+	(void)type;
+	if (mem_fail_after && !--mem_fail_after)
+		return NULL;
+	return calloc(1, size);
+}
+
+#define MEM_ALLOC_OBJECT(pObj, Obj, Signature)		\
+{							\
+	pObj = mem_calloc(sizeof(Obj), MEM_NONPAGED);	\
+	if (pObj)					\
+		pObj->dw_signature = Signature;		\
+}
+
+#define MEM_FREE_OBJECT(pObj)				\
+{							\
+	pObj->dw_signature = 0x00;			\
+	kfree(pObj);					\
+}
+
+#define MEM_IS_VALID_HANDLE(hObj, Sig)			\
+	((hObj != NULL) && (hObj->dw_signature == Sig))
+
+#endif
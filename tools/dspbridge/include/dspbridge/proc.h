@@ -0,0 +1,12 @@
+/*
+ * Userspace stand-in for <dspbridge/proc.h>.
+ */
+#ifndef _DMM_TEST_PROC_H
+#define _DMM_TEST_PROC_H
+
+struct dev_object;
+
+extern dsp_status proc_get_dev_object(void *hprocessor,
+				      struct dev_object **phDevObject);
+
+#endif
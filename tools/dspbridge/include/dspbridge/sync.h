@@ -0,0 +1,15 @@
+/*
+ * Userspace stand-in for <dspbridge/sync.h>. The test provides the
+ * functions and checks that entering and leaving are balanced.
+ */
+#ifndef _DMM_TEST_SYNC_H
+#define _DMM_TEST_SYNC_H
+
+struct sync_csobject;
+
+extern dsp_status sync_initialize_cs(struct sync_csobject **phCSObj);
+extern dsp_status sync_delete_cs(struct sync_csobject *hCSObj);
+extern dsp_status sync_enter_cs(struct sync_csobject *hCSObj);
+extern dsp_status sync_leave_cs(struct sync_csobject *hCSObj);
+
+#endif
@@ -0,0 +1,18 @@
+/*
+ * Userspace stand-in for <linux/kernel.h>, just enough for dmm.c and
+ * lib/rbtree.c.
+ */
+#ifndef _DMM_TEST_LINUX_KERNEL_H
+#define _DMM_TEST_LINUX_KERNEL_H
+
+#include <stddef.h>
+#include <linux/types.h>
+
+#define likely(x)	__builtin_expect(!!(x), 1)
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+
+#define container_of(ptr, type, member) ({			\
+	const typeof(((type *)0)->member) * __mptr = (ptr);	\
+	(type *)((char *)__mptr - offsetof(type, member)); })
+
+#endif
@@ -0,0 +1,9 @@
+/*
+ * Userspace stand-in for <linux/module.h>.
+ */
+#ifndef _DMM_TEST_LINUX_MODULE_H
+#define _DMM_TEST_LINUX_MODULE_H
+
+#define EXPORT_SYMBOL(sym)
+
+#endif
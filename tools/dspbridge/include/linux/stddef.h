@@ -0,0 +1,4 @@
+/*
+ * Userspace stand-in for <linux/stddef.h>.
+ */
+#include <stddef.h>
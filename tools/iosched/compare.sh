@@ -0,0 +1,115 @@
+#!/bin/sh
+#
+# Compare io schedulers on one block device: run the same iobench
+# workloads under each scheduler and print the results side by side.
+#
+# Without a device, a scsi_debug RAM disk is created and used. Unlike
+# loop and brd, which hand bios straight to their driver, scsi_debug
+# queues requests, so it goes through the io scheduler. Its delay
+# parameter (in jiffies) sets how long each command takes.
+#
+# Everything on the device is overwritten.
+#
+# Copyright (C) 2010 Nokia Corporation
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# version 2 as published by the Free Software Foundation.
+
+usage()
+{
+	echo "Usage: $0 [-t seconds] [-s \"scheds\"] [-m size_mb] [device]" >&2
+	echo "  -t  seconds per workload (default 10)" >&2
+	echo "  -s  io schedulers to compare (default: all available)" >&2
+	echo "  -m  size of the scsi_debug disk (default 256)" >&2
+	exit 2
+}
+
+seconds=10
+scheds=
+size_mb=256
+while getopts t:s:m: opt; do
+	case $opt in
+	t) seconds=$OPTARG ;;
+	s) scheds=$OPTARG ;;
+	m) size_mb=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -le 1 ] || usage
+
+dir=$(dirname "$0")
+iobench=$dir/iobench
+[ -x "$iobench" ] || { echo "$iobench: build it with make" >&2; exit 1; }
+
+scsi_debug_disk()
+{
+	for d in /sys/block/sd*; do
+		grep -q scsi_debug "$d/device/model" 2>/dev/null &&
+			basename "$d" && return
+	done
+}
+
+if [ $# -eq 1 ]; then
+	dev=$1
+	disk=$(basename "$(readlink -f "$dev")")
+else
+	if [ -z "$(scsi_debug_disk)" ]; then
+		modprobe scsi_debug dev_size_mb=$size_mb delay=1 || exit 1
+		udevadm settle 2>/dev/null || sleep 2
+		loaded=1
+	fi
+	disk=$(scsi_debug_disk)
+	[ -n "$disk" ] || { echo "no scsi_debug disk" >&2; exit 1; }
+	dev=/dev/$disk
+fi
+
+queue=/sys/block/$disk/queue
+if [ ! -w $queue/scheduler ] || [ "$(cat $queue/scheduler)" = none ]; then
+	echo "$dev has no io scheduler" \
+	     "(loop and brd devices bypass it)" >&2
+	exit 1
+fi
+if grep -q "^$dev[0-9]* " /proc/mounts; then
+	echo "$dev is mounted" >&2
+	exit 1
+fi
+
+old=$(sed 's/.*\[\(.*\)\].*/\1/' $queue/scheduler)
+[ -n "$scheds" ] || scheds=$(sed 's/[][]//g' $queue/scheduler)
+
+run()
+{
+	title=$1
+	shift
+	for s in $scheds; do
+		echo $s > $queue/scheduler || continue
+		sync
+		echo 3 > /proc/sys/vm/drop_caches
+		echo "== $title, $s"
+		"$iobench" -t $seconds $dev "$@"
+	done
+	echo
+}
+
+echo "Comparing $scheds on $dev, $seconds s per run"
+echo
+
+run "reads under streaming writes" \
+	name=read,rw=randread,bs=4k \
+	name=write,rw=write,bs=64k,direct=0,fsync=64,threads=2
+
+run "foreground reads against background reads and writes" \
+	name=fg,rw=randread,bs=4k,prio=be/0 \
+	name=bg,rw=randread,bs=4k,prio=be/7,threads=4 \
+	name=write,rw=randwrite,bs=16k,threads=2
+
+run "small random reads" \
+	name=randread,rw=randread,bs=4k,threads=4
+
+run "small random writes" \
+	name=randwrite,rw=randwrite,bs=4k,threads=4
+
+echo $old > $queue/scheduler
+[ -z "$loaded" ] || rmmod scsi_debug
@@ -0,0 +1,353 @@
+/*
+ * iobench - fio-style block device load generator for comparing io
+ * schedulers
+ *
+ * Runs a set of jobs against one block device at the same time for a
+ * fixed duration and reports, per job, the operations and bandwidth
+ * achieved and the latency distribution of the individual reads and
+ * writes. Each job is one or more threads described by a comma
+ * separated list of options:
+ *
+ *	name=<str>		name printed in the results
+ *	rw=<pattern>		read, write, randread or randwrite
+ *	bs=<size>		block size, with an optional k or m suffix
+ *	threads=<n>		threads running the job
+ *	direct=<0|1>		use O_DIRECT (default 1)
+ *	fsync=<n>		fsync after every n writes (buffered writes)
+ *	prio=<class>/<level>	io priority: rt, be or idle, and 0 - 7
+ *
+ * for instance
+ *
+ *	iobench -t 10 /dev/sdb name=fg,rw=randread,prio=be/0 \
+ *		name=bg,rw=write,bs=64k,direct=0,fsync=64,threads=2
+ *
+ * The device is overwritten by write jobs.
+ *
+ * Copyright (C) 2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#define IOPRIO_CLASS_SHIFT	13
+#define IOPRIO_WHO_PROCESS	1
+
+#define MAX_JOBS	16
+#define LAT_BUCKETS	512
+
+struct job {
+	char name[32];
+	int write;
+	int random;
+	unsigned long bs;
+	unsigned int threads;
+	int direct;
+	unsigned int fsync;
+	int ioprio;		/* -1: leave as is */
+
+	pthread_mutex_t lock;
+	unsigned long ops;
+	unsigned long errors;
+	double lat_sum;
+	unsigned long lat_max;	/* in us */
+	unsigned long lat[LAT_BUCKETS];
+};
+
+struct thread {
+	pthread_t id;
+	struct job *job;
+	unsigned int index;
+};
+
+static const char *device;
+static unsigned long long dev_size;
+static struct job jobs[MAX_JOBS];
+static unsigned int nr_jobs;
+static volatile int stop;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Latencies are kept in buckets of 8 per power of two microseconds */
+static unsigned int lat_bucket(unsigned long us)
+{
+	unsigned int msb;
+
+	if (us < 8)
+		return us;
+	msb = 63 - __builtin_clzl(us);
+	if (msb > LAT_BUCKETS / 8)
+		return LAT_BUCKETS - 1;
+	return (msb - 2) * 8 + ((us >> (msb - 3)) & 7);
+}
+
+static unsigned long lat_value(unsigned int bucket)
+{
+	if (bucket < 8)
+		return bucket;
+	return (8UL + bucket % 8) << (bucket / 8 - 1);
+}
+
+static unsigned long lat_percentile(struct job *job, double pct)
+{
+	unsigned long want = job->ops * pct / 100, sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		sum += job->lat[i];
+		if (sum > want)
+			return lat_value(i);
+	}
+	return job->lat_max;
+}
+
+static unsigned long parse_size(const char *s)
+{
+	char *end;
+	unsigned long v = strtoul(s, &end, 0);
+
+	if (*end == 'k' || *end == 'K')
+		v <<= 10;
+	else if (*end == 'm' || *end == 'M')
+		v <<= 20;
+	return v;
+}
+
+static int parse_prio(const char *s)
+{
+	static const char *classes[] = { "rt", "be", "idle" };
+	const char *slash = strchr(s, '/');
+	unsigned int i, level = slash ? atoi(slash + 1) : 4;
+
+	for (i = 0; i < 3; i++)
+		if (!strncmp(s, classes[i], strlen(classes[i])))
+			return (i + 1) << IOPRIO_CLASS_SHIFT | (level & 7);
+	return -1;
+}
+
+static int parse_job(struct job *job, char *spec)
+{
+	char *opt, *val;
+
+	snprintf(job->name, sizeof(job->name), "job%u", nr_jobs);
+	job->bs = 4096;
+	job->threads = 1;
+	job->direct = 1;
+	job->ioprio = -1;
+	pthread_mutex_init(&job->lock, NULL);
+
+	for (opt = strtok(spec, ","); opt; opt = strtok(NULL, ",")) {
+		val = strchr(opt, '=');
+		if (!val)
+			return -1;
+		*val++ = '\0';
+		if (!strcmp(opt, "name")) {
+			snprintf(job->name, sizeof(job->name), "%s", val);
+		} else if (!strcmp(opt, "rw")) {
+			job->write = strstr(val, "write") != NULL;
+			job->random = !strncmp(val, "rand", 4);
+		} else if (!strcmp(opt, "bs")) {
+			job->bs = parse_size(val);
+		} else if (!strcmp(opt, "threads")) {
+			job->threads = atoi(val);
+		} else if (!strcmp(opt, "direct")) {
+			job->direct = atoi(val);
+		} else if (!strcmp(opt, "fsync")) {
+			job->fsync = atoi(val);
+		} else if (!strcmp(opt, "prio")) {
+			job->ioprio = parse_prio(val);
+			if (job->ioprio < 0)
+				return -1;
+		} else {
+			return -1;
+		}
+	}
+	if (!job->bs || job->bs % 512 || !job->threads)
+		return -1;
+	return 0;
+}
+
+static void account(struct job *job, double start, int ok)
+{
+	unsigned long us = (now() - start) * 1e6;
+
+	pthread_mutex_lock(&job->lock);
+	if (ok) {
+		job->ops++;
+		job->lat_sum += us;
+		if (us > job->lat_max)
+			job->lat_max = us;
+		job->lat[lat_bucket(us)]++;
+	} else {
+		job->errors++;
+	}
+	pthread_mutex_unlock(&job->lock);
+}
+
+static void *run(void *arg)
+{
+	struct thread *t = arg;
+	struct job *job = t->job;
+	unsigned long long blocks = dev_size / job->bs, block;
+	unsigned int seed = t->index * 7919 + job->bs, writes = 0;
+	double start;
+	ssize_t ret;
+	void *buf;
+	int fd;
+
+	/* Sequential threads each walk their own share of the device */
+	block = blocks / job->threads * t->index;
+
+	if (job->ioprio >= 0 &&
+	    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS,
+		    (int)syscall(SYS_gettid), job->ioprio))
+		perror("ioprio_set");
+
+	fd = open(device, (job->write ? O_RDWR : O_RDONLY) |
+		  (job->direct ? O_DIRECT : 0));
+	if (fd < 0 || posix_memalign(&buf, 4096, job->bs)) {
+		perror(device);
+		account(job, now(), 0);
+		return NULL;
+	}
+	memset(buf, 0xa5, job->bs);
+
+	while (!stop) {
+		if (job->random)
+			block = ((unsigned long long)rand_r(&seed) << 16 ^
+				 rand_r(&seed)) % blocks;
+		else if (++block >= blocks)
+			block = 0;
+		start = now();
+		if (job->write)
+			ret = pwrite(fd, buf, job->bs, block * job->bs);
+		else
+			ret = pread(fd, buf, job->bs, block * job->bs);
+		if (ret == (ssize_t)job->bs && job->fsync &&
+		    ++writes % job->fsync == 0 && fdatasync(fd))
+			ret = -1;
+		account(job, start, ret == (ssize_t)job->bs);
+	}
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-t seconds] [-s size] device job...\n"
+		"  -t  duration in seconds (default 10)\n"
+		"  -s  use only the first size bytes of the device\n"
+		"  job: name=,rw=,bs=,threads=,direct=,fsync=,prio= (see "
+		"the source)\n",
+		name);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int seconds = 10, nr_threads = 0, i, j, k;
+	unsigned long long size = 0;
+	struct thread *threads;
+	struct job *job;
+	double elapsed;
+	int fd, opt, errors = 0;
+
+	while ((opt = getopt(argc, argv, "t:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = parse_size(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!seconds || argc - optind < 2 || argc - optind > MAX_JOBS + 1)
+		usage(argv[0]);
+	device = argv[optind++];
+
+	fd = open(device, O_RDONLY);
+	if (fd < 0 || ioctl(fd, BLKGETSIZE64, &dev_size)) {
+		perror(device);
+		return 1;
+	}
+	close(fd);
+	if (size && size < dev_size)
+		dev_size = size;
+
+	for (; optind < argc; optind++) {
+		job = &jobs[nr_jobs];
+		if (parse_job(job, argv[optind]) || dev_size < job->bs) {
+			fprintf(stderr, "bad job: %s\n", argv[optind]);
+			return 2;
+		}
+		nr_jobs++;
+		nr_threads += job->threads;
+	}
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads) {
+		perror("calloc");
+		return 1;
+	}
+	elapsed = now();
+	for (i = 0, k = 0; i < nr_jobs; i++)
+		for (j = 0; j < jobs[i].threads; j++, k++) {
+			threads[k].job = &jobs[i];
+			threads[k].index = j;
+			errno = pthread_create(&threads[k].id, NULL, run,
+					       &threads[k]);
+			if (errno) {
+				perror("pthread_create");
+				return 1;
+			}
+		}
+	sleep(seconds);
+	stop = 1;
+	for (k = 0; k < nr_threads; k++)
+		pthread_join(threads[k].id, NULL);
+	elapsed = now() - elapsed;
+
+	for (i = 0; i < nr_jobs; i++) {
+		job = &jobs[i];
+		printf("%-10s iops=%7.0f bw=%7.2fMB/s lat(ms) avg=%6.2f "
+		       "p50=%6.2f p99=%7.2f max=%.2f",
+		       job->name, job->ops / elapsed,
+		       job->ops * job->bs / elapsed / (1 << 20),
+		       job->ops ? job->lat_sum / job->ops / 1000 : 0.0,
+		       lat_percentile(job, 50) / 1000.0,
+		       lat_percentile(job, 99) / 1000.0,
+		       job->lat_max / 1000.0);
+		if (job->errors)
+			printf(" errors=%lu", job->errors);
+		putchar('\n');
+		errors += job->errors != 0;
+	}
+	free(threads);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,38 @@
+#!/usr/bin/awk -f
+#
+# Turn the RA_Alloc()/RA_Free() debug messages of a PVR driver built with
+# message level debug output into a ra_replay trace. Set arena to keep
+# only one arena's operations:
+#
+#	dmesg | awk -f dmesg2trace.awk -v arena=<name> > trace
+#
+# The allocation base becomes the tag, which is why a trace only makes
+# sense for one arena at a time.
+
+function field(name,	s) {
+	if (!match($0, name "=[^,]*"))
+		return ""
+	s = substr($0, RSTART + length(name) + 1, RLENGTH - length(name) - 1)
+	gsub(/'/, "", s)
+	return s
+}
+
+/RA_Alloc: arena=/ {
+	if (arena == "" || field("arena") == arena)
+		align[field("arena")] = field("alignment")
+	next
+}
+
+/RA_Alloc: name=.*= 1$/ {
+	name = field("name")
+	if (arena != "" && name != arena)
+		next
+	split(field("base"), b, " ")
+	print "a", b[1], field("size"), align[name]
+	next
+}
+
+/RA_Free: name=/ {
+	if (arena == "" || field("name") == arena)
+		print "f", field("base")
+}
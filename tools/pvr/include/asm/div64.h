@@ -0,0 +1,15 @@
+/*
+ * Userspace stand-in for <asm/div64.h>.
+ */
+#ifndef _RA_REPLAY_ASM_DIV64_H
+#define _RA_REPLAY_ASM_DIV64_H
+
+#include <stdint.h>
+
+#define do_div(n, base) ({				\
+	uint32_t __base = (base);			\
+	uint32_t __rem = (uint64_t)(n) % __base;	\
+	(n) = (uint64_t)(n) / __base;			\
+	__rem; })
+
+#endif
@@ -0,0 +1,14 @@
+/*
+ * Userspace stand-in for drivers/gpu/pvr/buffer_manager.h: ra.c only
+ * looks at the flags of the mapping a span was imported with.
+ */
+#ifndef _BUFFER_MANAGER_H_
+#define _BUFFER_MANAGER_H_
+
+#include "img_types.h"
+
+struct BM_MAPPING {
+	u32 ui32Flags;
+};
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ * Userspace stand-in for drivers/gpu/pvr/hash.h: the u32 keyed subset
+ * used by ra.c.
+ */
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include "img_types.h"
+
+struct HASH_TABLE;
+struct HASH_TABLE *HASH_Create(u32 uInitialLen);
+void HASH_Delete(struct HASH_TABLE *pHash);
+IMG_BOOL HASH_Insert(struct HASH_TABLE *pHash, u32 k, u32 v);
+u32 HASH_Remove(struct HASH_TABLE *pHash, u32 k);
+u32 HASH_Retrieve(struct HASH_TABLE *pHash, u32 k);
+
+#endif
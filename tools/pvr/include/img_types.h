@@ -0,0 +1,21 @@
+/*
+ * Userspace stand-in for drivers/gpu/pvr/img_types.h.
+ */
+#ifndef __IMG_TYPES_H__
+#define __IMG_TYPES_H__
+
+#include <linux/types.h>
+
+typedef enum tag_img_bool {
+	IMG_FALSE = 0,
+	IMG_TRUE = 1,
+	IMG_FORCE_ALIGN = 0x7FFFFFFF
+} IMG_BOOL, *IMG_PBOOL;
+
+struct IMG_CPU_PHYADDR {
+	u32 uiAddr;
+};
+
+#define PVR_UNREFERENCED_PARAMETER(param)	(param) = (param)
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ * Userspace stand-in for <linux/kernel.h>, just enough for ra.c and
+ * lib/rbtree.c.
+ */
+#ifndef _RA_REPLAY_LINUX_KERNEL_H
+#define _RA_REPLAY_LINUX_KERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <linux/types.h>
+
+#define container_of(ptr, type, member) ({			\
+	const typeof(((type *)0)->member) * __mptr = (ptr);	\
+	(type *)((char *)__mptr - offsetof(type, member)); })
+
+#endif
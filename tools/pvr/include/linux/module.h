@@ -0,0 +1,2 @@
+/* Userspace stand-in for <linux/module.h> */
+#define EXPORT_SYMBOL(sym)
@@ -0,0 +1,2 @@
+/* Userspace stand-in for <linux/stddef.h> */
+#include <stddef.h>
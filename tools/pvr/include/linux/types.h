@@ -0,0 +1,16 @@
+/*
+ * Userspace stand-in for <linux/types.h>.
+ */
+#ifndef _RA_REPLAY_LINUX_TYPES_H
+#define _RA_REPLAY_LINUX_TYPES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+
+#endif
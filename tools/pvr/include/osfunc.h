@@ -0,0 +1,26 @@
+/*
+ * Userspace stand-in for drivers/gpu/pvr/osfunc.h. Memory comes from a
+ * pool below 4GB, since ra.c stores segment pointers in u32 hash values.
+ */
+#ifndef __OSFUNC_H__
+#define __OSFUNC_H__
+
+#include <stdio.h>
+#include "img_types.h"
+
+enum PVRSRV_ERROR {
+	PVRSRV_OK = 0,
+	PVRSRV_ERROR_OUT_OF_MEMORY,
+	PVRSRV_ERROR_INVALID_PARAMS,
+};
+
+#define PVRSRV_OS_PAGEABLE_HEAP		1
+
+enum PVRSRV_ERROR OSAllocMem(u32 ui32Flags, u32 ui32Size, void **ppvLinAddr,
+			     void *phBlockAlloc);
+void OSFreeMem(u32 ui32Flags, u32 ui32Size, void *pvLinAddr,
+	       void *hBlockAlloc);
+
+#define OSSNPrintf snprintf
+
+#endif
@@ -0,0 +1 @@
+/* Userspace stand-in for drivers/gpu/pvr/proc.h: no proc entries */
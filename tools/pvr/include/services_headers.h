@@ -0,0 +1,17 @@
+/*
+ * Userspace stand-in for drivers/gpu/pvr/services_headers.h.
+ */
+#ifndef SERVICES_HEADERS_H
+#define SERVICES_HEADERS_H
+
+#include <assert.h>
+#include "img_types.h"
+#include "osfunc.h"
+
+#define PVR_DBG_ERROR		1
+#define PVR_DBG_MESSAGE		2
+
+#define PVR_ASSERT(EXPR)	assert(EXPR)
+#define PVR_DPF(level, fmt, ...) do { } while (0)
+
+#endif
@@ -0,0 +1,388 @@
+/*
+ * ra_replay - replay allocation traces against the PVR resource allocator
+ *
+ * Builds drivers/gpu/pvr/ra.c in userspace and runs a trace of
+ * allocations and frees through it, checking the result and reporting
+ * the time per operation, search steps and fragmentation. Traces are
+ * text, one operation per line:
+ *
+ *	a <tag> <size> [<alignment> [<flags>]]	allocate, naming it <tag>
+ *	f <tag>					free the allocation <tag>
+ *
+ * Numbers may be decimal or 0x-prefixed hex; '#' starts a comment. A
+ * tag can be reused once freed, so the bases logged by RA_Alloc() and
+ * RA_Free() with PVR debug messages enabled make valid tags (see
+ * README). Instead of a trace, -g generates a random long-running
+ * workload; -w saves it so that the same trace can be replayed against
+ * another version of ra.c.
+ *
+ * Copyright (C) 2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "img_types.h"
+#include "hash.h"
+#include "buffer_manager.h"
+#include "ra.h"
+
+struct alloc {
+	u32 tag;
+	u32 base;
+	u32 size;
+	u32 align;
+	int next_free;		/* Free slot chain, -1 terminated */
+};
+
+static struct RA_ARENA *arena;
+static struct HASH_TABLE *tags;	/* tag -> index + 1 in allocs */
+static struct alloc *allocs;
+static int nr_allocs, max_allocs, first_free = -1;
+static unsigned long live;
+
+static int check_each;
+static u32 import_size;
+static u32 import_next;
+static unsigned long imports, exports;
+
+static unsigned long nr_alloc_ops, nr_free_ops, failed, errors;
+static double alloc_ns, free_ns;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static IMG_BOOL import_alloc(void *h, size_t size, size_t *actual,
+			     struct BM_MAPPING **mapping, u32 flags, u32 *base)
+{
+	(void)h;
+	if (size < import_size)
+		size = import_size;
+	if ((u64)import_next + size > 0xffffffffULL)
+		return IMG_FALSE;
+	*mapping = malloc(sizeof(**mapping));
+	if (!*mapping)
+		return IMG_FALSE;
+	(*mapping)->ui32Flags = flags;
+	*actual = size;
+	*base = import_next;
+	import_next += size;
+	imports++;
+	return IMG_TRUE;
+}
+
+static void import_free(void *h, u32 base, struct BM_MAPPING *mapping)
+{
+	(void)h;
+	(void)base;
+	free(mapping);
+	exports++;
+}
+
+static int new_slot(void)
+{
+	int i;
+
+	if (first_free >= 0) {
+		i = first_free;
+		first_free = allocs[i].next_free;
+		return i;
+	}
+	if (nr_allocs == max_allocs) {
+		max_allocs = max_allocs ? max_allocs * 2 : 1024;
+		allocs = realloc(allocs, max_allocs * sizeof(*allocs));
+		if (!allocs) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	return nr_allocs++;
+}
+
+static void error(unsigned long line, const char *msg, u32 tag)
+{
+	fprintf(stderr, "line %lu: %s (tag 0x%x)\n", line, msg, tag);
+	errors++;
+}
+
+/* Walk the live segments and compare them with what we allocated */
+static void check(unsigned long line)
+{
+	struct RA_SEGMENT_DETAILS seg = { 0 };
+	unsigned long n = 0;
+	u32 end = 0;
+	int i;
+
+	while (RA_GetNextLiveSegment(arena, &seg)) {
+		if (n && seg.sCpuPhyAddr.uiAddr < end)
+			error(line, "live segments overlap",
+			      seg.sCpuPhyAddr.uiAddr);
+		end = seg.sCpuPhyAddr.uiAddr + seg.uiSize;
+		n++;
+	}
+	if (n != live) {
+		fprintf(stderr, "line %lu: %lu live segments, expected %lu\n",
+			line, n, live);
+		errors++;
+	}
+	for (i = 0; i < nr_allocs; i++)
+		if (allocs[i].next_free == -2 && allocs[i].align > 1 &&
+		    allocs[i].base % allocs[i].align)
+			error(line, "misaligned allocation", allocs[i].tag);
+}
+
+static void do_alloc(unsigned long line, u32 tag, u32 size, u32 align,
+		     u32 flags)
+{
+	struct BM_MAPPING *mapping;
+	IMG_BOOL ok;
+	double t;
+	u32 base;
+	int i;
+
+	if (HASH_Retrieve(tags, tag)) {
+		error(line, "tag already allocated", tag);
+		return;
+	}
+	t = now_ns();
+	ok = RA_Alloc(arena, size, &mapping, flags, align, &base);
+	alloc_ns += now_ns() - t;
+	nr_alloc_ops++;
+	if (!ok) {
+		failed++;
+		return;
+	}
+	i = new_slot();
+	allocs[i].tag = tag;
+	allocs[i].base = base;
+	allocs[i].size = size;
+	allocs[i].align = align;
+	allocs[i].next_free = -2;
+	HASH_Insert(tags, tag, i + 1);
+	live++;
+}
+
+static void do_free(unsigned long line, u32 tag)
+{
+	u32 i = HASH_Remove(tags, tag);
+	double t;
+
+	if (!i) {
+		/* Allocations that failed during replay are skipped */
+		return;
+	}
+	i--;
+	t = now_ns();
+	RA_Free(arena, allocs[i].base, IMG_TRUE);
+	free_ns += now_ns() - t;
+	nr_free_ops++;
+	allocs[i].next_free = first_free;
+	first_free = i;
+	live--;
+	(void)line;
+}
+
+static void replay(FILE *f)
+{
+	char buf[256], op;
+	unsigned long line = 0;
+	unsigned long tag, size, align, flags;
+	int n;
+
+	while (fgets(buf, sizeof(buf), f)) {
+		line++;
+		align = 0;
+		flags = 0;
+		n = sscanf(buf, " %c %li %li %li %li", &op, &tag, &size,
+			   &align, &flags);
+		if (n <= 0 || op == '#')
+			continue;
+		if (op == 'a' && n >= 3)
+			do_alloc(line, tag, size, align, flags);
+		else if (op == 'f' && n == 2)
+			do_free(line, tag);
+		else
+			error(line, "bad line", 0);
+		if (check_each)
+			check(line);
+	}
+	check(line);
+}
+
+/*
+ * Random workload in the spirit of a long running compositor: a base of
+ * long lived surfaces, with a churn of short lived buffers of mostly
+ * small sizes, some of them 64K aligned.
+ */
+static void generate(FILE *out, unsigned long ops, unsigned int seed)
+{
+	u32 *live_tags;
+	unsigned long nr_live = 0, i;
+	u32 tag = 0, size, align;
+	int idx;
+
+	live_tags = calloc(ops, sizeof(*live_tags));
+	if (!live_tags) {
+		perror("calloc");
+		exit(1);
+	}
+	srand(seed);
+	for (i = 0; i < ops; i++) {
+		if (nr_live && (rand() % 100 < 45 || nr_live > 4096)) {
+			/* Free a recent allocation most of the time */
+			if (rand() % 4)
+				idx = nr_live - 1 - rand() % (nr_live < 16 ?
+							       nr_live : 16);
+			else
+				idx = rand() % nr_live;
+			fprintf(out, "f 0x%x\n", live_tags[idx]);
+			live_tags[idx] = live_tags[--nr_live];
+			continue;
+		}
+		switch (rand() % 10) {
+		case 0:
+			size = (1 + rand() % 256) << 12;	/* to 1MB */
+			break;
+		case 1:
+			size = (1 + rand() % 16) << 16;		/* to 1MB */
+			break;
+		default:
+			size = (1 + rand() % 16) << 12;		/* to 64K */
+		}
+		align = rand() % 8 ? 4096 : 65536;
+		live_tags[nr_live++] = ++tag;
+		fprintf(out, "a 0x%x 0x%x 0x%x\n", tag, size, align);
+	}
+	free(live_tags);
+}
+
+static void print_stats(void)
+{
+	static char buf[1 << 16];
+	char *str = buf, *end;
+	u32 len = sizeof(buf);
+
+	/*
+	 * The segment chain at the end rarely fits; what we want comes
+	 * before it and is already in buf when RA_GetStats() gives up.
+	 */
+	RA_GetStats(arena, &str, &len);
+	end = strstr(buf, "  segment Chain:");
+	if (end)
+		*end = '\0';
+	fputs(buf, stdout);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [trace]\n"
+		"  -b base     arena base (default 0)\n"
+		"  -s size     arena size (default 0x40000000)\n"
+		"  -q quantum  arena quantum (default 4096)\n"
+		"  -i size     start empty and import spans of at least size\n"
+		"  -g ops      replay a generated workload of ops operations\n"
+		"  -S seed     seed for -g (default 1)\n"
+		"  -w file     write the generated workload to file\n"
+		"  -c          check the arena after every operation\n",
+		name);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long base = 0, size = 0x40000000, quantum = 4096;
+	unsigned long gen_ops = 0;
+	unsigned int seed = 1;
+	const char *gen_file = NULL;
+	FILE *f = stdin;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:s:q:i:g:S:w:c")) != -1) {
+		switch (opt) {
+		case 'b':
+			base = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			quantum = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			import_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			gen_ops = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			gen_file = optarg;
+			break;
+		case 'c':
+			check_each = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!quantum || (gen_ops && optind < argc) || optind + 1 < argc)
+		usage(argv[0]);
+
+	if (gen_ops) {
+		f = gen_file ? fopen(gen_file, "w+") : tmpfile();
+		if (!f) {
+			perror(gen_file ? gen_file : "tmpfile");
+			return 1;
+		}
+		generate(f, gen_ops, seed);
+		rewind(f);
+	} else if (optind < argc) {
+		f = fopen(argv[optind], "r");
+		if (!f) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+
+	tags = HASH_Create(1024);
+	if (import_size) {
+		import_next = base;
+		arena = RA_Create("replay", 0, 0, NULL, quantum,
+				  import_alloc, import_free, NULL, NULL);
+	} else {
+		arena = RA_Create("replay", base, size, NULL, quantum,
+				  NULL, NULL, NULL, NULL);
+	}
+	if (!arena || !tags) {
+		fprintf(stderr, "cannot create arena\n");
+		return 1;
+	}
+
+	replay(f);
+
+	printf("allocs\t\t\t%lu (%lu failed), %.0f ns each\n", nr_alloc_ops,
+	       failed, nr_alloc_ops ? alloc_ns / nr_alloc_ops : 0.0);
+	printf("frees\t\t\t%lu, %.0f ns each\n", nr_free_ops,
+	       nr_free_ops ? free_ns / nr_free_ops : 0.0);
+	if (import_size)
+		printf("imports/exports\t\t%lu/%lu\n", imports, exports);
+	print_stats();
+	if (errors)
+		printf("%lu errors\n", errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * Userspace implementations of the services ra.c depends on.
+ *
+ * Copyright (C) 2010 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "img_types.h"
+#include "osfunc.h"
+#include "hash.h"
+
+#ifndef MAP_32BIT
+#define MAP_32BIT 0
+#endif
+
+/*
+ * ra.c keeps struct BT pointers in u32 hash values, which only works if
+ * they fit in 32 bits. Hand out memory from a pool mapped below 4GB,
+ * with a free list per 16 byte size class.
+ */
+#define POOL_SIZE	(512UL << 20)
+#define POOL_ALIGN	16
+#define POOL_CLASSES	64
+
+struct pool_free {
+	struct pool_free *next;
+};
+
+static char *pool_base, *pool_next;
+static struct pool_free *pool_free[POOL_CLASSES];
+
+static void pool_init(void)
+{
+	pool_base = mmap(NULL, POOL_SIZE, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE |
+			 MAP_32BIT, -1, 0);
+	if (pool_base == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	if ((unsigned long)pool_base + POOL_SIZE - 1 > 0xffffffffUL) {
+		fprintf(stderr, "cannot map memory below 4GB\n");
+		exit(1);
+	}
+	pool_next = pool_base;
+}
+
+enum PVRSRV_ERROR OSAllocMem(u32 ui32Flags, u32 ui32Size, void **ppvLinAddr,
+			     void *phBlockAlloc)
+{
+	u32 cls = (ui32Size + POOL_ALIGN - 1) / POOL_ALIGN;
+
+	(void)ui32Flags;
+	(void)phBlockAlloc;
+	if (!pool_base)
+		pool_init();
+	if (cls >= POOL_CLASSES)
+		return PVRSRV_ERROR_OUT_OF_MEMORY;
+	if (pool_free[cls]) {
+		*ppvLinAddr = pool_free[cls];
+		pool_free[cls] = pool_free[cls]->next;
+		return PVRSRV_OK;
+	}
+	if (pool_next + cls * POOL_ALIGN > pool_base + POOL_SIZE)
+		return PVRSRV_ERROR_OUT_OF_MEMORY;
+	*ppvLinAddr = pool_next;
+	pool_next += cls * POOL_ALIGN;
+	return PVRSRV_OK;
+}
+
+void OSFreeMem(u32 ui32Flags, u32 ui32Size, void *pvLinAddr,
+	       void *hBlockAlloc)
+{
+	u32 cls = (ui32Size + POOL_ALIGN - 1) / POOL_ALIGN;
+	struct pool_free *p = pvLinAddr;
+
+	(void)ui32Flags;
+	(void)hBlockAlloc;
+	p->next = pool_free[cls];
+	pool_free[cls] = p;
+}
+
+/* Chained hash of u32 keys to u32 values, doubling as it fills */
+struct hash_entry {
+	struct hash_entry *next;
+	u32 key;
+	u32 value;
+};
+
+struct HASH_TABLE {
+	struct hash_entry **buckets;
+	u32 size;
+	u32 count;
+};
+
+static u32 hash_index(const struct HASH_TABLE *h, u32 k)
+{
+	return (k * 2654435761U) >> 7 & (h->size - 1);
+}
+
+struct HASH_TABLE *HASH_Create(u32 uInitialLen)
+{
+	struct HASH_TABLE *h = calloc(1, sizeof(*h));
+
+	if (!h)
+		return NULL;
+	for (h->size = 1; h->size < uInitialLen; h->size <<= 1)
+		;
+	h->buckets = calloc(h->size, sizeof(*h->buckets));
+	if (!h->buckets) {
+		free(h);
+		return NULL;
+	}
+	return h;
+}
+
+void HASH_Delete(struct HASH_TABLE *h)
+{
+	struct hash_entry *e, *next;
+	u32 i;
+
+	for (i = 0; i < h->size; i++)
+		for (e = h->buckets[i]; e; e = next) {
+			next = e->next;
+			free(e);
+		}
+	free(h->buckets);
+	free(h);
+}
+
+static void hash_grow(struct HASH_TABLE *h)
+{
+	struct hash_entry **old = h->buckets, *e, *next;
+	u32 old_size = h->size, i, j;
+
+	h->buckets = calloc(old_size * 2, sizeof(*h->buckets));
+	if (!h->buckets) {
+		h->buckets = old;
+		return;
+	}
+	h->size = old_size * 2;
+	for (i = 0; i < old_size; i++)
+		for (e = old[i]; e; e = next) {
+			next = e->next;
+			j = hash_index(h, e->key);
+			e->next = h->buckets[j];
+			h->buckets[j] = e;
+		}
+	free(old);
+}
+
+IMG_BOOL HASH_Insert(struct HASH_TABLE *h, u32 k, u32 v)
+{
+	struct hash_entry *e = malloc(sizeof(*e));
+	u32 i;
+
+	if (!e)
+		return IMG_FALSE;
+	if (h->count >= h->size * 2)
+		hash_grow(h);
+	i = hash_index(h, k);
+	e->key = k;
+	e->value = v;
+	e->next = h->buckets[i];
+	h->buckets[i] = e;
+	h->count++;
+	return IMG_TRUE;
+}
+
+u32 HASH_Remove(struct HASH_TABLE *h, u32 k)
+{
+	struct hash_entry **pe, *e;
+	u32 v;
+
+	for (pe = &h->buckets[hash_index(h, k)]; *pe; pe = &(*pe)->next) {
+		e = *pe;
+		if (e->key != k)
+			continue;
+		*pe = e->next;
+		v = e->value;
+		free(e);
+		h->count--;
+		return v;
+	}
+	return 0;
+}
+
+u32 HASH_Retrieve(struct HASH_TABLE *h, u32 k)
+{
+	struct hash_entry *e;
+
+	for (e = h->buckets[hash_index(h, k)]; e; e = e->next)
+		if (e->key == k)
+			return e->value;
+	return 0;
+}